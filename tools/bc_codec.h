@@ -0,0 +1,640 @@
+/*
+ * CPU encoders and decoders for the BC1, BC3, BC5 and BC7 block formats.
+ * The decoders are only there to check the encoders (knz_texcook --psnr), the GPU decodes when sampling.
+ *
+ * Everything works on one 4x4 block of RGBA8 pixels at a time, pixel (x, y) at px[y * 4 + x].
+ *
+ * BC1/BC3 color: The endpoints start at the extremes of the block along its principal axis, then get refit to the
+ * selectors they produced with least squares a few times, keeping whichever was best after 565 quantization.
+ * BC1 blocks with any alpha below 128 use the 3 color mode, with transparent black for those pixels.
+ * BC4 (BC3 alpha and both BC5 channels): Min/max endpoints in the 8 value mode.
+ * BC7: Only mode 6 (one RGBA subset, 7 bit endpoints + p-bit, 4 bit indices), which is what most fast encoders
+ * lean on, and is already well ahead of BC3 for the textures here. The decoder only knows mode 6 as well,
+ * any other mode decodes to opaque magenta.
+ */
+#ifndef KNZ_BC_CODEC_H
+#define KNZ_BC_CODEC_H
+
+#include "common.h"
+#include "texture_file.h"
+
+#include <math.h>
+#include <float.h>
+
+#define BC_BLOCK_PIXELS 16
+#define BC_REFINE_ITERATIONS 2
+
+/* Shared */
+static inline float bc_clampf(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Mean and principal axis (power iteration on the covariance) of count points with dims channels each
+static inline void bc_principal_axis(const float (*pts)[4], int count, int dims, float mean[4], float axis[4])
+{
+    for(int c = 0; c < 4; ++c) {
+        mean[c] = 0.0f;
+        axis[c] = 0.0f;
+    }
+
+    for(int i = 0; i < count; ++i) {
+        for(int c = 0; c < dims; ++c) {
+            mean[c] += pts[i][c];
+        }
+    }
+    for(int c = 0; c < dims; ++c) {
+        mean[c] /= (float)count;
+    }
+
+    float cov[4][4] = {0};
+    for(int i = 0; i < count; ++i) {
+        for(int a = 0; a < dims; ++a) {
+            for(int b = 0; b < dims; ++b) {
+                cov[a][b] += (pts[i][a] - mean[a]) * (pts[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // Start from the row with the largest variance, which can't be orthogonal to the principal axis
+    int start = 0;
+    for(int c = 1; c < dims; ++c) {
+        if(cov[c][c] > cov[start][start]) {
+            start = c;
+        }
+    }
+
+    float v[4] = {0};
+    for(int c = 0; c < dims; ++c) {
+        v[c] = cov[start][c];
+    }
+
+    for(int iter = 0; iter < 8; ++iter) {
+        float next[4] = {0};
+        float len = 0.0f;
+        for(int a = 0; a < dims; ++a) {
+            for(int b = 0; b < dims; ++b) {
+                next[a] += cov[a][b] * v[b];
+            }
+            len += next[a] * next[a];
+        }
+
+        if(len < 1e-12f) {
+            break;
+        }
+
+        len = 1.0f / sqrtf(len);
+        for(int c = 0; c < dims; ++c) {
+            v[c] = next[c] * len;
+        }
+    }
+
+    float len = 0.0f;
+    for(int c = 0; c < dims; ++c) {
+        len += v[c] * v[c];
+    }
+
+    // Flat blocks don't have an axis, any will do since both endpoints end up on the mean
+    for(int c = 0; c < dims; ++c) {
+        axis[c] = len > 1e-12f ? v[c] / sqrtf(len) : 1.0f / sqrtf((float)dims);
+    }
+}
+
+// Endpoints at the extremes of the points along the axis
+static inline void bc_axis_endpoints(const float (*pts)[4], int count, int dims, const float mean[4], const float axis[4], float lo[4], float hi[4])
+{
+    float t_min = FLT_MAX, t_max = -FLT_MAX;
+    for(int i = 0; i < count; ++i) {
+        float t = 0.0f;
+        for(int c = 0; c < dims; ++c) {
+            t += (pts[i][c] - mean[c]) * axis[c];
+        }
+        t_min = t < t_min ? t : t_min;
+        t_max = t > t_max ? t : t_max;
+    }
+
+    for(int c = 0; c < 4; ++c) {
+        lo[c] = c < dims ? bc_clampf(mean[c] + axis[c] * t_min, 0.0f, 255.0f) : 0.0f;
+        hi[c] = c < dims ? bc_clampf(mean[c] + axis[c] * t_max, 0.0f, 255.0f) : 0.0f;
+    }
+}
+
+// Least squares fit of a and b to x = a * (1 - w) + b * w, for the weights the selectors picked
+// Returns false when the weights don't determine the endpoints (e.g. all the same)
+static inline bool bc_refit_endpoints(const float (*pts)[4], const float *weights, int count, int dims, float a[4], float b[4])
+{
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[4] = {0}, bx[4] = {0};
+
+    for(int i = 0; i < count; ++i) {
+        const float wb = weights[i];
+        const float wa = 1.0f - wb;
+        aa += wa * wa;
+        bb += wb * wb;
+        ab += wa * wb;
+        for(int c = 0; c < dims; ++c) {
+            ax[c] += wa * pts[i][c];
+            bx[c] += wb * pts[i][c];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if(fabsf(det) < 1e-6f) {
+        return false;
+    }
+
+    for(int c = 0; c < dims; ++c) {
+        a[c] = bc_clampf((bb * ax[c] - ab * bx[c]) / det, 0.0f, 255.0f);
+        b[c] = bc_clampf((aa * bx[c] - ab * ax[c]) / det, 0.0f, 255.0f);
+    }
+
+    return true;
+}
+
+static inline void bc_write_bits(uint8_t *out, uint32_t *pos, uint32_t value, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; ++i, ++*pos) {
+        out[*pos >> 3] |= (uint8_t)(((value >> i) & 1) << (*pos & 7));
+    }
+}
+
+static inline uint32_t bc_read_bits(const uint8_t *in, uint32_t *pos, uint32_t count)
+{
+    uint32_t value = 0;
+    for(uint32_t i = 0; i < count; ++i, ++*pos) {
+        value |= (uint32_t)((in[*pos >> 3] >> (*pos & 7)) & 1) << i;
+    }
+
+    return value;
+}
+
+/* BC1 */
+static inline uint16_t bc1_pack_565(const float c[3])
+{
+    const uint32_t r = (uint32_t)(bc_clampf(c[0], 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+    const uint32_t g = (uint32_t)(bc_clampf(c[1], 0.0f, 255.0f) * (63.0f / 255.0f) + 0.5f);
+    const uint32_t b = (uint32_t)(bc_clampf(c[2], 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static inline void bc1_unpack_565(uint16_t v, int out[3])
+{
+    const int r = (v >> 11) & 31;
+    const int g = (v >> 5) & 63;
+    const int b = v & 31;
+
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 picks the mode from the endpoint order, BC3 always uses 4 colors. Index 3 of the 3 color mode is transparent black.
+static inline void bc1_palette(uint16_t c0, uint16_t c1, bool four_color, int pal[4][3])
+{
+    bc1_unpack_565(c0, pal[0]);
+    bc1_unpack_565(c1, pal[1]);
+
+    for(int c = 0; c < 3; ++c) {
+        if(four_color) {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+        }
+        else {
+            pal[2][c] = (pal[0][c] + pal[1][c]) / 2;
+            pal[3][c] = 0;
+        }
+    }
+}
+
+// Picks the closest palette entry for every opaque pixel, returns the squared error
+static inline float bc1_select(uint16_t c0, uint16_t c1, bool four_color, const uint8_t px[BC_BLOCK_PIXELS][4], const bool *transparent, uint32_t *out_selectors)
+{
+    int pal[4][3];
+    bc1_palette(c0, c1, four_color, pal);
+
+    const int color_count = four_color ? 4 : 3;
+    float total_err = 0.0f;
+    uint32_t selectors = 0;
+
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        if(transparent[i]) {
+            selectors |= 3u << (i * 2);
+            continue;
+        }
+
+        int best = 0;
+        int best_err = INT32_MAX;
+        for(int j = 0; j < color_count; ++j) {
+            const int dr = px[i][0] - pal[j][0];
+            const int dg = px[i][1] - pal[j][1];
+            const int db = px[i][2] - pal[j][2];
+            const int err = dr * dr + dg * dg + db * db;
+            if(err < best_err) {
+                best_err = err;
+                best = j;
+            }
+        }
+
+        selectors |= (uint32_t)best << (i * 2);
+        total_err += (float)best_err;
+    }
+
+    *out_selectors = selectors;
+    return total_err;
+}
+
+// The color half of BC1 and BC3, BC3 has its own alpha so it never uses the 3 color mode
+static inline void bc1_encode_color(uint8_t out[8], const uint8_t px[BC_BLOCK_PIXELS][4], bool allow_transparent)
+{
+    bool transparent[BC_BLOCK_PIXELS];
+    bool any_transparent = false;
+
+    float pts[BC_BLOCK_PIXELS][4];
+    int pt_index[BC_BLOCK_PIXELS];
+    int count = 0;
+
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        transparent[i] = allow_transparent && px[i][3] < 128;
+        any_transparent |= transparent[i];
+
+        if(!transparent[i]) {
+            for(int c = 0; c < 3; ++c) {
+                pts[count][c] = px[i][c];
+            }
+            pt_index[count++] = i;
+        }
+    }
+
+    uint16_t best_c0 = 0, best_c1 = 0;
+    uint32_t best_selectors = 0xFFFFFFFFu; // Everything transparent
+
+    if(count > 0) {
+        float mean[4], axis[4], lo[4], hi[4];
+        bc_principal_axis((const float (*)[4])pts, count, 3, mean, axis);
+        bc_axis_endpoints((const float (*)[4])pts, count, 3, mean, axis, lo, hi);
+
+        float best_err = FLT_MAX;
+        for(int iter = 0; iter <= BC_REFINE_ITERATIONS; ++iter) {
+            uint16_t c0 = bc1_pack_565(hi);
+            uint16_t c1 = bc1_pack_565(lo);
+
+            // The order of the endpoints picks the mode: c0 > c1 is 4 colors, otherwise 3 colors + transparent
+            if((c0 < c1 && !any_transparent) || (c0 > c1 && any_transparent)) {
+                const uint16_t tmp = c0;
+                c0 = c1;
+                c1 = tmp;
+            }
+
+            const bool four_color = !allow_transparent || c0 > c1;
+
+            uint32_t selectors;
+            const float err = bc1_select(c0, c1, four_color, px, transparent, &selectors);
+            if(err < best_err) {
+                best_err = err;
+                best_c0 = c0;
+                best_c1 = c1;
+                best_selectors = selectors;
+            }
+
+            if(best_err == 0.0f || iter == BC_REFINE_ITERATIONS) {
+                break;
+            }
+
+            // Weights are how far along from c0 to c1 each selector is
+            static const float weights_4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+            static const float weights_3[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+            const float *weight_table = four_color ? weights_4 : weights_3;
+
+            float weights[BC_BLOCK_PIXELS];
+            for(int i = 0; i < count; ++i) {
+                weights[i] = weight_table[(selectors >> (pt_index[i] * 2)) & 3];
+            }
+
+            if(!bc_refit_endpoints((const float (*)[4])pts, weights, count, 3, hi, lo)) {
+                break;
+            }
+        }
+    }
+
+    out[0] = (uint8_t)best_c0;
+    out[1] = (uint8_t)(best_c0 >> 8);
+    out[2] = (uint8_t)best_c1;
+    out[3] = (uint8_t)(best_c1 >> 8);
+    for(int i = 0; i < 4; ++i) {
+        out[4 + i] = (uint8_t)(best_selectors >> (i * 8));
+    }
+}
+
+static inline void bc1_decode_color(uint8_t px[BC_BLOCK_PIXELS][4], const uint8_t in[8], bool allow_transparent)
+{
+    const uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+    const uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+    const uint32_t selectors = (uint32_t)in[4] | ((uint32_t)in[5] << 8) | ((uint32_t)in[6] << 16) | ((uint32_t)in[7] << 24);
+
+    const bool four_color = !allow_transparent || c0 > c1;
+
+    int pal[4][3];
+    bc1_palette(c0, c1, four_color, pal);
+
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        const uint32_t s = (selectors >> (i * 2)) & 3;
+        for(int c = 0; c < 3; ++c) {
+            px[i][c] = (uint8_t)pal[s][c];
+        }
+        px[i][3] = (!four_color && s == 3) ? 0 : 255;
+    }
+}
+
+/* BC4 */
+static inline void bc4_palette(uint8_t a0, uint8_t a1, int pal[8])
+{
+    pal[0] = a0;
+    pal[1] = a1;
+
+    if(a0 > a1) {
+        for(int i = 1; i < 7; ++i) {
+            pal[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        }
+    }
+    else {
+        for(int i = 1; i < 5; ++i) {
+            pal[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        }
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+}
+
+// One channel, taken from every pixel at channel
+static inline void bc4_encode(uint8_t out[8], const uint8_t px[BC_BLOCK_PIXELS][4], int channel)
+{
+    uint8_t lo = 255, hi = 0;
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        const uint8_t v = px[i][channel];
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+    }
+
+    memset(out, 0, 8);
+    out[0] = hi;
+    out[1] = lo;
+
+    if(hi == lo) {
+        return;
+    }
+
+    int pal[8];
+    bc4_palette(hi, lo, pal);
+
+    uint32_t pos = 16;
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        int best = 0;
+        int best_err = INT32_MAX;
+        for(int j = 0; j < 8; ++j) {
+            const int d = px[i][channel] - pal[j];
+            if(d * d < best_err) {
+                best_err = d * d;
+                best = j;
+            }
+        }
+
+        bc_write_bits(out, &pos, (uint32_t)best, 3);
+    }
+}
+
+static inline void bc4_decode(uint8_t px[BC_BLOCK_PIXELS][4], const uint8_t in[8], int channel)
+{
+    int pal[8];
+    bc4_palette(in[0], in[1], pal);
+
+    uint32_t pos = 16;
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        px[i][channel] = (uint8_t)pal[bc_read_bits(in, &pos, 3)];
+    }
+}
+
+/* BC7 */
+static const uint8_t s_bc7_weights_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static inline int bc7_interpolate(int e0, int e1, int weight)
+{
+    return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+// Quantizes the endpoints for the given p-bits and picks the indices, returns the squared error
+static inline float bc7_mode6_try(const uint8_t px[BC_BLOCK_PIXELS][4], const float lo[4], const float hi[4], uint32_t p0, uint32_t p1,
+                                  uint8_t q0[4], uint8_t q1[4], uint8_t indices[BC_BLOCK_PIXELS])
+{
+    int e0[4], e1[4], d[4];
+    int dd = 0;
+    for(int c = 0; c < 4; ++c) {
+        q0[c] = (uint8_t)bc_clampf(floorf((lo[c] - (float)p0) * 0.5f + 0.5f), 0.0f, 127.0f);
+        q1[c] = (uint8_t)bc_clampf(floorf((hi[c] - (float)p1) * 0.5f + 0.5f), 0.0f, 127.0f);
+        e0[c] = (q0[c] << 1) | p0;
+        e1[c] = (q1[c] << 1) | p1;
+        d[c] = e1[c] - e0[c];
+        dd += d[c] * d[c];
+    }
+
+    float total_err = 0.0f;
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        // Project onto the endpoint line for a first guess, then check the neighbouring indices for the real palette
+        int guess = 0;
+        if(dd > 0) {
+            int dot = 0;
+            for(int c = 0; c < 4; ++c) {
+                dot += (px[i][c] - e0[c]) * d[c];
+            }
+
+            const float t = bc_clampf((float)dot / (float)dd, 0.0f, 1.0f) * 15.0f;
+            guess = (int)(t + 0.5f);
+        }
+
+        int best = guess;
+        int best_err = INT32_MAX;
+        for(int j = guess - 1; j <= guess + 1; ++j) {
+            if(j < 0 || j > 15) {
+                continue;
+            }
+
+            int err = 0;
+            for(int c = 0; c < 4; ++c) {
+                const int v = bc7_interpolate(e0[c], e1[c], s_bc7_weights_4[j]);
+                err += (px[i][c] - v) * (px[i][c] - v);
+            }
+
+            if(err < best_err) {
+                best_err = err;
+                best = j;
+            }
+        }
+
+        indices[i] = (uint8_t)best;
+        total_err += (float)best_err;
+    }
+
+    return total_err;
+}
+
+static inline void bc7_encode_mode6(uint8_t out[16], const uint8_t px[BC_BLOCK_PIXELS][4])
+{
+    float pts[BC_BLOCK_PIXELS][4];
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        for(int c = 0; c < 4; ++c) {
+            pts[i][c] = px[i][c];
+        }
+    }
+
+    float mean[4], axis[4], lo[4], hi[4];
+    bc_principal_axis((const float (*)[4])pts, BC_BLOCK_PIXELS, 4, mean, axis);
+    bc_axis_endpoints((const float (*)[4])pts, BC_BLOCK_PIXELS, 4, mean, axis, lo, hi);
+
+    float best_err = FLT_MAX;
+    uint8_t best_q0[4] = {0}, best_q1[4] = {0}, best_indices[BC_BLOCK_PIXELS] = {0};
+    uint32_t best_p0 = 0, best_p1 = 0;
+
+    for(int iter = 0; iter <= BC_REFINE_ITERATIONS; ++iter) {
+        for(uint32_t p = 0; p < 4; ++p) {
+            uint8_t q0[4], q1[4], indices[BC_BLOCK_PIXELS];
+            const float err = bc7_mode6_try(px, lo, hi, p & 1, p >> 1, q0, q1, indices);
+            if(err < best_err) {
+                best_err = err;
+                best_p0 = p & 1;
+                best_p1 = p >> 1;
+                memcpy(best_q0, q0, sizeof(q0));
+                memcpy(best_q1, q1, sizeof(q1));
+                memcpy(best_indices, indices, sizeof(indices));
+            }
+        }
+
+        if(best_err == 0.0f || iter == BC_REFINE_ITERATIONS) {
+            break;
+        }
+
+        float weights[BC_BLOCK_PIXELS];
+        for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+            weights[i] = s_bc7_weights_4[best_indices[i]] / 64.0f;
+        }
+
+        if(!bc_refit_endpoints((const float (*)[4])pts, weights, BC_BLOCK_PIXELS, 4, lo, hi)) {
+            break;
+        }
+    }
+
+    // The first index is stored without its top bit, so it has to be below 8. Swapping the endpoints flips the indices.
+    if(best_indices[0] & 8) {
+        for(int c = 0; c < 4; ++c) {
+            const uint8_t tmp = best_q0[c];
+            best_q0[c] = best_q1[c];
+            best_q1[c] = tmp;
+        }
+
+        const uint32_t tmp = best_p0;
+        best_p0 = best_p1;
+        best_p1 = tmp;
+
+        for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+            best_indices[i] = 15 - best_indices[i];
+        }
+    }
+
+    memset(out, 0, 16);
+    uint32_t pos = 0;
+    bc_write_bits(out, &pos, 1u << 6, 7); // Mode 6
+    for(int c = 0; c < 4; ++c) {
+        bc_write_bits(out, &pos, best_q0[c], 7);
+        bc_write_bits(out, &pos, best_q1[c], 7);
+    }
+    bc_write_bits(out, &pos, best_p0, 1);
+    bc_write_bits(out, &pos, best_p1, 1);
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        bc_write_bits(out, &pos, best_indices[i], i == 0 ? 3 : 4);
+    }
+}
+
+static inline void bc7_decode(uint8_t px[BC_BLOCK_PIXELS][4], const uint8_t in[16])
+{
+    if((in[0] & 0x7F) != 0x40) {
+        for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+            px[i][0] = 255;
+            px[i][1] = 0;
+            px[i][2] = 255;
+            px[i][3] = 255;
+        }
+        return;
+    }
+
+    uint32_t pos = 7;
+    int e0[4], e1[4];
+    for(int c = 0; c < 4; ++c) {
+        e0[c] = (int)bc_read_bits(in, &pos, 7) << 1;
+        e1[c] = (int)bc_read_bits(in, &pos, 7) << 1;
+    }
+
+    const uint32_t p0 = bc_read_bits(in, &pos, 1);
+    const uint32_t p1 = bc_read_bits(in, &pos, 1);
+    for(int c = 0; c < 4; ++c) {
+        e0[c] |= p0;
+        e1[c] |= p1;
+    }
+
+    for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+        const uint32_t index = bc_read_bits(in, &pos, i == 0 ? 3 : 4);
+        for(int c = 0; c < 4; ++c) {
+            px[i][c] = (uint8_t)bc7_interpolate(e0[c], e1[c], s_bc7_weights_4[index]);
+        }
+    }
+}
+
+/* Dispatch */
+static inline void bc_encode_block(uint32_t format, uint8_t *out, const uint8_t px[BC_BLOCK_PIXELS][4])
+{
+    switch(format) {
+    case TEXTURE_FILE_FORMAT_BC1:
+        bc1_encode_color(out, px, true);
+        break;
+    case TEXTURE_FILE_FORMAT_BC3:
+        bc4_encode(out, px, 3);
+        bc1_encode_color(out + 8, px, false);
+        break;
+    case TEXTURE_FILE_FORMAT_BC5:
+        bc4_encode(out, px, 0);
+        bc4_encode(out + 8, px, 1);
+        break;
+    case TEXTURE_FILE_FORMAT_BC7:
+        bc7_encode_mode6(out, px);
+        break;
+    default:
+        panic("Not a block compressed format");
+    }
+}
+
+// BC5 decodes to (R, G, 0, 255), like the GPU does
+static inline void bc_decode_block(uint32_t format, uint8_t px[BC_BLOCK_PIXELS][4], const uint8_t *in)
+{
+    switch(format) {
+    case TEXTURE_FILE_FORMAT_BC1:
+        bc1_decode_color(px, in, true);
+        break;
+    case TEXTURE_FILE_FORMAT_BC3:
+        bc1_decode_color(px, in + 8, false);
+        bc4_decode(px, in, 3);
+        break;
+    case TEXTURE_FILE_FORMAT_BC5:
+        for(int i = 0; i < BC_BLOCK_PIXELS; ++i) {
+            px[i][2] = 0;
+            px[i][3] = 255;
+        }
+        bc4_decode(px, in, 0);
+        bc4_decode(px, in + 8, 1);
+        break;
+    case TEXTURE_FILE_FORMAT_BC7:
+        bc7_decode(px, in);
+        break;
+    default:
+        panic("Not a block compressed format");
+    }
+}
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Small helpers shared by the offline tools.
+ * Everything is static inline so each tool stays a single translation unit, same as the samples,
+ * without warnings about the helpers a tool doesn't use.
+ */
+#ifndef KNZ_TOOLS_COMMON_H
+#define KNZ_TOOLS_COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/resource.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <pthread.h>
+#endif
+
+#define countof(x) (sizeof(x) / sizeof(x[0]))
+
+#define CHECK(x_, msg_) do { if(!(x_)) { panic(msg_); } } while(0);
+static inline void panic(const char *message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(1);
+}
+
+static inline void *xmalloc(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    CHECK(ptr, "Out of memory");
+
+    return ptr;
+}
+
+// NOTE: timespec_get is C11 and available on both glibc and MSVC, unlike clock_gettime
+static inline double time_now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t next_pow2(uint64_t x)
+{
+    uint64_t p = 1;
+    while(p < x) {
+        p <<= 1;
+    }
+
+    return p;
+}
+
+/* File mapping */
+struct File_Mapping {
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static inline bool file_map_readonly(const char *path, struct File_Mapping *out)
+{
+    struct File_Mapping fm = {0};
+
+#ifdef _WIN32
+    fm.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(fm.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(fm.file, &size);
+    fm.size = (size_t)size.QuadPart;
+
+    fm.mapping = CreateFileMappingA(fm.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    fm.data = fm.mapping ? MapViewOfFile(fm.mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if(!fm.data) {
+        if(fm.mapping) CloseHandle(fm.mapping);
+        CloseHandle(fm.file);
+        return false;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    fm.size = (size_t)st.st_size;
+
+    void *data = mmap(NULL, fm.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // NOTE: The mapping keeps its own reference to the file
+
+    if(data == MAP_FAILED) {
+        return false;
+    }
+
+    fm.data = data;
+#endif
+
+    *out = fm;
+    return true;
+}
+
+static inline void file_unmap(struct File_Mapping *fm)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(fm->data);
+    CloseHandle(fm->mapping);
+    CloseHandle(fm->file);
+#else
+    munmap((void *)fm->data, fm->size);
+#endif
+    *fm = (struct File_Mapping){0};
+}
+
+// Hint that a range of the mapping won't be read again, so its pages can leave the working set
+static inline void file_mapping_release_range(struct File_Mapping *fm, size_t offset, size_t size)
+{
+#ifndef _WIN32
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t begin = (offset + page_size - 1) & ~(page_size - 1);
+    const size_t end = (offset + size) & ~(page_size - 1);
+
+    if(end > begin) {
+        madvise((void *)(fm->data + begin), end - begin, MADV_DONTNEED);
+    }
+#endif
+}
+
+/* Threads */
+#define PARALLEL_MAX_THREADS 64
+
+typedef void (*Parallel_Func)(void *data, uint32_t thread_idx, uint32_t thread_count);
+
+struct Parallel_Task {
+    Parallel_Func func;
+    void *data;
+    uint32_t thread_idx;
+    uint32_t thread_count;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_thread_main(LPVOID arg)
+{
+    struct Parallel_Task *task = arg;
+    task->func(task->data, task->thread_idx, task->thread_count);
+    return 0;
+}
+#else
+static void *parallel_thread_main(void *arg)
+{
+    struct Parallel_Task *task = arg;
+    task->func(task->data, task->thread_idx, task->thread_count);
+    return NULL;
+}
+#endif
+
+// Runs func on thread_count threads (the calling thread being thread 0) and waits for all of them to finish
+static inline void parallel_run(uint32_t thread_count, Parallel_Func func, void *data)
+{
+    CHECK(thread_count >= 1 && thread_count <= PARALLEL_MAX_THREADS, "Bad thread count");
+
+    struct Parallel_Task tasks[PARALLEL_MAX_THREADS];
+#ifdef _WIN32
+    HANDLE threads[PARALLEL_MAX_THREADS];
+#else
+    pthread_t threads[PARALLEL_MAX_THREADS];
+#endif
+
+    for(uint32_t i = 0; i < thread_count; ++i) {
+        tasks[i] = (struct Parallel_Task) {
+            .func = func,
+            .data = data,
+            .thread_idx = i,
+            .thread_count = thread_count
+        };
+    }
+
+    for(uint32_t i = 1; i < thread_count; ++i) {
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, parallel_thread_main, &tasks[i], 0, NULL);
+        CHECK(threads[i], "Couldn't create thread");
+#else
+        CHECK(0 == pthread_create(&threads[i], NULL, parallel_thread_main, &tasks[i]), "Couldn't create thread");
+#endif
+    }
+
+    func(data, 0, thread_count);
+
+    for(uint32_t i = 1; i < thread_count; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
+
+// The part of [0, count) that thread_idx of thread_count works on
+static inline void parallel_range(uint64_t count, uint32_t thread_idx, uint32_t thread_count, uint64_t *out_begin, uint64_t *out_end)
+{
+    *out_begin = count * thread_idx / thread_count;
+    *out_end = count * (thread_idx + 1) / thread_count;
+}
+
+static inline uint32_t cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const uint32_t count = info.dwNumberOfProcessors;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if(count < 1) {
+        return 1;
+    }
+
+    return count < PARALLEL_MAX_THREADS ? (uint32_t)count : PARALLEL_MAX_THREADS;
+}
+
+// Peak resident set size of the whole process so far, in KB (0 when unsupported)
+static inline uint64_t peak_rss_kb(void)
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+        return (uint64_t)usage.ru_maxrss / 1024;
+    #else
+        return (uint64_t)usage.ru_maxrss;
+    #endif
+#endif
+}
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * knz_meshcompress: Compresses the vertex and index buffers of .bin meshes (see mesh_codec.h).
+ *
+ * Quantized inputs stay quantized. The compression is lossless, apart from triangles possibly being rotated.
+ * Vertex compression works best after knz_meshopt, since neighbouring vertices in memory are then
+ * also close on the mesh, and the index coding relies on vertices being in order of first use.
+ *
+ * The benchmark encodes every input in both vertex formats and measures the decode throughput
+ * in GB/s of decoded data, for the scalar and the SSE2 vertex decoder:
+ *
+ *   knz_meshcompress --bench suzanne.bin cube.bin
+ */
+#include "common.h"
+#include "mesh_file.h"
+#include "mesh_codec.h"
+
+#define BENCH_MIN_TIME 0.25
+
+static const char *s_usage =
+    "Usage:\n"
+    "  knz_meshcompress <input.bin> [output.bin]\n"
+    "  knz_meshcompress --bench <input.bin>...\n"
+    "\n"
+    "Without an output only the compression ratio is printed.\n";
+
+typedef bool (*Decode_Func)(void *out, uint32_t count, size_t stride, const uint8_t *in, size_t in_size);
+
+// Runs the decoder until BENCH_MIN_TIME has passed, returns GB/s of decoded data
+static double bench_decode(Decode_Func decode, void *out, uint32_t count, size_t stride, const uint8_t *in, size_t in_size)
+{
+    uint32_t iterations = 0;
+    const double t_start = time_now_sec();
+    double t = 0.0;
+
+    do {
+        CHECK(decode(out, count, stride, in, in_size), "Decode failed");
+        iterations++;
+        t = time_now_sec() - t_start;
+    } while(t < BENCH_MIN_TIME);
+
+    return (double)count * stride * iterations / t * 1e-9;
+}
+
+static bool decode_indices(void *out, uint32_t count, size_t stride, const uint8_t *in, size_t in_size)
+{
+    return mesh_codec_decode_indices(out, count, stride, in, in_size);
+}
+
+static void bench_vertices(const char *label, const void *vertices, uint32_t vert_count, size_t stride)
+{
+    const size_t raw_size = (size_t)vert_count * stride;
+
+    uint8_t *stream = xmalloc(mesh_codec_vertex_bound(vert_count, stride));
+    const size_t size = mesh_codec_encode_vertices(stream, vertices, vert_count, stride);
+
+    void *decoded = xmalloc(raw_size);
+    CHECK(mesh_codec_decode_vertices_scalar(decoded, vert_count, stride, stream, size) && 0 == memcmp(decoded, vertices, raw_size), "Scalar vertex decode mismatch");
+
+    printf("\t%-18s %9zu -> %9zu bytes (%.2fx)  scalar: %6.2f GB/s", label, raw_size, size, (double)raw_size / size,
+           bench_decode(mesh_codec_decode_vertices_scalar, decoded, vert_count, stride, stream, size));
+
+#if MESH_CODEC_SSE2
+    memset(decoded, 0, raw_size);
+    CHECK(mesh_codec_decode_vertices_sse2(decoded, vert_count, stride, stream, size) && 0 == memcmp(decoded, vertices, raw_size), "SSE2 vertex decode mismatch");
+
+    printf("  SSE2: %6.2f GB/s", bench_decode(mesh_codec_decode_vertices_sse2, decoded, vert_count, stride, stream, size));
+#endif
+
+    printf("\n");
+
+    free(decoded);
+    free(stream);
+}
+
+// Decoded triangles can be rotated, so compare them as sets of rotations
+static bool triangles_match(const uint32_t *expected, const void *decoded, size_t index_size, uint32_t index_count)
+{
+    for(uint32_t t = 0; t < index_count / 3; ++t) {
+        uint32_t tri[3];
+        for(int k = 0; k < 3; ++k) {
+            tri[k] = index_size == sizeof(uint16_t) ? ((const uint16_t *)decoded)[t * 3 + k] : ((const uint32_t *)decoded)[t * 3 + k];
+        }
+
+        bool match = false;
+        for(int r = 0; r < 3; ++r) {
+            match = match || (tri[r] == expected[t * 3] && tri[(r + 1) % 3] == expected[t * 3 + 1] && tri[(r + 2) % 3] == expected[t * 3 + 2]);
+        }
+
+        if(!match) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void bench_indices(const struct Mesh_Data *mesh)
+{
+    const size_t index_size = mesh_needs_index_32(mesh->vert_count) ? sizeof(uint32_t) : sizeof(uint16_t);
+    const size_t raw_size = (size_t)mesh->index_count * index_size;
+
+    uint8_t *stream = xmalloc(mesh_codec_index_bound(mesh->index_count));
+    const size_t size = mesh_codec_encode_indices(stream, mesh->indices, mesh->index_count);
+
+    void *decoded = xmalloc(raw_size);
+    CHECK(mesh_codec_decode_indices(decoded, mesh->index_count, index_size, stream, size) &&
+          triangles_match(mesh->indices, decoded, index_size, mesh->index_count), "Index decode mismatch");
+
+    printf("\t%-18s %9zu -> %9zu bytes (%.2fx)  scalar: %6.2f GB/s\n", index_size == sizeof(uint16_t) ? "Indices (u16):" : "Indices (u32):",
+           raw_size, size, (double)raw_size / size, bench_decode(decode_indices, decoded, mesh->index_count, index_size, stream, size));
+
+    free(decoded);
+    free(stream);
+}
+
+static int bench(char **input_paths, int input_count)
+{
+    for(int i = 0; i < input_count; ++i) {
+        struct Mesh_Data mesh;
+        if(!mesh_file_load(input_paths[i], &mesh)) {
+            return 1;
+        }
+
+        printf("%s: %u verts, %u tris\n", input_paths[i], mesh.vert_count, mesh.index_count / 3);
+
+        bench_vertices("Vertices (float):", mesh.verts, mesh.vert_count, MESH_VERT_SIZE_BYTES);
+
+        struct Mesh_File_Quantization quant;
+        mesh_quantization_from_verts(mesh.verts, mesh.vert_count, &quant);
+
+        struct Mesh_Quant_Vert *quant_verts = xmalloc((size_t)mesh.vert_count * MESH_QUANT_VERT_SIZE_BYTES);
+        for(uint32_t v = 0; v < mesh.vert_count; ++v) {
+            quant_verts[v] = mesh_vert_quantize(&mesh.verts[(size_t)v * MESH_VERT_ELEM_COUNT], &quant);
+        }
+
+        bench_vertices("Vertices (quant):", quant_verts, mesh.vert_count, MESH_QUANT_VERT_SIZE_BYTES);
+        bench_indices(&mesh);
+
+        free(quant_verts);
+        mesh_data_free(&mesh);
+    }
+
+    return 0;
+}
+
+static long file_size(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if(!fp) {
+        return 0;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    fclose(fp);
+
+    return size;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc >= 3 && 0 == strcmp(argv[1], "--bench")) {
+        return bench(&argv[2], argc - 2);
+    }
+
+    if(argc < 2 || argc > 3 || argv[1][0] == '-') {
+        fprintf(stderr, "%s", s_usage);
+        return 1;
+    }
+
+    const char *input_path = argv[1];
+    const char *output_path = argc > 2 ? argv[2] : NULL;
+
+    // Only to keep quantized inputs quantized
+    struct Mesh_File_Header header = {0};
+    struct Mesh_File_Quantization quant;
+    FILE *fp = fopen(input_path, "rb");
+    const bool header_ok = fp && mesh_file_read_header(fp, &header, &quant);
+    if(fp) {
+        fclose(fp);
+    }
+
+    struct Mesh_Data mesh;
+    if(!header_ok || !mesh_file_load(input_path, &mesh)) {
+        return 1;
+    }
+
+    const bool quantized = header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED;
+
+    if(output_path) {
+        if(!mesh_file_save_ex(output_path, &mesh, quantized, true)) {
+            return 1;
+        }
+
+        printf("%s: %ld -> %ld bytes (%.2fx)\n", input_path, file_size(input_path), file_size(output_path),
+               (double)file_size(input_path) / (double)file_size(output_path));
+    }
+    else {
+        const size_t vertex_stride = quantized ? MESH_QUANT_VERT_SIZE_BYTES : MESH_VERT_SIZE_BYTES;
+        void *vertex_data = mesh.verts;
+        struct Mesh_Quant_Vert *quant_verts = NULL;
+
+        if(quantized) {
+            quant_verts = xmalloc((size_t)mesh.vert_count * MESH_QUANT_VERT_SIZE_BYTES);
+            for(uint32_t v = 0; v < mesh.vert_count; ++v) {
+                quant_verts[v] = mesh_vert_quantize(&mesh.verts[(size_t)v * MESH_VERT_ELEM_COUNT], &quant);
+            }
+            vertex_data = quant_verts;
+        }
+
+        uint8_t *stream = xmalloc(mesh_codec_vertex_bound(mesh.vert_count, vertex_stride) + mesh_codec_index_bound(mesh.index_count));
+        const size_t vertex_size = mesh_codec_encode_vertices(stream, vertex_data, mesh.vert_count, vertex_stride);
+        const size_t index_size = mesh_codec_encode_indices(stream, mesh.indices, mesh.index_count);
+
+        const size_t raw_vertex_size = (size_t)mesh.vert_count * vertex_stride;
+        const size_t raw_index_size = (size_t)mesh.index_count * (mesh_needs_index_32(mesh.vert_count) ? sizeof(uint32_t) : sizeof(uint16_t));
+
+        printf("Vertices: %zu -> %zu bytes (%.2fx)\n", raw_vertex_size, vertex_size, (double)raw_vertex_size / vertex_size);
+        printf("Indices:  %zu -> %zu bytes (%.2fx)\n", raw_index_size, index_size, (double)raw_index_size / index_size);
+
+        free(stream);
+        free(quant_verts);
+    }
+
+    mesh_data_free(&mesh);
+    return 0;
+}
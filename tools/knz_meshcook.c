@@ -0,0 +1,1471 @@
+/*
+ * knz_meshcook: Turns triangle soups into deduplicated, indexed .bin meshes.
+ *
+ * This is the production version of vk_meshview/tools/test_vertex_deduplicate_hashtable.c.
+ * Vertices are welded with an open-addressing hash table that is sized from the input,
+ * so it scales to tens of millions of vertices without any fixed scratch memory.
+ *
+ * Inputs can either be an existing .bin mesh (indexed), or with --soup, a headerless
+ * float[N][8] array where every 3 vertices make a triangle (unindexed).
+ *
+ * With --bench the O(n^2) brute force search from test_vertex_deduplicate.c is run as well,
+ * the results are checked against each other and the speedup is printed.
+ * Soups too big for memory can be welded with --out-of-core, which sorts them in chunks on all cores and merges
+ * the sorted runs through temporary files, within --mem-budget (see Out-of-Core Welding Notes):
+ *
+ *   knz_meshcook --soup --out-of-core --mem-budget 4096 --temp-dir /scratch scan.soup scan.bin
+ *
+ * --bench-kernels measures the scalar, SSE2 and AVX2 vertex kernels (vertex_kernels.h) against each other,
+ * and the collision rate of the full vertex hash against the position-only one from the test program.
+ *
+ * By default only bit-identical vertices are welded. With --epsilon (or the per-attribute --weld-* options)
+ * vertices that are merely close are welded as well, using a hash grid instead (see Tolerance Welding Notes).
+ * This catches vertices that only differ by float noise from the exporter, e.g. the ~3% extra vertices
+ * mesh_export.py mentions since it started comparing float tuples:
+ *
+ *   knz_meshcook --epsilon 0.0001 --bench suzanne.bin suzanne_welded.bin
+ */
+#include "common.h"
+#include "mesh_file.h"
+#include "vertex_kernels.h"
+
+#include <assert.h>
+#include <math.h>
+
+static const char *s_usage =
+    "Usage: knz_meshcook [options] <input> [output.bin]\n"
+    "\n"
+    "Options:\n"
+    "  --soup            Input is a headerless float[N][8] unindexed triangle soup\n"
+    "  --bench           Also run the O(n^2) brute force dedup and compare timings\n"
+    "  --bench-limit N   Only brute force the first N input verts (default: all)\n"
+    "  --epsilon E       Weld vertices whose attributes all differ by at most E (default: 0, exact)\n"
+    "  --weld-pos E      Position tolerance, overrides --epsilon\n"
+    "  --weld-normal E   Normal tolerance, overrides --epsilon\n"
+    "  --weld-uv E       UV tolerance, overrides --epsilon\n"
+    "  --kernels NAME    Vertex kernels to weld with: scalar, sse2 or avx2 (default: the best the CPU supports)\n"
+    "  --bench-kernels   Benchmark every vertex kernel set the CPU supports on the input\n"
+    "  --out-of-core     Weld a soup in sorted runs through temporary files, for soups that don't fit in memory (exact only)\n"
+    "  --mem-budget MB   Memory for --out-of-core to work in (default: 1024)\n"
+    "  --threads N       Threads for --out-of-core to sort with (default: all cores)\n"
+    "  --temp-dir DIR    Where --out-of-core puts its temporary files (default: next to the output)\n";
+
+/* Input */
+static bool load_soup(const char *path, struct Mesh_Data *out)
+{
+    FILE *fp = fopen(path, "rb");
+    if(!fp) {
+        fprintf(stderr, "File open error: Couldn't open %s\n", path);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+
+    if(size < 0 || size % (3 * MESH_VERT_SIZE_BYTES) != 0) {
+        fprintf(stderr, "%s: size is not a whole number of float[8] triangles\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    const uint32_t vert_count = (uint32_t)(size / MESH_VERT_SIZE_BYTES);
+
+    struct Mesh_Data mesh = {
+        .verts = xmalloc((size_t)vert_count * MESH_VERT_SIZE_BYTES),
+        .vert_count = vert_count,
+    };
+
+    bool ok = fread(mesh.verts, MESH_VERT_SIZE_BYTES, vert_count, fp) == vert_count;
+    fclose(fp);
+
+    if(!ok) {
+        fprintf(stderr, "%s: read failed\n", path);
+        mesh_data_free(&mesh);
+        return false;
+    }
+
+    *out = mesh;
+    return true;
+}
+
+/* Hash Table Notes:
+ *
+ * Open addressing over groups of VERTEX_KERNELS_GROUP_SIZE slots, kept at most half full.
+ * Every slot has a 7-bit tag from the top of its hash, and the tags of a group sit next to each other,
+ * so one match_group call checks the whole group and almost every slot that isn't a real match is rejected
+ * without touching the vertex data. The low bits of the hash pick the first group, and the next group is only
+ * probed when the current one is full. Nothing is ever removed, so a group with an empty slot ends the search.
+ *
+ * Hashing and comparing go through the vertex kernels (see vertex_kernels.h), picked for the CPU at runtime.
+ */
+struct Vertex_Hash_Table {
+    uint8_t *tags;     // [group_count * VERTEX_KERNELS_GROUP_SIZE], VERTEX_KERNELS_TAG_EMPTY if unused
+    uint32_t *indices;
+    uint64_t group_mask;
+    const float *verts;
+    const struct Vertex_Kernels *kernels;
+
+    uint64_t probe_count;       // Groups looked at
+    uint64_t false_match_count; // Tags that matched but the vertex didn't
+};
+
+static struct Vertex_Hash_Table verthash_create(const float *verts, uint32_t max_vert_count, const struct Vertex_Kernels *kernels)
+{
+    const uint64_t slot_count = next_pow2((uint64_t)max_vert_count * 2 + VERTEX_KERNELS_GROUP_SIZE);
+
+    struct Vertex_Hash_Table table = {
+        .tags = xmalloc(slot_count),
+        .indices = xmalloc(slot_count * sizeof(uint32_t)),
+        .group_mask = slot_count / VERTEX_KERNELS_GROUP_SIZE - 1,
+        .verts = verts,
+        .kernels = kernels
+    };
+
+    memset(table.tags, VERTEX_KERNELS_TAG_EMPTY, slot_count);
+
+    return table;
+}
+
+static void verthash_destroy(struct Vertex_Hash_Table *table)
+{
+    free(table->tags);
+    free(table->indices);
+    table->tags = NULL;
+    table->indices = NULL;
+}
+
+// Returns the index of a matching vertex, or inserts new_index and returns it if there is none
+static uint32_t verthash_find_or_insert(struct Vertex_Hash_Table *table, const float *vert, uint32_t new_index)
+{
+    const struct Vertex_Kernels *kernels = table->kernels;
+
+    const uint32_t hash = kernels->hash(vert);
+    const uint8_t tag = vertex_kernels_tag(hash);
+    uint64_t group = hash & table->group_mask;
+
+    for(;;) {
+        const size_t base = group * VERTEX_KERNELS_GROUP_SIZE;
+        ++table->probe_count;
+
+        uint32_t matches = kernels->match_group(&table->tags[base], tag);
+        while(matches) {
+            const uint32_t index = table->indices[base + vertex_kernels_next_match(&matches)];
+
+            if(kernels->equal(&table->verts[(size_t)index * MESH_VERT_ELEM_COUNT], vert)) {
+                return index;
+            }
+
+            ++table->false_match_count;
+        }
+
+        uint32_t empty = kernels->match_group(&table->tags[base], VERTEX_KERNELS_TAG_EMPTY);
+        if(empty) {
+            const size_t slot = base + vertex_kernels_next_match(&empty);
+            table->tags[slot] = tag;
+            table->indices[slot] = new_index;
+
+            return new_index;
+        }
+
+        group = (group + 1) & table->group_mask;
+    }
+}
+
+/* Tolerance Welding Notes:
+ *
+ * With a tolerance, a vertex is welded when every attribute is within its epsilon of an already welded vertex.
+ * This is the WITH_THRESHOLD mode of test_vertex_deduplicate.c, except that the comparison is inclusive so that
+ * an epsilon of 0 means exact. Like there, a vertex is welded to the first welded vertex it matches, so the
+ * result depends on the input order and chains of close vertices are not merged transitively.
+ *
+ * To do this in linear time, the welded vertices are bucketed in a hash grid over their positions with a cell size of
+ * (a hair over) twice the position epsilon. Anything within the epsilon is then either in the same cell, or one cell
+ * over towards whichever side of the cell the vertex is closer to, so only 8 cells need to be searched (instead of 27
+ * with a cell size of the epsilon). Cells keep their vertices in order of index, so the first match in a cell
+ * is its lowest, and the lowest match over all cells is the one the brute force finds.
+ *
+ * With a position epsilon of 0 the cells are the exact positions, and only the vertex's own cell is searched.
+ */
+#define SLOT_EMPTY UINT32_MAX
+#define GRID_CELL_MARGIN 1.0001     // Keeps rounding in the cell calculation from putting a match two cells away
+#define GRID_COORD_MAX 4.0e18       // Cell coordinates are clamped to this so any float converts to int64_t
+
+struct Weld_Tolerance {
+    float position;
+    float normal;
+    float uv;
+};
+
+static bool weld_tolerance_is_exact(const struct Weld_Tolerance *tolerance)
+{
+    return tolerance->position == 0.0f && tolerance->normal == 0.0f && tolerance->uv == 0.0f;
+}
+
+// NOTE: With all tolerances at 0 this is the same as the equal vertex kernel
+static bool vert_compare_tolerance(const float *a, const float *b, const struct Weld_Tolerance *tolerance)
+{
+    return (
+        fabsf(a[0] - b[0]) <= tolerance->position &&
+        fabsf(a[1] - b[1]) <= tolerance->position &&
+        fabsf(a[2] - b[2]) <= tolerance->position &&
+        fabsf(a[3] - b[3]) <= tolerance->normal &&
+        fabsf(a[4] - b[4]) <= tolerance->normal &&
+        fabsf(a[5] - b[5]) <= tolerance->normal &&
+        fabsf(a[6] - b[6]) <= tolerance->uv &&
+        fabsf(a[7] - b[7]) <= tolerance->uv
+    );
+}
+
+struct Grid_Cell_Slot {
+    int64_t cell[3];
+    uint32_t first; // Welded verts in this cell, linked through Weld_Grid::next in order of index
+    uint32_t last;
+};
+
+struct Weld_Grid {
+    struct Grid_Cell_Slot *slots;
+    uint64_t mask;
+    uint32_t *next;        // welded vert -> next welded vert in the same cell
+    double inv_cell_size;  // 0 when cells are exact positions
+
+    uint64_t probe_count;
+};
+
+static struct Weld_Grid weld_grid_create(uint32_t max_vert_count, float position_tolerance)
+{
+    const uint64_t capacity = next_pow2((uint64_t)max_vert_count * 2 + 1);
+
+    struct Weld_Grid grid = {
+        .slots = xmalloc(capacity * sizeof(struct Grid_Cell_Slot)),
+        .mask = capacity - 1,
+        .next = xmalloc(((size_t)max_vert_count + 1) * sizeof(uint32_t)),
+        .inv_cell_size = position_tolerance > 0.0f ? 1.0 / (2.0 * (double)position_tolerance * GRID_CELL_MARGIN) : 0.0
+    };
+
+    for(uint64_t i = 0; i < capacity; ++i) {
+        grid.slots[i].first = SLOT_EMPTY;
+    }
+
+    return grid;
+}
+
+static void weld_grid_destroy(struct Weld_Grid *grid)
+{
+    free(grid->slots);
+    free(grid->next);
+    *grid = (struct Weld_Grid){0};
+}
+
+// Returns the cell coordinate, and in out_side which neighbouring cell can also have matches (0 if none can)
+static int64_t weld_grid_coord(const struct Weld_Grid *grid, float p, int64_t *out_side)
+{
+    if(grid->inv_cell_size == 0.0) {
+        uint32_t bits;
+        memcpy(&bits, &p, sizeof(bits));
+
+        // NOTE: Same as in the vertex kernel hash, -0.0f and 0.0f have to end up in the same cell
+        *out_side = 0;
+        return bits == 0x80000000u ? 0 : bits;
+    }
+
+    const double q = (double)p * grid->inv_cell_size;
+    const double c = floor(q);
+    *out_side = q - c < 0.5 ? -1 : 1;
+
+    // NOTE: The clamping is monotonic, so vertices that are one cell apart stay at most one cell apart.
+    //       NaNs never match anything, so it doesn't matter which cell they go in.
+    if(!(c > -GRID_COORD_MAX)) {
+        return (int64_t)-GRID_COORD_MAX;
+    }
+
+    return c < GRID_COORD_MAX ? (int64_t)c : (int64_t)GRID_COORD_MAX;
+}
+
+static uint64_t hash_cell(const int64_t *cell)
+{
+    uint64_t h = 0x84222325cbf29ce4ull;
+
+    for(int i = 0; i < 3; ++i) {
+        h ^= (uint64_t)cell[i];
+        h *= 0x9e3779b97f4a7c15ull;
+        h ^= h >> 32;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+// Returns the slot of the cell, which is empty (first == SLOT_EMPTY) if it has no verts yet
+static struct Grid_Cell_Slot *weld_grid_find(struct Weld_Grid *grid, const int64_t *cell)
+{
+    uint64_t slot_idx = hash_cell(cell) & grid->mask;
+
+    for(;;) {
+        struct Grid_Cell_Slot *slot = &grid->slots[slot_idx];
+        ++grid->probe_count;
+
+        if(slot->first == SLOT_EMPTY || (slot->cell[0] == cell[0] && slot->cell[1] == cell[1] && slot->cell[2] == cell[2])) {
+            return slot;
+        }
+
+        slot_idx = (slot_idx + 1) & grid->mask;
+    }
+}
+
+// NOTE: index must be higher than all the verts already in the grid
+static void weld_grid_insert(struct Weld_Grid *grid, const int64_t *cell, uint32_t index)
+{
+    struct Grid_Cell_Slot *slot = weld_grid_find(grid, cell);
+
+    if(slot->first == SLOT_EMPTY) {
+        *slot = (struct Grid_Cell_Slot) {
+            .cell = { cell[0], cell[1], cell[2] },
+            .first = index
+        };
+    }
+    else {
+        grid->next[slot->last] = index;
+    }
+
+    slot->last = index;
+    grid->next[index] = SLOT_EMPTY;
+}
+
+/* Welding */
+struct Weld_Result {
+    float *verts;
+    uint32_t *remap; // input vert -> welded vert
+    uint32_t vert_count;
+};
+
+static struct Weld_Result weld_hashtable(const float *verts, uint32_t vert_count, const struct Vertex_Kernels *kernels, uint64_t *out_probe_count)
+{
+    struct Weld_Result result = {
+        .verts = xmalloc((size_t)vert_count * MESH_VERT_SIZE_BYTES),
+        .remap = xmalloc((size_t)vert_count * sizeof(uint32_t))
+    };
+
+    struct Vertex_Hash_Table table = verthash_create(result.verts, vert_count, kernels);
+
+    for(uint32_t i = 0; i < vert_count; ++i) {
+        const float *vert = &verts[(size_t)i * MESH_VERT_ELEM_COUNT];
+
+        // NOTE: Copy first so the table can compare against it, it is simply overwritten if it was a duplicate
+        memcpy(&result.verts[(size_t)result.vert_count * MESH_VERT_ELEM_COUNT], vert, MESH_VERT_SIZE_BYTES);
+
+        const uint32_t found_index = verthash_find_or_insert(&table, vert, result.vert_count);
+        if(found_index == result.vert_count) {
+            ++result.vert_count;
+        }
+
+        result.remap[i] = found_index;
+    }
+
+    *out_probe_count = table.probe_count;
+    verthash_destroy(&table);
+
+    return result;
+}
+
+static struct Weld_Result weld_grid(const float *verts, uint32_t vert_count, const struct Weld_Tolerance *tolerance, uint64_t *out_probe_count)
+{
+    struct Weld_Result result = {
+        .verts = xmalloc((size_t)vert_count * MESH_VERT_SIZE_BYTES),
+        .remap = xmalloc((size_t)vert_count * sizeof(uint32_t))
+    };
+
+    struct Weld_Grid grid = weld_grid_create(vert_count, tolerance->position);
+    const int neighbour_count = grid.inv_cell_size == 0.0 ? 1 : 8;
+
+    for(uint32_t i = 0; i < vert_count; ++i) {
+        const float *vert = &verts[(size_t)i * MESH_VERT_ELEM_COUNT];
+
+        int64_t side[3];
+        const int64_t cell[3] = {
+            weld_grid_coord(&grid, vert[0], &side[0]),
+            weld_grid_coord(&grid, vert[1], &side[1]),
+            weld_grid_coord(&grid, vert[2], &side[2])
+        };
+
+        uint32_t found_index = SLOT_EMPTY;
+
+        // Bit n of the neighbour index picks the own cell or the neighbouring one on axis n
+        for(int n = 0; n < neighbour_count; ++n) {
+            const int64_t neighbour[3] = {
+                cell[0] + ((n >> 0) & 1) * side[0],
+                cell[1] + ((n >> 1) & 1) * side[1],
+                cell[2] + ((n >> 2) & 1) * side[2]
+            };
+            const struct Grid_Cell_Slot *slot = weld_grid_find(&grid, neighbour);
+
+            // Only verts below the best match so far can still be the first match
+            for(uint32_t j = slot->first; j < found_index; j = grid.next[j]) {
+                ++grid.probe_count;
+
+                if(vert_compare_tolerance(&result.verts[(size_t)j * MESH_VERT_ELEM_COUNT], vert, tolerance)) {
+                    found_index = j;
+                    break;
+                }
+            }
+        }
+
+        if(found_index == SLOT_EMPTY) {
+            found_index = result.vert_count++;
+            memcpy(&result.verts[(size_t)found_index * MESH_VERT_ELEM_COUNT], vert, MESH_VERT_SIZE_BYTES);
+            weld_grid_insert(&grid, cell, found_index);
+        }
+
+        result.remap[i] = found_index;
+    }
+
+    *out_probe_count = grid.probe_count;
+    weld_grid_destroy(&grid);
+
+    return result;
+}
+
+static struct Weld_Result weld(const float *verts, uint32_t vert_count, const struct Weld_Tolerance *tolerance, const struct Vertex_Kernels *kernels, uint64_t *out_probe_count)
+{
+    if(weld_tolerance_is_exact(tolerance)) {
+        return weld_hashtable(verts, vert_count, kernels, out_probe_count);
+    }
+
+    return weld_grid(verts, vert_count, tolerance, out_probe_count);
+}
+
+// Same algorithm as test_vertex_deduplicate.c, kept around to measure against
+static struct Weld_Result weld_brute_force(const float *verts, uint32_t vert_count, const struct Weld_Tolerance *tolerance)
+{
+    struct Weld_Result result = {
+        .verts = xmalloc((size_t)vert_count * MESH_VERT_SIZE_BYTES),
+        .remap = xmalloc((size_t)vert_count * sizeof(uint32_t))
+    };
+
+    for(uint32_t i = 0; i < vert_count; ++i) {
+        const float *vert = &verts[(size_t)i * MESH_VERT_ELEM_COUNT];
+
+        uint32_t found_index = result.vert_count;
+        for(uint32_t j = 0; j < result.vert_count; ++j) {
+            if(vert_compare_tolerance(&result.verts[(size_t)j * MESH_VERT_ELEM_COUNT], vert, tolerance)) {
+                found_index = j;
+                break;
+            }
+        }
+
+        if(found_index == result.vert_count) {
+            memcpy(&result.verts[(size_t)result.vert_count++ * MESH_VERT_ELEM_COUNT], vert, MESH_VERT_SIZE_BYTES);
+        }
+
+        result.remap[i] = found_index;
+    }
+
+    return result;
+}
+
+static void weld_result_free(struct Weld_Result *result)
+{
+    free(result->verts);
+    free(result->remap);
+    *result = (struct Weld_Result){0};
+}
+
+/* Out-of-Core Welding Notes:
+ *
+ * Soups that don't fit in memory are welded with --out-of-core, in passes that each need a bounded amount of memory
+ * (--mem-budget) and go through the input, output and temporary files sequentially:
+ *
+ * 1. Runs:    The input is read in chunks. Every vertex of a chunk gets a (hash << 32 | index in chunk) sort key, which is
+ *             radix sorted 8 bits at a time on all threads (each thread histograms its part, then scatters it).
+ *             Vertices with the same hash but different bytes are then put in order of their bytes, so the chunk is in
+ *             (hash, vertex) order, and it is written out as a sorted run of (hash, input index, vertex) records.
+ * 2. Merge:   The runs are merged with a heap, so equal vertices from every run come out next to each other.
+ *             Each group of equal vertices is one welded vertex, written straight to the output file, and the
+ *             (input index, welded index) pairs of the group go to the bucket for their input index range.
+ * 3. Indices: Every bucket is small enough to be scattered into an array, which is the next part of the index buffer.
+ *
+ * The welded vertices are the same as with the in-memory weld (which --bench checks), but they're in hash order
+ * instead of in order of first occurrence, so running knz_meshopt afterwards matters more.
+ * Vertices are compared by their bytes with -0.0f turned into 0.0f, which only differs from == for NaNs.
+ */
+#define OOC_DEFAULT_MEM_BUDGET_MB 1024
+#define OOC_RADIX_BITS 8
+#define OOC_RADIX_BUCKETS (1 << OOC_RADIX_BITS)
+#define OOC_MAX_FILES 512               // Runs or buckets, all of them are open at once
+#define OOC_READ_BUFFER_SIZE (1 << 20)  // Per run while merging, at most
+#define OOC_PAIR_BUFFER_COUNT 8192      // Per bucket while merging
+
+struct Ooc_Record {
+    uint32_t hash;
+    uint32_t index; // Into the input
+    float vert[MESH_VERT_ELEM_COUNT];
+};
+
+struct Ooc_Pair {
+    uint32_t index; // Into the input
+    uint32_t welded;
+};
+
+struct Ooc_Options {
+    const char *temp_dir;
+    uint64_t mem_budget;
+    uint32_t thread_count;
+    const struct Vertex_Kernels *kernels;
+};
+
+struct Ooc_Stats {
+    uint32_t run_count;
+    uint32_t bucket_count;
+    double t_runs;
+    double t_merge;
+    double t_indices;
+};
+
+static uint64_t ooc_file_size(FILE *fp)
+{
+#ifdef _WIN32
+    _fseeki64(fp, 0, SEEK_END);
+    const int64_t size = _ftelli64(fp);
+#else
+    fseeko(fp, 0, SEEK_END);
+    const int64_t size = ftello(fp);
+#endif
+    rewind(fp);
+
+    return size < 0 ? 0 : (uint64_t)size;
+}
+
+static void ooc_temp_path(char *out, size_t out_size, const struct Ooc_Options *options, const char *output_path, const char *kind, uint32_t n)
+{
+    if(options->temp_dir) {
+        const char *name = output_path;
+        for(const char *c = output_path; *c; ++c) {
+            if(*c == '/' || *c == '\\') {
+                name = c + 1;
+            }
+        }
+
+        snprintf(out, out_size, "%s/%s.%s%u.tmp", options->temp_dir, name, kind, n);
+    }
+    else {
+        snprintf(out, out_size, "%s.%s%u.tmp", output_path, kind, n);
+    }
+}
+
+/* Run sorting */
+struct Ooc_Sort_Job {
+    float *verts;
+    uint64_t *keys;    // (hash << 32) | index in chunk
+    uint64_t *scratch;
+    uint64_t count;
+    uint32_t shift;
+    uint64_t (*histograms)[OOC_RADIX_BUCKETS]; // [thread], turned into scatter offsets in place
+    const struct Vertex_Kernels *kernels;
+};
+
+static void ooc_hash_job(void *data, uint32_t thread_idx, uint32_t thread_count)
+{
+    struct Ooc_Sort_Job *job = data;
+
+    uint64_t begin, end;
+    parallel_range(job->count, thread_idx, thread_count, &begin, &end);
+
+    for(uint64_t i = begin; i < end; ++i) {
+        float *vert = &job->verts[i * MESH_VERT_ELEM_COUNT];
+
+        // NOTE: So that equal vertices also have equal bytes
+        for(int c = 0; c < MESH_VERT_ELEM_COUNT; ++c) {
+            vert[c] = vert[c] == 0.0f ? 0.0f : vert[c];
+        }
+
+        job->keys[i] = ((uint64_t)job->kernels->hash(vert) << 32) | i;
+    }
+}
+
+static void ooc_histogram_job(void *data, uint32_t thread_idx, uint32_t thread_count)
+{
+    struct Ooc_Sort_Job *job = data;
+
+    uint64_t begin, end;
+    parallel_range(job->count, thread_idx, thread_count, &begin, &end);
+
+    uint64_t *histogram = job->histograms[thread_idx];
+    memset(histogram, 0, OOC_RADIX_BUCKETS * sizeof(uint64_t));
+
+    for(uint64_t i = begin; i < end; ++i) {
+        ++histogram[(job->keys[i] >> job->shift) & (OOC_RADIX_BUCKETS - 1)];
+    }
+}
+
+static void ooc_scatter_job(void *data, uint32_t thread_idx, uint32_t thread_count)
+{
+    struct Ooc_Sort_Job *job = data;
+
+    uint64_t begin, end;
+    parallel_range(job->count, thread_idx, thread_count, &begin, &end);
+
+    uint64_t *offsets = job->histograms[thread_idx];
+
+    for(uint64_t i = begin; i < end; ++i) {
+        const uint64_t key = job->keys[i];
+        job->scratch[offsets[(key >> job->shift) & (OOC_RADIX_BUCKETS - 1)]++] = key;
+    }
+}
+
+// Stable LSD radix sort of the keys by their hash (the top 32 bits), the index in the chunk breaks ties
+static void ooc_sort_keys(struct Ooc_Sort_Job *job, uint32_t thread_count)
+{
+    for(uint32_t shift = 32; shift < 64; shift += OOC_RADIX_BITS) {
+        job->shift = shift;
+        parallel_run(thread_count, ooc_histogram_job, job);
+
+        // Thread t's part of bucket d goes after every earlier bucket, and after the earlier threads' parts of bucket d
+        uint64_t offset = 0;
+        for(uint32_t d = 0; d < OOC_RADIX_BUCKETS; ++d) {
+            for(uint32_t t = 0; t < thread_count; ++t) {
+                const uint64_t count = job->histograms[t][d];
+                job->histograms[t][d] = offset;
+                offset += count;
+            }
+        }
+
+        parallel_run(thread_count, ooc_scatter_job, job);
+
+        uint64_t *swap = job->keys;
+        job->keys = job->scratch;
+        job->scratch = swap;
+    }
+}
+
+// Puts vertices with the same hash in order of their bytes, keeping equal ones in input order
+static void ooc_sort_hash_collisions(const float *verts, uint64_t *keys, uint64_t count)
+{
+    uint64_t group_begin = 0;
+
+    for(uint64_t i = 1; i <= count; ++i) {
+        if(i < count && (keys[i] >> 32) == (keys[group_begin] >> 32)) {
+            continue;
+        }
+
+        // Insertion sort, groups are almost always all the same vertex and then nothing moves
+        for(uint64_t j = group_begin + 1; j < i; ++j) {
+            const uint64_t key = keys[j];
+            const float *vert = &verts[(key & UINT32_MAX) * MESH_VERT_ELEM_COUNT];
+
+            uint64_t k = j;
+            while(k > group_begin && memcmp(&verts[(keys[k - 1] & UINT32_MAX) * MESH_VERT_ELEM_COUNT], vert, MESH_VERT_SIZE_BYTES) > 0) {
+                keys[k] = keys[k - 1];
+                --k;
+            }
+            keys[k] = key;
+        }
+
+        group_begin = i;
+    }
+}
+
+static int ooc_record_compare(const struct Ooc_Record *a, const struct Ooc_Record *b)
+{
+    if(a->hash != b->hash) {
+        return a->hash < b->hash ? -1 : 1;
+    }
+
+    return memcmp(a->vert, b->vert, MESH_VERT_SIZE_BYTES);
+}
+
+/* Run merging */
+struct Ooc_Run_Reader {
+    FILE *fp;
+    struct Ooc_Record *buffer;
+    uint32_t buffer_capacity;
+    uint32_t buffer_count;
+    uint32_t buffer_pos;
+};
+
+static bool ooc_reader_next(struct Ooc_Run_Reader *reader)
+{
+    if(++reader->buffer_pos < reader->buffer_count) {
+        return true;
+    }
+
+    reader->buffer_count = (uint32_t)fread(reader->buffer, sizeof(struct Ooc_Record), reader->buffer_capacity, reader->fp);
+    reader->buffer_pos = 0;
+
+    return reader->buffer_count > 0;
+}
+
+static const struct Ooc_Record *ooc_reader_current(const struct Ooc_Run_Reader *reader)
+{
+    return &reader->buffer[reader->buffer_pos];
+}
+
+static void ooc_heap_sift_down(uint32_t *heap, uint32_t heap_count, const struct Ooc_Run_Reader *readers, uint32_t i)
+{
+    for(;;) {
+        uint32_t smallest = i;
+        const uint32_t left = i * 2 + 1;
+        const uint32_t right = i * 2 + 2;
+
+        if(left < heap_count && ooc_record_compare(ooc_reader_current(&readers[heap[left]]), ooc_reader_current(&readers[heap[smallest]])) < 0) {
+            smallest = left;
+        }
+        if(right < heap_count && ooc_record_compare(ooc_reader_current(&readers[heap[right]]), ooc_reader_current(&readers[heap[smallest]])) < 0) {
+            smallest = right;
+        }
+
+        if(smallest == i) {
+            return;
+        }
+
+        const uint32_t swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+struct Ooc_Bucket_Writer {
+    FILE *fp;
+    struct Ooc_Pair pairs[OOC_PAIR_BUFFER_COUNT];
+    uint32_t pair_count;
+};
+
+static bool ooc_bucket_push(struct Ooc_Bucket_Writer *bucket, struct Ooc_Pair pair)
+{
+    bucket->pairs[bucket->pair_count++] = pair;
+
+    if(bucket->pair_count == OOC_PAIR_BUFFER_COUNT) {
+        bucket->pair_count = 0;
+        return fwrite(bucket->pairs, sizeof(struct Ooc_Pair), OOC_PAIR_BUFFER_COUNT, bucket->fp) == OOC_PAIR_BUFFER_COUNT;
+    }
+
+    return true;
+}
+
+static bool weld_out_of_core(const char *input_path, const char *output_path, const struct Ooc_Options *options,
+                             uint32_t *out_input_count, uint32_t *out_welded_count, struct Ooc_Stats *out_stats)
+{
+    struct Ooc_Stats stats = {0};
+    char path[4096];
+    bool ok = true;
+
+    FILE *in = fopen(input_path, "rb");
+    if(!in) {
+        fprintf(stderr, "File open error: Couldn't open %s\n", input_path);
+        return false;
+    }
+
+    const uint64_t input_size = ooc_file_size(in);
+    if(input_size % (3 * MESH_VERT_SIZE_BYTES) != 0 || input_size / MESH_VERT_SIZE_BYTES >= UINT32_MAX) {
+        fprintf(stderr, "%s: size is not a whole number of float[8] triangles, or has more than 2^32 - 1 verts\n", input_path);
+        fclose(in);
+        return false;
+    }
+
+    const uint32_t input_count = (uint32_t)(input_size / MESH_VERT_SIZE_BYTES);
+
+    /* 1. Runs */
+    double t_start = time_now_sec();
+
+    // Per vertex: the vertex itself, the sort keys and their scratch. The index in the chunk has to fit in the low half of a key.
+    uint64_t chunk_capacity = options->mem_budget / (MESH_VERT_SIZE_BYTES + 2 * sizeof(uint64_t));
+    chunk_capacity = chunk_capacity < UINT32_MAX ? chunk_capacity : UINT32_MAX;
+    const uint64_t run_count = input_count ? (input_count + chunk_capacity - 1) / chunk_capacity : 0;
+    if(run_count > OOC_MAX_FILES) {
+        fprintf(stderr, "Input needs %llu runs with this --mem-budget, the most is %d\n", (unsigned long long)run_count, OOC_MAX_FILES);
+        fclose(in);
+        return false;
+    }
+
+    const uint64_t chunk_count_max = input_count < chunk_capacity ? input_count : chunk_capacity;
+    uint64_t histograms[PARALLEL_MAX_THREADS][OOC_RADIX_BUCKETS];
+
+    struct Ooc_Sort_Job job = {
+        .verts = xmalloc(chunk_count_max * MESH_VERT_SIZE_BYTES),
+        .keys = xmalloc(chunk_count_max * sizeof(uint64_t)),
+        .scratch = xmalloc(chunk_count_max * sizeof(uint64_t)),
+        .histograms = histograms,
+        .kernels = options->kernels
+    };
+
+    struct Ooc_Record *records = xmalloc(OOC_READ_BUFFER_SIZE);
+    const uint32_t records_capacity = OOC_READ_BUFFER_SIZE / sizeof(struct Ooc_Record);
+
+    for(uint32_t run = 0; ok && run < run_count; ++run) {
+        const uint64_t chunk_begin = run * chunk_capacity;
+        job.count = input_count - chunk_begin < chunk_capacity ? input_count - chunk_begin : chunk_capacity;
+
+        ok = fread(job.verts, MESH_VERT_SIZE_BYTES, job.count, in) == job.count;
+
+        parallel_run(options->thread_count, ooc_hash_job, &job);
+        ooc_sort_keys(&job, options->thread_count);
+        ooc_sort_hash_collisions(job.verts, job.keys, job.count);
+
+        ooc_temp_path(path, sizeof(path), options, output_path, "run", run);
+        FILE *fp = fopen(path, "wb");
+        ok = ok && fp;
+
+        uint32_t record_count = 0;
+        for(uint64_t i = 0; ok && i < job.count; ++i) {
+            const uint64_t local_index = job.keys[i] & UINT32_MAX;
+
+            struct Ooc_Record *record = &records[record_count++];
+            record->hash = (uint32_t)(job.keys[i] >> 32);
+            record->index = (uint32_t)(chunk_begin + local_index);
+            memcpy(record->vert, &job.verts[local_index * MESH_VERT_ELEM_COUNT], MESH_VERT_SIZE_BYTES);
+
+            if(record_count == records_capacity || i + 1 == job.count) {
+                ok = fwrite(records, sizeof(struct Ooc_Record), record_count, fp) == record_count;
+                record_count = 0;
+            }
+        }
+
+        ok = fp && fclose(fp) == 0 && ok;
+    }
+
+    fclose(in);
+    free(job.verts);
+    free(job.keys);
+    free(job.scratch);
+    free(records);
+
+    stats.run_count = (uint32_t)run_count;
+    stats.t_runs = time_now_sec() - t_start;
+
+    /* 2. Merge */
+    t_start = time_now_sec();
+
+    // Scattering a bucket needs its pairs and the indices they're scattered into
+    const uint64_t bucket_capacity = options->mem_budget / (sizeof(struct Ooc_Pair) + sizeof(uint32_t));
+    const uint64_t bucket_count = input_count ? (input_count + bucket_capacity - 1) / bucket_capacity : 0;
+    if(bucket_count > OOC_MAX_FILES) {
+        fprintf(stderr, "Input needs %llu index buckets with this --mem-budget, the most is %d\n", (unsigned long long)bucket_count, OOC_MAX_FILES);
+        ok = false;
+    }
+
+    FILE *out = fopen(output_path, "wb");
+    if(!out) {
+        fprintf(stderr, "File open error: Couldn't open %s for writing\n", output_path);
+        ok = false;
+    }
+
+    // Written again once the counts are known
+    struct Mesh_File_Header header = {
+        .magic = MESH_FILE_MAGIC,
+        .version = 1,
+        .header_size = sizeof(header),
+        .index_count = input_count
+    };
+    ok = ok && fwrite(&header, sizeof(header), 1, out) == 1;
+
+    struct Ooc_Run_Reader *readers = calloc(run_count ? run_count : 1, sizeof(struct Ooc_Run_Reader));
+    uint32_t *heap = xmalloc((run_count ? run_count : 1) * sizeof(uint32_t));
+    uint32_t heap_count = 0;
+
+    // Every run gets an equal part of half the budget to read with
+    uint64_t read_buffer_size = options->mem_budget / 2 / (run_count ? run_count : 1);
+    read_buffer_size = read_buffer_size < OOC_READ_BUFFER_SIZE ? read_buffer_size : OOC_READ_BUFFER_SIZE;
+    const uint32_t read_buffer_capacity = read_buffer_size > sizeof(struct Ooc_Record) ? (uint32_t)(read_buffer_size / sizeof(struct Ooc_Record)) : 1;
+
+    for(uint32_t run = 0; ok && run < run_count; ++run) {
+        ooc_temp_path(path, sizeof(path), options, output_path, "run", run);
+
+        struct Ooc_Run_Reader *reader = &readers[run];
+        reader->fp = fopen(path, "rb");
+        reader->buffer = xmalloc(read_buffer_capacity * sizeof(struct Ooc_Record));
+        reader->buffer_capacity = read_buffer_capacity;
+        reader->buffer_pos = UINT32_MAX;
+        ok = reader->fp != NULL;
+
+        if(ok && ooc_reader_next(reader)) {
+            heap[heap_count++] = run;
+        }
+    }
+
+    for(uint32_t i = heap_count / 2; i-- > 0;) {
+        ooc_heap_sift_down(heap, heap_count, readers, i);
+    }
+
+    struct Ooc_Bucket_Writer *buckets = calloc(bucket_count ? bucket_count : 1, sizeof(struct Ooc_Bucket_Writer));
+    for(uint32_t b = 0; ok && b < bucket_count; ++b) {
+        ooc_temp_path(path, sizeof(path), options, output_path, "bucket", b);
+        buckets[b].fp = fopen(path, "wb");
+        ok = buckets[b].fp != NULL;
+    }
+
+    uint32_t welded_count = 0;
+    uint64_t merged_count = 0;
+
+    float *vert_buffer = xmalloc(OOC_READ_BUFFER_SIZE);
+    const uint32_t vert_buffer_capacity = OOC_READ_BUFFER_SIZE / MESH_VERT_SIZE_BYTES;
+    uint32_t vert_buffer_count = 0;
+
+    while(ok && heap_count) {
+        const struct Ooc_Record group = *ooc_reader_current(&readers[heap[0]]);
+        const uint32_t welded = welded_count++;
+
+        memcpy(&vert_buffer[(size_t)vert_buffer_count++ * MESH_VERT_ELEM_COUNT], group.vert, MESH_VERT_SIZE_BYTES);
+        if(vert_buffer_count == vert_buffer_capacity) {
+            ok = fwrite(vert_buffer, MESH_VERT_SIZE_BYTES, vert_buffer_count, out) == vert_buffer_count;
+            vert_buffer_count = 0;
+        }
+
+        do {
+            struct Ooc_Run_Reader *reader = &readers[heap[0]];
+            const uint32_t index = ooc_reader_current(reader)->index;
+
+            ok = ok && ooc_bucket_push(&buckets[index / bucket_capacity], (struct Ooc_Pair){ index, welded });
+            ++merged_count;
+
+            if(!ooc_reader_next(reader)) {
+                heap[0] = heap[--heap_count];
+            }
+
+            ooc_heap_sift_down(heap, heap_count, readers, 0);
+        } while(ok && heap_count && ooc_record_compare(ooc_reader_current(&readers[heap[0]]), &group) == 0);
+    }
+
+    ok = ok && merged_count == input_count;
+    ok = ok && fwrite(vert_buffer, MESH_VERT_SIZE_BYTES, vert_buffer_count, out) == vert_buffer_count;
+    free(vert_buffer);
+
+    for(uint32_t run = 0; run < run_count; ++run) {
+        if(readers[run].fp) {
+            fclose(readers[run].fp);
+        }
+        free(readers[run].buffer);
+
+        ooc_temp_path(path, sizeof(path), options, output_path, "run", run);
+        remove(path);
+    }
+    free(readers);
+    free(heap);
+
+    for(uint32_t b = 0; b < bucket_count; ++b) {
+        if(buckets[b].fp) {
+            ok = ok && fwrite(buckets[b].pairs, sizeof(struct Ooc_Pair), buckets[b].pair_count, buckets[b].fp) == buckets[b].pair_count;
+            ok = fclose(buckets[b].fp) == 0 && ok;
+        }
+    }
+    free(buckets);
+
+    stats.t_merge = time_now_sec() - t_start;
+
+    /* 3. Indices */
+    t_start = time_now_sec();
+
+    const bool index_32 = mesh_needs_index_32(welded_count);
+    const uint64_t bucket_index_count_max = input_count < bucket_capacity ? input_count : bucket_capacity;
+
+    struct Ooc_Pair *pairs = xmalloc(bucket_index_count_max * sizeof(struct Ooc_Pair));
+    uint32_t *indices = xmalloc(bucket_index_count_max * sizeof(uint32_t));
+
+    for(uint32_t b = 0; b < bucket_count; ++b) {
+        ooc_temp_path(path, sizeof(path), options, output_path, "bucket", b);
+
+        const uint64_t bucket_begin = b * bucket_capacity;
+        const uint64_t count = input_count - bucket_begin < bucket_capacity ? input_count - bucket_begin : bucket_capacity;
+
+        FILE *fp = ok ? fopen(path, "rb") : NULL;
+        ok = fp && fread(pairs, sizeof(struct Ooc_Pair), count, fp) == count;
+        if(fp) {
+            fclose(fp);
+        }
+        remove(path);
+
+        for(uint64_t i = 0; ok && i < count; ++i) {
+            indices[pairs[i].index - bucket_begin] = pairs[i].welded;
+        }
+
+        if(ok && index_32) {
+            ok = fwrite(indices, sizeof(uint32_t), count, out) == count;
+        }
+        else if(ok) {
+            // NOTE: Narrowed in place, every u16 lands at or before the u32 it came from
+            for(uint64_t i = 0; i < count; ++i) {
+                const uint16_t index = (uint16_t)indices[i];
+                memcpy((char *)indices + i * sizeof(uint16_t), &index, sizeof(index));
+            }
+
+            ok = fwrite(indices, sizeof(uint16_t), count, out) == count;
+        }
+    }
+
+    free(pairs);
+    free(indices);
+
+    header.flags = index_32 ? MESH_FILE_FLAG_INDEX_32 : 0;
+    header.vert_count = welded_count;
+
+    if(out) {
+        ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+        ok = fclose(out) == 0 && ok;
+    }
+
+    stats.bucket_count = (uint32_t)bucket_count;
+    stats.t_indices = time_now_sec() - t_start;
+
+    if(!ok) {
+        fprintf(stderr, "%s: out-of-core weld failed\n", output_path);
+        remove(output_path);
+        return false;
+    }
+
+    *out_input_count = input_count;
+    *out_welded_count = welded_count;
+    *out_stats = stats;
+
+    return true;
+}
+
+// Welds the soup at input_path into output_path out-of-core, and with bench also welds it in memory to check against
+static int cook_out_of_core(const char *input_path, const char *output_path, const struct Ooc_Options *options, bool bench)
+{
+    uint32_t input_count, welded_count;
+    struct Ooc_Stats stats;
+
+    const double t_start = time_now_sec();
+    if(!weld_out_of_core(input_path, output_path, options, &input_count, &welded_count, &stats)) {
+        return 1;
+    }
+    const double t_total = time_now_sec() - t_start;
+
+    printf("Input:  %u verts (soup)\n", input_count);
+    printf("Output: %u verts, %u indices\n", welded_count, input_count);
+    printf("Welding: exact, out-of-core (%s kernels, %u threads, %lluMB budget, %u runs, %u index buckets)\n", options->kernels->name,
+           options->thread_count, (unsigned long long)(options->mem_budget >> 20), stats.run_count, stats.bucket_count);
+    printf("Timings:\n");
+    printf("\tRuns:    %9.3fms\n", stats.t_runs * 1000.0);
+    printf("\tMerge:   %9.3fms\n", stats.t_merge * 1000.0);
+    printf("\tIndices: %9.3fms\n", stats.t_indices * 1000.0);
+    printf("\tTotal:   %9.3fms (%.1fM verts/s)\n", t_total * 1000.0, t_total > 0.0 ? input_count / t_total * 1e-6 : 0.0);
+    printf("Peak RSS: %.1fMB\n", peak_rss_kb() / 1024.0);
+
+    if(!bench) {
+        return 0;
+    }
+
+    /* Check against the in-memory weld, which has its vertices in a different order */
+    struct Mesh_Data input, output;
+    if(!load_soup(input_path, &input) || !mesh_file_load(output_path, &output)) {
+        return 1;
+    }
+
+    const double t_memory_start = time_now_sec();
+    uint64_t probe_count;
+    struct Weld_Result welded = weld_hashtable(input.verts, input.vert_count, options->kernels, &probe_count);
+    const double t_memory = time_now_sec() - t_memory_start;
+
+    bool match = welded.vert_count == output.vert_count && input.vert_count == output.index_count;
+    for(uint32_t i = 0; match && i < input.vert_count; ++i) {
+        match = options->kernels->equal(&output.verts[(size_t)output.indices[i] * MESH_VERT_ELEM_COUNT],
+                                        &welded.verts[(size_t)welded.remap[i] * MESH_VERT_ELEM_COUNT]);
+    }
+
+    printf("Benchmark (%u input verts -> %u welded):\n", input.vert_count, welded.vert_count);
+    printf("\tIn memory:    %9.3fms (weld only)\n", t_memory * 1000.0);
+    printf("\tOut-of-core:  %9.3fms (read, weld and write)\n", t_total * 1000.0);
+    printf("\tResults %s\n", match ? "match" : "DO NOT MATCH");
+
+    weld_result_free(&welded);
+    mesh_data_free(&output);
+    mesh_data_free(&input);
+
+    return match ? 0 : 1;
+}
+
+/* Kernel benchmark */
+#define BENCH_MIN_TIME 0.25
+
+// The position-only hash from test_vertex_deduplicate_hashtable.c, only to compare collision rates against
+static uint64_t hash_pos_legacy(const float *vert)
+{
+    uint32_t a, b, c;
+    memcpy(&a, &vert[0], sizeof(a));
+    memcpy(&b, &vert[1], sizeof(b));
+    memcpy(&c, &vert[2], sizeof(c));
+
+    uint32_t lower = a | ((b >> 4) ^ c);
+    uint32_t upper = b ^ (a >> 5) ^ c;
+
+    return (uint64_t)(upper << 31) | lower;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Fraction of the (unique) vertices whose hash is the same as another one's, sorts the hashes
+static double hash_collision_rate(uint64_t *hashes, uint32_t count)
+{
+    qsort(hashes, count, sizeof(uint64_t), compare_u64);
+
+    uint32_t collision_count = 0;
+    for(uint32_t i = 1; i < count; ++i) {
+        collision_count += hashes[i] == hashes[i - 1];
+    }
+
+    return count ? (double)collision_count / (double)count : 0.0;
+}
+
+/* Measures every kernel set the CPU supports on the input verts:
+ * - hash:   vertex hashes per second
+ * - weld:   the whole weld, which must give the same result as with the scalar kernels
+ * - lookup: probes per second into a table that already has every unique vertex, so every probe is a hit,
+ *           with the groups looked at and the tags that matched but whose vertex didn't, per probe */
+static int bench_kernels(const float *verts, uint32_t vert_count)
+{
+    uint64_t probe_count;
+    struct Weld_Result reference = weld_hashtable(verts, vert_count, vertex_kernels_get(VERTEX_KERNELS_SCALAR), &probe_count);
+
+    printf("Kernel benchmark (%u verts, %u unique):\n", vert_count, reference.vert_count);
+    printf("\t%-8s %14s %10s %16s %14s %16s\n", "Kernels", "Hash Mverts/s", "Weld ms", "Lookup Mprobe/s", "Groups/probe", "False tags/probe");
+
+    bool all_match = true;
+
+    for(int level = 0; level < VERTEX_KERNELS_LEVEL_COUNT; ++level) {
+        const struct Vertex_Kernels *kernels = vertex_kernels_get((enum Vertex_Kernels_Level)level);
+        if(!kernels) {
+            printf("\t%-8s (not supported)\n", s_vertex_kernels[level].name ? s_vertex_kernels[level].name : "?");
+            continue;
+        }
+
+        /* Hash */
+        uint32_t hash_sink = 0;
+        uint64_t hash_count = 0;
+        double t_start = time_now_sec();
+        double t_hash;
+
+        do {
+            for(uint32_t i = 0; i < vert_count; ++i) {
+                const uint32_t hash = kernels->hash(&verts[(size_t)i * MESH_VERT_ELEM_COUNT]);
+                hash_sink ^= hash;
+
+                all_match = all_match && (hash_count || hash == vertex_kernels_hash_scalar(&verts[(size_t)i * MESH_VERT_ELEM_COUNT]));
+            }
+            hash_count += vert_count;
+            t_hash = time_now_sec() - t_start;
+        } while(t_hash < BENCH_MIN_TIME);
+
+        /* Weld */
+        t_start = time_now_sec();
+        struct Weld_Result welded = weld_hashtable(verts, vert_count, kernels, &probe_count);
+        const double t_weld = time_now_sec() - t_start;
+
+        all_match = all_match && welded.vert_count == reference.vert_count &&
+                    0 == memcmp(welded.remap, reference.remap, (size_t)vert_count * sizeof(uint32_t));
+        weld_result_free(&welded);
+
+        /* Lookup */
+        struct Vertex_Hash_Table table = verthash_create(reference.verts, reference.vert_count, kernels);
+        for(uint32_t i = 0; i < reference.vert_count; ++i) {
+            verthash_find_or_insert(&table, &reference.verts[(size_t)i * MESH_VERT_ELEM_COUNT], i);
+        }
+
+        table.probe_count = 0;
+        table.false_match_count = 0;
+
+        uint32_t lookup_sink = 0;
+        uint64_t lookup_count = 0;
+        t_start = time_now_sec();
+        double t_lookup;
+
+        do {
+            for(uint32_t i = 0; i < vert_count; ++i) {
+                lookup_sink += verthash_find_or_insert(&table, &verts[(size_t)i * MESH_VERT_ELEM_COUNT], SLOT_EMPTY);
+            }
+            lookup_count += vert_count;
+            t_lookup = time_now_sec() - t_start;
+        } while(t_lookup < BENCH_MIN_TIME);
+
+        printf("\t%-8s %14.1f %10.3f %16.1f %14.3f %16.5f\n", kernels->name,
+               hash_count / t_hash * 1e-6, t_weld * 1000.0, lookup_count / t_lookup * 1e-6,
+               (double)table.probe_count / lookup_count, (double)table.false_match_count / lookup_count);
+
+        // NOTE: Printed so the loops above can't be optimized out
+        if(hash_sink == 0x12345678u && lookup_sink == 0) {
+            printf("\t(unlucky checksum)\n");
+        }
+
+        verthash_destroy(&table);
+    }
+
+    /* Collisions of the full 32-bit hash (the same for every kernel set) against the old position-only hash */
+    uint64_t *hashes = xmalloc((size_t)reference.vert_count * sizeof(uint64_t));
+
+    for(uint32_t i = 0; i < reference.vert_count; ++i) {
+        hashes[i] = vertex_kernels_hash_scalar(&reference.verts[(size_t)i * MESH_VERT_ELEM_COUNT]);
+    }
+    const double full_collision_rate = hash_collision_rate(hashes, reference.vert_count);
+
+    for(uint32_t i = 0; i < reference.vert_count; ++i) {
+        hashes[i] = hash_pos_legacy(&reference.verts[(size_t)i * MESH_VERT_ELEM_COUNT]);
+    }
+    const double legacy_collision_rate = hash_collision_rate(hashes, reference.vert_count);
+
+    printf("Hash collisions between unique verts:\n");
+    printf("\tFull vertex hash: %8.4f%%\n", full_collision_rate * 100.0);
+    printf("\thash_pos (old):   %8.4f%%\n", legacy_collision_rate * 100.0);
+    printf("\tKernel results %s\n", all_match ? "match" : "DO NOT MATCH");
+
+    free(hashes);
+    weld_result_free(&reference);
+
+    return all_match ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    bool is_soup = false;
+    bool bench = false;
+    uint32_t bench_limit = UINT32_MAX;
+    float epsilon = 0.0f;
+    float weld_pos = -1.0f;
+    float weld_normal = -1.0f;
+    float weld_uv = -1.0f;
+    const char *kernels_name = NULL;
+    bool bench_kernel_sets = false;
+    bool out_of_core = false;
+    uint64_t mem_budget_mb = OOC_DEFAULT_MEM_BUDGET_MB;
+    uint32_t thread_count = cpu_count();
+    const char *temp_dir = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+        if(0 == strcmp(argv[i], "--soup")) {
+            is_soup = true;
+        }
+        else if(0 == strcmp(argv[i], "--bench")) {
+            bench = true;
+        }
+        else if(0 == strcmp(argv[i], "--bench-limit") && i + 1 < argc) {
+            bench = true;
+            bench_limit = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--epsilon") && i + 1 < argc) {
+            epsilon = strtof(argv[++i], NULL);
+        }
+        else if(0 == strcmp(argv[i], "--weld-pos") && i + 1 < argc) {
+            weld_pos = strtof(argv[++i], NULL);
+        }
+        else if(0 == strcmp(argv[i], "--weld-normal") && i + 1 < argc) {
+            weld_normal = strtof(argv[++i], NULL);
+        }
+        else if(0 == strcmp(argv[i], "--weld-uv") && i + 1 < argc) {
+            weld_uv = strtof(argv[++i], NULL);
+        }
+        else if(0 == strcmp(argv[i], "--kernels") && i + 1 < argc) {
+            kernels_name = argv[++i];
+        }
+        else if(0 == strcmp(argv[i], "--bench-kernels")) {
+            bench_kernel_sets = true;
+        }
+        else if(0 == strcmp(argv[i], "--out-of-core")) {
+            out_of_core = true;
+        }
+        else if(0 == strcmp(argv[i], "--mem-budget") && i + 1 < argc) {
+            mem_budget_mb = strtoull(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--threads") && i + 1 < argc) {
+            thread_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--temp-dir") && i + 1 < argc) {
+            temp_dir = argv[++i];
+        }
+        else if(argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n\n%s", argv[i], s_usage);
+            return 1;
+        }
+        else if(!input_path) {
+            input_path = argv[i];
+        }
+        else if(!output_path) {
+            output_path = argv[i];
+        }
+        else {
+            fprintf(stderr, "%s", s_usage);
+            return 1;
+        }
+    }
+
+    if(!input_path || (!output_path && !bench && !bench_kernel_sets)) {
+        fprintf(stderr, "%s", s_usage);
+        return 1;
+    }
+
+    const struct Weld_Tolerance tolerance = {
+        .position = weld_pos >= 0.0f ? weld_pos : epsilon,
+        .normal = weld_normal >= 0.0f ? weld_normal : epsilon,
+        .uv = weld_uv >= 0.0f ? weld_uv : epsilon
+    };
+
+    if(!(tolerance.position >= 0.0f && tolerance.normal >= 0.0f && tolerance.uv >= 0.0f)) {
+        fprintf(stderr, "Tolerances must be 0 or more\n");
+        return 1;
+    }
+
+    const bool exact = weld_tolerance_is_exact(&tolerance);
+
+    const struct Vertex_Kernels *kernels = kernels_name ? vertex_kernels_find(kernels_name) : vertex_kernels_best();
+    if(!kernels) {
+        fprintf(stderr, "Vertex kernels %s don't exist or aren't supported by this CPU\n", kernels_name);
+        return 1;
+    }
+
+    if(out_of_core) {
+        if(!is_soup || !output_path || !exact || bench_kernel_sets) {
+            fprintf(stderr, "--out-of-core needs --soup and an output, and only does exact welding\n");
+            return 1;
+        }
+
+        if(thread_count < 1 || thread_count > PARALLEL_MAX_THREADS || mem_budget_mb < 1) {
+            fprintf(stderr, "--threads must be 1 to %d, and --mem-budget at least 1\n", PARALLEL_MAX_THREADS);
+            return 1;
+        }
+
+        const struct Ooc_Options options = {
+            .temp_dir = temp_dir,
+            .mem_budget = mem_budget_mb << 20,
+            .thread_count = thread_count,
+            .kernels = kernels
+        };
+
+        return cook_out_of_core(input_path, output_path, &options, bench);
+    }
+
+    /* Load */
+    double t_start = time_now_sec();
+
+    struct Mesh_Data input;
+    if(!(is_soup ? load_soup(input_path, &input) : mesh_file_load(input_path, &input))) {
+        return 1;
+    }
+
+    const double t_load = time_now_sec() - t_start;
+
+    /* Weld */
+    t_start = time_now_sec();
+
+    uint64_t probe_count;
+    struct Weld_Result welded = weld(input.verts, input.vert_count, &tolerance, kernels, &probe_count);
+
+    // For soups the remap table is the index buffer, otherwise it is applied to the existing indices
+    struct Mesh_Data output = {
+        .verts = welded.verts,
+        .vert_count = welded.vert_count,
+    };
+
+    if(input.indices) {
+        output.index_count = input.index_count;
+        output.indices = xmalloc((size_t)input.index_count * sizeof(uint32_t));
+
+        for(uint32_t i = 0; i < input.index_count; ++i) {
+            output.indices[i] = welded.remap[input.indices[i]];
+        }
+    }
+    else {
+        output.index_count = input.vert_count;
+        output.indices = welded.remap;
+        welded.remap = NULL;
+    }
+
+    const double t_weld = time_now_sec() - t_start;
+
+    /* Write */
+    double t_write = 0.0;
+    if(output_path) {
+        t_start = time_now_sec();
+        if(!mesh_file_save(output_path, &output)) {
+            return 1;
+        }
+
+        t_write = time_now_sec() - t_start;
+    }
+
+    printf("Input:  %u verts, %u indices (%s)\n", input.vert_count, input.index_count ? input.index_count : input.vert_count, is_soup ? "soup" : "indexed");
+    printf("Output: %u verts, %u indices\n", output.vert_count, output.index_count);
+    if(exact) {
+        printf("Welding: exact (%s kernels)\n", kernels->name);
+    }
+    else {
+        printf("Welding: position %g, normal %g, uv %g\n", tolerance.position, tolerance.normal, tolerance.uv);
+    }
+    printf("Avg probes per vert: %.3f\n", input.vert_count ? (double)probe_count / (double)input.vert_count : 0.0);
+    printf("Timings:\n");
+    printf("\tLoad:  %9.3fms\n", t_load * 1000.0);
+    printf("\tWeld:  %9.3fms (%.1fM verts/s)\n", t_weld * 1000.0, t_weld > 0.0 ? input.vert_count / t_weld * 1e-6 : 0.0);
+    if(output_path) {
+        printf("\tWrite: %9.3fms\n", t_write * 1000.0);
+    }
+
+    /* Benchmark against brute force */
+    if(bench) {
+        const uint32_t bench_count = input.vert_count < bench_limit ? input.vert_count : bench_limit;
+
+        t_start = time_now_sec();
+        struct Weld_Result hashed = weld(input.verts, bench_count, &tolerance, kernels, &probe_count);
+        const double t_hash = time_now_sec() - t_start;
+
+        t_start = time_now_sec();
+        struct Weld_Result brute = weld_brute_force(input.verts, bench_count, &tolerance);
+        const double t_brute = time_now_sec() - t_start;
+
+        // Both assign indices in order of first occurrence, so the results must be identical
+        bool match = hashed.vert_count == brute.vert_count &&
+                     0 == memcmp(hashed.remap, brute.remap, (size_t)bench_count * sizeof(uint32_t)) &&
+                     0 == memcmp(hashed.verts, brute.verts, (size_t)brute.vert_count * MESH_VERT_SIZE_BYTES);
+
+        printf("Benchmark (%u input verts -> %u welded):\n", bench_count, brute.vert_count);
+        printf("\t%s  %9.3fms\n", exact ? "Hash table:" : "Hash grid: ", t_hash * 1000.0);
+        printf("\tBrute force: %9.3fms\n", t_brute * 1000.0);
+        printf("\tSpeedup:     %9.1fx\n", t_hash > 0.0 ? t_brute / t_hash : 0.0);
+        printf("\tResults %s\n", match ? "match" : "DO NOT MATCH");
+
+        weld_result_free(&hashed);
+        weld_result_free(&brute);
+
+        if(!match) {
+            return 1;
+        }
+    }
+
+    /* Benchmark the vertex kernels */
+    if(bench_kernel_sets) {
+        // Indexed inputs are unpacked first like in test_vertex_deduplicate.c, so that there are duplicates to find
+        float *unpacked = input.verts;
+        uint32_t unpacked_count = input.vert_count;
+
+        if(input.indices) {
+            unpacked_count = input.index_count;
+            unpacked = xmalloc((size_t)unpacked_count * MESH_VERT_SIZE_BYTES);
+
+            for(uint32_t i = 0; i < input.index_count; ++i) {
+                memcpy(&unpacked[(size_t)i * MESH_VERT_ELEM_COUNT], &input.verts[(size_t)input.indices[i] * MESH_VERT_ELEM_COUNT], MESH_VERT_SIZE_BYTES);
+            }
+        }
+
+        const int result = bench_kernels(unpacked, unpacked_count);
+
+        if(unpacked != input.verts) {
+            free(unpacked);
+        }
+
+        if(result != 0) {
+            return result;
+        }
+    }
+
+    weld_result_free(&welded);
+    free(output.indices);
+    mesh_data_free(&input);
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * knz_meshlets: Splits .bin meshes into meshlets with bounding spheres and normal cones (see meshlet.h).
+ *
+ * The meshlets are stored at the end of the .bin and the index buffer is reordered to match,
+ * so readers that don't know about meshlets still load the same mesh.
+ * vk_scene uses them to cull clusters on the CPU and only issue indirect draws for the visible ones.
+ *
+ * The stats include how many triangles the cones alone would cull when looking at the mesh
+ * from the 6 axis directions, as a rough idea of what cluster culling gets on top of frustum culling.
+ */
+#include "common.h"
+#include "mesh_file.h"
+#include "meshlet.h"
+
+static const char *s_usage =
+    "Usage: knz_meshlets <input.bin> [output.bin]\n"
+    "\n"
+    "Without an output only the stats are printed.\n";
+
+static bool meshlet_cone_culled(const struct Mesh_File_Meshlet *meshlet, const float *camera_position)
+{
+    const float d[3] = {
+        meshlet->cone_apex[0] - camera_position[0],
+        meshlet->cone_apex[1] - camera_position[1],
+        meshlet->cone_apex[2] - camera_position[2]
+    };
+    const float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    return d[0] * meshlet->cone_axis[0] + d[1] * meshlet->cone_axis[1] + d[2] * meshlet->cone_axis[2] >= meshlet->cone_cutoff * length;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || argc > 3 || argv[1][0] == '-') {
+        fprintf(stderr, "%s", s_usage);
+        return 1;
+    }
+
+    const char *input_path = argv[1];
+    const char *output_path = argc > 2 ? argv[2] : NULL;
+
+    struct Mesh_Data mesh;
+    if(!mesh_file_load(input_path, &mesh)) {
+        return 1;
+    }
+
+    CHECK(mesh.index_count % 3 == 0, "Index count is not a multiple of 3");
+
+    const double t_start = time_now_sec();
+    meshlets_build(&mesh);
+    const double t_build = time_now_sec() - t_start;
+
+    /* Stats */
+    uint64_t total_verts = 0;
+    uint32_t cone_count = 0;
+    for(uint32_t i = 0; i < mesh.meshlet_count; ++i) {
+        total_verts += mesh.meshlets[i].vertex_count;
+        cone_count += mesh.meshlets[i].cone_cutoff <= 1.0f;
+    }
+
+    struct Mesh_File_Quantization bounds;
+    mesh_quantization_from_verts(mesh.verts, mesh.vert_count, &bounds);
+
+    float mesh_center[3];
+    float mesh_size = 0.0f;
+    for(int c = 0; c < 3; ++c) {
+        mesh_center[c] = bounds.position_min[c] + bounds.position_extent[c] * 0.5f;
+        mesh_size = fmaxf(mesh_size, bounds.position_extent[c]);
+    }
+
+    uint64_t culled_tris = 0;
+    for(int axis = 0; axis < 3; ++axis) {
+        for(int dir = -1; dir <= 1; dir += 2) {
+            float camera_position[3] = { mesh_center[0], mesh_center[1], mesh_center[2] };
+            camera_position[axis] += (float)dir * mesh_size * 2.0f;
+
+            for(uint32_t i = 0; i < mesh.meshlet_count; ++i) {
+                culled_tris += meshlet_cone_culled(&mesh.meshlets[i], camera_position) ? mesh.meshlets[i].triangle_count : 0;
+            }
+        }
+    }
+
+    const uint32_t tri_count = mesh.index_count / 3;
+
+    printf("%u verts, %u tris -> %u meshlets (max %u verts, %u tris)\n", mesh.vert_count, tri_count, mesh.meshlet_count, MESHLET_MAX_VERTS, MESHLET_MAX_TRIS);
+    printf("Avg per meshlet: %.1f verts, %.1f tris\n",
+           mesh.meshlet_count ? (double)total_verts / mesh.meshlet_count : 0.0,
+           mesh.meshlet_count ? (double)tri_count / mesh.meshlet_count : 0.0);
+    printf("Usable cones: %u / %u\n", cone_count, mesh.meshlet_count);
+    printf("Cone culled from the 6 axis views: %.1f%% of triangles on average\n", tri_count ? (double)culled_tris / (6.0 * tri_count) * 100.0 : 0.0);
+    printf("Build: %.3fms\n", t_build * 1000.0);
+
+    if(output_path && !mesh_file_save(output_path, &mesh)) {
+        return 1;
+    }
+
+    mesh_data_free(&mesh);
+    return 0;
+}
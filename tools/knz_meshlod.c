@@ -0,0 +1,97 @@
+/*
+ * knz_meshlod: Adds a chain of simplified LODs to .bin meshes (see mesh_simplify.h).
+ *
+ * Every LOD is another range of the index buffer and they all share the one vertex buffer,
+ * so the LODs only cost index memory. Each LOD stores its simplification error,
+ * which vk_scene projects to the screen to pick the LOD to draw.
+ *
+ * Meshlets of the input are dropped, since the index buffer changes. Run knz_meshlets afterwards,
+ * which builds them per LOD.
+ */
+#include "common.h"
+#include "mesh_file.h"
+#include "mesh_simplify.h"
+
+static const char *s_usage =
+    "Usage: knz_meshlod [options] <input.bin> [output.bin]\n"
+    "\n"
+    "Without an output only the stats are printed.\n"
+    "\n"
+    "Options:\n"
+    "  --levels N        Number of LODs including the full mesh, at most 8 (default: 4)\n"
+    "  --ratio R         Triangle count of each LOD relative to the one before (default: 0.5)\n"
+    "  --max-error E     Largest error allowed, relative to the mesh size (default: 0.05)\n";
+
+int main(int argc, char **argv)
+{
+    uint32_t lod_count = MESH_LOD_DEFAULT_COUNT;
+    float ratio = MESH_LOD_DEFAULT_RATIO;
+    float max_error = MESH_LOD_DEFAULT_MAX_ERROR;
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if(0 == strcmp(argv[arg], "--levels") && arg + 1 < argc) {
+            lod_count = (uint32_t)strtoul(argv[++arg], NULL, 10);
+        }
+        else if(0 == strcmp(argv[arg], "--ratio") && arg + 1 < argc) {
+            ratio = strtof(argv[++arg], NULL);
+        }
+        else if(0 == strcmp(argv[arg], "--max-error") && arg + 1 < argc) {
+            max_error = strtof(argv[++arg], NULL);
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n\n%s", argv[arg], s_usage);
+            return 1;
+        }
+    }
+
+    const int positional_count = argc - arg;
+    if(positional_count < 1 || positional_count > 2 || lod_count < 1 || !(ratio > 0.0f && ratio < 1.0f)) {
+        fprintf(stderr, "%s", s_usage);
+        return 1;
+    }
+
+    const char *input_path = argv[arg];
+    const char *output_path = positional_count > 1 ? argv[arg + 1] : NULL;
+
+    struct Mesh_Data mesh;
+    if(!mesh_file_load(input_path, &mesh)) {
+        return 1;
+    }
+
+    CHECK(mesh.index_count % 3 == 0, "Index count is not a multiple of 3");
+
+    if(mesh.meshlets) {
+        fprintf(stderr, "Note: Dropping the input's meshlets, since the index buffer changes\n");
+    }
+
+    const double t_start = time_now_sec();
+    mesh_lods_build(&mesh, lod_count, ratio, max_error);
+    const double t_build = time_now_sec() - t_start;
+
+    if(!mesh.lods) {
+        printf("%u verts, %u tris: Couldn't simplify, everything is on a seam or border or over the error limit\n", mesh.vert_count, mesh.index_count / 3);
+    }
+    else {
+        const uint32_t base_index_count = mesh.lods[0].index_count;
+
+        printf("%u verts, %u LODs:\n", mesh.vert_count, mesh.lod_count);
+        for(uint32_t i = 0; i < mesh.lod_count; ++i) {
+            printf("\tLOD %u: %8u tris (%5.1f%%), error %.4g\n", i, mesh.lods[i].index_count / 3,
+                   (double)mesh.lods[i].index_count / base_index_count * 100.0, mesh.lods[i].error);
+        }
+
+        printf("Index buffer: %zu -> %zu bytes\n",
+               (size_t)base_index_count * (mesh_needs_index_32(mesh.vert_count) ? sizeof(uint32_t) : sizeof(uint16_t)),
+               (size_t)mesh.index_count * (mesh_needs_index_32(mesh.vert_count) ? sizeof(uint32_t) : sizeof(uint16_t)));
+    }
+
+    printf("Build: %.3fms\n", t_build * 1000.0);
+
+    if(output_path && !mesh_file_save(output_path, &mesh)) {
+        return 1;
+    }
+
+    mesh_data_free(&mesh);
+    return 0;
+}
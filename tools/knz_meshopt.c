@@ -0,0 +1,673 @@
+/*
+ * knz_meshopt: Reorders .bin meshes for the post-transform vertex cache, vertex fetch and (optionally) overdraw.
+ *
+ * The exporter emits triangles in Blender's loop order, which has poor vertex reuse on the GPU.
+ * Three passes are run, all of them only reorder, so the rendered result is identical:
+ *
+ * 1. Triangle order: Tipsify (Sander, Nehab, Barczak 2007, "Fast Triangle Reordering for Vertex Locality
+ *    and Reduced Overdraw"). Fans around the vertex that is most likely still in a FIFO cache of --cache-size.
+ * 2. Overdraw (--overdraw T): Splits the Tipsify output into clusters wherever the cache has to start over,
+ *    and again wherever a cluster's ACMR is already within T times of what it ends up at.
+ *    Clusters facing outwards from the mesh center are drawn first, since they are the most likely to occlude the rest.
+ * 3. Vertex order: Vertices are renumbered in order of first use, so vertex pulling reads memory mostly linearly.
+ *    Unreferenced vertices are dropped.
+ *
+ * All stats are simulated on the CPU, so no GPU is needed to measure the gain:
+ * ACMR:     Average cache miss ratio, vertex shader invocations per triangle (0.5 is ideal, 3.0 is worst)
+ * ATVR:     Average transformed vertex ratio, vertex shader invocations per vertex (1.0 is ideal)
+ * Fetch:    Bytes read from the vertex buffer through a small direct mapped cache, relative to the vertex buffer size
+ * Overdraw: Pixels shaded per pixel covered, rasterized from the 6 axis directions with back-face culling and early depth test
+ */
+#include "common.h"
+#include "mesh_file.h"
+#include "mesh_adjacency.h"
+
+#include <assert.h>
+#include <math.h>
+
+#define DEFAULT_CACHE_SIZE 16
+
+#define FETCH_CACHE_LINE_SIZE 64
+#define FETCH_CACHE_LINE_COUNT 256 // 16KB, roughly a vertex fetch L1
+
+#define OVERDRAW_RESOLUTION 256
+
+static const char *s_usage =
+    "Usage: knz_meshopt [options] <input.bin> [output.bin]\n"
+    "\n"
+    "Without an output the mesh is only optimized in memory to print the stats.\n"
+    "\n"
+    "Options:\n"
+    "  --cache-size N    FIFO cache size to optimize and simulate for (default: 16)\n"
+    "  --overdraw T      Also cluster for overdraw, allowing ACMR to get up to T times worse per cluster (e.g. 1.05)\n";
+
+/* Analysis */
+struct Mesh_Stats {
+    uint32_t vert_count;
+    uint32_t tri_count;
+    double acmr;
+    double atvr;
+    double fetch;
+    double overdraw;
+};
+
+// FIFO cache, a vertex is a hit if fewer than cache_size misses happened since it was loaded
+static uint32_t simulate_vertex_cache(const uint32_t *indices, uint32_t index_count, uint32_t *cache_time, uint32_t *time, uint32_t cache_size)
+{
+    uint32_t misses = 0;
+    for(uint32_t i = 0; i < index_count; ++i) {
+        const uint32_t v = indices[i];
+        if(*time - cache_time[v] > cache_size) {
+            cache_time[v] = (*time)++;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+static void analyze_vertex_cache(const struct Mesh_Data *mesh, uint32_t cache_size, struct Mesh_Stats *stats)
+{
+    uint32_t *cache_time = xmalloc((size_t)mesh->vert_count * sizeof(uint32_t));
+    memset(cache_time, 0, (size_t)mesh->vert_count * sizeof(uint32_t));
+
+    uint32_t time = cache_size + 1;
+    const uint32_t misses = simulate_vertex_cache(mesh->indices, mesh->index_count, cache_time, &time, cache_size);
+
+    // Only count vertices that are actually referenced, so ATVR is comparable after unused ones are dropped
+    uint32_t used_vert_count = 0;
+    for(uint32_t v = 0; v < mesh->vert_count; ++v) {
+        used_vert_count += cache_time[v] != 0;
+    }
+
+    stats->acmr = mesh->index_count ? (double)misses / (double)(mesh->index_count / 3) : 0.0;
+    stats->atvr = used_vert_count ? (double)misses / (double)used_vert_count : 0.0;
+
+    free(cache_time);
+}
+
+static void analyze_vertex_fetch(const struct Mesh_Data *mesh, struct Mesh_Stats *stats)
+{
+    uint64_t tags[FETCH_CACHE_LINE_COUNT];
+    memset(tags, 0xff, sizeof(tags));
+
+    uint64_t bytes_fetched = 0;
+    for(uint32_t i = 0; i < mesh->index_count; ++i) {
+        const uint64_t begin = (uint64_t)mesh->indices[i] * MESH_VERT_SIZE_BYTES;
+        const uint64_t end = begin + MESH_VERT_SIZE_BYTES;
+
+        for(uint64_t line = begin / FETCH_CACHE_LINE_SIZE; line <= (end - 1) / FETCH_CACHE_LINE_SIZE; ++line) {
+            uint64_t *tag = &tags[line % FETCH_CACHE_LINE_COUNT];
+            if(*tag != line) {
+                *tag = line;
+                bytes_fetched += FETCH_CACHE_LINE_SIZE;
+            }
+        }
+    }
+
+    stats->fetch = mesh->vert_count ? (double)bytes_fetched / (double)((uint64_t)mesh->vert_count * MESH_VERT_SIZE_BYTES) : 0.0;
+}
+
+static void rasterize_triangle(float *depth_buffer, uint32_t *shaded, const float p[3][3])
+{
+    // Edge functions with pixel centers, p is in pixels with z as depth (smaller is closer)
+    int min_x = (int)floorf(fminf(p[0][0], fminf(p[1][0], p[2][0])));
+    int max_x = (int)ceilf(fmaxf(p[0][0], fmaxf(p[1][0], p[2][0])));
+    int min_y = (int)floorf(fminf(p[0][1], fminf(p[1][1], p[2][1])));
+    int max_y = (int)ceilf(fmaxf(p[0][1], fmaxf(p[1][1], p[2][1])));
+
+    min_x = min_x < 0 ? 0 : min_x;
+    min_y = min_y < 0 ? 0 : min_y;
+    max_x = max_x > OVERDRAW_RESOLUTION - 1 ? OVERDRAW_RESOLUTION - 1 : max_x;
+    max_y = max_y > OVERDRAW_RESOLUTION - 1 ? OVERDRAW_RESOLUTION - 1 : max_y;
+
+    const float area = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+
+    for(int y = min_y; y <= max_y; ++y) {
+        for(int x = min_x; x <= max_x; ++x) {
+            const float px = (float)x + 0.5f;
+            const float py = (float)y + 0.5f;
+
+            const float w0 = (p[2][0] - p[1][0]) * (py - p[1][1]) - (p[2][1] - p[1][1]) * (px - p[1][0]);
+            const float w1 = (p[0][0] - p[2][0]) * (py - p[2][1]) - (p[0][1] - p[2][1]) * (px - p[2][0]);
+            const float w2 = (p[1][0] - p[0][0]) * (py - p[0][1]) - (p[1][1] - p[0][1]) * (px - p[0][0]);
+
+            if(w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+                continue;
+            }
+
+            const float z = (w0 * p[0][2] + w1 * p[1][2] + w2 * p[2][2]) / area;
+            float *depth = &depth_buffer[y * OVERDRAW_RESOLUTION + x];
+            if(z < *depth) {
+                *depth = z;
+                (*shaded)++;
+            }
+        }
+    }
+}
+
+static void analyze_overdraw(const struct Mesh_Data *mesh, struct Mesh_Stats *stats)
+{
+    float bounds_min[3] = { INFINITY, INFINITY, INFINITY };
+    float bounds_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for(uint32_t v = 0; v < mesh->vert_count; ++v) {
+        for(int c = 0; c < 3; ++c) {
+            bounds_min[c] = fminf(bounds_min[c], mesh->verts[v * MESH_VERT_ELEM_COUNT + c]);
+            bounds_max[c] = fmaxf(bounds_max[c], mesh->verts[v * MESH_VERT_ELEM_COUNT + c]);
+        }
+    }
+
+    const float extent = fmaxf(bounds_max[0] - bounds_min[0], fmaxf(bounds_max[1] - bounds_min[1], bounds_max[2] - bounds_min[2]));
+    const float scale = extent > 0.0f ? (float)(OVERDRAW_RESOLUTION - 1) / extent : 0.0f;
+
+    float *depth_buffer = xmalloc(OVERDRAW_RESOLUTION * OVERDRAW_RESOLUTION * sizeof(float));
+
+    uint64_t total_shaded = 0;
+    uint64_t total_covered = 0;
+
+    for(int axis = 0; axis < 3; ++axis) {
+        for(int dir = -1; dir <= 1; dir += 2) {
+            for(int i = 0; i < OVERDRAW_RESOLUTION * OVERDRAW_RESOLUTION; ++i) {
+                depth_buffer[i] = INFINITY;
+            }
+
+            // Looking down the axis from the -dir side, so smaller depth is closer
+            const int ax_u = (axis + 1) % 3;
+            const int ax_v = (axis + 2) % 3;
+
+            uint32_t shaded = 0;
+            for(uint32_t i = 0; i + 2 < mesh->index_count; i += 3) {
+                float p[3][3];
+                float facing = 0.0f;
+                for(int k = 0; k < 3; ++k) {
+                    const float *pos = &mesh->verts[mesh->indices[i + k] * MESH_VERT_ELEM_COUNT];
+                    facing += pos[3 + axis] * (float)dir;
+                    p[k][0] = (pos[ax_u] - bounds_min[ax_u]) * scale;
+                    p[k][1] = (pos[ax_v] - bounds_min[ax_v]) * scale;
+                    p[k][2] = (pos[axis] - bounds_min[axis]) * (float)dir;
+                }
+
+                const float area = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+                // NOTE: Culling uses the vertex normals rather than the winding, so it doesn't depend on the exporter's convention
+                if(area == 0.0f || facing >= 0.0f) {
+                    continue;
+                }
+
+                // The rasterizer expects counter-clockwise on screen
+                if(area < 0.0f) {
+                    for(int c = 0; c < 3; ++c) {
+                        const float tmp = p[1][c];
+                        p[1][c] = p[2][c];
+                        p[2][c] = tmp;
+                    }
+                }
+
+                rasterize_triangle(depth_buffer, &shaded, p);
+            }
+
+            for(int i = 0; i < OVERDRAW_RESOLUTION * OVERDRAW_RESOLUTION; ++i) {
+                total_covered += depth_buffer[i] != INFINITY;
+            }
+            total_shaded += shaded;
+        }
+    }
+
+    stats->overdraw = total_covered ? (double)total_shaded / (double)total_covered : 0.0;
+
+    free(depth_buffer);
+}
+
+// With LODs only LOD 0 is measured, the rest would just be drawn on top of it
+static struct Mesh_Stats analyze(const struct Mesh_Data *mesh, uint32_t cache_size)
+{
+    struct Mesh_Data lod0 = *mesh;
+    if(mesh->lods) {
+        lod0.index_count = mesh->lods[0].index_count;
+    }
+
+    struct Mesh_Stats stats = {
+        .vert_count = lod0.vert_count,
+        .tri_count = lod0.index_count / 3
+    };
+    analyze_vertex_cache(&lod0, cache_size, &stats);
+    analyze_vertex_fetch(&lod0, &stats);
+    analyze_overdraw(&lod0, &stats);
+
+    return stats;
+}
+
+/* Tipsify */
+struct Tipsify_State {
+    const uint32_t *indices;
+    struct Vertex_Adjacency adj;
+    uint32_t *live_count;  // [vert_count] triangles left to emit per vertex
+    uint32_t *cache_time;  // [vert_count]
+    uint32_t *dead_end;    // [index_count] stack of recently used vertices
+    uint32_t dead_end_top;
+    uint32_t cursor;
+    uint32_t vert_count;
+    uint32_t time;
+    uint32_t cache_size;
+};
+
+static uint32_t tipsify_skip_dead_end(struct Tipsify_State *s)
+{
+    while(s->dead_end_top > 0) {
+        const uint32_t v = s->dead_end[--s->dead_end_top];
+        if(s->live_count[v] > 0) {
+            return v;
+        }
+    }
+
+    while(s->cursor < s->vert_count) {
+        const uint32_t v = s->cursor++;
+        if(s->live_count[v] > 0) {
+            return v;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static uint32_t tipsify_next_vertex(struct Tipsify_State *s, const uint32_t *candidates, uint32_t candidate_count)
+{
+    uint32_t best = UINT32_MAX;
+    int64_t best_priority = -1;
+
+    for(uint32_t i = 0; i < candidate_count; ++i) {
+        const uint32_t v = candidates[i];
+        if(s->live_count[v] == 0) {
+            continue;
+        }
+
+        // Prefer the oldest vertex that will still be in the cache after fanning all of its triangles
+        int64_t priority = 0;
+        const uint32_t age = s->time - s->cache_time[v];
+        if(age + 2 * s->live_count[v] <= s->cache_size) {
+            priority = age;
+        }
+
+        if(priority > best_priority) {
+            best_priority = priority;
+            best = v;
+        }
+    }
+
+    return best;
+}
+
+// Writes the reordered indices, and the first triangle of every hard cluster (where the cache starts over)
+static void tipsify(const uint32_t *indices, uint32_t index_count, uint32_t vert_count, uint32_t cache_size,
+                    uint32_t *out_indices, uint32_t *out_clusters, uint32_t *out_cluster_count)
+{
+    const uint32_t tri_count = index_count / 3;
+
+    struct Tipsify_State s = {
+        .indices = indices,
+        .adj = adjacency_build(indices, index_count, vert_count),
+        .live_count = xmalloc((size_t)vert_count * sizeof(uint32_t)),
+        .cache_time = xmalloc((size_t)vert_count * sizeof(uint32_t)),
+        .dead_end = xmalloc((size_t)index_count * sizeof(uint32_t)),
+        .vert_count = vert_count,
+        .time = cache_size + 1,
+        .cache_size = cache_size
+    };
+
+    for(uint32_t v = 0; v < vert_count; ++v) {
+        s.live_count[v] = s.adj.offsets[v + 1] - s.adj.offsets[v];
+        s.cache_time[v] = 0;
+    }
+
+    bool *emitted = xmalloc((size_t)tri_count * sizeof(bool));
+    memset(emitted, 0, (size_t)tri_count * sizeof(bool));
+
+    uint32_t *candidates = xmalloc((size_t)index_count * sizeof(uint32_t));
+
+    uint32_t out_tri = 0;
+    uint32_t cluster_count = 0;
+
+    uint32_t fan = tipsify_skip_dead_end(&s);
+    bool new_cluster = true;
+
+    while(fan != UINT32_MAX) {
+        uint32_t candidate_count = 0;
+
+        for(uint32_t a = s.adj.offsets[fan]; a < s.adj.offsets[fan + 1]; ++a) {
+            const uint32_t t = s.adj.triangles[a];
+            if(emitted[t]) {
+                continue;
+            }
+
+            if(new_cluster) {
+                out_clusters[cluster_count++] = out_tri;
+                new_cluster = false;
+            }
+
+            for(int k = 0; k < 3; ++k) {
+                const uint32_t v = indices[t * 3 + k];
+                out_indices[out_tri * 3 + k] = v;
+
+                s.dead_end[s.dead_end_top++] = v;
+                candidates[candidate_count++] = v;
+                s.live_count[v]--;
+
+                if(s.time - s.cache_time[v] > cache_size) {
+                    s.cache_time[v] = s.time++;
+                }
+            }
+
+            emitted[t] = true;
+            out_tri++;
+        }
+
+        fan = tipsify_next_vertex(&s, candidates, candidate_count);
+        if(fan == UINT32_MAX) {
+            fan = tipsify_skip_dead_end(&s);
+            new_cluster = true;
+        }
+    }
+
+    assert(out_tri == tri_count);
+    *out_cluster_count = cluster_count;
+
+    free(candidates);
+    free(emitted);
+    free(s.dead_end);
+    free(s.cache_time);
+    free(s.live_count);
+    adjacency_free(&s.adj);
+}
+
+/* Overdraw */
+struct Cluster_Sort_Entry {
+    float sort_key;
+    uint32_t cluster;
+};
+
+static int cluster_sort_compare(const void *a, const void *b)
+{
+    const struct Cluster_Sort_Entry *ca = a;
+    const struct Cluster_Sort_Entry *cb = b;
+
+    // Highest key first, ties keep the Tipsify order
+    if(ca->sort_key != cb->sort_key) {
+        return ca->sort_key < cb->sort_key ? 1 : -1;
+    }
+
+    return ca->cluster < cb->cluster ? -1 : 1;
+}
+
+// Splits the hard clusters further, wherever the cluster so far already has an ACMR close to the whole cluster's
+static uint32_t split_soft_clusters(const uint32_t *indices, uint32_t tri_count, uint32_t vert_count, uint32_t cache_size, float threshold,
+                                    const uint32_t *hard_clusters, uint32_t hard_cluster_count, uint32_t *out_clusters)
+{
+    uint32_t *cache_time = xmalloc((size_t)vert_count * sizeof(uint32_t));
+    uint32_t cluster_count = 0;
+
+    for(uint32_t c = 0; c < hard_cluster_count; ++c) {
+        const uint32_t begin = hard_clusters[c];
+        const uint32_t end = c + 1 < hard_cluster_count ? hard_clusters[c + 1] : tri_count;
+
+        memset(cache_time, 0, (size_t)vert_count * sizeof(uint32_t));
+        uint32_t time = cache_size + 1;
+        const uint32_t cluster_misses = simulate_vertex_cache(&indices[begin * 3], (end - begin) * 3, cache_time, &time, cache_size);
+        const double target_acmr = (double)cluster_misses / (double)(end - begin) * threshold;
+
+        memset(cache_time, 0, (size_t)vert_count * sizeof(uint32_t));
+        time = cache_size + 1;
+
+        uint32_t start = begin;
+        uint32_t misses = 0;
+        out_clusters[cluster_count++] = begin;
+
+        for(uint32_t t = begin; t < end; ++t) {
+            misses += simulate_vertex_cache(&indices[t * 3], 3, cache_time, &time, cache_size);
+
+            if(t + 1 < end && (double)misses / (double)(t + 1 - start) <= target_acmr) {
+                out_clusters[cluster_count++] = t + 1;
+                start = t + 1;
+                misses = 0;
+
+                // The new cluster may get drawn anywhere, so it can't count on what's in the cache now
+                memset(cache_time, 0, (size_t)vert_count * sizeof(uint32_t));
+                time = cache_size + 1;
+            }
+        }
+    }
+
+    free(cache_time);
+    return cluster_count;
+}
+
+static void optimize_overdraw(const float *verts, uint32_t *indices, uint32_t index_count, uint32_t vert_count, uint32_t cache_size, float threshold,
+                              const uint32_t *hard_clusters, uint32_t hard_cluster_count, uint32_t *out_cluster_count)
+{
+    const uint32_t tri_count = index_count / 3;
+
+    uint32_t *clusters = xmalloc((size_t)tri_count * sizeof(uint32_t));
+    const uint32_t cluster_count = split_soft_clusters(indices, tri_count, vert_count, cache_size, threshold, hard_clusters, hard_cluster_count, clusters);
+
+    float mesh_center[3] = {0};
+    double mesh_area = 0.0;
+
+    struct Cluster_Sort_Entry *sort_entries = xmalloc((size_t)cluster_count * sizeof(struct Cluster_Sort_Entry));
+    float (*cluster_centers)[3] = xmalloc((size_t)cluster_count * sizeof(float[3]));
+    float (*cluster_normals)[3] = xmalloc((size_t)cluster_count * sizeof(float[3]));
+
+    // Area weighted center and normal per cluster
+    for(uint32_t c = 0; c < cluster_count; ++c) {
+        const uint32_t begin = clusters[c];
+        const uint32_t end = c + 1 < cluster_count ? clusters[c + 1] : tri_count;
+
+        float center[3] = {0};
+        float normal[3] = {0};
+        float cluster_area = 0.0f;
+
+        for(uint32_t t = begin; t < end; ++t) {
+            const float *p0 = &verts[indices[t * 3 + 0] * MESH_VERT_ELEM_COUNT];
+            const float *p1 = &verts[indices[t * 3 + 1] * MESH_VERT_ELEM_COUNT];
+            const float *p2 = &verts[indices[t * 3 + 2] * MESH_VERT_ELEM_COUNT];
+
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]
+            };
+            const float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5f;
+
+            for(int k = 0; k < 3; ++k) {
+                center[k] += (p0[k] + p1[k] + p2[k]) * (area / 3.0f);
+                normal[k] += n[k];
+            }
+            cluster_area += area;
+        }
+
+        for(int k = 0; k < 3; ++k) {
+            mesh_center[k] += center[k];
+            cluster_centers[c][k] = cluster_area > 0.0f ? center[k] / cluster_area : verts[indices[begin * 3] * MESH_VERT_ELEM_COUNT + k];
+            cluster_normals[c][k] = normal[k];
+        }
+        mesh_area += cluster_area;
+    }
+
+    for(int k = 0; k < 3; ++k) {
+        mesh_center[k] = mesh_area > 0.0 ? (float)(mesh_center[k] / mesh_area) : 0.0f;
+    }
+
+    for(uint32_t c = 0; c < cluster_count; ++c) {
+        const float *n = cluster_normals[c];
+        const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        float key = 0.0f;
+        if(length > 0.0f) {
+            for(int k = 0; k < 3; ++k) {
+                key += (cluster_centers[c][k] - mesh_center[k]) * n[k] / length;
+            }
+        }
+
+        sort_entries[c] = (struct Cluster_Sort_Entry){ .sort_key = key, .cluster = c };
+    }
+
+    qsort(sort_entries, cluster_count, sizeof(*sort_entries), cluster_sort_compare);
+
+    uint32_t *sorted = xmalloc((size_t)index_count * sizeof(uint32_t));
+    uint32_t write = 0;
+    for(uint32_t i = 0; i < cluster_count; ++i) {
+        const uint32_t c = sort_entries[i].cluster;
+        const uint32_t begin = clusters[c];
+        const uint32_t end = c + 1 < cluster_count ? clusters[c + 1] : tri_count;
+
+        memcpy(&sorted[write], &indices[begin * 3], (size_t)(end - begin) * 3 * sizeof(uint32_t));
+        write += (end - begin) * 3;
+    }
+
+    memcpy(indices, sorted, (size_t)index_count * sizeof(uint32_t));
+    *out_cluster_count = cluster_count;
+
+    free(sorted);
+    free(cluster_normals);
+    free(cluster_centers);
+    free(sort_entries);
+    free(clusters);
+}
+
+/* Vertex fetch */
+// Renumbers vertices in order of first use, dropping unreferenced ones
+static void optimize_vertex_fetch(struct Mesh_Data *mesh)
+{
+    uint32_t *remap = xmalloc((size_t)mesh->vert_count * sizeof(uint32_t));
+    memset(remap, 0xff, (size_t)mesh->vert_count * sizeof(uint32_t));
+
+    float *verts = xmalloc((size_t)mesh->vert_count * MESH_VERT_SIZE_BYTES);
+    uint32_t vert_count = 0;
+
+    for(uint32_t i = 0; i < mesh->index_count; ++i) {
+        const uint32_t v = mesh->indices[i];
+        if(remap[v] == UINT32_MAX) {
+            memcpy(&verts[(size_t)vert_count * MESH_VERT_ELEM_COUNT], &mesh->verts[(size_t)v * MESH_VERT_ELEM_COUNT], MESH_VERT_SIZE_BYTES);
+            remap[v] = vert_count++;
+        }
+
+        mesh->indices[i] = remap[v];
+    }
+
+    free(mesh->verts);
+    mesh->verts = verts;
+    mesh->vert_count = vert_count;
+
+    free(remap);
+}
+
+static void print_stats(const char *label, const struct Mesh_Stats *stats)
+{
+    printf("%-7s %8u verts %8u tris  ACMR: %.3f  ATVR: %.3f  Fetch: %.3f  Overdraw: %.3f\n",
+           label, stats->vert_count, stats->tri_count, stats->acmr, stats->atvr, stats->fetch, stats->overdraw);
+}
+
+int main(int argc, char **argv)
+{
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    uint32_t cache_size = DEFAULT_CACHE_SIZE;
+    float overdraw_threshold = 0.0f;
+
+    for(int i = 1; i < argc; ++i) {
+        if(0 == strcmp(argv[i], "--cache-size") && i + 1 < argc) {
+            cache_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--overdraw") && i + 1 < argc) {
+            overdraw_threshold = strtof(argv[++i], NULL);
+        }
+        else if(argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n\n%s", argv[i], s_usage);
+            return 1;
+        }
+        else if(!input_path) {
+            input_path = argv[i];
+        }
+        else if(!output_path) {
+            output_path = argv[i];
+        }
+        else {
+            fprintf(stderr, "%s", s_usage);
+            return 1;
+        }
+    }
+
+    if(!input_path || cache_size < 3 || (overdraw_threshold != 0.0f && overdraw_threshold < 1.0f)) {
+        fprintf(stderr, "%s", s_usage);
+        return 1;
+    }
+
+    struct Mesh_Data mesh;
+    if(!mesh_file_load(input_path, &mesh)) {
+        return 1;
+    }
+
+    CHECK(mesh.index_count % 3 == 0, "Index count is not a multiple of 3");
+
+    const struct Mesh_Stats before = analyze(&mesh, cache_size);
+
+    /* Optimize */
+    const double t_start = time_now_sec();
+
+    uint32_t *indices = xmalloc((size_t)mesh.index_count * sizeof(uint32_t));
+    uint32_t *hard_clusters = xmalloc((size_t)(mesh.index_count / 3 + 1) * sizeof(uint32_t));
+    uint32_t hard_cluster_count = 0;
+
+    // Every LOD is its own draw, so they are optimized separately and stay where they are in the index buffer
+    const uint32_t lod0_index_count = mesh.lods ? mesh.lods[0].index_count : mesh.index_count;
+    tipsify(mesh.indices, lod0_index_count, mesh.vert_count, cache_size, indices, hard_clusters, &hard_cluster_count);
+
+    if(mesh.lods) {
+        uint32_t *lod_clusters = xmalloc((size_t)(mesh.index_count / 3 + 1) * sizeof(uint32_t));
+
+        for(uint32_t i = 1; i < mesh.lod_count; ++i) {
+            uint32_t lod_cluster_count;
+            tipsify(&mesh.indices[mesh.lods[i].first_index], mesh.lods[i].index_count, mesh.vert_count, cache_size,
+                    &indices[mesh.lods[i].first_index], lod_clusters, &lod_cluster_count);
+        }
+
+        free(lod_clusters);
+    }
+
+    free(mesh.indices);
+    mesh.indices = indices;
+
+    // Meshlets point into the old triangle order, run knz_meshlets again afterwards. LODs stay valid.
+    if(mesh.meshlets) {
+        fprintf(stderr, "Note: Dropping the input's meshlets, since the triangle order changes\n");
+        free(mesh.meshlets);
+        mesh.meshlets = NULL;
+        mesh.meshlet_count = 0;
+    }
+
+    uint32_t cluster_count = hard_cluster_count;
+    if(overdraw_threshold >= 1.0f) {
+        // Only for LOD 0, the others are for far away where overdraw hardly matters
+        optimize_overdraw(mesh.verts, mesh.indices, lod0_index_count, mesh.vert_count, cache_size, overdraw_threshold,
+                          hard_clusters, hard_cluster_count, &cluster_count);
+    }
+
+    optimize_vertex_fetch(&mesh);
+
+    const double t_optimize = time_now_sec() - t_start;
+
+    const struct Mesh_Stats after = analyze(&mesh, cache_size);
+
+    print_stats("Before:", &before);
+    print_stats("After:", &after);
+    printf("Clusters: %u (%u hard)\n", cluster_count, hard_cluster_count);
+    printf("Optimize: %.3fms (cache size %u)\n", t_optimize * 1000.0, cache_size);
+
+    if(output_path && !mesh_file_save(output_path, &mesh)) {
+        return 1;
+    }
+
+    free(hard_clusters);
+    mesh_data_free(&mesh);
+
+    return 0;
+}
@@ -0,0 +1,496 @@
+/*
+ * knz_meshpack: Packs many .bin meshes into a single file that can be memory mapped at startup.
+ * See mesh_pack.h for the format.
+ *
+ * There is also a benchmark that simulates vk_scene's startup for both the per-file path
+ * (file_load_binary into a heap buffer, then a copy into staging) and the pack path
+ * (mmap, then a copy straight from the mapping into staging), without needing a GPU.
+ * Compressed meshes are decoded straight into staging instead of copied, like vk_scene does.
+ * Peak RSS is per-process, so run each mode as its own invocation:
+ *
+ *   knz_meshpack --repeat 1000 test.pack suzanne.bin
+ *   knz_meshpack --bench-files --repeat 1000 suzanne.bin
+ *   knz_meshpack --bench-pack test.pack
+ */
+#include "common.h"
+#include "mesh_file.h"
+#include "mesh_pack.h"
+#include "meshlet.h"
+#include "mesh_simplify.h"
+#include "mesh_codec.h"
+
+// NOTE: Same as GPU_STAGING_POOL_SIZE in vk_scene
+#define STAGING_SIZE (16 * 1024 * 1024)
+
+static const char *s_usage =
+    "Usage:\n"
+    "  knz_meshpack [--repeat N] [--lods] [--meshlets] [--compress] <output.pack> <input.bin>...\n"
+    "  knz_meshpack --list <input.pack>\n"
+    "  knz_meshpack --bench-files [--repeat N] <input.bin>...\n"
+    "  knz_meshpack --bench-pack <input.pack>\n"
+    "\n"
+    "--repeat N adds every input N times, to make large test packs out of the sample meshes.\n"
+    "--lods builds LODs for the inputs that don't have them yet, with knz_meshlod's defaults.\n"
+    "--meshlets builds meshlets for the inputs that don't have them yet (see knz_meshlets).\n"
+    "--compress compresses the vertex and index buffers (see knz_meshcompress).\n";
+
+static uint64_t align_offset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static void mesh_name_from_path(char *out, const char *path)
+{
+    const char *base = path;
+    for(const char *p = path; *p; ++p) {
+        if(*p == '/' || *p == '\\') {
+            base = p + 1;
+        }
+    }
+
+    size_t len = strcspn(base, ".");
+    if(len > MESH_PACK_NAME_SIZE - 1) {
+        len = MESH_PACK_NAME_SIZE - 1;
+    }
+
+    memset(out, 0, MESH_PACK_NAME_SIZE);
+    memcpy(out, base, len);
+}
+
+static bool write_padding(FILE *fp, uint64_t *offset, uint64_t target)
+{
+    static const char zeroes[MESH_PACK_ALIGNMENT];
+
+    const size_t count = (size_t)(target - *offset);
+    *offset = target;
+
+    return fwrite(zeroes, 1, count, fp) == count;
+}
+
+struct Mesh_Streams {
+    uint8_t *vertex_stream;
+    uint8_t *index_stream;
+    uint32_t vertex_stream_size;
+    uint32_t index_stream_size;
+};
+
+static int build_pack(const char *output_path, char **input_paths, int input_count, uint32_t repeat, bool build_lods, bool build_meshlets, bool compress)
+{
+    struct Mesh_Data *meshes = xmalloc(input_count * sizeof(*meshes));
+
+    uint16_t **indices_16 = xmalloc(input_count * sizeof(*indices_16));
+    struct Mesh_Streams *streams = xmalloc(input_count * sizeof(*streams));
+
+    for(int i = 0; i < input_count; ++i) {
+        if(!mesh_file_load(input_paths[i], &meshes[i])) {
+            return 1;
+        }
+
+        // LODs first, since they replace the index buffer that the meshlets are built from
+        if(build_lods && !meshes[i].lods) {
+            mesh_lods_build(&meshes[i], MESH_LOD_DEFAULT_COUNT, MESH_LOD_DEFAULT_RATIO, MESH_LOD_DEFAULT_MAX_ERROR);
+        }
+
+        if(build_meshlets && !meshes[i].meshlets) {
+            meshlets_build(&meshes[i]);
+        }
+
+        // Narrow once up front, since every input may be written many times with --repeat
+        indices_16[i] = xmalloc((size_t)meshes[i].index_count * sizeof(uint16_t));
+        for(uint32_t j = 0; j < meshes[i].index_count; ++j) {
+            indices_16[i][j] = (uint16_t)meshes[i].indices[j];
+        }
+
+        // Same for compression, which is much slower than writing
+        streams[i] = (struct Mesh_Streams){0};
+        if(compress) {
+            const struct Mesh_Data *mesh = &meshes[i];
+
+            streams[i].vertex_stream = xmalloc(mesh_codec_vertex_bound(mesh->vert_count, MESH_VERT_SIZE_BYTES));
+            streams[i].vertex_stream_size = (uint32_t)mesh_codec_encode_vertices(streams[i].vertex_stream, mesh->verts, mesh->vert_count, MESH_VERT_SIZE_BYTES);
+
+            streams[i].index_stream = xmalloc(mesh_codec_index_bound(mesh->index_count));
+            streams[i].index_stream_size = (uint32_t)mesh_codec_encode_indices(streams[i].index_stream, mesh->indices, mesh->index_count);
+        }
+    }
+
+    /* Lay out the file */
+    const uint32_t mesh_count = (uint32_t)input_count * repeat;
+
+    struct Mesh_Pack_Header header = {
+        .magic = MESH_PACK_MAGIC,
+        .version = MESH_PACK_VERSION,
+        .mesh_count = mesh_count,
+        .toc_offset = sizeof(header)
+    };
+
+    struct Mesh_Pack_Entry *toc = xmalloc((size_t)mesh_count * sizeof(*toc));
+    uint64_t offset = sizeof(header) + (uint64_t)mesh_count * sizeof(*toc);
+
+    for(uint32_t i = 0; i < mesh_count; ++i) {
+        const struct Mesh_Data *mesh = &meshes[i % input_count];
+        struct Mesh_Pack_Entry *entry = &toc[i];
+
+        *entry = (struct Mesh_Pack_Entry) {
+            .flags = (mesh_needs_index_32(mesh->vert_count) ? MESH_FILE_FLAG_INDEX_32 : 0) |
+                     (mesh->meshlets ? MESH_FILE_FLAG_MESHLETS : 0) |
+                     (mesh->lods ? MESH_FILE_FLAG_LODS : 0) |
+                     (compress ? MESH_FILE_FLAG_COMPRESSED : 0),
+            .vert_count = mesh->vert_count,
+            .index_count = mesh->index_count,
+            .vertex_stride = MESH_VERT_SIZE_BYTES,
+            .meshlet_count = mesh->meshlet_count,
+            .lod_count = mesh->lod_count,
+            .vertex_stream_size = streams[i % input_count].vertex_stream_size,
+            .index_stream_size = streams[i % input_count].index_stream_size
+        };
+
+        mesh_name_from_path(entry->name, input_paths[i % input_count]);
+
+        entry->vertex_offset = align_offset(offset, MESH_PACK_ALIGNMENT);
+        offset = entry->vertex_offset + mesh_pack_entry_vertex_payload_size(entry);
+
+        entry->index_offset = align_offset(offset, MESH_PACK_ALIGNMENT);
+        offset = entry->index_offset + mesh_pack_entry_index_payload_size(entry);
+
+        if(mesh->meshlets) {
+            entry->meshlet_offset = align_offset(offset, MESH_PACK_ALIGNMENT);
+            offset = entry->meshlet_offset + mesh_pack_entry_meshlet_size(entry);
+        }
+
+        if(mesh->lods) {
+            entry->lod_offset = align_offset(offset, MESH_PACK_ALIGNMENT);
+            offset = entry->lod_offset + mesh_pack_entry_lod_size(entry);
+        }
+    }
+
+    /* Write */
+    FILE *fp = fopen(output_path, "wb");
+    if(!fp) {
+        fprintf(stderr, "File open error: Couldn't open %s for writing\n", output_path);
+        return 1;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(toc, sizeof(*toc), mesh_count, fp) == mesh_count;
+
+    offset = sizeof(header) + (uint64_t)mesh_count * sizeof(*toc);
+
+    for(uint32_t i = 0; ok && i < mesh_count; ++i) {
+        const struct Mesh_Data *mesh = &meshes[i % input_count];
+        const struct Mesh_Streams *mesh_streams = &streams[i % input_count];
+        const struct Mesh_Pack_Entry *entry = &toc[i];
+
+        ok = write_padding(fp, &offset, entry->vertex_offset);
+
+        if(compress) {
+            ok = ok && fwrite(mesh_streams->vertex_stream, 1, mesh_streams->vertex_stream_size, fp) == mesh_streams->vertex_stream_size;
+        }
+        else {
+            ok = ok && fwrite(mesh->verts, MESH_VERT_SIZE_BYTES, mesh->vert_count, fp) == mesh->vert_count;
+        }
+
+        offset += mesh_pack_entry_vertex_payload_size(entry);
+
+        ok = ok && write_padding(fp, &offset, entry->index_offset);
+
+        if(compress) {
+            ok = ok && fwrite(mesh_streams->index_stream, 1, mesh_streams->index_stream_size, fp) == mesh_streams->index_stream_size;
+        }
+        else if(entry->flags & MESH_FILE_FLAG_INDEX_32) {
+            ok = ok && fwrite(mesh->indices, sizeof(uint32_t), mesh->index_count, fp) == mesh->index_count;
+        }
+        else {
+            ok = ok && fwrite(indices_16[i % input_count], sizeof(uint16_t), mesh->index_count, fp) == mesh->index_count;
+        }
+
+        offset += mesh_pack_entry_index_payload_size(entry);
+
+        if(mesh->meshlets) {
+            ok = ok && write_padding(fp, &offset, entry->meshlet_offset) &&
+                 fwrite(mesh->meshlets, sizeof(struct Mesh_File_Meshlet), mesh->meshlet_count, fp) == mesh->meshlet_count;
+            offset += mesh_pack_entry_meshlet_size(entry);
+        }
+
+        if(mesh->lods) {
+            ok = ok && write_padding(fp, &offset, entry->lod_offset) &&
+                 fwrite(mesh->lods, sizeof(struct Mesh_File_Lod), mesh->lod_count, fp) == mesh->lod_count;
+            offset += mesh_pack_entry_lod_size(entry);
+        }
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok) {
+        fprintf(stderr, "%s: write failed\n", output_path);
+        return 1;
+    }
+
+    printf("Packed %u meshes into %s (%.1fMB)\n", mesh_count, output_path, (double)offset / (1024.0 * 1024.0));
+
+    for(int i = 0; i < input_count; ++i) {
+        mesh_data_free(&meshes[i]);
+        free(indices_16[i]);
+        free(streams[i].vertex_stream);
+        free(streams[i].index_stream);
+    }
+
+    free(streams);
+    free(indices_16);
+    free(meshes);
+    free(toc);
+
+    return 0;
+}
+
+static int list_pack(const char *path)
+{
+    struct File_Mapping fm;
+    if(!file_map_readonly(path, &fm)) {
+        fprintf(stderr, "File open error: Couldn't map %s\n", path);
+        return 1;
+    }
+
+    uint32_t mesh_count;
+    const struct Mesh_Pack_Entry *toc = mesh_pack_validate(fm.data, fm.size, &mesh_count);
+    if(!toc) {
+        fprintf(stderr, "%s: not a valid mesh pack\n", path);
+        return 1;
+    }
+
+    for(uint32_t i = 0; i < mesh_count; ++i) {
+        printf("[%u] %-24s verts: %8u indices: %9u (%s%s) meshlets: %5u LODs: %u @ %llu / %llu / %llu\n",
+               i, toc[i].name, toc[i].vert_count, toc[i].index_count,
+               (toc[i].flags & MESH_FILE_FLAG_INDEX_32) ? "u32" : "u16", (toc[i].flags & MESH_FILE_FLAG_COMPRESSED) ? ", compressed" : "",
+               toc[i].meshlet_count, toc[i].lod_count,
+               (unsigned long long)toc[i].vertex_offset, (unsigned long long)toc[i].index_offset, (unsigned long long)toc[i].meshlet_offset);
+    }
+
+    file_unmap(&fm);
+    return 0;
+}
+
+/* Benchmark */
+struct Staging_Sim {
+    char *mem;
+    size_t top;
+    uint32_t flush_count;
+    uint64_t bytes_copied;
+};
+
+// Mirrors vk_map_buffer_staged, minus the GPU copy on flush
+static void *staging_sim_map(struct Staging_Sim *staging, size_t size)
+{
+    CHECK(size <= STAGING_SIZE, "Upload is larger than the whole staging buffer");
+
+    if(size > STAGING_SIZE - staging->top) {
+        staging->top = 0;
+        ++staging->flush_count;
+    }
+
+    void *mem = staging->mem + staging->top;
+    staging->top = align_offset(staging->top + size, 128);
+    staging->bytes_copied += size;
+
+    return mem;
+}
+
+// Mirrors vk_update_buffer
+static void staging_sim_copy(struct Staging_Sim *staging, const void *data, size_t size)
+{
+    memcpy(staging_sim_map(staging, size), data, size);
+}
+
+// Mirrors how vk_scene decodes compressed meshes, the streams are decoded straight into staging
+static void staging_sim_decode(struct Staging_Sim *staging, const void *vertex_stream, size_t vertex_stream_size, uint32_t vert_count, size_t vert_stride,
+                               const void *index_stream, size_t index_stream_size, uint32_t index_count, size_t index_size)
+{
+    CHECK(mesh_codec_decode_vertices(staging_sim_map(staging, (size_t)vert_count * vert_stride), vert_count, vert_stride, vertex_stream, vertex_stream_size),
+          "Corrupt vertex stream");
+    CHECK(mesh_codec_decode_indices(staging_sim_map(staging, (size_t)index_count * index_size), index_count, index_size, index_stream, index_stream_size),
+          "Corrupt index stream");
+}
+
+static void print_bench_results(const char *name, double t, uint32_t mesh_count, const struct Staging_Sim *staging)
+{
+    printf("%s: %u meshes\n", name, mesh_count);
+    printf("\tTime:          %9.3fms\n", t * 1000.0);
+    printf("\tStaged:        %9.1fMB (%.2fGB/s)\n", staging->bytes_copied / (1024.0 * 1024.0), t > 0.0 ? staging->bytes_copied / t * 1e-9 : 0.0);
+    printf("\tStaging flushes: %u\n", staging->flush_count);
+    printf("\tPeak RSS:      %9.1fMB\n", peak_rss_kb() / 1024.0);
+}
+
+static int bench_files(char **input_paths, int input_count, uint32_t repeat)
+{
+    struct Staging_Sim staging = { .mem = xmalloc(STAGING_SIZE) };
+    memset(staging.mem, 0, STAGING_SIZE);
+
+    const double t_start = time_now_sec();
+
+    for(uint32_t r = 0; r < repeat; ++r) {
+        for(int i = 0; i < input_count; ++i) {
+            /* Same as file_load_binary */
+            FILE *fp = fopen(input_paths[i], "rb");
+            CHECK(fp, "Couldn't open input file");
+
+            fseek(fp, 0, SEEK_END);
+            const size_t size = ftell(fp);
+            rewind(fp);
+
+            char *buf = xmalloc(size);
+            CHECK(fread(buf, 1, size, fp) == size, "Read failed");
+            fclose(fp);
+
+            /* Same as upload_mesh_from_raw_data */
+            struct Mesh_File_Header header = {0};
+            const char *p = buf;
+            if(*(uint32_t *)p == MESH_FILE_MAGIC) {
+                memcpy(&header, p, sizeof(header));
+                p += header.header_size;
+            }
+            else {
+                header.vert_count = ((uint32_t *)p)[0];
+                header.index_count = ((uint32_t *)p)[1];
+                p += 2 * sizeof(uint32_t);
+            }
+
+            const size_t vert_stride = (header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) ? MESH_QUANT_VERT_SIZE_BYTES : MESH_VERT_SIZE_BYTES;
+            const size_t index_stride = (header.flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t);
+
+            if(header.flags & MESH_FILE_FLAG_COMPRESSED) {
+                uint32_t vertex_stream_size, index_stream_size;
+                memcpy(&vertex_stream_size, p, sizeof(uint32_t));
+                const char *vertex_stream = p + sizeof(uint32_t);
+                memcpy(&index_stream_size, vertex_stream + vertex_stream_size, sizeof(uint32_t));
+                const char *index_stream = vertex_stream + vertex_stream_size + sizeof(uint32_t);
+
+                staging_sim_decode(&staging, vertex_stream, vertex_stream_size, header.vert_count, vert_stride,
+                                   index_stream, index_stream_size, header.index_count, index_stride);
+            }
+            else {
+                const size_t vert_size = (size_t)header.vert_count * vert_stride;
+                const size_t index_size = (size_t)header.index_count * index_stride;
+
+                staging_sim_copy(&staging, p, vert_size);
+                staging_sim_copy(&staging, p + vert_size, index_size);
+            }
+
+            free(buf);
+        }
+    }
+
+    print_bench_results("Per-file path", time_now_sec() - t_start, (uint32_t)input_count * repeat, &staging);
+
+    free(staging.mem);
+    return 0;
+}
+
+static int bench_pack(const char *path)
+{
+    struct Staging_Sim staging = { .mem = xmalloc(STAGING_SIZE) };
+    memset(staging.mem, 0, STAGING_SIZE);
+
+    const double t_start = time_now_sec();
+
+    struct File_Mapping fm;
+    if(!file_map_readonly(path, &fm)) {
+        fprintf(stderr, "File open error: Couldn't map %s\n", path);
+        return 1;
+    }
+
+    uint32_t mesh_count;
+    const struct Mesh_Pack_Entry *toc = mesh_pack_validate(fm.data, fm.size, &mesh_count);
+    CHECK(toc, "Not a valid mesh pack");
+
+    for(uint32_t i = 0; i < mesh_count; ++i) {
+        if(toc[i].flags & MESH_FILE_FLAG_COMPRESSED) {
+            staging_sim_decode(&staging, fm.data + toc[i].vertex_offset, toc[i].vertex_stream_size, toc[i].vert_count, toc[i].vertex_stride,
+                               fm.data + toc[i].index_offset, toc[i].index_stream_size, toc[i].index_count,
+                               (toc[i].flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t));
+        }
+        else {
+            staging_sim_copy(&staging, fm.data + toc[i].vertex_offset, mesh_pack_entry_vertex_size(&toc[i]));
+            staging_sim_copy(&staging, fm.data + toc[i].index_offset, mesh_pack_entry_index_size(&toc[i]));
+        }
+
+        // NOTE: Without this every touched page of the pack stays resident until unmapping
+        file_mapping_release_range(&fm, toc[i].vertex_offset, toc[i].index_offset + mesh_pack_entry_index_payload_size(&toc[i]) - toc[i].vertex_offset);
+    }
+
+    file_unmap(&fm);
+
+    print_bench_results("Pack path", time_now_sec() - t_start, mesh_count, &staging);
+
+    free(staging.mem);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    enum { MODE_BUILD, MODE_LIST, MODE_BENCH_FILES, MODE_BENCH_PACK } mode = MODE_BUILD;
+    uint32_t repeat = 1;
+    bool build_lods = false;
+    bool build_meshlets = false;
+    bool compress = false;
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if(0 == strcmp(argv[arg], "--list")) {
+            mode = MODE_LIST;
+        }
+        else if(0 == strcmp(argv[arg], "--bench-files")) {
+            mode = MODE_BENCH_FILES;
+        }
+        else if(0 == strcmp(argv[arg], "--bench-pack")) {
+            mode = MODE_BENCH_PACK;
+        }
+        else if(0 == strcmp(argv[arg], "--lods")) {
+            build_lods = true;
+        }
+        else if(0 == strcmp(argv[arg], "--meshlets")) {
+            build_meshlets = true;
+        }
+        else if(0 == strcmp(argv[arg], "--compress")) {
+            compress = true;
+        }
+        else if(0 == strcmp(argv[arg], "--repeat") && arg + 1 < argc) {
+            repeat = (uint32_t)strtoul(argv[++arg], NULL, 10);
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n\n%s", argv[arg], s_usage);
+            return 1;
+        }
+    }
+
+    const int positional_count = argc - arg;
+    char **positional = &argv[arg];
+
+    if(repeat == 0) {
+        repeat = 1;
+    }
+
+    switch(mode) {
+    case MODE_BUILD:
+        if(positional_count >= 2) {
+            return build_pack(positional[0], &positional[1], positional_count - 1, repeat, build_lods, build_meshlets, compress);
+        }
+        break;
+    case MODE_LIST:
+        if(positional_count == 1) {
+            return list_pack(positional[0]);
+        }
+        break;
+    case MODE_BENCH_FILES:
+        if(positional_count >= 1) {
+            return bench_files(positional, positional_count, repeat);
+        }
+        break;
+    case MODE_BENCH_PACK:
+        if(positional_count == 1) {
+            return bench_pack(positional[0]);
+        }
+        break;
+    }
+
+    fprintf(stderr, "%s", s_usage);
+    return 1;
+}
@@ -0,0 +1,80 @@
+/*
+ * knz_meshquant: Converts .bin meshes to the quantized 16 byte vertex format (see mesh_file.h).
+ *
+ * Positions become unorm16 relative to the mesh bounds, normals are octahedral encoded snorm16
+ * and UVs are half floats, which halves the vertex buffer compared to 8 floats.
+ * The file is decoded again the same way vk_scene's vertex shader does, and the worst error is reported.
+ * Quantized inputs are accepted too, in which case they are decoded and quantized again.
+ */
+#include "common.h"
+#include "mesh_file.h"
+
+static const char *s_usage =
+    "Usage: knz_meshquant <input.bin> [output.bin]\n"
+    "\n"
+    "Without an output only the quantization error is reported.\n";
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || argc > 3 || argv[1][0] == '-') {
+        fprintf(stderr, "%s", s_usage);
+        return 1;
+    }
+
+    const char *input_path = argv[1];
+    const char *output_path = argc > 2 ? argv[2] : NULL;
+
+    struct Mesh_Data mesh;
+    if(!mesh_file_load(input_path, &mesh)) {
+        return 1;
+    }
+
+    struct Mesh_File_Quantization quant;
+    mesh_quantization_from_verts(mesh.verts, mesh.vert_count, &quant);
+
+    /* Measure the error */
+    double max_position_error = 0.0;
+    double max_normal_error_deg = 0.0;
+    double max_uv_error = 0.0;
+
+    for(uint32_t i = 0; i < mesh.vert_count; ++i) {
+        const float *vert = &mesh.verts[(size_t)i * MESH_VERT_ELEM_COUNT];
+
+        const struct Mesh_Quant_Vert quant_vert = mesh_vert_quantize(vert, &quant);
+        float decoded[MESH_VERT_ELEM_COUNT];
+        mesh_vert_dequantize(&quant_vert, &quant, decoded);
+
+        for(int c = 0; c < 3; ++c) {
+            max_position_error = fmax(max_position_error, fabs((double)decoded[c] - (double)vert[c]));
+        }
+
+        const double normal_length = sqrt((double)vert[3] * vert[3] + (double)vert[4] * vert[4] + (double)vert[5] * vert[5]);
+        if(normal_length > 0.0) {
+            double cos_angle = (vert[3] * decoded[3] + vert[4] * decoded[4] + vert[5] * decoded[5]) / normal_length;
+            cos_angle = cos_angle > 1.0 ? 1.0 : (cos_angle < -1.0 ? -1.0 : cos_angle);
+            max_normal_error_deg = fmax(max_normal_error_deg, acos(cos_angle) * (180.0 / 3.14159265358979323846));
+        }
+
+        for(int c = 6; c < 8; ++c) {
+            max_uv_error = fmax(max_uv_error, fabs((double)decoded[c] - (double)vert[c]));
+        }
+    }
+
+    const double max_extent = fmax(quant.position_extent[0], fmax(quant.position_extent[1], quant.position_extent[2]));
+
+    printf("%u verts, bounds min (%.4f %.4f %.4f) extent (%.4f %.4f %.4f)\n", mesh.vert_count,
+           quant.position_min[0], quant.position_min[1], quant.position_min[2],
+           quant.position_extent[0], quant.position_extent[1], quant.position_extent[2]);
+    printf("Vertex buffer: %zu -> %zu bytes\n", (size_t)mesh.vert_count * MESH_VERT_SIZE_BYTES, (size_t)mesh.vert_count * MESH_QUANT_VERT_SIZE_BYTES);
+    printf("Max error:\n");
+    printf("\tPosition: %.3g (%.3g%% of the largest extent)\n", max_position_error, max_extent > 0.0 ? max_position_error / max_extent * 100.0 : 0.0);
+    printf("\tNormal:   %.4f degrees\n", max_normal_error_deg);
+    printf("\tUV:       %.3g\n", max_uv_error);
+
+    if(output_path && !mesh_file_save_ex(output_path, &mesh, true, false)) {
+        return 1;
+    }
+
+    mesh_data_free(&mesh);
+    return 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * knz_texcook: Turns images into .ktex textures with a full mip chain in a GPU block compressed format.
+ * See texture_file.h for the format and bc_codec.h for the encoders.
+ *
+ * RGBA8 takes 4 bytes per texel, BC1 takes 0.5 and BC3/BC5/BC7 take 1, so the VRAM vk_scene needs for a texture
+ * goes down 4-8x, and so does the bandwidth when sampling it. The encoding is spread over all cores.
+ *
+ * Mips are generated with the same box filter as vk_scene's texture_generate_mips (in linear space for sRGB textures).
+ *
+ * --psnr decodes every level on the CPU again and prints the PSNR against the uncompressed level,
+ * which is how the encoders are checked. With --min-psnr it fails if level 0 comes out worse than that:
+ *
+ *   knz_texcook --format bc7 --psnr --min-psnr 40 grid.png grid.ktex
+ */
+#include "common.h"
+#include "texture_file.h"
+#include "bc_codec.h"
+
+#include <math.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+static const char *s_usage =
+    "Usage: knz_texcook [options] <input image> <output.ktex>\n"
+    "\n"
+    "Options:\n"
+    "  --format NAME     rgba8, bc1, bc3, bc5 or bc7 (default: bc7)\n"
+    "  --linear          The image isn't sRGB (always the case for bc5), e.g. normal maps\n"
+    "  --no-mips         Only write level 0\n"
+    "  --threads N       Threads to encode with (default: all cores)\n"
+    "  --psnr            Decode the output again and print the PSNR of every level\n"
+    "  --min-psnr DB     With --psnr, fail if level 0 is below DB\n";
+
+static const char *s_format_names[TEXTURE_FILE_FORMAT_COUNT] = {
+    [TEXTURE_FILE_FORMAT_RGBA8] = "rgba8",
+    [TEXTURE_FILE_FORMAT_BC1] = "bc1",
+    [TEXTURE_FILE_FORMAT_BC3] = "bc3",
+    [TEXTURE_FILE_FORMAT_BC5] = "bc5",
+    [TEXTURE_FILE_FORMAT_BC7] = "bc7",
+};
+
+/* Mips */
+static float s_srgb_to_linear[256];
+
+static float linear_to_srgb(float l)
+{
+    return l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+}
+
+// Returns every level as RGBA8, level 0 is the image itself
+static void generate_mips(uint8_t **levels, uint32_t width, uint32_t height, uint32_t mip_count, bool srgb)
+{
+    for(int i = 0; i < 256; ++i) {
+        const float c = i / 255.0f;
+        s_srgb_to_linear[i] = srgb ? (c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f)) : c;
+    }
+
+    // Kept in linear float between levels, so only the output gets quantized
+    float *src = xmalloc((size_t)width * height * 4 * sizeof(float));
+    float *dst = xmalloc((size_t)texture_level_dim(width, 1) * texture_level_dim(height, 1) * 4 * sizeof(float));
+
+    for(size_t i = 0; i < (size_t)width * height; ++i) {
+        for(int c = 0; c < 4; ++c) {
+            src[i * 4 + c] = c < 3 ? s_srgb_to_linear[levels[0][i * 4 + c]] : levels[0][i * 4 + c] / 255.0f;
+        }
+    }
+
+    for(uint32_t level = 1; level < mip_count; ++level) {
+        const uint32_t src_width = texture_level_dim(width, level - 1);
+        const uint32_t src_height = texture_level_dim(height, level - 1);
+        const uint32_t dst_width = texture_level_dim(width, level);
+        const uint32_t dst_height = texture_level_dim(height, level);
+
+        // NOTE: Needs to match texture_generate_mips in vk_scene (odd sizes drop the last row/column)
+        for(uint32_t y = 0; y < dst_height; ++y) {
+            const float *row0 = src + (size_t)(y * 2) * src_width * 4;
+            const float *row1 = src + (size_t)(y * 2 + 1 < src_height ? y * 2 + 1 : src_height - 1) * src_width * 4;
+
+            for(uint32_t x = 0; x < dst_width; ++x) {
+                const uint32_t x0 = x * 2 * 4;
+                const uint32_t x1 = (x * 2 + 1 < src_width ? x * 2 + 1 : src_width - 1) * 4;
+
+                for(int c = 0; c < 4; ++c) {
+                    dst[((size_t)y * dst_width + x) * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+                }
+            }
+        }
+
+        const size_t texel_count = (size_t)dst_width * dst_height;
+        levels[level] = xmalloc(texel_count * 4);
+
+        for(size_t i = 0; i < texel_count; ++i) {
+            for(int c = 0; c < 4; ++c) {
+                float v = dst[i * 4 + c];
+                v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+                if(srgb && c < 3) {
+                    v = linear_to_srgb(v);
+                }
+                levels[level][i * 4 + c] = (uint8_t)(v * 255.0f + 0.5f);
+            }
+        }
+
+        float *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    free(src);
+    free(dst);
+}
+
+/* Encoding */
+struct Level_Job {
+    uint32_t format;
+    const uint8_t *pixels;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *out;
+};
+
+// Edge blocks repeat the last row/column, which keeps the padding from pulling the endpoints around
+static void gather_block(uint8_t px[BC_BLOCK_PIXELS][4], const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t block_x, uint32_t block_y)
+{
+    for(uint32_t y = 0; y < 4; ++y) {
+        const uint32_t sy = block_y * 4 + y < height ? block_y * 4 + y : height - 1;
+        for(uint32_t x = 0; x < 4; ++x) {
+            const uint32_t sx = block_x * 4 + x < width ? block_x * 4 + x : width - 1;
+            memcpy(px[y * 4 + x], pixels + ((size_t)sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+static void encode_level_job(void *data, uint32_t thread_idx, uint32_t thread_count)
+{
+    const struct Level_Job *job = data;
+    const uint32_t blocks_x = (job->width + 3) / 4;
+    const uint32_t blocks_y = (job->height + 3) / 4;
+    const uint32_t block_size = texture_format_unit_size(job->format);
+
+    uint64_t begin, end;
+    parallel_range(blocks_y, thread_idx, thread_count, &begin, &end);
+
+    for(uint64_t by = begin; by < end; ++by) {
+        for(uint32_t bx = 0; bx < blocks_x; ++bx) {
+            uint8_t px[BC_BLOCK_PIXELS][4];
+            gather_block(px, job->pixels, job->width, job->height, bx, (uint32_t)by);
+            bc_encode_block(job->format, job->out + (by * blocks_x + bx) * block_size, px);
+        }
+    }
+}
+
+static void encode_level(uint32_t format, const uint8_t *pixels, uint32_t width, uint32_t height, uint8_t *out, uint32_t thread_count)
+{
+    if(!texture_format_is_block_compressed(format)) {
+        memcpy(out, pixels, (size_t)width * height * 4);
+        return;
+    }
+
+    struct Level_Job job = {
+        .format = format,
+        .pixels = pixels,
+        .width = width,
+        .height = height,
+        .out = out
+    };
+
+    // Small levels aren't worth the threads
+    const uint32_t blocks_y = (height + 3) / 4;
+    parallel_run(blocks_y < thread_count ? blocks_y : thread_count, encode_level_job, &job);
+}
+
+/* PSNR */
+// Squared error summed over the channels the format keeps, for the whole level
+static double level_squared_error(uint32_t format, const uint8_t *pixels, uint32_t width, uint32_t height, const uint8_t *encoded, uint32_t *out_channel_count)
+{
+    // BC1 alpha is only 1 bit and BC5 only has two channels, so leave out what they can't store
+    const uint32_t channel_count = format == TEXTURE_FILE_FORMAT_BC5 ? 2 : (format == TEXTURE_FILE_FORMAT_BC1 ? 3 : 4);
+    *out_channel_count = channel_count;
+
+    if(!texture_format_is_block_compressed(format)) {
+        return 0.0;
+    }
+
+    const uint32_t blocks_x = (width + 3) / 4;
+    const uint32_t blocks_y = (height + 3) / 4;
+    const uint32_t block_size = texture_format_unit_size(format);
+
+    double total = 0.0;
+    for(uint32_t by = 0; by < blocks_y; ++by) {
+        for(uint32_t bx = 0; bx < blocks_x; ++bx) {
+            uint8_t decoded[BC_BLOCK_PIXELS][4];
+            bc_decode_block(format, decoded, encoded + ((size_t)by * blocks_x + bx) * block_size);
+
+            for(uint32_t y = 0; y < 4 && by * 4 + y < height; ++y) {
+                for(uint32_t x = 0; x < 4 && bx * 4 + x < width; ++x) {
+                    const uint8_t *src = pixels + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4;
+                    for(uint32_t c = 0; c < channel_count; ++c) {
+                        const double d = (double)src[c] - (double)decoded[y * 4 + x][c];
+                        total += d * d;
+                    }
+                }
+            }
+        }
+    }
+
+    return total;
+}
+
+static double psnr_from_mse(double mse)
+{
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+int main(int argc, char **argv)
+{
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    uint32_t format = TEXTURE_FILE_FORMAT_BC7;
+    bool linear = false;
+    bool mips = true;
+    uint32_t thread_count = cpu_count();
+    bool psnr = false;
+    double min_psnr = -1.0;
+
+    for(int i = 1; i < argc; ++i) {
+        if(0 == strcmp(argv[i], "--format") && i + 1 < argc) {
+            const char *name = argv[++i];
+            format = TEXTURE_FILE_FORMAT_COUNT;
+            for(uint32_t f = 0; f < TEXTURE_FILE_FORMAT_COUNT; ++f) {
+                if(0 == strcmp(name, s_format_names[f])) {
+                    format = f;
+                }
+            }
+
+            if(format == TEXTURE_FILE_FORMAT_COUNT) {
+                fprintf(stderr, "Unknown format %s\n\n%s", name, s_usage);
+                return 1;
+            }
+        }
+        else if(0 == strcmp(argv[i], "--linear")) {
+            linear = true;
+        }
+        else if(0 == strcmp(argv[i], "--no-mips")) {
+            mips = false;
+        }
+        else if(0 == strcmp(argv[i], "--threads") && i + 1 < argc) {
+            thread_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--psnr")) {
+            psnr = true;
+        }
+        else if(0 == strcmp(argv[i], "--min-psnr") && i + 1 < argc) {
+            min_psnr = strtod(argv[++i], NULL);
+        }
+        else if(argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n\n%s", argv[i], s_usage);
+            return 1;
+        }
+        else if(!input_path) {
+            input_path = argv[i];
+        }
+        else if(!output_path) {
+            output_path = argv[i];
+        }
+        else {
+            fprintf(stderr, "%s", s_usage);
+            return 1;
+        }
+    }
+
+    if(!input_path || !output_path) {
+        fprintf(stderr, "%s", s_usage);
+        return 1;
+    }
+
+    if(thread_count < 1 || thread_count > PARALLEL_MAX_THREADS) {
+        fprintf(stderr, "--threads must be 1 to %d\n", PARALLEL_MAX_THREADS);
+        return 1;
+    }
+
+    // BC5 is for data (normals), there is no sRGB variant of it
+    const bool srgb = !linear && format != TEXTURE_FILE_FORMAT_BC5;
+
+    /* Load */
+    int x, y, n;
+    uint8_t *pixels = stbi_load(input_path, &x, &y, &n, 4);
+    if(!pixels) {
+        fprintf(stderr, "%s: couldn't load image (%s)\n", input_path, stbi_failure_reason());
+        return 1;
+    }
+
+    const uint32_t width = (uint32_t)x;
+    const uint32_t height = (uint32_t)y;
+    const uint32_t mip_count = mips ? texture_full_mip_count(width, height) : 1;
+
+    uint8_t *levels[TEXTURE_FILE_MAX_MIPS] = { pixels };
+
+    const double t_mips = time_now_sec();
+    generate_mips(levels, width, height, mip_count, srgb);
+
+    /* Lay out the file */
+    struct Texture_File_Header header = {
+        .magic = TEXTURE_FILE_MAGIC,
+        .version = TEXTURE_FILE_VERSION,
+        .format = format,
+        .flags = srgb ? TEXTURE_FILE_FLAG_SRGB : 0,
+        .width = width,
+        .height = height,
+        .mip_count = mip_count
+    };
+
+    struct Texture_File_Level level_table[TEXTURE_FILE_MAX_MIPS];
+    uint64_t offset = sizeof(header) + (uint64_t)mip_count * sizeof(struct Texture_File_Level);
+
+    offset = (offset + TEXTURE_FILE_ALIGNMENT - 1) & ~(uint64_t)(TEXTURE_FILE_ALIGNMENT - 1);
+
+    for(uint32_t i = 0; i < mip_count; ++i) {
+        level_table[i].offset = offset;
+        level_table[i].size = texture_level_size(format, width, height, i);
+        offset += level_table[i].size;
+    }
+
+    const uint64_t file_size = offset;
+    uint8_t *file_data = calloc(1, file_size);
+    CHECK(file_data, "Out of memory");
+
+    memcpy(file_data, &header, sizeof(header));
+    memcpy(file_data + sizeof(header), level_table, (size_t)mip_count * sizeof(struct Texture_File_Level));
+
+    /* Encode */
+    const double t_encode = time_now_sec();
+    uint64_t texel_count = 0;
+    for(uint32_t i = 0; i < mip_count; ++i) {
+        encode_level(format, levels[i], texture_level_dim(width, i), texture_level_dim(height, i), file_data + level_table[i].offset, thread_count);
+        texel_count += (uint64_t)texture_level_dim(width, i) * texture_level_dim(height, i);
+    }
+    const double t_end = time_now_sec();
+
+    /* Write */
+    FILE *fp = fopen(output_path, "wb");
+    if(!fp) {
+        fprintf(stderr, "File open error: Couldn't open %s for writing\n", output_path);
+        return 1;
+    }
+
+    bool ok = fwrite(file_data, 1, file_size, fp) == file_size;
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok) {
+        fprintf(stderr, "%s: write failed\n", output_path);
+        return 1;
+    }
+
+    // What the same chain costs as RGBA8, which is what vk_scene uploads for plain images
+    const uint64_t rgba8_size = texel_count * 4;
+    uint64_t payload_size = 0;
+    for(uint32_t i = 0; i < mip_count; ++i) {
+        payload_size += level_table[i].size;
+    }
+
+    printf("%s: %ux%u, %u mips, %s%s -> %s\n", input_path, width, height, mip_count, s_format_names[format], srgb ? " (sRGB)" : "", output_path);
+    printf("  %.2fMB vs %.2fMB as RGBA8 (%.1fx smaller)\n", (double)payload_size / (1024.0 * 1024.0), (double)rgba8_size / (1024.0 * 1024.0), (double)rgba8_size / (double)payload_size);
+    printf("  Mips: %.1fms, encode: %.1fms on %u threads (%.1f Mtexels/s)\n", (t_encode - t_mips) * 1000.0, (t_end - t_encode) * 1000.0,
+           thread_count, (double)texel_count / (t_end - t_encode) / 1e6);
+
+    /* Round trip */
+    int result = 0;
+    if(psnr && texture_format_is_block_compressed(format)) {
+        double total_err = 0.0;
+        uint64_t total_samples = 0;
+
+        for(uint32_t i = 0; i < mip_count; ++i) {
+            const uint32_t level_width = texture_level_dim(width, i);
+            const uint32_t level_height = texture_level_dim(height, i);
+
+            uint32_t channel_count;
+            const double err = level_squared_error(format, levels[i], level_width, level_height, file_data + level_table[i].offset, &channel_count);
+            const uint64_t samples = (uint64_t)level_width * level_height * channel_count;
+            const double level_psnr = psnr_from_mse(err / (double)samples);
+
+            printf("  Level %2u %5ux%-5u PSNR %.2fdB\n", i, level_width, level_height, level_psnr);
+
+            total_err += err;
+            total_samples += samples;
+
+            if(i == 0 && level_psnr < min_psnr) {
+                fprintf(stderr, "Level 0 PSNR %.2fdB is below --min-psnr %.2fdB\n", level_psnr, min_psnr);
+                result = 1;
+            }
+        }
+
+        printf("  All levels PSNR %.2fdB\n", psnr_from_mse(total_err / (double)total_samples));
+    }
+
+    for(uint32_t i = 0; i < mip_count; ++i) {
+        if(i == 0) {
+            stbi_image_free(levels[i]);
+        }
+        else {
+            free(levels[i]);
+        }
+    }
+    free(file_data);
+
+    return result;
+}
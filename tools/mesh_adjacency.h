@@ -0,0 +1,49 @@
+/*
+ * Vertex to triangle adjacency, for the tools that walk a mesh by shared vertices.
+ */
+#ifndef KNZ_MESH_ADJACENCY_H
+#define KNZ_MESH_ADJACENCY_H
+
+#include "common.h"
+
+struct Vertex_Adjacency {
+    uint32_t *offsets;   // [vert_count + 1], triangles of vertex v are triangles[offsets[v]..offsets[v + 1]]
+    uint32_t *triangles; // [index_count]
+};
+
+static inline struct Vertex_Adjacency adjacency_build(const uint32_t *indices, uint32_t index_count, uint32_t vert_count)
+{
+    struct Vertex_Adjacency adj = {
+        .offsets = xmalloc(((size_t)vert_count + 1) * sizeof(uint32_t)),
+        .triangles = xmalloc((size_t)index_count * sizeof(uint32_t))
+    };
+
+    memset(adj.offsets, 0, ((size_t)vert_count + 1) * sizeof(uint32_t));
+    for(uint32_t i = 0; i < index_count; ++i) {
+        adj.offsets[indices[i] + 1]++;
+    }
+
+    for(uint32_t v = 0; v < vert_count; ++v) {
+        adj.offsets[v + 1] += adj.offsets[v];
+    }
+
+    // Fill using offsets[v] as the write cursor, then shift everything back by one vertex
+    for(uint32_t i = 0; i < index_count; ++i) {
+        adj.triangles[adj.offsets[indices[i]]++] = i / 3;
+    }
+
+    for(uint32_t v = vert_count; v > 0; --v) {
+        adj.offsets[v] = adj.offsets[v - 1];
+    }
+    adj.offsets[0] = 0;
+
+    return adj;
+}
+
+static inline void adjacency_free(struct Vertex_Adjacency *adj)
+{
+    free(adj->offsets);
+    free(adj->triangles);
+}
+
+#endif
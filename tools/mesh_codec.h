@@ -0,0 +1,670 @@
+/*
+ * Lossless compression for vertex and index buffers, meant to be decoded at load time straight into staging memory.
+ *
+ * --- Vertex Stream ---
+ * Vertices are treated as stride / 4 columns of u32 words, so it works for any vertex format.
+ * Every word is stored as the zigzag encoded difference to the same word of the previous vertex,
+ * then split into byte planes (byte 0 of every vertex, then byte 1, ...), since the high bytes of the deltas are mostly 0.
+ *
+ * The vertices are split into blocks of MESH_CODEC_BLOCK_VERTS, and every byte plane of a block is stored as
+ * groups of 16 bytes, each group packed to 0, 2, 4 or 8 bits per byte:
+ * BLOCK:  PLANE[stride]
+ * PLANE:  u8 HEADER[ceil(GROUP_COUNT / 4)] (2 bits per group, group i in bits (i % 4) * 2), then the packed groups
+ * GROUP:  0 bits: nothing, 2 bits: 4 bytes, 4 bits: 8 bytes, 8 bits: 16 bytes.
+ *         Byte i of a group is in bits (i % (8 / BITS)) * BITS of packed byte i / (8 / BITS)
+ * The last block is padded to a multiple of 16 vertices with zero deltas.
+ *
+ * --- Index Stream ---
+ * Triangles are coded against a FIFO of recent edges and a FIFO of recent vertices, with a "next" vertex
+ * that is expected to be the next one that hasn't been used yet (true for most vertices after knz_meshopt):
+ * Edge hit: u8 (EDGE << 4) | REF, the triangle is EDGE's two vertices followed by REF
+ * Miss:     u8 0xF0 | REF_A, u8 REF_B | (REF_C << 4)
+ * REF:      0: next, 1 - 14: VERTEX_FIFO[REF - 1], 15: explicit, a zigzag LEB128 delta to the previous explicit vertex follows
+ * Triangles can come out rotated (same winding), which doesn't change what's drawn.
+ *
+ * Only the vertex decoder is vectorized (SSE2), since the index decoder is a serial dependency chain by nature.
+ */
+#ifndef KNZ_MESH_CODEC_H
+#define KNZ_MESH_CODEC_H
+
+// NOTE: Doesn't use common.h, so that vk_scene can include it for the decoders
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define MESH_CODEC_SSE2 1
+#else
+    #define MESH_CODEC_SSE2 0
+#endif
+
+#define MESH_CODEC_BLOCK_VERTS 256
+#define MESH_CODEC_GROUP_SIZE 16
+#define MESH_CODEC_MAX_STRIDE 64
+
+#define MESH_CODEC_EDGE_FIFO_SIZE 16
+#define MESH_CODEC_VERTEX_FIFO_SIZE 16
+
+#define MESH_CODEC_REF_NEXT 0
+#define MESH_CODEC_REF_EXPLICIT 15
+#define MESH_CODEC_MISS 15
+
+static inline uint32_t mesh_codec_zigzag(uint32_t delta)
+{
+    return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static inline uint32_t mesh_codec_unzigzag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+/* Vertex encoding */
+// Vertex strides need to be a multiple of 16, which covers both vk_scene vertex formats
+static inline bool mesh_codec_vertex_stride_supported(size_t stride)
+{
+    return stride > 0 && stride <= MESH_CODEC_MAX_STRIDE && stride % 16 == 0;
+}
+
+static inline size_t mesh_codec_vertex_bound(uint32_t vert_count, size_t stride)
+{
+    const size_t padded_count = ((size_t)vert_count + MESH_CODEC_GROUP_SIZE - 1) & ~(size_t)(MESH_CODEC_GROUP_SIZE - 1);
+    const size_t block_count = ((size_t)vert_count + MESH_CODEC_BLOCK_VERTS - 1) / MESH_CODEC_BLOCK_VERTS;
+    const size_t header_size = (MESH_CODEC_BLOCK_VERTS / MESH_CODEC_GROUP_SIZE + 3) / 4;
+
+    return padded_count * stride + block_count * stride * header_size;
+}
+
+static inline size_t mesh_codec_encode_plane(uint8_t *out, const uint8_t *plane, uint32_t padded_count)
+{
+    const uint32_t group_count = padded_count / MESH_CODEC_GROUP_SIZE;
+
+    uint8_t *header = out;
+    uint8_t *p = out + (group_count + 3) / 4;
+    memset(header, 0, (group_count + 3) / 4);
+
+    for(uint32_t g = 0; g < group_count; ++g) {
+        const uint8_t *group = &plane[g * MESH_CODEC_GROUP_SIZE];
+
+        uint8_t max_value = 0;
+        for(int i = 0; i < MESH_CODEC_GROUP_SIZE; ++i) {
+            max_value |= group[i];
+        }
+
+        const uint32_t mode = max_value == 0 ? 0 : (max_value < 4 ? 1 : (max_value < 16 ? 2 : 3));
+        header[g / 4] |= (uint8_t)(mode << ((g % 4) * 2));
+
+        if(mode == 3) {
+            memcpy(p, group, MESH_CODEC_GROUP_SIZE);
+            p += MESH_CODEC_GROUP_SIZE;
+        }
+        else if(mode > 0) {
+            const uint32_t bits = 1u << mode; // 2 or 4
+            const uint32_t per_byte = 8 / bits;
+
+            for(uint32_t i = 0; i < MESH_CODEC_GROUP_SIZE / per_byte; ++i) {
+                uint8_t packed = 0;
+                for(uint32_t k = 0; k < per_byte; ++k) {
+                    packed |= (uint8_t)(group[i * per_byte + k] << (k * bits));
+                }
+                *p++ = packed;
+            }
+        }
+    }
+
+    return (size_t)(p - out);
+}
+
+// out needs room for mesh_codec_vertex_bound bytes, returns the encoded size
+static inline size_t mesh_codec_encode_vertices(uint8_t *out, const void *vertices, uint32_t vert_count, size_t stride)
+{
+    if(!mesh_codec_vertex_stride_supported(stride)) {
+        fprintf(stderr, "Unsupported vertex stride for compression\n");
+        exit(1);
+    }
+
+    const uint8_t *src = vertices;
+    const size_t word_count = stride / 4;
+
+    uint32_t prev[MESH_CODEC_MAX_STRIDE / 4] = {0};
+    uint8_t planes[MESH_CODEC_MAX_STRIDE][MESH_CODEC_BLOCK_VERTS];
+
+    uint8_t *p = out;
+
+    for(uint32_t base = 0; base < vert_count; base += MESH_CODEC_BLOCK_VERTS) {
+        const uint32_t count = vert_count - base < MESH_CODEC_BLOCK_VERTS ? vert_count - base : MESH_CODEC_BLOCK_VERTS;
+        const uint32_t padded_count = (count + MESH_CODEC_GROUP_SIZE - 1) & ~(uint32_t)(MESH_CODEC_GROUP_SIZE - 1);
+
+        for(uint32_t v = 0; v < padded_count; ++v) {
+            for(size_t w = 0; w < word_count; ++w) {
+                uint32_t value = 0;
+                if(v < count) {
+                    uint32_t word;
+                    memcpy(&word, &src[(size_t)(base + v) * stride + w * 4], sizeof(word));
+
+                    value = mesh_codec_zigzag(word - prev[w]);
+                    prev[w] = word;
+                }
+
+                for(int k = 0; k < 4; ++k) {
+                    planes[w * 4 + k][v] = (uint8_t)(value >> (k * 8));
+                }
+            }
+        }
+
+        for(size_t b = 0; b < stride; ++b) {
+            p += mesh_codec_encode_plane(p, planes[b], padded_count);
+        }
+    }
+
+    return (size_t)(p - out);
+}
+
+/* Vertex decoding */
+// Returns the number of bytes read, or 0 if the input ends too early
+static inline size_t mesh_codec_decode_plane_scalar(uint8_t *plane, uint32_t padded_count, const uint8_t *in, size_t in_size)
+{
+    const uint32_t group_count = padded_count / MESH_CODEC_GROUP_SIZE;
+    const uint32_t header_size = (group_count + 3) / 4;
+    if(in_size < header_size) {
+        return 0;
+    }
+
+    const uint8_t *header = in;
+    const uint8_t *p = in + header_size;
+    const uint8_t *end = in + in_size;
+
+    for(uint32_t g = 0; g < group_count; ++g) {
+        uint8_t *group = &plane[g * MESH_CODEC_GROUP_SIZE];
+        const uint32_t mode = (header[g / 4] >> ((g % 4) * 2)) & 3;
+
+        if(mode == 0) {
+            memset(group, 0, MESH_CODEC_GROUP_SIZE);
+            continue;
+        }
+
+        const uint32_t bits = mode == 3 ? 8 : 1u << mode;
+        const uint32_t per_byte = 8 / bits;
+        const uint32_t packed_size = MESH_CODEC_GROUP_SIZE / per_byte;
+        if((size_t)(end - p) < packed_size) {
+            return 0;
+        }
+
+        const uint8_t mask = (uint8_t)((1u << bits) - 1);
+        for(uint32_t i = 0; i < MESH_CODEC_GROUP_SIZE; ++i) {
+            group[i] = (p[i / per_byte] >> ((i % per_byte) * bits)) & mask;
+        }
+
+        p += packed_size;
+    }
+
+    return (size_t)(p - in);
+}
+
+static inline bool mesh_codec_decode_vertices_scalar(void *out, uint32_t vert_count, size_t stride, const uint8_t *in, size_t in_size)
+{
+    if(!mesh_codec_vertex_stride_supported(stride)) {
+        return false;
+    }
+
+    uint8_t *dst = out;
+    const size_t word_count = stride / 4;
+
+    uint32_t prev[MESH_CODEC_MAX_STRIDE / 4] = {0};
+    uint8_t planes[MESH_CODEC_MAX_STRIDE][MESH_CODEC_BLOCK_VERTS];
+
+    const uint8_t *p = in;
+    const uint8_t *end = in + in_size;
+
+    for(uint32_t base = 0; base < vert_count; base += MESH_CODEC_BLOCK_VERTS) {
+        const uint32_t count = vert_count - base < MESH_CODEC_BLOCK_VERTS ? vert_count - base : MESH_CODEC_BLOCK_VERTS;
+        const uint32_t padded_count = (count + MESH_CODEC_GROUP_SIZE - 1) & ~(uint32_t)(MESH_CODEC_GROUP_SIZE - 1);
+
+        for(size_t b = 0; b < stride; ++b) {
+            const size_t read = mesh_codec_decode_plane_scalar(planes[b], padded_count, p, (size_t)(end - p));
+            if(read == 0) {
+                return false;
+            }
+            p += read;
+        }
+
+        for(uint32_t v = 0; v < count; ++v) {
+            for(size_t w = 0; w < word_count; ++w) {
+                const uint32_t value = (uint32_t)planes[w * 4 + 0][v] |
+                                       ((uint32_t)planes[w * 4 + 1][v] << 8) |
+                                       ((uint32_t)planes[w * 4 + 2][v] << 16) |
+                                       ((uint32_t)planes[w * 4 + 3][v] << 24);
+
+                prev[w] += mesh_codec_unzigzag(value);
+                memcpy(&dst[(size_t)(base + v) * stride + w * 4], &prev[w], sizeof(uint32_t));
+            }
+        }
+    }
+
+    return p == end;
+}
+
+#if MESH_CODEC_SSE2
+static inline size_t mesh_codec_decode_plane_sse2(uint8_t *plane, uint32_t padded_count, const uint8_t *in, size_t in_size)
+{
+    const uint32_t group_count = padded_count / MESH_CODEC_GROUP_SIZE;
+    const uint32_t header_size = (group_count + 3) / 4;
+    if(in_size < header_size) {
+        return 0;
+    }
+
+    // Worst case every group is 16 bytes, only then does every group need its own bounds check
+    const bool check_bounds = in_size < header_size + (size_t)group_count * MESH_CODEC_GROUP_SIZE;
+
+    const uint8_t *header = in;
+    const uint8_t *p = in + header_size;
+    const uint8_t *end = in + in_size;
+
+    const __m128i mask_2 = _mm_set1_epi8(3);
+    const __m128i mask_4 = _mm_set1_epi8(15);
+
+    for(uint32_t g = 0; g < group_count; ++g) {
+        const uint32_t mode = (header[g / 4] >> ((g % 4) * 2)) & 3;
+        __m128i result;
+
+        if(check_bounds && (size_t)(end - p) < (mode == 0 ? 0u : (4u << (mode - 1)))) {
+            return 0;
+        }
+
+        switch(mode) {
+        case 0:
+            result = _mm_setzero_si128();
+            break;
+        case 1: {
+            uint32_t packed_bits;
+            memcpy(&packed_bits, p, sizeof(packed_bits));
+            const __m128i packed = _mm_cvtsi32_si128((int)packed_bits);
+
+            // Separate the 4 crumbs of every byte, then interleave them back in order
+            const __m128i a = _mm_and_si128(packed, mask_2);
+            const __m128i b = _mm_and_si128(_mm_srli_epi16(packed, 2), mask_2);
+            const __m128i c = _mm_and_si128(_mm_srli_epi16(packed, 4), mask_2);
+            const __m128i d = _mm_and_si128(_mm_srli_epi16(packed, 6), mask_2);
+            result = _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, b), _mm_unpacklo_epi8(c, d));
+            p += 4;
+        } break;
+        case 2: {
+            const __m128i packed = _mm_loadl_epi64((const __m128i *)p);
+
+            const __m128i lo = _mm_and_si128(packed, mask_4);
+            const __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), mask_4);
+            result = _mm_unpacklo_epi8(lo, hi);
+            p += 8;
+        } break;
+        default:
+            result = _mm_loadu_si128((const __m128i *)p);
+            p += 16;
+            break;
+        }
+
+        _mm_storeu_si128((__m128i *)&plane[g * MESH_CODEC_GROUP_SIZE], result);
+    }
+
+    return (size_t)(p - in);
+}
+
+static inline __m128i mesh_codec_unzigzag_sse2(__m128i value)
+{
+    const __m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(value, _mm_set1_epi32(1)));
+    return _mm_xor_si128(_mm_srli_epi32(value, 1), sign);
+}
+
+// Running sum of 4 deltas, on top of the last value of the previous 4
+static inline __m128i mesh_codec_prefix_sum_sse2(__m128i value, __m128i carry)
+{
+    value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+    value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+    return _mm_add_epi32(value, carry);
+}
+
+/* Rebuilds 16 vertices at a time, 4 words (16 bytes of every vertex) at a time:
+ * 4 byte planes interleave back into 4 registers of 4 vertices per word, which are prefix summed along the vertices
+ * and then transposed so every register is 16 bytes of one vertex that can be stored as-is. */
+static inline bool mesh_codec_decode_vertices_sse2(void *out, uint32_t vert_count, size_t stride, const uint8_t *in, size_t in_size)
+{
+    if(!mesh_codec_vertex_stride_supported(stride)) {
+        return false;
+    }
+
+    uint8_t *dst = out;
+    const size_t word_group_count = stride / 16;
+
+    __m128i carry[MESH_CODEC_MAX_STRIDE / 4];
+    for(size_t w = 0; w < stride / 4; ++w) {
+        carry[w] = _mm_setzero_si128();
+    }
+
+    uint8_t planes[MESH_CODEC_MAX_STRIDE][MESH_CODEC_BLOCK_VERTS];
+
+    const uint8_t *p = in;
+    const uint8_t *end = in + in_size;
+
+    for(uint32_t base = 0; base < vert_count; base += MESH_CODEC_BLOCK_VERTS) {
+        const uint32_t count = vert_count - base < MESH_CODEC_BLOCK_VERTS ? vert_count - base : MESH_CODEC_BLOCK_VERTS;
+        const uint32_t padded_count = (count + MESH_CODEC_GROUP_SIZE - 1) & ~(uint32_t)(MESH_CODEC_GROUP_SIZE - 1);
+
+        for(size_t b = 0; b < stride; ++b) {
+            const size_t read = mesh_codec_decode_plane_sse2(planes[b], padded_count, p, (size_t)(end - p));
+            if(read == 0) {
+                return false;
+            }
+            p += read;
+        }
+
+        for(size_t wg = 0; wg < word_group_count; ++wg) {
+            for(uint32_t v = 0; v < padded_count; v += 16) {
+                __m128i words[4][4]; // [word][vertex quad]
+
+                for(int k = 0; k < 4; ++k) {
+                    const size_t w = wg * 4 + k;
+                    const __m128i p0 = _mm_loadu_si128((const __m128i *)&planes[w * 4 + 0][v]);
+                    const __m128i p1 = _mm_loadu_si128((const __m128i *)&planes[w * 4 + 1][v]);
+                    const __m128i p2 = _mm_loadu_si128((const __m128i *)&planes[w * 4 + 2][v]);
+                    const __m128i p3 = _mm_loadu_si128((const __m128i *)&planes[w * 4 + 3][v]);
+
+                    const __m128i lo_01 = _mm_unpacklo_epi8(p0, p1);
+                    const __m128i hi_01 = _mm_unpackhi_epi8(p0, p1);
+                    const __m128i lo_23 = _mm_unpacklo_epi8(p2, p3);
+                    const __m128i hi_23 = _mm_unpackhi_epi8(p2, p3);
+
+                    words[k][0] = _mm_unpacklo_epi16(lo_01, lo_23);
+                    words[k][1] = _mm_unpackhi_epi16(lo_01, lo_23);
+                    words[k][2] = _mm_unpacklo_epi16(hi_01, hi_23);
+                    words[k][3] = _mm_unpackhi_epi16(hi_01, hi_23);
+
+                    for(int q = 0; q < 4; ++q) {
+                        words[k][q] = mesh_codec_prefix_sum_sse2(mesh_codec_unzigzag_sse2(words[k][q]), carry[w]);
+                        carry[w] = _mm_shuffle_epi32(words[k][q], _MM_SHUFFLE(3, 3, 3, 3));
+                    }
+                }
+
+                for(int q = 0; q < 4; ++q) {
+                    const __m128i t0 = _mm_unpacklo_epi32(words[0][q], words[1][q]);
+                    const __m128i t1 = _mm_unpacklo_epi32(words[2][q], words[3][q]);
+                    const __m128i t2 = _mm_unpackhi_epi32(words[0][q], words[1][q]);
+                    const __m128i t3 = _mm_unpackhi_epi32(words[2][q], words[3][q]);
+
+                    const __m128i rows[4] = {
+                        _mm_unpacklo_epi64(t0, t1),
+                        _mm_unpackhi_epi64(t0, t1),
+                        _mm_unpacklo_epi64(t2, t3),
+                        _mm_unpackhi_epi64(t2, t3)
+                    };
+
+                    for(uint32_t i = 0; i < 4; ++i) {
+                        const uint32_t vertex = v + q * 4 + i;
+                        if(vertex < count) {
+                            _mm_storeu_si128((__m128i *)&dst[(size_t)(base + vertex) * stride + wg * 16], rows[i]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return p == end;
+}
+#endif
+
+// Decodes exactly vert_count vertices of stride bytes into out, returns false if the stream is corrupt
+static inline bool mesh_codec_decode_vertices(void *out, uint32_t vert_count, size_t stride, const uint8_t *in, size_t in_size)
+{
+#if MESH_CODEC_SSE2
+    return mesh_codec_decode_vertices_sse2(out, vert_count, stride, in, in_size);
+#else
+    return mesh_codec_decode_vertices_scalar(out, vert_count, stride, in, in_size);
+#endif
+}
+
+/* Index encoding */
+struct Mesh_Codec_Index_State {
+    uint32_t edges[MESH_CODEC_EDGE_FIFO_SIZE][2];
+    uint32_t edge_head;
+    uint32_t vertices[MESH_CODEC_VERTEX_FIFO_SIZE];
+    uint32_t vertex_head;
+    uint32_t next;
+    uint32_t last_explicit;
+};
+
+static inline void mesh_codec_index_state_init(struct Mesh_Codec_Index_State *s)
+{
+    memset(s, 0xff, sizeof(*s));
+    s->edge_head = 0;
+    s->vertex_head = 0;
+    s->next = 0;
+    s->last_explicit = 0;
+}
+
+static inline void mesh_codec_push_edge(struct Mesh_Codec_Index_State *s, uint32_t a, uint32_t b)
+{
+    s->edge_head = (s->edge_head + 1) % MESH_CODEC_EDGE_FIFO_SIZE;
+    s->edges[s->edge_head][0] = a;
+    s->edges[s->edge_head][1] = b;
+}
+
+// Index 0 is the most recent
+static inline const uint32_t *mesh_codec_get_edge(const struct Mesh_Codec_Index_State *s, uint32_t index)
+{
+    return s->edges[(s->edge_head + MESH_CODEC_EDGE_FIFO_SIZE - index) % MESH_CODEC_EDGE_FIFO_SIZE];
+}
+
+static inline void mesh_codec_push_vertex(struct Mesh_Codec_Index_State *s, uint32_t v)
+{
+    s->vertex_head = (s->vertex_head + 1) % MESH_CODEC_VERTEX_FIFO_SIZE;
+    s->vertices[s->vertex_head] = v;
+}
+
+static inline uint32_t mesh_codec_get_vertex(const struct Mesh_Codec_Index_State *s, uint32_t index)
+{
+    return s->vertices[(s->vertex_head + MESH_CODEC_VERTEX_FIFO_SIZE - index) % MESH_CODEC_VERTEX_FIFO_SIZE];
+}
+
+// The edges are stored reversed, since a neighbouring triangle with the same winding walks the shared edge the other way
+static inline void mesh_codec_push_triangle_edges(struct Mesh_Codec_Index_State *s, uint32_t a, uint32_t b, uint32_t c, bool include_first)
+{
+    if(include_first) {
+        mesh_codec_push_edge(s, b, a);
+    }
+    mesh_codec_push_edge(s, c, b);
+    mesh_codec_push_edge(s, a, c);
+}
+
+static inline uint8_t *mesh_codec_write_varint(uint8_t *p, uint32_t value)
+{
+    while(value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+
+    return p;
+}
+
+// Returns the REF for v and updates the state the same way the decoder will. Explicit deltas are appended to *extra.
+static inline uint32_t mesh_codec_encode_vertex_ref(struct Mesh_Codec_Index_State *s, uint32_t v, uint8_t **extra)
+{
+    if(v == s->next) {
+        s->next++;
+        mesh_codec_push_vertex(s, v);
+        return MESH_CODEC_REF_NEXT;
+    }
+
+    for(uint32_t i = 0; i < MESH_CODEC_REF_EXPLICIT - 1; ++i) {
+        if(mesh_codec_get_vertex(s, i) == v) {
+            return i + 1;
+        }
+    }
+
+    *extra = mesh_codec_write_varint(*extra, mesh_codec_zigzag(v - s->last_explicit));
+    s->last_explicit = v;
+    mesh_codec_push_vertex(s, v);
+
+    return MESH_CODEC_REF_EXPLICIT;
+}
+
+static inline size_t mesh_codec_index_bound(uint32_t index_count)
+{
+    // Worst case is a miss with 3 explicit 5 byte varints
+    return (size_t)(index_count / 3) * (2 + 3 * 5);
+}
+
+// out needs room for mesh_codec_index_bound bytes, returns the encoded size
+static inline size_t mesh_codec_encode_indices(uint8_t *out, const uint32_t *indices, uint32_t index_count)
+{
+    struct Mesh_Codec_Index_State s;
+    mesh_codec_index_state_init(&s);
+
+    uint8_t *p = out;
+
+    for(uint32_t t = 0; t < index_count / 3; ++t) {
+        const uint32_t *tri = &indices[t * 3];
+
+        // Find the most recent edge that any rotation of the triangle starts with
+        uint32_t best_edge = MESH_CODEC_MISS;
+        uint32_t best_rotation = 0;
+        for(uint32_t e = 0; e < MESH_CODEC_MISS && best_edge == MESH_CODEC_MISS; ++e) {
+            const uint32_t *edge = mesh_codec_get_edge(&s, e);
+            for(uint32_t r = 0; r < 3; ++r) {
+                if(edge[0] == tri[r] && edge[1] == tri[(r + 1) % 3]) {
+                    best_edge = e;
+                    best_rotation = r;
+                    break;
+                }
+            }
+        }
+
+        const uint32_t a = tri[best_rotation];
+        const uint32_t b = tri[(best_rotation + 1) % 3];
+        const uint32_t c = tri[(best_rotation + 2) % 3];
+
+        if(best_edge != MESH_CODEC_MISS) {
+            uint8_t extra[5];
+            uint8_t *extra_end = extra;
+
+            const uint32_t ref = mesh_codec_encode_vertex_ref(&s, c, &extra_end);
+            *p++ = (uint8_t)((best_edge << 4) | ref);
+            memcpy(p, extra, (size_t)(extra_end - extra));
+            p += extra_end - extra;
+
+            mesh_codec_push_triangle_edges(&s, a, b, c, false);
+        }
+        else {
+            uint8_t extra[15];
+            uint8_t *extra_end = extra;
+
+            const uint32_t ref_a = mesh_codec_encode_vertex_ref(&s, a, &extra_end);
+            const uint32_t ref_b = mesh_codec_encode_vertex_ref(&s, b, &extra_end);
+            const uint32_t ref_c = mesh_codec_encode_vertex_ref(&s, c, &extra_end);
+
+            *p++ = (uint8_t)((MESH_CODEC_MISS << 4) | ref_a);
+            *p++ = (uint8_t)(ref_b | (ref_c << 4));
+            memcpy(p, extra, (size_t)(extra_end - extra));
+            p += extra_end - extra;
+
+            mesh_codec_push_triangle_edges(&s, a, b, c, true);
+        }
+    }
+
+    return (size_t)(p - out);
+}
+
+/* Index decoding */
+static inline bool mesh_codec_decode_vertex_ref(struct Mesh_Codec_Index_State *s, uint32_t ref, const uint8_t **p, const uint8_t *end, uint32_t *out)
+{
+    if(ref == MESH_CODEC_REF_NEXT) {
+        *out = s->next++;
+        mesh_codec_push_vertex(s, *out);
+    }
+    else if(ref == MESH_CODEC_REF_EXPLICIT) {
+        uint32_t value = 0;
+        for(uint32_t shift = 0;; shift += 7) {
+            if(*p == end || shift > 28) {
+                return false;
+            }
+
+            const uint8_t byte = *(*p)++;
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if(!(byte & 0x80)) {
+                break;
+            }
+        }
+
+        *out = s->last_explicit + mesh_codec_unzigzag(value);
+        s->last_explicit = *out;
+        mesh_codec_push_vertex(s, *out);
+    }
+    else {
+        *out = mesh_codec_get_vertex(s, ref - 1);
+    }
+
+    return true;
+}
+
+// Decodes index_count indices as u16 or u32 (index_size 2 or 4) into out, returns false if the stream is corrupt
+static inline bool mesh_codec_decode_indices(void *out, uint32_t index_count, size_t index_size, const uint8_t *in, size_t in_size)
+{
+    struct Mesh_Codec_Index_State s;
+    mesh_codec_index_state_init(&s);
+
+    const uint8_t *p = in;
+    const uint8_t *end = in + in_size;
+
+    for(uint32_t t = 0; t < index_count / 3; ++t) {
+        if(p == end) {
+            return false;
+        }
+
+        const uint8_t code = *p++;
+        uint32_t tri[3];
+
+        if((code >> 4) != MESH_CODEC_MISS) {
+            const uint32_t *edge = mesh_codec_get_edge(&s, code >> 4);
+            tri[0] = edge[0];
+            tri[1] = edge[1];
+
+            if(!mesh_codec_decode_vertex_ref(&s, code & 15, &p, end, &tri[2])) {
+                return false;
+            }
+
+            mesh_codec_push_triangle_edges(&s, tri[0], tri[1], tri[2], false);
+        }
+        else {
+            if(p == end) {
+                return false;
+            }
+
+            const uint8_t refs = *p++;
+            if(!mesh_codec_decode_vertex_ref(&s, code & 15, &p, end, &tri[0]) ||
+               !mesh_codec_decode_vertex_ref(&s, refs & 15, &p, end, &tri[1]) ||
+               !mesh_codec_decode_vertex_ref(&s, refs >> 4, &p, end, &tri[2])
+            ) {
+                return false;
+            }
+
+            mesh_codec_push_triangle_edges(&s, tri[0], tri[1], tri[2], true);
+        }
+
+        if(index_size == sizeof(uint16_t)) {
+            uint16_t *dst = &((uint16_t *)out)[t * 3];
+            dst[0] = (uint16_t)tri[0];
+            dst[1] = (uint16_t)tri[1];
+            dst[2] = (uint16_t)tri[2];
+        }
+        else {
+            memcpy(&((uint32_t *)out)[t * 3], tri, sizeof(tri));
+        }
+    }
+
+    return p == end;
+}
+
+#endif
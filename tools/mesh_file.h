@@ -0,0 +1,615 @@
+/*
+ * Reading and writing the .bin mesh format produced by mesh_export.py.
+ *
+ * --- Data Format ---
+ * MAGIC:         char[4] "KNZM"
+ * VERSION:       u32 (the oldest reader version that can load the file)
+ * HEADER_SIZE:   u32 (offset of VERTEX_BUFFER, newer versions may append header fields)
+ * FLAGS:         u32 (MESH_FILE_FLAG_*)
+ * VERTEX_COUNT:  u32
+ * INDEX_COUNT:   u32
+ * QUANTIZATION:  Mesh_File_Quantization, only with MESH_FILE_FLAG_VERTEX_QUANTIZED
+ * VERTEX_BUFFER: float[VERTEX_COUNT][8] or Mesh_Quant_Vert[VERTEX_COUNT] with MESH_FILE_FLAG_VERTEX_QUANTIZED
+ * INDEX_BUFFER:  u16[INDEX_COUNT] or u32[INDEX_COUNT] with MESH_FILE_FLAG_INDEX_32
+ *                With MESH_FILE_FLAG_COMPRESSED, both buffers are instead a u32 size followed by a compressed stream
+ *                (see mesh_codec.h) that decodes to the same layout
+ * MESHLETS:      Only with MESH_FILE_FLAG_MESHLETS, starting at the next multiple of 4 after INDEX_BUFFER
+ *                u32 MESHLET_COUNT, then Mesh_File_Meshlet[MESHLET_COUNT]
+ * LODS:          Only with MESH_FILE_FLAG_LODS, starting at the next multiple of 4 after the previous section
+ *                u32 LOD_COUNT, then Mesh_File_Lod[LOD_COUNT]
+ *
+ * Files without the magic are from before the header was versioned,
+ * those start directly with VERTEX_COUNT and always have 16-bit indices.
+ *
+ * Quantized files are version 2, everything else is still written as version 1 so older readers keep working.
+ * Meshlets come after everything else, so readers that don't know about them just never read that far.
+ * Files with LODs are version 3, since INDEX_BUFFER then holds every LOD back to back
+ * and a reader that doesn't know about them would draw all of them on top of each other.
+ * Compressed files are version 4.
+ *
+ * In memory the indices are always widened to u32 and quantized vertices are decoded back to floats,
+ * so tools don't need to care. When writing, 16-bit indices are picked automatically whenever they are enough.
+ *
+ * --- Quantized Vertex Format (16 bytes) ---
+ * position:   unorm16[3], relative to the mesh bounds in Mesh_File_Quantization
+ * reserved:   u16 (zero)
+ * normal:     snorm16[2], octahedral encoded
+ * uv:         f16[2]
+ *
+ * With MESH_FILE_FORMAT_ONLY defined before including this, it's only the definitions of the format, without the readers
+ * and writers that need common.h. That's for the samples, which parse the files themselves and have their own helpers.
+ */
+#ifndef KNZ_MESH_FILE_H
+#define KNZ_MESH_FILE_H
+
+#include <stdint.h>
+
+#ifndef MESH_FILE_FORMAT_ONLY
+#include "common.h"
+#include "mesh_codec.h"
+
+#include <math.h>
+#endif
+
+#define MESH_VERT_ELEM_COUNT 8
+#define MESH_VERT_SIZE_BYTES (MESH_VERT_ELEM_COUNT * sizeof(float))
+
+#define MESH_FILE_MAGIC 0x4D5A4E4Bu // "KNZM" read as a little-endian u32
+#define MESH_FILE_VERSION 4
+#define MESH_FILE_VERSION_QUANTIZED 2
+#define MESH_FILE_VERSION_LODS 3
+#define MESH_FILE_VERSION_COMPRESSED 4
+
+#define MESH_FILE_FLAG_INDEX_32 (1u << 0)
+#define MESH_FILE_FLAG_VERTEX_QUANTIZED (1u << 1)
+#define MESH_FILE_FLAG_MESHLETS (1u << 2)
+#define MESH_FILE_FLAG_LODS (1u << 3)
+#define MESH_FILE_FLAG_COMPRESSED (1u << 4)
+
+#define MESHLET_MAX_VERTS 64
+#define MESHLET_MAX_TRIS 124
+
+#define MESH_MAX_LODS 8
+
+struct Mesh_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t flags;
+    uint32_t vert_count;
+    uint32_t index_count;
+};
+
+struct Mesh_File_Quantization {
+    float position_min[3];
+    float position_extent[3]; // position = position_min + unorm * position_extent
+};
+
+struct Mesh_Quant_Vert {
+    uint16_t position[3];
+    uint16_t reserved;
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+#define MESH_QUANT_VERT_SIZE_BYTES sizeof(struct Mesh_Quant_Vert)
+
+/* A cluster of up to MESHLET_MAX_TRIS triangles that are contiguous in the index buffer.
+ * The cluster can be skipped when the bounding sphere is outside the frustum,
+ * or when dot(normalize(cone_apex - camera_position), cone_axis) >= cone_cutoff (all triangles face away).
+ * cone_cutoff is above 1 when the normals are too spread out for the cone to ever cull.
+ */
+struct Mesh_File_Meshlet {
+    float center[3];
+    float radius;
+    float cone_apex[3];
+    float cone_cutoff;
+    float cone_axis[3];
+    uint32_t first_index;   // Relative to the start of the mesh's index buffer
+    uint32_t triangle_count;
+    uint32_t vertex_count;
+    uint32_t padding[2];
+};
+
+/* One level of detail, LOD 0 is the full mesh and every following one has fewer triangles.
+ * All LODs index the same vertex buffer.
+ * error is the largest distance the simplification moved the surface, in mesh units,
+ * so the renderer can pick a LOD by how big that error would be on screen.
+ */
+struct Mesh_File_Lod {
+    uint32_t first_index;   // Relative to the start of the mesh's index buffer
+    uint32_t index_count;
+    uint32_t first_meshlet; // Meshlets of this LOD, only with MESH_FILE_FLAG_MESHLETS
+    uint32_t meshlet_count;
+    float error;
+    uint32_t padding[3];
+};
+
+#ifndef MESH_FILE_FORMAT_ONLY
+struct Mesh_Data {
+    float *verts;       // [vert_count][MESH_VERT_ELEM_COUNT]
+    uint32_t *indices;  // [index_count]
+    uint32_t vert_count;
+    uint32_t index_count;
+
+    // Optional, NULL when the mesh doesn't have meshlets. Tools that reorder indices need to drop these.
+    struct Mesh_File_Meshlet *meshlets;
+    uint32_t meshlet_count;
+
+    // Optional, NULL when the mesh only has the one level. Same as meshlets, these point into the index order.
+    struct Mesh_File_Lod *lods;
+    uint32_t lod_count;
+};
+
+// 16-bit indices are used whenever they are enough, to save memory and bandwidth
+static inline bool mesh_needs_index_32(uint32_t vert_count)
+{
+    return vert_count > 65536;
+}
+
+/* Quantization */
+static inline uint16_t float_to_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const int32_t exponent = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = x & 0x7fffff;
+
+    if(((x >> 23) & 0xff) == 0xff) {
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0)); // Inf/NaN
+    }
+    if(exponent >= 31) {
+        return (uint16_t)(sign | 0x7c00);
+    }
+    if(exponent <= 0) {
+        if(exponent < -10) {
+            return (uint16_t)sign;
+        }
+
+        // Denormal, round to nearest even
+        mantissa |= 0x800000;
+        const uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+
+        return (uint16_t)(sign | half);
+    }
+
+    // Round to nearest even, a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1fff;
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++;
+    }
+
+    return (uint16_t)half;
+}
+
+static inline float half_to_float(uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f;
+    const uint32_t mantissa = h & 0x3ff;
+
+    uint32_t x;
+    if(exponent == 0) {
+        // Zero or denormal, which are exact as floats
+        float f = (float)mantissa * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    else if(exponent == 31) {
+        x = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else {
+        x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static inline uint16_t quantize_unorm16(float v)
+{
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint16_t)(v * 65535.0f + 0.5f);
+}
+
+static inline int16_t quantize_snorm16(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int16_t)(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+}
+
+static inline float sign_not_zero(float v)
+{
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+static inline void mesh_quantization_from_verts(const float *verts, uint32_t vert_count, struct Mesh_File_Quantization *out)
+{
+    float bounds_min[3] = { 0.0f, 0.0f, 0.0f };
+    float bounds_max[3] = { 0.0f, 0.0f, 0.0f };
+
+    for(uint32_t v = 0; v < vert_count; ++v) {
+        for(int c = 0; c < 3; ++c) {
+            const float p = verts[(size_t)v * MESH_VERT_ELEM_COUNT + c];
+            bounds_min[c] = (v == 0 || p < bounds_min[c]) ? p : bounds_min[c];
+            bounds_max[c] = (v == 0 || p > bounds_max[c]) ? p : bounds_max[c];
+        }
+    }
+
+    for(int c = 0; c < 3; ++c) {
+        out->position_min[c] = bounds_min[c];
+        out->position_extent[c] = bounds_max[c] - bounds_min[c];
+    }
+}
+
+static inline struct Mesh_Quant_Vert mesh_vert_quantize(const float *vert, const struct Mesh_File_Quantization *quant)
+{
+    struct Mesh_Quant_Vert out = {0};
+
+    for(int c = 0; c < 3; ++c) {
+        const float extent = quant->position_extent[c];
+        out.position[c] = extent > 0.0f ? quantize_unorm16((vert[c] - quant->position_min[c]) / extent) : 0;
+    }
+
+    // Octahedral encoding: project onto the octahedron, then fold the bottom half over the top
+    const float *n = &vert[3];
+    const float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float ox = l1 > 0.0f ? n[0] / l1 : 0.0f;
+    float oy = l1 > 0.0f ? n[1] / l1 : 0.0f;
+    if(n[2] < 0.0f) {
+        const float fx = (1.0f - fabsf(oy)) * sign_not_zero(ox);
+        const float fy = (1.0f - fabsf(ox)) * sign_not_zero(oy);
+        ox = fx;
+        oy = fy;
+    }
+
+    out.normal[0] = quantize_snorm16(ox);
+    out.normal[1] = quantize_snorm16(oy);
+
+    out.uv[0] = float_to_half(vert[6]);
+    out.uv[1] = float_to_half(vert[7]);
+
+    return out;
+}
+
+// NOTE: Must match load_vertex_quantized in vk_scene/shaders/lit_vert.glsl
+static inline void mesh_vert_dequantize(const struct Mesh_Quant_Vert *in, const struct Mesh_File_Quantization *quant, float *out_vert)
+{
+    for(int c = 0; c < 3; ++c) {
+        out_vert[c] = quant->position_min[c] + ((float)in->position[c] / 65535.0f) * quant->position_extent[c];
+    }
+
+    float nx = fmaxf((float)in->normal[0] / 32767.0f, -1.0f);
+    float ny = fmaxf((float)in->normal[1] / 32767.0f, -1.0f);
+    const float nz = 1.0f - fabsf(nx) - fabsf(ny);
+    const float t = fmaxf(-nz, 0.0f);
+    nx += nx >= 0.0f ? -t : t;
+    ny += ny >= 0.0f ? -t : t;
+
+    const float length = sqrtf(nx * nx + ny * ny + nz * nz);
+    out_vert[3] = nx / length;
+    out_vert[4] = ny / length;
+    out_vert[5] = nz / length;
+
+    out_vert[6] = half_to_float(in->uv[0]);
+    out_vert[7] = half_to_float(in->uv[1]);
+}
+
+static inline void mesh_data_free(struct Mesh_Data *mesh)
+{
+    free(mesh->verts);
+    free(mesh->indices);
+    free(mesh->meshlets);
+    free(mesh->lods);
+    *mesh = (struct Mesh_Data){0};
+}
+
+// Fills in the header, also for legacy files. Leaves fp at the start of the vertex buffer.
+// out_quant is only filled in for quantized files.
+static inline bool mesh_file_read_header(FILE *fp, struct Mesh_File_Header *out, struct Mesh_File_Quantization *out_quant)
+{
+    struct Mesh_File_Header header = {0};
+
+    uint32_t first[2];
+    if(fread(first, sizeof(first), 1, fp) != 1) {
+        return false;
+    }
+
+    if(first[0] != MESH_FILE_MAGIC) {
+        header.vert_count = first[0];
+        header.index_count = first[1];
+        header.header_size = sizeof(first);
+    }
+    else {
+        header.magic = first[0];
+        header.version = first[1];
+
+        if(fread(&header.header_size, sizeof(header) - sizeof(first), 1, fp) != 1 ||
+           header.header_size < sizeof(header) ||
+           header.version > MESH_FILE_VERSION
+        ) {
+            return false;
+        }
+
+        if(header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) {
+            if(header.header_size < sizeof(header) + sizeof(*out_quant) ||
+               fread(out_quant, sizeof(*out_quant), 1, fp) != 1
+            ) {
+                return false;
+            }
+        }
+
+        fseek(fp, header.header_size, SEEK_SET);
+    }
+
+    *out = header;
+    return true;
+}
+
+// Reads a u32 size and the compressed stream after it, and decodes count elements of stride bytes into out
+static inline bool mesh_file_read_stream(FILE *fp, void *out, uint32_t count, size_t stride, bool is_index)
+{
+    uint32_t size;
+    if(fread(&size, sizeof(size), 1, fp) != 1) {
+        return false;
+    }
+
+    uint8_t *stream = xmalloc(size);
+    bool ok = fread(stream, 1, size, fp) == size;
+
+    if(is_index) {
+        ok = ok && mesh_codec_decode_indices(out, count, stride, stream, size);
+    }
+    else {
+        ok = ok && mesh_codec_decode_vertices(out, count, stride, stream, size);
+    }
+
+    free(stream);
+    return ok;
+}
+
+static inline bool mesh_file_write_stream(FILE *fp, const void *data, uint32_t count, size_t stride, bool is_index)
+{
+    const size_t bound = is_index ? mesh_codec_index_bound(count) : mesh_codec_vertex_bound(count, stride);
+    uint8_t *stream = xmalloc(bound);
+
+    const size_t size = is_index ? mesh_codec_encode_indices(stream, data, count) : mesh_codec_encode_vertices(stream, data, count, stride);
+    const uint32_t size_32 = (uint32_t)size;
+
+    const bool ok = fwrite(&size_32, sizeof(size_32), 1, fp) == 1 &&
+                    fwrite(stream, 1, size, fp) == size;
+
+    free(stream);
+    return ok;
+}
+
+static inline bool mesh_file_load(const char *path, struct Mesh_Data *out)
+{
+    FILE *fp = fopen(path, "rb");
+    if(!fp) {
+        fprintf(stderr, "File open error: Couldn't open %s\n", path);
+        return false;
+    }
+
+    struct Mesh_File_Header header;
+    struct Mesh_File_Quantization quant = {0};
+    if(!mesh_file_read_header(fp, &header, &quant)) {
+        fprintf(stderr, "%s: truncated header or unsupported version\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    struct Mesh_Data mesh = {
+        .vert_count = header.vert_count,
+        .index_count = header.index_count
+    };
+
+    mesh.verts = xmalloc((size_t)mesh.vert_count * MESH_VERT_SIZE_BYTES);
+    mesh.indices = xmalloc((size_t)mesh.index_count * sizeof(uint32_t));
+
+    const size_t vertex_stride = (header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) ? MESH_QUANT_VERT_SIZE_BYTES : MESH_VERT_SIZE_BYTES;
+    const size_t index_size = (header.flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    // The buffers as they are in the file, before dequantizing and widening
+    char *vertex_data = xmalloc((size_t)mesh.vert_count * vertex_stride);
+    char *index_data = xmalloc((size_t)mesh.index_count * index_size);
+
+    bool ok;
+    if(header.flags & MESH_FILE_FLAG_COMPRESSED) {
+        ok = mesh_file_read_stream(fp, vertex_data, mesh.vert_count, vertex_stride, false) &&
+             mesh_file_read_stream(fp, index_data, mesh.index_count, index_size, true);
+    }
+    else {
+        ok = fread(vertex_data, vertex_stride, mesh.vert_count, fp) == mesh.vert_count &&
+             fread(index_data, index_size, mesh.index_count, fp) == mesh.index_count;
+    }
+
+    if(header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) {
+        const struct Mesh_Quant_Vert *quant_verts = (const struct Mesh_Quant_Vert *)vertex_data;
+        for(uint32_t i = 0; ok && i < mesh.vert_count; ++i) {
+            mesh_vert_dequantize(&quant_verts[i], &quant, &mesh.verts[(size_t)i * MESH_VERT_ELEM_COUNT]);
+        }
+    }
+    else {
+        memcpy(mesh.verts, vertex_data, (size_t)mesh.vert_count * MESH_VERT_SIZE_BYTES);
+    }
+
+    if(header.flags & MESH_FILE_FLAG_INDEX_32) {
+        memcpy(mesh.indices, index_data, (size_t)mesh.index_count * sizeof(uint32_t));
+    }
+    else {
+        const uint16_t *indices_16 = (const uint16_t *)index_data;
+        for(uint32_t i = 0; i < mesh.index_count; ++i) {
+            mesh.indices[i] = indices_16[i];
+        }
+    }
+
+    free(index_data);
+    free(vertex_data);
+
+    if(ok && (header.flags & MESH_FILE_FLAG_MESHLETS)) {
+        const long index_end = ftell(fp);
+        fseek(fp, (index_end + 3) & ~3l, SEEK_SET);
+
+        ok = fread(&mesh.meshlet_count, sizeof(uint32_t), 1, fp) == 1;
+        if(ok) {
+            mesh.meshlets = xmalloc((size_t)mesh.meshlet_count * sizeof(struct Mesh_File_Meshlet));
+            ok = fread(mesh.meshlets, sizeof(struct Mesh_File_Meshlet), mesh.meshlet_count, fp) == mesh.meshlet_count;
+        }
+
+        for(uint32_t i = 0; ok && i < mesh.meshlet_count; ++i) {
+            ok = (uint64_t)mesh.meshlets[i].first_index + (uint64_t)mesh.meshlets[i].triangle_count * 3 <= mesh.index_count;
+        }
+    }
+
+    if(ok && (header.flags & MESH_FILE_FLAG_LODS)) {
+        const long section_start = ftell(fp);
+        fseek(fp, (section_start + 3) & ~3l, SEEK_SET);
+
+        ok = fread(&mesh.lod_count, sizeof(uint32_t), 1, fp) == 1 && mesh.lod_count <= MESH_MAX_LODS;
+        if(ok) {
+            mesh.lods = xmalloc((size_t)mesh.lod_count * sizeof(struct Mesh_File_Lod));
+            ok = fread(mesh.lods, sizeof(struct Mesh_File_Lod), mesh.lod_count, fp) == mesh.lod_count;
+        }
+
+        for(uint32_t i = 0; ok && i < mesh.lod_count; ++i) {
+            ok = (uint64_t)mesh.lods[i].first_index + mesh.lods[i].index_count <= mesh.index_count &&
+                 (uint64_t)mesh.lods[i].first_meshlet + mesh.lods[i].meshlet_count <= mesh.meshlet_count;
+        }
+    }
+
+    fclose(fp);
+
+    for(uint32_t i = 0; ok && i < mesh.index_count; ++i) {
+        ok = mesh.indices[i] < mesh.vert_count;
+    }
+
+    if(!ok) {
+        fprintf(stderr, "%s: truncated or corrupt mesh data\n", path);
+        mesh_data_free(&mesh);
+        return false;
+    }
+
+    *out = mesh;
+    return true;
+}
+
+static inline bool mesh_file_write_indices(FILE *fp, const struct Mesh_Data *mesh, bool index_32)
+{
+    if(index_32) {
+        return fwrite(mesh->indices, sizeof(uint32_t), mesh->index_count, fp) == mesh->index_count;
+    }
+
+    uint16_t *indices_16 = xmalloc((size_t)mesh->index_count * sizeof(uint16_t));
+    for(uint32_t i = 0; i < mesh->index_count; ++i) {
+        indices_16[i] = (uint16_t)mesh->indices[i];
+    }
+
+    const bool ok = fwrite(indices_16, sizeof(uint16_t), mesh->index_count, fp) == mesh->index_count;
+    free(indices_16);
+
+    return ok;
+}
+
+// With quantize set, the vertices are stored in the quantized format and the file is version 2 (3 with LODs).
+// With compress set, both buffers are compressed and the file is version 4.
+static inline bool mesh_file_save_ex(const char *path, const struct Mesh_Data *mesh, bool quantize, bool compress)
+{
+    FILE *fp = fopen(path, "wb");
+    if(!fp) {
+        fprintf(stderr, "File open error: Couldn't open %s for writing\n", path);
+        return false;
+    }
+
+    const bool index_32 = mesh_needs_index_32(mesh->vert_count);
+
+    struct Mesh_File_Header header = {
+        .magic = MESH_FILE_MAGIC,
+        .version = compress ? MESH_FILE_VERSION_COMPRESSED : (mesh->lods ? MESH_FILE_VERSION_LODS : (quantize ? MESH_FILE_VERSION_QUANTIZED : 1)),
+        .header_size = sizeof(header) + (quantize ? sizeof(struct Mesh_File_Quantization) : 0),
+        .flags = (index_32 ? MESH_FILE_FLAG_INDEX_32 : 0) |
+                 (quantize ? MESH_FILE_FLAG_VERTEX_QUANTIZED : 0) |
+                 (mesh->meshlets ? MESH_FILE_FLAG_MESHLETS : 0) |
+                 (mesh->lods ? MESH_FILE_FLAG_LODS : 0) |
+                 (compress ? MESH_FILE_FLAG_COMPRESSED : 0),
+        .vert_count = mesh->vert_count,
+        .index_count = mesh->index_count
+    };
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    const void *vertex_data = mesh->verts;
+    size_t vertex_stride = MESH_VERT_SIZE_BYTES;
+    struct Mesh_Quant_Vert *quant_verts = NULL;
+
+    if(quantize) {
+        struct Mesh_File_Quantization quant;
+        mesh_quantization_from_verts(mesh->verts, mesh->vert_count, &quant);
+
+        quant_verts = xmalloc((size_t)mesh->vert_count * MESH_QUANT_VERT_SIZE_BYTES);
+        for(uint32_t i = 0; i < mesh->vert_count; ++i) {
+            quant_verts[i] = mesh_vert_quantize(&mesh->verts[(size_t)i * MESH_VERT_ELEM_COUNT], &quant);
+        }
+
+        ok = ok && fwrite(&quant, sizeof(quant), 1, fp) == 1;
+
+        vertex_data = quant_verts;
+        vertex_stride = MESH_QUANT_VERT_SIZE_BYTES;
+    }
+
+    if(compress) {
+        // The index stream always encodes from u32, the width only matters when decoding
+        ok = ok && mesh_file_write_stream(fp, vertex_data, mesh->vert_count, vertex_stride, false) &&
+                   mesh_file_write_stream(fp, mesh->indices, mesh->index_count, index_32 ? sizeof(uint32_t) : sizeof(uint16_t), true);
+    }
+    else {
+        ok = ok && fwrite(vertex_data, vertex_stride, mesh->vert_count, fp) == mesh->vert_count &&
+                   mesh_file_write_indices(fp, mesh, index_32);
+    }
+
+    free(quant_verts);
+
+    const uint8_t padding[4] = {0};
+
+    if(mesh->meshlets) {
+        const size_t padding_size = (4 - (ftell(fp) & 3)) & 3;
+
+        ok = ok && fwrite(padding, 1, padding_size, fp) == padding_size &&
+                   fwrite(&mesh->meshlet_count, sizeof(uint32_t), 1, fp) == 1 &&
+                   fwrite(mesh->meshlets, sizeof(struct Mesh_File_Meshlet), mesh->meshlet_count, fp) == mesh->meshlet_count;
+    }
+
+    if(mesh->lods) {
+        const size_t padding_size = (4 - (ftell(fp) & 3)) & 3;
+
+        ok = ok && fwrite(padding, 1, padding_size, fp) == padding_size &&
+                   fwrite(&mesh->lod_count, sizeof(uint32_t), 1, fp) == 1 &&
+                   fwrite(mesh->lods, sizeof(struct Mesh_File_Lod), mesh->lod_count, fp) == mesh->lod_count;
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+
+    if(!ok) {
+        fprintf(stderr, "%s: write failed\n", path);
+    }
+
+    return ok;
+}
+
+static inline bool mesh_file_save(const char *path, const struct Mesh_Data *mesh)
+{
+    return mesh_file_save_ex(path, mesh, false, false);
+}
+
+#endif // MESH_FILE_FORMAT_ONLY
+
+#endif
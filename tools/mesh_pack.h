@@ -0,0 +1,114 @@
+/*
+ * Multi-mesh pack files, meant to be memory mapped and uploaded straight from the mapping.
+ *
+ * --- Pack Format ---
+ * HEADER:   Mesh_Pack_Header
+ * TOC:      Mesh_Pack_Entry[MESH_COUNT]
+ * SECTIONS: Vertex, index, meshlet and LOD payloads, in the same layout as the .bin format,
+ *           each starting at a multiple of MESH_PACK_ALIGNMENT from the start of the file
+ *
+ * All offsets are from the start of the file.
+ * Entry flags are the same as the .bin MESH_FILE_FLAG_* flags.
+ * Meshlets are Mesh_File_Meshlet[meshlet_count], only with MESH_FILE_FLAG_MESHLETS.
+ * LODs are Mesh_File_Lod[lod_count], only with MESH_FILE_FLAG_LODS. index_count is then the total of all LODs.
+ * With MESH_FILE_FLAG_COMPRESSED the vertex and index payloads are mesh_codec.h streams of vertex_stream_size
+ * and index_stream_size bytes (without the u32 size in front like in .bin files), which decode to the usual layout.
+ *
+ * Packs are build outputs, so there is no backwards compatibility, older packs just need to be rebuilt.
+ */
+#ifndef KNZ_MESH_PACK_H
+#define KNZ_MESH_PACK_H
+
+#include "common.h"
+#include "mesh_file.h"
+
+#define MESH_PACK_MAGIC 0x505A4E4Bu // "KNZP" read as a little-endian u32
+#define MESH_PACK_VERSION 4
+#define MESH_PACK_ALIGNMENT 256
+#define MESH_PACK_NAME_SIZE 64
+
+struct Mesh_Pack_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t mesh_count;
+    uint32_t toc_offset;
+};
+
+struct Mesh_Pack_Entry {
+    char name[MESH_PACK_NAME_SIZE];
+    uint32_t flags;
+    uint32_t vert_count;
+    uint32_t index_count;
+    uint32_t vertex_stride;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t meshlet_offset;
+    uint32_t meshlet_count;
+    uint32_t lod_count;
+    uint64_t lod_offset;
+    uint32_t vertex_stream_size; // Only with MESH_FILE_FLAG_COMPRESSED
+    uint32_t index_stream_size;
+};
+
+// Decoded sizes, which is what the GPU buffers need
+static inline uint64_t mesh_pack_entry_vertex_size(const struct Mesh_Pack_Entry *entry)
+{
+    return (uint64_t)entry->vert_count * entry->vertex_stride;
+}
+
+static inline uint64_t mesh_pack_entry_index_size(const struct Mesh_Pack_Entry *entry)
+{
+    return (uint64_t)entry->index_count * ((entry->flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t));
+}
+
+// Sizes of the payloads in the file, which are the compressed streams for compressed entries
+static inline uint64_t mesh_pack_entry_vertex_payload_size(const struct Mesh_Pack_Entry *entry)
+{
+    return (entry->flags & MESH_FILE_FLAG_COMPRESSED) ? entry->vertex_stream_size : mesh_pack_entry_vertex_size(entry);
+}
+
+static inline uint64_t mesh_pack_entry_index_payload_size(const struct Mesh_Pack_Entry *entry)
+{
+    return (entry->flags & MESH_FILE_FLAG_COMPRESSED) ? entry->index_stream_size : mesh_pack_entry_index_size(entry);
+}
+
+static inline uint64_t mesh_pack_entry_meshlet_size(const struct Mesh_Pack_Entry *entry)
+{
+    return (uint64_t)entry->meshlet_count * sizeof(struct Mesh_File_Meshlet);
+}
+
+static inline uint64_t mesh_pack_entry_lod_size(const struct Mesh_Pack_Entry *entry)
+{
+    return (uint64_t)entry->lod_count * sizeof(struct Mesh_File_Lod);
+}
+
+// Checks that the header and every entry lie within the mapping, returns the TOC
+static inline const struct Mesh_Pack_Entry *mesh_pack_validate(const char *data, size_t size, uint32_t *out_mesh_count)
+{
+    const struct Mesh_Pack_Header *header = (const struct Mesh_Pack_Header *)data;
+
+    if(size < sizeof(*header) ||
+       header->magic != MESH_PACK_MAGIC ||
+       header->version != MESH_PACK_VERSION ||
+       (uint64_t)header->toc_offset + (uint64_t)header->mesh_count * sizeof(struct Mesh_Pack_Entry) > size
+    ) {
+        return NULL;
+    }
+
+    const struct Mesh_Pack_Entry *toc = (const struct Mesh_Pack_Entry *)(data + header->toc_offset);
+
+    for(uint32_t i = 0; i < header->mesh_count; ++i) {
+        if(toc[i].vertex_offset + mesh_pack_entry_vertex_payload_size(&toc[i]) > size ||
+           toc[i].index_offset + mesh_pack_entry_index_payload_size(&toc[i]) > size ||
+           toc[i].meshlet_offset + mesh_pack_entry_meshlet_size(&toc[i]) > size ||
+           toc[i].lod_offset + mesh_pack_entry_lod_size(&toc[i]) > size
+        ) {
+            return NULL;
+        }
+    }
+
+    *out_mesh_count = header->mesh_count;
+    return toc;
+}
+
+#endif
@@ -0,0 +1,471 @@
+/*
+ * Quadric error mesh simplification (Garland, Heckbert 1997, "Surface Simplification Using Quadric Error Metrics"),
+ * restricted to collapsing a vertex onto one of its neighbours, so that the simplified index buffer
+ * still indexes the original vertex buffer and every LOD of a mesh can share it.
+ *
+ * Vertices are compared by position, since UV and normal seams split one position into several vertices.
+ * Positions on a seam or on an open border are locked, which keeps the LODs free of cracks at the cost of some reduction
+ * (a hard-edged cube, where every corner is a seam, doesn't simplify at all).
+ *
+ * The quadrics are not area weighted, so the error of a collapse is a sum of squared distances to the original planes
+ * and its square root is roughly how far the surface moved, in mesh units.
+ */
+#ifndef KNZ_MESH_SIMPLIFY_H
+#define KNZ_MESH_SIMPLIFY_H
+
+#include "common.h"
+#include "mesh_file.h"
+#include "mesh_adjacency.h"
+
+#include <math.h>
+
+#define SIMPLIFY_MAX_PASSES 64
+
+// Defaults for mesh_lods_build, shared by knz_meshlod and knz_meshpack --lods
+#define MESH_LOD_DEFAULT_COUNT 4
+#define MESH_LOD_DEFAULT_RATIO 0.5f
+#define MESH_LOD_DEFAULT_MAX_ERROR 0.05f
+
+// Symmetric 4x4 matrix of the plane equations, p^T Q p is the sum of squared distances of p to the planes
+struct Quadric {
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+};
+
+static inline void quadric_add_plane(struct Quadric *q, double a, double b, double c, double d)
+{
+    q->a2 += a * a; q->ab += a * b; q->ac += a * c; q->ad += a * d;
+    q->b2 += b * b; q->bc += b * c; q->bd += b * d;
+    q->c2 += c * c; q->cd += c * d;
+    q->d2 += d * d;
+}
+
+static inline void quadric_add(struct Quadric *q, const struct Quadric *other)
+{
+    q->a2 += other->a2; q->ab += other->ab; q->ac += other->ac; q->ad += other->ad;
+    q->b2 += other->b2; q->bc += other->bc; q->bd += other->bd;
+    q->c2 += other->c2; q->cd += other->cd;
+    q->d2 += other->d2;
+}
+
+static inline double quadric_eval(const struct Quadric *q, const float *p)
+{
+    const double x = p[0], y = p[1], z = p[2];
+
+    const double result = q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x +
+                          q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y +
+                          q->c2 * z * z + 2.0 * q->cd * z +
+                          q->d2;
+
+    return result > 0.0 ? result : 0.0;
+}
+
+// Maps every vertex to the first vertex with the exact same position
+static inline uint32_t *mesh_position_remap(const float *verts, uint32_t vert_count)
+{
+    const uint32_t table_size = (uint32_t)next_pow2((uint64_t)vert_count * 2);
+    uint32_t *table = xmalloc((size_t)table_size * sizeof(uint32_t));
+    memset(table, 0xff, (size_t)table_size * sizeof(uint32_t));
+
+    uint32_t *remap = xmalloc((size_t)vert_count * sizeof(uint32_t));
+
+    for(uint32_t v = 0; v < vert_count; ++v) {
+        const float *p = &verts[(size_t)v * MESH_VERT_ELEM_COUNT];
+
+        uint32_t bits[3];
+        memcpy(bits, p, sizeof(bits));
+        const uint32_t hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+
+        for(uint32_t slot = hash & (table_size - 1);; slot = (slot + 1) & (table_size - 1)) {
+            if(table[slot] == UINT32_MAX) {
+                table[slot] = v;
+                remap[v] = v;
+                break;
+            }
+
+            if(0 == memcmp(&verts[(size_t)table[slot] * MESH_VERT_ELEM_COUNT], p, 3 * sizeof(float))) {
+                remap[v] = table[slot];
+                break;
+            }
+        }
+    }
+
+    free(table);
+    return remap;
+}
+
+static inline bool triangle_normal_unnormalized(const float *p0, const float *p1, const float *p2, double *out)
+{
+    const double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    const double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+    out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+    return out[0] != 0.0 || out[1] != 0.0 || out[2] != 0.0;
+}
+
+struct Simplify_Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+static int simplify_collapse_compare(const void *a, const void *b)
+{
+    const double cost_a = ((const struct Simplify_Collapse *)a)->cost;
+    const double cost_b = ((const struct Simplify_Collapse *)b)->cost;
+
+    return (cost_a > cost_b) - (cost_a < cost_b);
+}
+
+/* Simplifies indices[index_count] down to about target_index_count, without any collapse going over max_error.
+ * out_indices needs room for index_count indices. Returns the new index count, out_error gets the largest error used.
+ *
+ * Every pass sorts all the possible collapses by cost and takes as many of the cheapest as it can,
+ * skipping the ones next to a collapse that was already taken in the pass, since their costs are out of date.
+ */
+static inline uint32_t mesh_simplify(const float *verts, uint32_t vert_count, const uint32_t *indices, uint32_t index_count,
+                                     uint32_t target_index_count, float max_error, uint32_t *out_indices, float *out_error)
+{
+    #define SIMPLIFY_POS(v_) (&verts[(size_t)(v_) * MESH_VERT_ELEM_COUNT])
+
+    uint32_t *position_remap = mesh_position_remap(verts, vert_count);
+
+    // Everything below is per position, keyed by the first vertex at that position
+    uint32_t *wedge_count = xmalloc((size_t)vert_count * sizeof(uint32_t));
+    memset(wedge_count, 0, (size_t)vert_count * sizeof(uint32_t));
+    for(uint32_t v = 0; v < vert_count; ++v) {
+        wedge_count[position_remap[v]]++;
+    }
+
+    uint32_t *pos_indices = xmalloc((size_t)index_count * sizeof(uint32_t));
+    for(uint32_t i = 0; i < index_count; ++i) {
+        pos_indices[i] = position_remap[indices[i]];
+    }
+
+    // Lock seams, and borders (edges with other than 2 triangles)
+    bool *locked = xmalloc((size_t)vert_count * sizeof(bool));
+    for(uint32_t v = 0; v < vert_count; ++v) {
+        locked[v] = wedge_count[v] > 1;
+    }
+
+    {
+        struct Vertex_Adjacency adj = adjacency_build(pos_indices, index_count, vert_count);
+
+        for(uint32_t i = 0; i < index_count; ++i) {
+            const uint32_t a = pos_indices[i];
+            const uint32_t b = pos_indices[i - i % 3 + (i + 1) % 3];
+
+            uint32_t edge_tri_count = 0;
+            for(uint32_t k = adj.offsets[a]; k < adj.offsets[a + 1]; ++k) {
+                const uint32_t *tri = &pos_indices[adj.triangles[k] * 3];
+                edge_tri_count += tri[0] == b || tri[1] == b || tri[2] == b;
+            }
+
+            if(edge_tri_count != 2) {
+                locked[a] = true;
+                locked[b] = true;
+            }
+        }
+
+        adjacency_free(&adj);
+    }
+
+    // Quadrics of the original planes
+    struct Quadric *quadrics = xmalloc((size_t)vert_count * sizeof(struct Quadric));
+    memset(quadrics, 0, (size_t)vert_count * sizeof(struct Quadric));
+
+    for(uint32_t t = 0; t < index_count / 3; ++t) {
+        const uint32_t *tri = &pos_indices[t * 3];
+
+        double n[3];
+        if(!triangle_normal_unnormalized(SIMPLIFY_POS(tri[0]), SIMPLIFY_POS(tri[1]), SIMPLIFY_POS(tri[2]), n)) {
+            continue;
+        }
+
+        const double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+
+        const float *p0 = SIMPLIFY_POS(tri[0]);
+        const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+
+        for(int k = 0; k < 3; ++k) {
+            quadric_add_plane(&quadrics[tri[k]], n[0], n[1], n[2], d);
+        }
+    }
+
+    /* Collapse passes */
+    memcpy(out_indices, indices, (size_t)index_count * sizeof(uint32_t));
+    uint32_t out_index_count = index_count;
+
+    struct Simplify_Collapse *collapses = xmalloc((size_t)index_count * 2 * sizeof(struct Simplify_Collapse));
+    uint32_t *vertex_remap = xmalloc((size_t)vert_count * sizeof(uint32_t));
+    bool *touched = xmalloc((size_t)vert_count * sizeof(bool));
+
+    uint32_t *link_mark = xmalloc((size_t)vert_count * sizeof(uint32_t));
+    memset(link_mark, 0, (size_t)vert_count * sizeof(uint32_t));
+    uint32_t link_stamp = 0;
+
+    const double max_cost = (double)max_error * (double)max_error;
+    double result_cost = 0.0;
+
+    for(int pass = 0; pass < SIMPLIFY_MAX_PASSES && out_index_count > target_index_count; ++pass) {
+        for(uint32_t i = 0; i < out_index_count; ++i) {
+            pos_indices[i] = position_remap[out_indices[i]];
+        }
+
+        // Every edge in both directions, interior edges show up twice but that doesn't matter
+        uint32_t collapse_count = 0;
+        for(uint32_t i = 0; i < out_index_count; ++i) {
+            const uint32_t a = pos_indices[i];
+            const uint32_t b = pos_indices[i - i % 3 + (i + 1) % 3];
+
+            for(int dir = 0; dir < 2; ++dir) {
+                const uint32_t from = dir ? b : a;
+                const uint32_t to = dir ? a : b;
+
+                if(!locked[from]) {
+                    struct Quadric q = quadrics[from];
+                    quadric_add(&q, &quadrics[to]);
+
+                    collapses[collapse_count++] = (struct Simplify_Collapse) {
+                        .from = from,
+                        .to = to,
+                        .cost = quadric_eval(&q, SIMPLIFY_POS(to))
+                    };
+                }
+            }
+        }
+
+        qsort(collapses, collapse_count, sizeof(*collapses), simplify_collapse_compare);
+
+        struct Vertex_Adjacency adj = adjacency_build(pos_indices, out_index_count, vert_count);
+
+        for(uint32_t v = 0; v < vert_count; ++v) {
+            vertex_remap[v] = v;
+        }
+        memset(touched, 0, (size_t)vert_count * sizeof(bool));
+
+        uint32_t tri_count = out_index_count / 3;
+        uint32_t applied_count = 0;
+
+        for(uint32_t c = 0; c < collapse_count && tri_count * 3 > target_index_count; ++c) {
+            const struct Simplify_Collapse *collapse = &collapses[c];
+            if(collapse->cost > max_cost) {
+                break;
+            }
+
+            if(touched[collapse->from] || touched[collapse->to]) {
+                continue;
+            }
+
+            /* The target vertex: with a seam at `to`, the triangles along the edge have to agree on which side of it to use.
+             * `from` is never on a seam, so its only vertex is the position's own. */
+            uint32_t target_vertex = wedge_count[collapse->to] == 1 ? collapse->to : UINT32_MAX;
+            bool valid = true;
+            uint32_t removed_tri_count = 0;
+
+            for(uint32_t k = adj.offsets[collapse->from]; valid && k < adj.offsets[collapse->from + 1]; ++k) {
+                const uint32_t t = adj.triangles[k];
+                const uint32_t *tri = &pos_indices[t * 3];
+
+                int to_corner = -1;
+                for(int corner = 0; corner < 3; ++corner) {
+                    to_corner = tri[corner] == collapse->to ? corner : to_corner;
+                }
+
+                if(to_corner >= 0) {
+                    removed_tri_count++;
+
+                    const uint32_t v = out_indices[t * 3 + to_corner];
+                    if(target_vertex == UINT32_MAX) {
+                        target_vertex = v;
+                    }
+                    valid = target_vertex == v;
+                    continue;
+                }
+
+                // The triangle must not flip or fold over when `from` moves onto `to`
+                const float *p[3];
+                const float *p_moved[3];
+                for(int corner = 0; corner < 3; ++corner) {
+                    p[corner] = SIMPLIFY_POS(tri[corner]);
+                    p_moved[corner] = tri[corner] == collapse->from ? SIMPLIFY_POS(collapse->to) : p[corner];
+                }
+
+                double n[3];
+                double n_moved[3];
+                triangle_normal_unnormalized(p[0], p[1], p[2], n);
+                if(!triangle_normal_unnormalized(p_moved[0], p_moved[1], p_moved[2], n_moved)) {
+                    valid = false;
+                    continue;
+                }
+
+                const double dot = n[0] * n_moved[0] + n[1] * n_moved[1] + n[2] * n_moved[2];
+                const double length_sq = (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * (n_moved[0] * n_moved[0] + n_moved[1] * n_moved[1] + n_moved[2] * n_moved[2]);
+                valid = dot > 0.0 && dot * dot >= 0.0625 * length_sq; // Within about 75 degrees
+            }
+
+            if(!valid || target_vertex == UINT32_MAX) {
+                continue;
+            }
+
+            /* Link condition: the only neighbours `from` and `to` share are the ones across the triangles being removed,
+             * otherwise the collapse pinches the surface into a non-manifold edge */
+            link_stamp += 2;
+            for(uint32_t k = adj.offsets[collapse->to]; k < adj.offsets[collapse->to + 1]; ++k) {
+                const uint32_t *tri = &pos_indices[adj.triangles[k] * 3];
+                link_mark[tri[0]] = link_mark[tri[1]] = link_mark[tri[2]] = link_stamp;
+            }
+
+            uint32_t shared_neighbour_count = 0;
+            for(uint32_t k = adj.offsets[collapse->from]; k < adj.offsets[collapse->from + 1]; ++k) {
+                const uint32_t *tri = &pos_indices[adj.triangles[k] * 3];
+                for(int corner = 0; corner < 3; ++corner) {
+                    const uint32_t n = tri[corner];
+                    if(n != collapse->from && n != collapse->to && link_mark[n] == link_stamp) {
+                        link_mark[n] = link_stamp + 1;
+                        shared_neighbour_count++;
+                    }
+                }
+            }
+
+            if(shared_neighbour_count != removed_tri_count) {
+                continue;
+            }
+
+            vertex_remap[collapse->from] = target_vertex;
+            quadric_add(&quadrics[collapse->to], &quadrics[collapse->from]);
+            result_cost = collapse->cost > result_cost ? collapse->cost : result_cost;
+
+            // Everything around `from` now has stale costs and flip checks
+            for(uint32_t k = adj.offsets[collapse->from]; k < adj.offsets[collapse->from + 1]; ++k) {
+                const uint32_t *tri = &pos_indices[adj.triangles[k] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+
+            tri_count -= removed_tri_count;
+            applied_count++;
+        }
+
+        adjacency_free(&adj);
+
+        if(applied_count == 0) {
+            break;
+        }
+
+        // Apply the remap and drop the triangles that collapsed
+        uint32_t write = 0;
+        for(uint32_t t = 0; t < out_index_count / 3; ++t) {
+            const uint32_t v0 = vertex_remap[out_indices[t * 3 + 0]];
+            const uint32_t v1 = vertex_remap[out_indices[t * 3 + 1]];
+            const uint32_t v2 = vertex_remap[out_indices[t * 3 + 2]];
+
+            const uint32_t p0 = position_remap[v0];
+            const uint32_t p1 = position_remap[v1];
+            const uint32_t p2 = position_remap[v2];
+
+            if(p0 != p1 && p1 != p2 && p0 != p2) {
+                out_indices[write++] = v0;
+                out_indices[write++] = v1;
+                out_indices[write++] = v2;
+            }
+        }
+
+        out_index_count = write;
+    }
+
+    #undef SIMPLIFY_POS
+
+    free(link_mark);
+    free(touched);
+    free(vertex_remap);
+    free(collapses);
+    free(quadrics);
+    free(locked);
+    free(pos_indices);
+    free(wedge_count);
+    free(position_remap);
+
+    *out_error = (float)sqrt(result_cost);
+    return out_index_count;
+}
+
+/* Replaces mesh->indices with LOD 0 followed by up to lod_count - 1 simplified LODs, each with about ratio times
+ * the triangles of the one before. Every LOD is simplified from LOD 0, so the errors are all against the original surface.
+ * max_error is relative to the largest extent of the mesh bounds.
+ *
+ * Stops early once a LOD doesn't get meaningfully smaller, when everything left is locked or over max_error.
+ * Existing meshlets are dropped, since they don't know about the LODs, build them again afterwards.
+ */
+static inline void mesh_lods_build(struct Mesh_Data *mesh, uint32_t lod_count, float ratio, float max_error)
+{
+    if(lod_count > MESH_MAX_LODS) {
+        lod_count = MESH_MAX_LODS;
+    }
+
+    free(mesh->meshlets);
+    mesh->meshlets = NULL;
+    mesh->meshlet_count = 0;
+
+    // Only the LOD 0 part of the old index buffer, in case it already had LODs
+    const uint32_t base_index_count = mesh->lods ? mesh->lods[0].index_count : mesh->index_count;
+    free(mesh->lods);
+    mesh->lods = NULL;
+    mesh->lod_count = 0;
+
+    struct Mesh_File_Quantization bounds;
+    mesh_quantization_from_verts(mesh->verts, mesh->vert_count, &bounds);
+    const float mesh_size = fmaxf(bounds.position_extent[0], fmaxf(bounds.position_extent[1], bounds.position_extent[2]));
+
+    struct Mesh_File_Lod lods[MESH_MAX_LODS] = {
+        { .first_index = 0, .index_count = base_index_count, .error = 0.0f }
+    };
+    uint32_t built_count = 1;
+
+    uint32_t *indices = xmalloc((size_t)base_index_count * lod_count * sizeof(uint32_t));
+    memcpy(indices, mesh->indices, (size_t)base_index_count * sizeof(uint32_t));
+
+    uint32_t total_index_count = base_index_count;
+    float target = (float)base_index_count;
+
+    while(built_count < lod_count) {
+        target *= ratio;
+        const uint32_t target_index_count = (uint32_t)target / 3 * 3;
+        const struct Mesh_File_Lod *prev = &lods[built_count - 1];
+
+        float error;
+        const uint32_t index_count = mesh_simplify(mesh->verts, mesh->vert_count, mesh->indices, base_index_count,
+                                                   target_index_count, max_error * mesh_size, &indices[total_index_count], &error);
+
+        if(index_count == 0 || index_count > prev->index_count * 9 / 10) {
+            break;
+        }
+
+        lods[built_count++] = (struct Mesh_File_Lod) {
+            .first_index = total_index_count,
+            .index_count = index_count,
+            .error = fmaxf(error, prev->error)
+        };
+
+        total_index_count += index_count;
+    }
+
+    free(mesh->indices);
+    mesh->indices = indices;
+    mesh->index_count = total_index_count;
+
+    if(built_count > 1) {
+        mesh->lod_count = built_count;
+        mesh->lods = xmalloc(built_count * sizeof(struct Mesh_File_Lod));
+        memcpy(mesh->lods, lods, built_count * sizeof(struct Mesh_File_Lod));
+    }
+}
+
+#endif
@@ -0,0 +1,326 @@
+/*
+ * Splits a mesh into meshlets of up to MESHLET_MAX_VERTS vertices and MESHLET_MAX_TRIS triangles,
+ * each with a bounding sphere and a normal cone for cluster culling (see Mesh_File_Meshlet).
+ *
+ * Meshlets are grown greedily over shared vertices, always taking the triangle that adds the fewest new vertices,
+ * and the index buffer is rewritten so that every meshlet is one contiguous range that can be drawn on its own.
+ * Vertices are not touched, so running knz_meshopt first still pays off for the vertex order.
+ * Meshes with LODs get separate meshlets per LOD, so every LOD stays a contiguous range of meshlets too.
+ */
+#ifndef KNZ_MESHLET_H
+#define KNZ_MESHLET_H
+
+#include "common.h"
+#include "mesh_file.h"
+#include "mesh_adjacency.h"
+
+#include <math.h>
+
+// Ritter's bounding sphere, not the tightest but close enough for culling
+static inline void meshlet_compute_sphere(const float *verts, const uint32_t *meshlet_verts, uint32_t vertex_count, float *out_center, float *out_radius)
+{
+    #define MESHLET_POS(i_) (&verts[(size_t)meshlet_verts[i_] * MESH_VERT_ELEM_COUNT])
+
+    // Start from the most distant pair among the axis extremes
+    uint32_t extremes_min[3] = {0};
+    uint32_t extremes_max[3] = {0};
+    for(uint32_t i = 1; i < vertex_count; ++i) {
+        for(int c = 0; c < 3; ++c) {
+            extremes_min[c] = MESHLET_POS(i)[c] < MESHLET_POS(extremes_min[c])[c] ? i : extremes_min[c];
+            extremes_max[c] = MESHLET_POS(i)[c] > MESHLET_POS(extremes_max[c])[c] ? i : extremes_max[c];
+        }
+    }
+
+    int best_axis = 0;
+    float best_dist_sq = -1.0f;
+    for(int c = 0; c < 3; ++c) {
+        const float *a = MESHLET_POS(extremes_min[c]);
+        const float *b = MESHLET_POS(extremes_max[c]);
+        const float dist_sq = (b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) + (b[2] - a[2]) * (b[2] - a[2]);
+        if(dist_sq > best_dist_sq) {
+            best_dist_sq = dist_sq;
+            best_axis = c;
+        }
+    }
+
+    const float *a = MESHLET_POS(extremes_min[best_axis]);
+    const float *b = MESHLET_POS(extremes_max[best_axis]);
+
+    float center[3] = { (a[0] + b[0]) * 0.5f, (a[1] + b[1]) * 0.5f, (a[2] + b[2]) * 0.5f };
+    float radius = sqrtf(best_dist_sq) * 0.5f;
+
+    // Grow to include every point
+    for(uint32_t i = 0; i < vertex_count; ++i) {
+        const float *p = MESHLET_POS(i);
+        const float d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+        const float dist = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+        if(dist > radius) {
+            const float new_radius = (radius + dist) * 0.5f;
+            const float k = (new_radius - radius) / dist;
+            for(int c = 0; c < 3; ++c) {
+                center[c] += d[c] * k;
+            }
+            radius = new_radius;
+        }
+    }
+
+    #undef MESHLET_POS
+
+    memcpy(out_center, center, sizeof(center));
+    *out_radius = radius;
+}
+
+// Face normal from the winding, flipped to agree with the vertex normals so the exporter's winding convention doesn't matter
+static inline bool meshlet_triangle_normal(const float *verts, const uint32_t *tri, float *out_normal)
+{
+    const float *p0 = &verts[(size_t)tri[0] * MESH_VERT_ELEM_COUNT];
+    const float *p1 = &verts[(size_t)tri[1] * MESH_VERT_ELEM_COUNT];
+    const float *p2 = &verts[(size_t)tri[2] * MESH_VERT_ELEM_COUNT];
+
+    const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    float n[3] = {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0]
+    };
+
+    const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(length == 0.0f) {
+        return false;
+    }
+
+    float facing = 0.0f;
+    for(int c = 0; c < 3; ++c) {
+        facing += n[c] * (p0[3 + c] + p1[3 + c] + p2[3 + c]);
+    }
+
+    const float scale = (facing < 0.0f ? -1.0f : 1.0f) / length;
+    for(int c = 0; c < 3; ++c) {
+        out_normal[c] = n[c] * scale;
+    }
+
+    return true;
+}
+
+static inline void meshlet_compute_cone(const float *verts, const uint32_t *indices, struct Mesh_File_Meshlet *meshlet)
+{
+    const uint32_t *tris = &indices[meshlet->first_index];
+
+    // Axis is the average normal, the cone half-angle comes from the normal furthest away from it
+    float axis[3] = {0};
+    for(uint32_t t = 0; t < meshlet->triangle_count; ++t) {
+        float n[3];
+        if(meshlet_triangle_normal(verts, &tris[t * 3], n)) {
+            axis[0] += n[0];
+            axis[1] += n[1];
+            axis[2] += n[2];
+        }
+    }
+
+    const float axis_length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+    // NOTE: Cones are only used when every triangle is at least a bit in front of the plane of the axis
+    memcpy(meshlet->cone_apex, meshlet->center, sizeof(meshlet->cone_apex));
+    meshlet->cone_axis[0] = 0.0f;
+    meshlet->cone_axis[1] = 0.0f;
+    meshlet->cone_axis[2] = 0.0f;
+    meshlet->cone_cutoff = 2.0f;
+
+    if(axis_length == 0.0f) {
+        return;
+    }
+
+    for(int c = 0; c < 3; ++c) {
+        axis[c] /= axis_length;
+    }
+
+    float min_dot = 1.0f;
+    for(uint32_t t = 0; t < meshlet->triangle_count; ++t) {
+        float n[3];
+        if(meshlet_triangle_normal(verts, &tris[t * 3], n)) {
+            min_dot = fminf(min_dot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+        }
+    }
+
+    if(min_dot <= 0.1f) {
+        return;
+    }
+
+    // Move the apex back along the axis until it's behind every triangle's plane,
+    // so the test is conservative for cameras close to the cluster too
+    float max_t = 0.0f;
+    for(uint32_t t = 0; t < meshlet->triangle_count; ++t) {
+        float n[3];
+        if(!meshlet_triangle_normal(verts, &tris[t * 3], n)) {
+            continue;
+        }
+
+        const float *p0 = &verts[(size_t)tris[t * 3] * MESH_VERT_ELEM_COUNT];
+        const float dc = (meshlet->center[0] - p0[0]) * n[0] + (meshlet->center[1] - p0[1]) * n[1] + (meshlet->center[2] - p0[2]) * n[2];
+        const float dn = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+
+        max_t = fmaxf(max_t, dc / dn);
+    }
+
+    for(int c = 0; c < 3; ++c) {
+        meshlet->cone_apex[c] = meshlet->center[c] - axis[c] * max_t;
+        meshlet->cone_axis[c] = axis[c];
+    }
+
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+struct Meshlet_Builder {
+    const struct Mesh_Data *mesh;
+    struct Vertex_Adjacency adj;
+
+    bool *tri_used;
+    bool *vert_in_meshlet;
+
+    uint32_t *out_indices;
+    uint32_t out_tri_count;
+
+    struct Mesh_File_Meshlet *meshlets;
+    uint32_t meshlet_count;
+};
+
+// Builds the meshlets for triangles [first_tri, end_tri), which need to be the next ones in the output order
+static inline void meshlets_build_range(struct Meshlet_Builder *b, uint32_t first_tri, uint32_t end_tri)
+{
+    const struct Mesh_Data *mesh = b->mesh;
+
+    // Triangles outside of the range count as used, so meshlets never cross LODs
+    memset(&b->tri_used[first_tri], 0, (size_t)(end_tri - first_tri) * sizeof(bool));
+
+    uint32_t meshlet_verts[MESHLET_MAX_VERTS];
+    uint32_t cursor = first_tri;
+
+    while(b->out_tri_count < end_tri) {
+        struct Mesh_File_Meshlet meshlet = { .first_index = b->out_tri_count * 3 };
+        uint32_t vertex_count = 0;
+
+        while(cursor < end_tri && b->tri_used[cursor]) {
+            cursor++;
+        }
+
+        uint32_t next_tri = cursor;
+
+        while(next_tri != UINT32_MAX) {
+            // Add the triangle
+            const uint32_t *tri = &mesh->indices[next_tri * 3];
+            for(int k = 0; k < 3; ++k) {
+                if(!b->vert_in_meshlet[tri[k]]) {
+                    b->vert_in_meshlet[tri[k]] = true;
+                    meshlet_verts[vertex_count++] = tri[k];
+                }
+                b->out_indices[b->out_tri_count * 3 + k] = tri[k];
+            }
+
+            b->tri_used[next_tri] = true;
+            b->out_tri_count++;
+            meshlet.triangle_count++;
+
+            if(meshlet.triangle_count == MESHLET_MAX_TRIS) {
+                break;
+            }
+
+            // Find the neighbouring triangle that adds the fewest new vertices
+            next_tri = UINT32_MAX;
+            uint32_t best_new_verts = 3;
+
+            for(uint32_t i = 0; i < vertex_count && best_new_verts > 0; ++i) {
+                const uint32_t v = meshlet_verts[i];
+                for(uint32_t a = b->adj.offsets[v]; a < b->adj.offsets[v + 1]; ++a) {
+                    const uint32_t t = b->adj.triangles[a];
+                    if(b->tri_used[t]) {
+                        continue;
+                    }
+
+                    const uint32_t *candidate = &mesh->indices[t * 3];
+                    const uint32_t new_verts = !b->vert_in_meshlet[candidate[0]] + !b->vert_in_meshlet[candidate[1]] + !b->vert_in_meshlet[candidate[2]];
+
+                    if(vertex_count + new_verts <= MESHLET_MAX_VERTS && (new_verts < best_new_verts || (new_verts == best_new_verts && t < next_tri))) {
+                        best_new_verts = new_verts;
+                        next_tri = t;
+                    }
+                }
+            }
+
+            // With no connected triangle left, continue with the next one in index order so disconnected pieces
+            // (like the faces of a hard-edged cube) still fill up meshlets instead of becoming tiny draws
+            if(next_tri == UINT32_MAX) {
+                while(cursor < end_tri && b->tri_used[cursor]) {
+                    cursor++;
+                }
+
+                if(cursor < end_tri) {
+                    const uint32_t *candidate = &mesh->indices[cursor * 3];
+                    const uint32_t new_verts = !b->vert_in_meshlet[candidate[0]] + !b->vert_in_meshlet[candidate[1]] + !b->vert_in_meshlet[candidate[2]];
+                    if(vertex_count + new_verts <= MESHLET_MAX_VERTS) {
+                        next_tri = cursor;
+                    }
+                }
+            }
+        }
+
+        meshlet.vertex_count = vertex_count;
+        meshlet_compute_sphere(mesh->verts, meshlet_verts, vertex_count, meshlet.center, &meshlet.radius);
+
+        for(uint32_t i = 0; i < vertex_count; ++i) {
+            b->vert_in_meshlet[meshlet_verts[i]] = false;
+        }
+
+        b->meshlets[b->meshlet_count++] = meshlet;
+    }
+}
+
+// Rewrites mesh->indices in meshlet order and fills in mesh->meshlets (and the meshlet ranges of mesh->lods)
+static inline void meshlets_build(struct Mesh_Data *mesh)
+{
+    const uint32_t tri_count = mesh->index_count / 3;
+
+    struct Meshlet_Builder b = {
+        .mesh = mesh,
+        .adj = adjacency_build(mesh->indices, mesh->index_count, mesh->vert_count),
+        .tri_used = xmalloc((size_t)tri_count * sizeof(bool)),
+        .vert_in_meshlet = xmalloc((size_t)mesh->vert_count * sizeof(bool)),
+        .out_indices = xmalloc((size_t)mesh->index_count * sizeof(uint32_t)),
+        // Every meshlet has at least 1 triangle, trimmed down at the end
+        .meshlets = xmalloc((size_t)(tri_count ? tri_count : 1) * sizeof(struct Mesh_File_Meshlet))
+    };
+
+    memset(b.tri_used, 1, (size_t)tri_count * sizeof(bool));
+    memset(b.vert_in_meshlet, 0, (size_t)mesh->vert_count * sizeof(bool));
+
+    if(mesh->lods) {
+        for(uint32_t i = 0; i < mesh->lod_count; ++i) {
+            struct Mesh_File_Lod *lod = &mesh->lods[i];
+
+            lod->first_meshlet = b.meshlet_count;
+            meshlets_build_range(&b, lod->first_index / 3, (lod->first_index + lod->index_count) / 3);
+            lod->meshlet_count = b.meshlet_count - lod->first_meshlet;
+        }
+    }
+    else {
+        meshlets_build_range(&b, 0, tri_count);
+    }
+
+    free(mesh->indices);
+    mesh->indices = b.out_indices;
+
+    for(uint32_t i = 0; i < b.meshlet_count; ++i) {
+        meshlet_compute_cone(mesh->verts, mesh->indices, &b.meshlets[i]);
+    }
+
+    free(mesh->meshlets);
+    mesh->meshlets = realloc(b.meshlets, (size_t)(b.meshlet_count ? b.meshlet_count : 1) * sizeof(struct Mesh_File_Meshlet));
+    mesh->meshlet_count = b.meshlet_count;
+
+    free(b.vert_in_meshlet);
+    free(b.tri_used);
+    adjacency_free(&b.adj);
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * .ktex texture files, with every mip level already encoded in the format the GPU samples from,
+ * so loading is just copying the levels into the staging buffer (like a stripped down KTX2/DDS).
+ *
+ * --- Data Format ---
+ * HEADER: Texture_File_Header
+ * LEVELS: Texture_File_Level[MIP_COUNT], right after the header
+ * DATA:   The mip levels from largest to smallest, tightly packed, starting at a multiple of TEXTURE_FILE_ALIGNMENT
+ *
+ * All offsets are from the start of the file.
+ * Levels are rows of pixels (RGBA8) or 4x4 blocks (BC*), tightly packed, top to bottom.
+ * Level sizes are always a multiple of the pixel/block size, so every level stays aligned enough to be copied to the image
+ * and the whole chain can go into the staging buffer with a single copy.
+ * Levels smaller than a block still take up a whole block, same as Vulkan expects.
+ * TEXTURE_FILE_FLAG_SRGB means the color channels are sRGB encoded, it's never set for BC5.
+ *
+ * Texture files are build outputs, so there is no backwards compatibility, older files just need to be rebuilt.
+ */
+#ifndef KNZ_TEXTURE_FILE_H
+#define KNZ_TEXTURE_FILE_H
+
+#include "common.h"
+
+#define TEXTURE_FILE_MAGIC 0x545A4E4Bu // "KNZT" read as a little-endian u32
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_FILE_ALIGNMENT 16
+#define TEXTURE_FILE_MAX_MIPS 16
+
+#define TEXTURE_FILE_FLAG_SRGB (1u << 0)
+
+enum Texture_File_Format {
+    TEXTURE_FILE_FORMAT_RGBA8,
+    TEXTURE_FILE_FORMAT_BC1, // RGB + 1 bit alpha, 8 bytes per block
+    TEXTURE_FILE_FORMAT_BC3, // RGBA, 16 bytes per block
+    TEXTURE_FILE_FORMAT_BC5, // Two independent channels (RG), 16 bytes per block, for normal maps
+    TEXTURE_FILE_FORMAT_BC7, // RGBA, 16 bytes per block, higher quality than BC3
+    TEXTURE_FILE_FORMAT_COUNT
+};
+
+struct Texture_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format; // Texture_File_Format
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    uint32_t padding;
+};
+
+struct Texture_File_Level {
+    uint64_t offset;
+    uint64_t size;
+};
+
+static inline bool texture_format_is_block_compressed(uint32_t format)
+{
+    return format != TEXTURE_FILE_FORMAT_RGBA8;
+}
+
+// Bytes per pixel for RGBA8, per 4x4 block otherwise
+static inline uint32_t texture_format_unit_size(uint32_t format)
+{
+    switch(format) {
+    case TEXTURE_FILE_FORMAT_RGBA8: return 4;
+    case TEXTURE_FILE_FORMAT_BC1:   return 8;
+    default:                        return 16;
+    }
+}
+
+static inline uint32_t texture_level_dim(uint32_t dim, uint32_t level)
+{
+    const uint32_t level_dim = dim >> level;
+    return level_dim ? level_dim : 1;
+}
+
+static inline uint64_t texture_level_size(uint32_t format, uint32_t width, uint32_t height, uint32_t level)
+{
+    uint64_t w = texture_level_dim(width, level);
+    uint64_t h = texture_level_dim(height, level);
+
+    if(texture_format_is_block_compressed(format)) {
+        w = (w + 3) / 4;
+        h = (h + 3) / 4;
+    }
+
+    return w * h * texture_format_unit_size(format);
+}
+
+static inline uint32_t texture_full_mip_count(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    while(((width | height) >> levels) && levels < TEXTURE_FILE_MAX_MIPS) {
+        ++levels;
+    }
+
+    return levels;
+}
+
+// Checks that the header and every level lie within the data, returns the level table
+static inline const struct Texture_File_Level *texture_file_validate(const char *data, size_t size)
+{
+    const struct Texture_File_Header *header = (const struct Texture_File_Header *)data;
+
+    if(size < sizeof(*header) ||
+       header->magic != TEXTURE_FILE_MAGIC ||
+       header->version != TEXTURE_FILE_VERSION ||
+       header->format >= TEXTURE_FILE_FORMAT_COUNT ||
+       header->mip_count == 0 || header->mip_count > TEXTURE_FILE_MAX_MIPS ||
+       sizeof(*header) + (uint64_t)header->mip_count * sizeof(struct Texture_File_Level) > size
+    ) {
+        return NULL;
+    }
+
+    const struct Texture_File_Level *levels = (const struct Texture_File_Level *)(data + sizeof(*header));
+
+    for(uint32_t i = 0; i < header->mip_count; ++i) {
+        const uint64_t expected_offset = i == 0 ? levels[0].offset : levels[i - 1].offset + levels[i - 1].size;
+
+        if(levels[i].size != texture_level_size(header->format, header->width, header->height, i) ||
+           levels[i].offset != expected_offset ||
+           (i == 0 && levels[0].offset % TEXTURE_FILE_ALIGNMENT != 0) ||
+           levels[i].offset + levels[i].size > size
+        ) {
+            return NULL;
+        }
+    }
+
+    return levels;
+}
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * Vertex hashing and comparison kernels for the welding hash tables, in scalar, SSE2 and AVX2 versions.
+ * The best one the CPU supports is picked at runtime with CPUID, so the tools don't need to be built for a specific CPU.
+ *
+ * All kernels give bit-identical results, only the speed differs:
+ * - hash:        32-bit hash of all 8 floats of a vertex (-0.0f hashes the same as 0.0f, since they compare equal)
+ * - equal:       Exact comparison of all 8 floats, same as == on each of them
+ * - match_group: Compares a tag against a probe group of VERTEX_KERNELS_GROUP_SIZE tags,
+ *                returns a bitmask of the matches (from movemask) to walk with vertex_kernels_next_match
+ *
+ * The hash is a multilinear hash: every 32-bit word is multiplied by its own 32-bit key into 64 bits,
+ * the products are summed and the sum is finalized with MurmurHash3's fmix64. Unlike the chained hash
+ * knz_meshcook used before, the words don't depend on each other, so SIMD can do them all at once.
+ *
+ * NOTE: Vertices are loaded unaligned everywhere, vertex data in a .bin file or a scratch buffer is only 4 byte aligned
+ *       (the AVX path in test_vertex_deduplicate.c uses aligned loads, which only works there because of its own allocator).
+ */
+#ifndef KNZ_VERTEX_KERNELS_H
+#define KNZ_VERTEX_KERNELS_H
+
+#include "common.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define VERTEX_KERNELS_X86 1
+    #include <immintrin.h>
+
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define VERTEX_KERNELS_TARGET_AVX2
+    #else
+        #include <cpuid.h>
+        #define VERTEX_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#else
+    #define VERTEX_KERNELS_X86 0
+#endif
+
+#define VERTEX_KERNELS_VERT_ELEM_COUNT 8
+#define VERTEX_KERNELS_GROUP_SIZE 32    // Tags per probe group, one AVX2 compare or two SSE2 ones
+#define VERTEX_KERNELS_TAG_EMPTY 0x80   // Tags are 7 bits, so this never matches one
+
+enum Vertex_Kernels_Level {
+    VERTEX_KERNELS_SCALAR,
+    VERTEX_KERNELS_SSE2,
+    VERTEX_KERNELS_AVX2,
+    VERTEX_KERNELS_LEVEL_COUNT
+};
+
+struct Vertex_Kernels {
+    const char *name;
+    uint32_t (*hash)(const float *vert);
+    bool (*equal)(const float *a, const float *b);
+    uint32_t (*match_group)(const uint8_t *tags, uint8_t tag);
+};
+
+// Multilinear hash keys, random odd 32-bit values
+static const uint32_t s_vertex_kernels_hash_keys[VERTEX_KERNELS_VERT_ELEM_COUNT] = {
+    0x9e3779b1u, 0x85ebca77u, 0xc2b2ae3du, 0x27d4eb2fu,
+    0x165667b1u, 0xd3a2646du, 0xfd7046c5u, 0xb55a4f09u
+};
+
+static inline uint32_t vertex_kernels_finalize(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return (uint32_t)h;
+}
+
+// The top 7 bits of the hash, the low bits pick the group
+static inline uint8_t vertex_kernels_tag(uint32_t hash)
+{
+    return (uint8_t)(hash >> 25);
+}
+
+// Returns the index of the lowest match and clears it from the mask, which must not be 0
+static inline uint32_t vertex_kernels_next_match(uint32_t *mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, *mask);
+#else
+    const uint32_t index = (uint32_t)__builtin_ctz(*mask);
+#endif
+
+    *mask &= *mask - 1;
+    return (uint32_t)index;
+}
+
+/* Scalar */
+static uint32_t vertex_kernels_hash_scalar(const float *vert)
+{
+    uint64_t h = 0;
+
+    for(int i = 0; i < VERTEX_KERNELS_VERT_ELEM_COUNT; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &vert[i], sizeof(bits));
+
+        if(bits == 0x80000000u) {
+            bits = 0;
+        }
+
+        h += (uint64_t)bits * s_vertex_kernels_hash_keys[i];
+    }
+
+    return vertex_kernels_finalize(h);
+}
+
+static bool vertex_kernels_equal_scalar(const float *a, const float *b)
+{
+    return (
+        a[0] == b[0] &&
+        a[1] == b[1] &&
+        a[2] == b[2] &&
+        a[3] == b[3] &&
+        a[4] == b[4] &&
+        a[5] == b[5] &&
+        a[6] == b[6] &&
+        a[7] == b[7]
+    );
+}
+
+static uint32_t vertex_kernels_match_group_scalar(const uint8_t *tags, uint8_t tag)
+{
+    uint32_t mask = 0;
+
+    for(uint32_t i = 0; i < VERTEX_KERNELS_GROUP_SIZE; ++i) {
+        mask |= (uint32_t)(tags[i] == tag) << i;
+    }
+
+    return mask;
+}
+
+#if VERTEX_KERNELS_X86
+/* SSE2 */
+// Zeroes the words that are exactly -0.0f
+static inline __m128i vertex_kernels_fix_negative_zero_sse2(__m128i words)
+{
+    const __m128i negative_zero = _mm_set1_epi32((int32_t)0x80000000u);
+    return _mm_andnot_si128(_mm_cmpeq_epi32(words, negative_zero), words);
+}
+
+static uint32_t vertex_kernels_hash_sse2(const float *vert)
+{
+    const __m128i keys_lo = _mm_loadu_si128((const __m128i *)&s_vertex_kernels_hash_keys[0]);
+    const __m128i keys_hi = _mm_loadu_si128((const __m128i *)&s_vertex_kernels_hash_keys[4]);
+
+    const __m128i lo = vertex_kernels_fix_negative_zero_sse2(_mm_loadu_si128((const __m128i *)&vert[0]));
+    const __m128i hi = vertex_kernels_fix_negative_zero_sse2(_mm_loadu_si128((const __m128i *)&vert[4]));
+
+    // _mm_mul_epu32 only multiplies the even words, so the odd ones are shifted down for a second multiply
+    __m128i sum = _mm_mul_epu32(lo, keys_lo);
+    sum = _mm_add_epi64(sum, _mm_mul_epu32(_mm_srli_epi64(lo, 32), _mm_srli_epi64(keys_lo, 32)));
+    sum = _mm_add_epi64(sum, _mm_mul_epu32(hi, keys_hi));
+    sum = _mm_add_epi64(sum, _mm_mul_epu32(_mm_srli_epi64(hi, 32), _mm_srli_epi64(keys_hi, 32)));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+    uint64_t h;
+    _mm_storel_epi64((__m128i *)&h, sum);
+
+    return vertex_kernels_finalize(h);
+}
+
+static bool vertex_kernels_equal_sse2(const float *a, const float *b)
+{
+    const __m128 lo = _mm_cmpeq_ps(_mm_loadu_ps(&a[0]), _mm_loadu_ps(&b[0]));
+    const __m128 hi = _mm_cmpeq_ps(_mm_loadu_ps(&a[4]), _mm_loadu_ps(&b[4]));
+
+    return _mm_movemask_ps(_mm_and_ps(lo, hi)) == 0xF;
+}
+
+static uint32_t vertex_kernels_match_group_sse2(const uint8_t *tags, uint8_t tag)
+{
+    const __m128i needle = _mm_set1_epi8((char)tag);
+
+    const uint32_t lo = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&tags[0]), needle));
+    const uint32_t hi = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&tags[16]), needle));
+
+    return lo | (hi << 16);
+}
+
+/* AVX2 */
+VERTEX_KERNELS_TARGET_AVX2 static uint32_t vertex_kernels_hash_avx2(const float *vert)
+{
+    const __m256i keys = _mm256_loadu_si256((const __m256i *)s_vertex_kernels_hash_keys);
+    const __m256i negative_zero = _mm256_set1_epi32((int32_t)0x80000000u);
+
+    __m256i words = _mm256_loadu_si256((const __m256i *)vert);
+    words = _mm256_andnot_si256(_mm256_cmpeq_epi32(words, negative_zero), words);
+
+    __m256i sum = _mm256_mul_epu32(words, keys);
+    sum = _mm256_add_epi64(sum, _mm256_mul_epu32(_mm256_srli_epi64(words, 32), _mm256_srli_epi64(keys, 32)));
+
+    __m128i sum_128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum_128 = _mm_add_epi64(sum_128, _mm_unpackhi_epi64(sum_128, sum_128));
+
+    uint64_t h;
+    _mm_storel_epi64((__m128i *)&h, sum_128);
+
+    return vertex_kernels_finalize(h);
+}
+
+VERTEX_KERNELS_TARGET_AVX2 static bool vertex_kernels_equal_avx2(const float *a, const float *b)
+{
+    const __m256 mask = _mm256_cmp_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b), _CMP_EQ_OQ);
+
+    return _mm256_movemask_ps(mask) == 0xFF;
+}
+
+VERTEX_KERNELS_TARGET_AVX2 static uint32_t vertex_kernels_match_group_avx2(const uint8_t *tags, uint8_t tag)
+{
+    const __m256i needle = _mm256_set1_epi8((char)tag);
+
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)tags), needle));
+}
+
+/* CPU detection */
+static inline void vertex_kernels_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+    int out[4];
+    __cpuidex(out, (int)leaf, (int)subleaf);
+    for(int i = 0; i < 4; ++i) {
+        regs[i] = (uint32_t)out[i];
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// NOTE: The CPU supporting AVX isn't enough, the OS also has to save the YMM registers (XCR0 bits 1 and 2)
+static inline bool vertex_kernels_cpu_has_avx2(void)
+{
+    uint32_t regs[4];
+    vertex_kernels_cpuid(0, 0, regs);
+    if(regs[0] < 7) {
+        return false;
+    }
+
+    vertex_kernels_cpuid(1, 0, regs);
+    const bool osxsave = regs[2] & (1u << 27);
+    const bool avx = regs[2] & (1u << 28);
+    if(!osxsave || !avx) {
+        return false;
+    }
+
+#ifdef _MSC_VER
+    const uint64_t xcr0 = _xgetbv(0);
+#else
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    const uint64_t xcr0 = ((uint64_t)xcr0_hi << 32) | xcr0_lo;
+#endif
+    if((xcr0 & 0x6) != 0x6) {
+        return false;
+    }
+
+    vertex_kernels_cpuid(7, 0, regs);
+    return regs[1] & (1u << 5);
+}
+#endif
+
+static const struct Vertex_Kernels s_vertex_kernels[VERTEX_KERNELS_LEVEL_COUNT] = {
+    [VERTEX_KERNELS_SCALAR] = { "scalar", vertex_kernels_hash_scalar, vertex_kernels_equal_scalar, vertex_kernels_match_group_scalar },
+#if VERTEX_KERNELS_X86
+    [VERTEX_KERNELS_SSE2]   = { "sse2", vertex_kernels_hash_sse2, vertex_kernels_equal_sse2, vertex_kernels_match_group_sse2 },
+    [VERTEX_KERNELS_AVX2]   = { "avx2", vertex_kernels_hash_avx2, vertex_kernels_equal_avx2, vertex_kernels_match_group_avx2 },
+#endif
+};
+
+// SSE2 is part of x86-64, so only AVX2 has to be checked for (32-bit x86 is assumed to have SSE2 as well)
+static inline bool vertex_kernels_supported(enum Vertex_Kernels_Level level)
+{
+    switch(level) {
+    case VERTEX_KERNELS_SCALAR:
+        return true;
+#if VERTEX_KERNELS_X86
+    case VERTEX_KERNELS_SSE2:
+        return true;
+    case VERTEX_KERNELS_AVX2:
+        return vertex_kernels_cpu_has_avx2();
+#endif
+    default:
+        return false;
+    }
+}
+
+static inline const struct Vertex_Kernels *vertex_kernels_get(enum Vertex_Kernels_Level level)
+{
+    return vertex_kernels_supported(level) ? &s_vertex_kernels[level] : NULL;
+}
+
+// The fastest kernels the CPU supports
+static inline const struct Vertex_Kernels *vertex_kernels_best(void)
+{
+    for(int level = VERTEX_KERNELS_LEVEL_COUNT - 1; level > VERTEX_KERNELS_SCALAR; --level) {
+        if(vertex_kernels_supported((enum Vertex_Kernels_Level)level)) {
+            return &s_vertex_kernels[level];
+        }
+    }
+
+    return &s_vertex_kernels[VERTEX_KERNELS_SCALAR];
+}
+
+// Returns NULL if there are no kernels with that name, or the CPU doesn't support them
+static inline const struct Vertex_Kernels *vertex_kernels_find(const char *name)
+{
+    for(int level = 0; level < VERTEX_KERNELS_LEVEL_COUNT; ++level) {
+        if(s_vertex_kernels[level].name && 0 == strcmp(s_vertex_kernels[level].name, name)) {
+            return vertex_kernels_get((enum Vertex_Kernels_Level)level);
+        }
+    }
+
+    return NULL;
+}
+
+#endif
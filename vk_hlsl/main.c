@@ -76,11 +76,21 @@ struct VK_Staging_Queue {
     uint32_t entries_top;
 };
 
+/* Mesh File Notes:
+ *
+ * See tools/mesh_file.h for the format, only version 1 files are read here (vk_scene reads the rest).
+ * Files that don't start with MESH_FILE_MAGIC are from before the header was versioned,
+ * those only have the two counts as a header and always use 16-bit indices.
+ */
+#define MESH_FILE_FORMAT_ONLY
+#include "../tools/mesh_file.h"
+
 struct Mesh {
     struct VK_Buffer vert_buf;
     struct VK_Buffer index_buf;
     uint32_t vert_count;
     uint32_t index_count;
+    VkIndexType index_type;
 };
 
 struct VK {
@@ -1305,23 +1315,35 @@ static struct Mesh upload_mesh_from_raw_data(struct VK *vk, const char *mesh_dat
     const size_t vert_buffer_stride_bytes = vert_buffer_stride * sizeof(float);
 
     const char *p = mesh_data;
-    uint32_t vert_count = *(uint32_t *)p;
-    p += sizeof(vert_count);
 
-    uint32_t index_count = *(uint32_t *)p;
-    p += sizeof(index_count);
+    struct Mesh_File_Header header = {0};
+    if(*(uint32_t *)p == MESH_FILE_MAGIC) {
+        memcpy(&header, p, sizeof(header));
+        CHECK(header.version < MESH_FILE_VERSION_QUANTIZED, "Mesh file is from a newer version of the exporter");
+        CHECK(header.header_size >= sizeof(header), "Mesh file header is too small");
+        p += header.header_size;
+    }
+    else {
+        // Legacy header
+        header.vert_count = ((uint32_t *)p)[0];
+        header.index_count = ((uint32_t *)p)[1];
+        p += 2 * sizeof(uint32_t);
+    }
+
+    const bool index_32 = header.flags & MESH_FILE_FLAG_INDEX_32;
 
-    const size_t vert_buffer_size = vert_count * vert_buffer_stride_bytes;
-    const size_t index_buffer_size = index_count * sizeof(uint16_t);
+    const size_t vert_buffer_size = header.vert_count * vert_buffer_stride_bytes;
+    const size_t index_buffer_size = header.index_count * (index_32 ? sizeof(uint32_t) : sizeof(uint16_t));
 
     const float *vert_buffer_data = (float *)p;
     p += vert_buffer_size;
 
-    const uint16_t *index_buffer_data = (uint16_t *)p;
+    const void *index_buffer_data = p;
 
     struct Mesh mesh = {
-        .vert_count = vert_count,
-        .index_count = index_count
+        .vert_count = header.vert_count,
+        .index_count = header.index_count,
+        .index_type = index_32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16
     };
 
     mesh.vert_buf = vk_create_and_upload_buffer(vk, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vert_buffer_data, vert_buffer_size);
@@ -1464,7 +1486,7 @@ static void render(struct Render_State *r, struct VK *vk)
         VkBuffer buffers[] = { mesh->vert_buf.handle };
 		VkDeviceSize offsets[] = { 0 };
 		vkCmdBindVertexBuffers(cmdbuf, 0, countof(buffers), buffers, offsets);
-        vkCmdBindIndexBuffer(cmdbuf, mesh->index_buf.handle, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdBindIndexBuffer(cmdbuf, mesh->index_buf.handle, 0, mesh->index_type);
 
 		if(r->unlit_shader) {
 			vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->flat_pipeline);
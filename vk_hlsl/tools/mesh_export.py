@@ -6,10 +6,21 @@ Mesh is triangulated. Hard edges are preserved.
 Coordinates are mesh-local, converted to Y-up.
 
 --- Data Format ---
+MAGIC:         char[4] "KNZM"
+VERSION:       u32
+HEADER_SIZE:   u32 (offset of VERTEX_BUFFER, newer versions may append header fields)
+FLAGS:         u32 (bit 0: INDEX_BUFFER is u32 instead of u16,
+                    bit 1: quantized vertices, only written by tools/knz_meshquant, see tools/mesh_file.h,
+                    bit 2: meshlets from tools/knz_meshlets, bit 3: LODs from tools/knz_meshlod, both appended after INDEX_BUFFER,
+                    bit 4: compressed buffers from tools/knz_meshcompress, see tools/mesh_codec.h)
 VERTEX_COUNT:  u32
 INDEX_COUNT:   u32
 VERTEX_BUFFER: float[VERTEX_COUNT][8]
-INDEX_BUFFER:  u16[INDEX_COUNT]
+INDEX_BUFFER:  u16[INDEX_COUNT] or u32[INDEX_COUNT]
+
+16-bit indices are used whenever the mesh has few enough vertices.
+Files without the magic are from before the header was versioned,
+those start directly with VERTEX_COUNT and always have 16-bit indices.
 
 --- Vertex Buffer Format ---
 pos.x pos.y pos.z  norm.x norm.y norm.z  uv.x uv.y
@@ -28,6 +39,11 @@ import bmesh
 import mathutils
 
 
+MESH_FILE_MAGIC = b'KNZM'
+MESH_FILE_VERSION = 1
+MESH_FILE_FLAG_INDEX_32 = 1 << 0
+MESH_FILE_HEADER_FORMAT = '<4sIIIII'
+
 def extract_vert_index_buffers(mesh_ob):
     depsgraph = bpy.context.evaluated_depsgraph_get()
     scene = bpy.context.scene
@@ -104,11 +120,13 @@ def print_buffers(vertex_buffer, index_buffer):
 def write_data(path, vertex_buffer, index_buffer):
     f = open(path, 'wb')
 
-    # NOTE: The index buffer is 16-bit
-    assert(len(vertex_buffer) < 65536)
+    # NOTE: Only switch to 32-bit indices when needed, to save on memory and bandwidth
+    index_32 = len(vertex_buffer) > 65536
     
     # Header
-    f.write(struct.pack('II', len(vertex_buffer), len(index_buffer)))
+    flags = MESH_FILE_FLAG_INDEX_32 if index_32 else 0
+    header_size = struct.calcsize(MESH_FILE_HEADER_FORMAT)
+    f.write(struct.pack(MESH_FILE_HEADER_FORMAT, MESH_FILE_MAGIC, MESH_FILE_VERSION, header_size, flags, len(vertex_buffer), len(index_buffer)))
     
     # Vertex buffer
     for vert in vertex_buffer:
@@ -116,8 +134,9 @@ def write_data(path, vertex_buffer, index_buffer):
         f.write(struct.pack('fff fff ff', pos[0], pos[1], pos[2], normal[0], normal[1], normal[2], uv[0], uv[1]))
     
     # Index buffer
+    index_format = 'I' if index_32 else 'H'
     for idx in index_buffer:
-        f.write(struct.pack('H', idx))
+        f.write(struct.pack(index_format, idx))
     
     f.close()
 
@@ -77,11 +77,21 @@ struct VK_Staging_Queue {
     uint32_t entries_top;
 };
 
+/* Mesh File Notes:
+ *
+ * See tools/mesh_file.h for the format, only version 1 files are read here (vk_scene reads the rest).
+ * Files that don't start with MESH_FILE_MAGIC are from before the header was versioned,
+ * those only have the two counts as a header and always use 16-bit indices.
+ */
+#define MESH_FILE_FORMAT_ONLY
+#include "../tools/mesh_file.h"
+
 struct Mesh {
     struct VK_Buffer vert_buf;
     struct VK_Buffer index_buf;
     uint32_t vert_count;
     uint32_t index_count;
+    VkIndexType index_type;
 };
 
 struct VK {
@@ -126,6 +136,7 @@ struct VK {
 
 	struct VK_Mem_Arena scratch_mem; // TODO CLEANUP: Rename this to arena_scratch_mem
 	struct VK_Mem_Arena gpu_mem;
+    void *scratch_mem_mapping; // Mapped once for as long as it lives, instead of on every update
 
 	struct VK_Buffer_Arena staging_buffer;
     struct VK_Staging_Queue staging_queue;
@@ -440,10 +451,8 @@ static struct VK_Buffer vk_create_and_upload_buffer(struct VK *vk, VkBufferUsage
 	const uint64_t staging_buffer_offset = vk_buffer_arena_push(vk, &vk->staging_buffer, mem_req);
 	
 	// TODO: Couple staging buffer and allocation as well, we shouldn't guess that it's in vk->scratch_mem!!
-	void *mapped_mem;
-	VK_CHECK(vkMapMemory(vk->device, vk->scratch_mem.allocation, vk->staging_buffer.buffer.offset + staging_buffer_offset, buffer.size, 0, &mapped_mem));
+	void *mapped_mem = (char *)vk->scratch_mem_mapping + vk->staging_buffer.buffer.offset + staging_buffer_offset;
 	memcpy(mapped_mem, data, size);
-	vkUnmapMemory(vk->device, vk->scratch_mem.allocation);
 
     vk->staging_queue.entries[vk->staging_queue.entries_top].destination_buffer = buffer.handle;
     vk->staging_queue.entries[vk->staging_queue.entries_top].size = buffer.size;
@@ -897,6 +906,8 @@ static void vk_init(struct VK *vk)
         vk->scratch_mem = vk_alloc_mem_arena(vk, vk->mem_host_coherent_idx, GPU_SCRATCH_POOL_SIZE);
         vk->gpu_mem = vk_alloc_mem_arena(vk, vk->mem_gpu_local_idx, GPU_VRAM_POOL_SIZE);
         vk->staging_buffer = vk_alloc_buffer_arena(vk, &vk->scratch_mem, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GPU_STAGING_POOL_SIZE);
+
+        VK_CHECK(vkMapMemory(vk->device, vk->scratch_mem.allocation, 0, VK_WHOLE_SIZE, 0, &vk->scratch_mem_mapping));
     }
 
 	/* swap chain */
@@ -1279,6 +1290,8 @@ static void vk_destroy(struct VK *vk)
 {
     vkDeviceWaitIdle(vk->device);
 
+    vkUnmapMemory(vk->device, vk->scratch_mem.allocation);
+
     for(int i = vk->deletion_queue.entries_top - 1; i >= 0; --i) {
         vk->deletion_queue.entries[i].func(vk->device, vk->deletion_queue.entries[i].handle, NULL);
     }
@@ -1294,10 +1307,7 @@ static void vk_update_buffer(struct VK *vk, struct VK_Buffer buf, void *data, si
 {
     assert(offset + size <= buf.size);
     
-    void *mapped_mem;
-    vkMapMemory(vk->device, vk->scratch_mem.allocation, buf.offset, buf.size, 0, &mapped_mem);
-    memcpy((char *)mapped_mem + offset, data, size);
-    vkUnmapMemory(vk->device, vk->scratch_mem.allocation);
+    memcpy((char *)vk->scratch_mem_mapping + buf.offset + offset, data, size);
 }
 
 static struct Mesh upload_mesh_from_raw_data(struct VK *vk, const char *mesh_data)
@@ -1306,23 +1316,35 @@ static struct Mesh upload_mesh_from_raw_data(struct VK *vk, const char *mesh_dat
     const size_t vert_buffer_stride_bytes = vert_buffer_stride * sizeof(float);
 
     const char *p = mesh_data;
-    uint32_t vert_count = *(uint32_t *)p;
-    p += sizeof(vert_count);
 
-    uint32_t index_count = *(uint32_t *)p;
-    p += sizeof(index_count);
+    struct Mesh_File_Header header = {0};
+    if(*(uint32_t *)p == MESH_FILE_MAGIC) {
+        memcpy(&header, p, sizeof(header));
+        CHECK(header.version < MESH_FILE_VERSION_QUANTIZED, "Mesh file is from a newer version of the exporter");
+        CHECK(header.header_size >= sizeof(header), "Mesh file header is too small");
+        p += header.header_size;
+    }
+    else {
+        // Legacy header
+        header.vert_count = ((uint32_t *)p)[0];
+        header.index_count = ((uint32_t *)p)[1];
+        p += 2 * sizeof(uint32_t);
+    }
+
+    const bool index_32 = header.flags & MESH_FILE_FLAG_INDEX_32;
 
-    const size_t vert_buffer_size = vert_count * vert_buffer_stride_bytes;
-    const size_t index_buffer_size = index_count * sizeof(uint16_t);
+    const size_t vert_buffer_size = header.vert_count * vert_buffer_stride_bytes;
+    const size_t index_buffer_size = header.index_count * (index_32 ? sizeof(uint32_t) : sizeof(uint16_t));
 
     const float *vert_buffer_data = (float *)p;
     p += vert_buffer_size;
 
-    const uint16_t *index_buffer_data = (uint16_t *)p;
+    const void *index_buffer_data = p;
 
     struct Mesh mesh = {
-        .vert_count = vert_count,
-        .index_count = index_count
+        .vert_count = header.vert_count,
+        .index_count = header.index_count,
+        .index_type = index_32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16
     };
 
     mesh.vert_buf = vk_create_and_upload_buffer(vk, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vert_buffer_data, vert_buffer_size);
@@ -1465,7 +1487,7 @@ static void render(struct Render_State *r, struct VK *vk)
         VkBuffer buffers[] = { mesh->vert_buf.handle };
 		VkDeviceSize offsets[] = { 0 };
 		vkCmdBindVertexBuffers(cmdbuf, 0, countof(buffers), buffers, offsets);
-        vkCmdBindIndexBuffer(cmdbuf, mesh->index_buf.handle, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdBindIndexBuffer(cmdbuf, mesh->index_buf.handle, 0, mesh->index_type);
 
 		if(r->unlit_shader) {
 			vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->flat_pipeline);
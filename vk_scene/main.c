@@ -24,56 +24,287 @@
 #include <stdlib.h>
 #include <math.h>
 
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <intrin.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define MIP_GEN_SSE2 1
+#else
+    #define MIP_GEN_SSE2 0
+#endif
+
+#include "../tools/mesh_codec.h"
+
 #define WIDTH 1280
 #define HEIGHT 720
 #define TIMEOUT 1000000000
 
-#define GPU_SCRATCH_POOL_SIZE (64 * 1024 * 1024)
-#define GPU_VRAM_POOL_SIZE    (128 * 1024 * 1024)
-#define GPU_STAGING_POOL_SIZE (16 * 1024 * 1024)
+#define VK_BUFFER_ARENA_ALIGNMENT 128 // A multiple of every vertex and index size, so offsets in buffer arenas can be in elements
 
-#define TEXTURE_DESCRIPTOR_COUNT 32
+// The first block of each memory arena, they grow past this (see Arena Growth Notes)
+#define GPU_SCRATCH_POOL_SIZE (64 * 1024 * 1024)
+#define GPU_VRAM_POOL_SIZE    (64 * 1024 * 1024)
+#define GPU_IMAGE_POOL_SIZE   (64 * 1024 * 1024)
+#define GPU_STAGING_POOL_SIZE (16 * 1024 * 1024) // Per upload partition, see Transfer Queue Notes
+#define GPU_STREAM_STAGING_POOL_SIZE (16 * 1024 * 1024)
+#define GPU_VRAM_MAPPED_POOL_SIZE (64 * 1024 * 1024) // Only on devices where it's used, see Unified Memory Notes
+
+#define VK_MEM_ARENA_MAX_BLOCKS 8
+#define VK_ARENA_GROWTH 2            // New memory blocks and relocated buffer arenas are this many times the size of the last
+#define VK_HEAP_USABLE_PERCENT 75    // Of a heap, how much we let ourselves allocate when there is no VK_EXT_memory_budget
+
+#define TEXTURE_DESCRIPTOR_MAX 16384     // Cap on the texture descriptor array, which is otherwise as big as the device allows
+#define TEXTURE_REGISTRY_MAX_WRITES 256   // Descriptor writes per vkUpdateDescriptorSets call
+#define TEXTURE_MAX_MIPS 16
+#define TEXTURE_IMAGE_FORMAT VK_FORMAT_R8G8B8A8_SRGB // What images loaded with stb_image are uploaded as
+#define TEXTURE_CACHE_DIR "data/cache"
+#define TEXTURE_CACHE_VERSION 1                      // Bump whenever the image import changes, e.g. the mip filter
+
+#define MAX_MESHLETS (64 * 1024)
+#define MAX_INDIRECT_DRAWS (64 * 1024)
+#define MAX_MESH_LODS 8
+
+#define LOD_ERROR_PIXELS 1.0f                   // How far a LOD may move the surface on screen before a finer one is used
+#define LOD_TRIANGLE_BUDGET (1 * 1000 * 1000)   // Triangles per frame before the LOD bias starts going up
+
+#define STREAM_WORKER_COUNT 2
+#define STREAM_MAX_REQUESTS 64                  // Requested but not yet resident, at once
+#define STREAM_BATCH_COUNT 2                    // Upload batches that can be in flight, each gets an equal part of the stream staging pool
+#define STREAM_MAX_BATCH_ITEMS 32
+
+#define TEXTURE_STREAM_TAIL_SIZE 64              // Mips this size and smaller are streamed in first, and always stay resident
+#define TEXTURE_STREAM_BUDGET (32 * 1024 * 1024) // Bytes of streamed textures, past this mips that aren't wanted anymore are evicted
+#define TEXTURE_STREAM_MAX_UPGRADES 4            // Textures getting finer mips at once, the rest wait by priority
+#define TEXTURE_STREAM_UNITS_PER_UV 2.0f         // Roughly how many object space units one repeat of a texture covers
+
+#define FRAMES_IN_FLIGHT 2                      // Frames the CPU can be ahead of the GPU by, see Frames in Flight Notes
+#define FRAME_SPIKE_MS 25.0                     // Frames longer than this are counted as spikes
+#define MEM_REPORT_INTERVAL 3600                // Frames between memory reports
+#define MEM_REPORT_MAX_ARENAS 16
+#define COMPACT_BUDGET_BYTES (4 * 1024 * 1024)  // Geometry moved per frame, see Geometry Compaction Notes
+#define COMPACT_MESHES_PER_FRAME 64             // Meshes looked at per frame, since finding a hole walks the arena
+#define VK_UPLOAD_PARTITIONS 2                  // Staging buffers that take turns, one is filled while the other's upload is copying
+#define VK_MAX_PENDING_ACQUIRES 4096            // Buffer and image ownership transfers each, waiting for a graphics submit to acquire them
 
 #define WITH_LOGGING 1
-
-/* Deletion Queue Notes:
- * 
- * So far, all of Vulkan's destroy calls have the same sort of signature,
- * with a device, handle, and allocator callbacks.
- * All handles on this platform at least are defined to be pointers to opaque structs,
- * so type punning the destroy function with void * is not a problem.
- * This is something that needs to be verified on other platforms as well, at a later date.
+#define WITH_CLUSTER_CULLING 1
+#define WITH_LOD_TRIANGLE_BUDGET 1
+#define WITH_STREAMING 1
+#define WITH_TEXTURE_CACHE 1
+#define WITH_MEMORY_REPORT 1
+#define WITH_UNIFIED_MEMORY 1
+#define WITH_GEOMETRY_COMPACTION 1
+#define WITH_TRANSFER_QUEUE 1
+
+static void panic(const char *message);
+#define RANGE_PANIC(msg_) panic(msg_)
+#include "range_allocator.h"
+
+/* Memory Report Notes:
+ *
+ * Everything pushed to a memory arena is counted under a category, so it's possible to tell what the memory actually goes to
+ * without reading through the push logs. The arenas and buffer arenas are registered by name, and their usage and
+ * high-water mark are reported against their capacity. The high-water marks are what GPU_VRAM_POOL_SIZE and the other pool
+ * sizes should be picked from, so they survive resets (e.g. the staging buffer's after every flush).
+ *
+ * With VK_EXT_memory_budget the heap usage and budget as the driver sees them are in the report too,
+ * which includes other processes and whatever the driver allocates for itself. Without it only the heap sizes are known.
+ *
+ * vk_mem_report_query fills in a Mem_Report, vk_mem_report_print prints one after init, every MEM_REPORT_INTERVAL frames and on M.
  */
-typedef void (*VK_Destroy_Func)(VkDevice device, void *handle, const VkAllocationCallbacks *pAllocator);
+enum Mem_Category {
+    MEM_CATEGORY_GEOMETRY,
+    MEM_CATEGORY_TEXTURES,
+    MEM_CATEGORY_STAGING,
+    MEM_CATEGORY_PER_FRAME,      // Uniforms, instances and draw commands rewritten every frame
+    MEM_CATEGORY_RENDER_TARGETS,
+    MEM_CATEGORY_COUNT
+};
 
-struct VK_Deletion_Entry {
-    VK_Destroy_Func func;
-    void *handle;
+static const char *s_mem_category_names[MEM_CATEGORY_COUNT] = {
+    "geometry",
+    "textures",
+    "staging",
+    "per-frame",
+    "render targets"
 };
 
-struct VK_Deletion_Queue {
-    // TODO: This should chain to another block or use a dynamic allocation
-    struct VK_Deletion_Entry entries[4096];
-    uint32_t entries_top;
+struct Mem_Category_Stats {
+    uint64_t current; // Bytes of memory arenas, as pushed (so including the alignment padding)
+    uint64_t peak;
+    uint32_t allocation_count;
+};
+
+// One of these is set
+struct Mem_Arena_Report {
+    const char *name;
+    const struct VK_Mem_Arena *mem_arena;
+    const struct VK_Buffer_Arena *buffer_arena;
+};
+
+struct Mem_Stats {
+    struct Mem_Category_Stats categories[MEM_CATEGORY_COUNT];
+    struct Mem_Arena_Report arenas[MEM_REPORT_MAX_ARENAS];
+    uint32_t arena_count;
+};
+
+struct Mem_Heap_Report {
+    uint64_t size;
+    uint64_t budget; // Only with VK_EXT_memory_budget, otherwise 0
+    uint64_t usage;  // Same, by every process
+    uint64_t arena_capacity; // Of our memory arenas in this heap
+};
+
+struct Mem_Report {
+    struct Mem_Heap_Report heaps[VK_MAX_MEMORY_HEAPS];
+    uint32_t heap_count;
+    bool has_budget;
+
+    struct Mem_Category_Stats categories[MEM_CATEGORY_COUNT];
+
+    struct {
+        const char *name;
+        const char *category; // Of the buffer arena, "mixed" for memory arenas
+        uint64_t used;
+        uint64_t peak;
+        uint64_t capacity;
+        uint32_t allocation_count;
+        uint32_t block_count; // Only for memory arenas
+        float fragmentation;
+    } arenas[MEM_REPORT_MAX_ARENAS];
+    uint32_t arena_count;
+};
+
+/* Arena Growth Notes:
+ *
+ * Memory arenas start out with one block (VkDeviceMemory) of the size they're created with, and when something doesn't fit
+ * in any of their blocks they add another one, VK_ARENA_GROWTH times as big as the last. Blocks are never given back.
+ * The growth is capped by what's left of the heap's budget (see vk_mem_heap_available), a block is only ever made smaller
+ * than that to still fit the allocation, and if even that doesn't fit we're out of memory.
+ * Host visible arenas can be created mapped, then every block stays mapped and allocations point into the mapping.
+ *
+ * Buffer arenas can't be made of several buffers, since the megabuffers are bound as one buffer in the draws.
+ * Growable ones instead relocate to a bigger buffer with a GPU copy (vk_buffer_arena_grow), which keeps every offset as it was,
+ * so the meshes in them don't need to change. It's a stall (the staging queue is flushed and the copy is waited on),
+ * which is fine for something that happens a handful of times over the whole run. The old buffer is retired, not destroyed,
+ * so frames still on the GPU don't have to be waited for (see Deletion Queue Notes).
+ * The copy is on the graphics queue, after every upload so far, which it acquires first (see Transfer Queue Notes).
+ * Anything that keeps the buffer handle around (descriptors, stream batches) has to pick the new one up, the arena's
+ * generation goes up on every relocation for that.
+ *
+ * An arena holds either buffers or optimally tiled images, never both (images go in gpu_image_mem), so allocations never
+ * have to be padded out to bufferImageGranularity to keep the two from sharing a page.
+ */
+struct VK_Mem_Block {
+    VkDeviceMemory memory;
+    void *mapping; // Only for mapped arenas
+    struct Range_Allocator ranges;
 };
 
 struct VK_Mem_Arena {
-    VkDeviceMemory allocation;
-    size_t top;
-    size_t capacity;
+    int memory_type_idx;
+    bool mapped;
+
+    struct VK_Mem_Block blocks[VK_MEM_ARENA_MAX_BLOCKS];
+    uint32_t block_count;
+    size_t capacity; // Of all of the blocks
+
+    /* Stats */
+    uint64_t used;
+    uint64_t peak_used;
+};
+
+struct VK_Mem_Allocation {
+    VkDeviceMemory memory;
+    uint64_t offset; // In memory
+    void *mapping;   // At offset, only for mapped arenas
+    uint32_t block;
+    uint32_t range;
 };
 
 struct VK_Buffer {
     VkBuffer handle;
-    size_t offset;
     size_t size;
     struct VK_Mem_Arena *arena;
+    struct VK_Mem_Allocation allocation;
+    enum Mem_Category category;
 };
 
 struct VK_Buffer_Arena {
     struct VK_Buffer buffer;
-    size_t top;
     size_t capacity;
+    enum Mem_Category category;
+    VkBufferUsageFlags usage;
+    bool growable;
+    uint32_t generation; // Goes up every time the arena is relocated to a new buffer
+    struct Range_Allocator ranges;
+};
+
+/* Deletion Queue Notes:
+ * 
+ * So far, all of Vulkan's destroy calls have the same sort of signature,
+ * with a device, handle, and allocator callbacks.
+ * All handles on this platform at least are defined to be pointers to opaque structs,
+ * so type punning the destroy function with void * is not a problem.
+ * This is something that needs to be verified on other platforms as well, at a later date.
+ *
+ * There are two queues, both made of VK_DELETION_BLOCK_SIZE entry blocks chained together, so there's no cap on them:
+ *  - deletion_queue: Everything that lives until shutdown (vk_push_deletable), destroyed in reverse order by vk_destroy.
+ *  - retire_queue: Things that are done with at runtime (vk_retire*), tagged with the frame they were retired on.
+ *    vk_retire_update runs once per frame after waiting on the render fence, and destroys whatever was retired
+ *    FRAMES_IN_FLIGHT or more frames ago, since the GPU can't be using it anymore (same as the texture registry's slots).
+ *    Entries can also carry memory that goes back to its owner right after the handle is destroyed:
+ *    a VK_Mem_Arena allocation (buffers, images) or a VK_Buffer_Arena range (mesh geometry), or only that without a handle.
+ * Emptied blocks of the retire queue are kept around for reuse, so churning through resources doesn't allocate.
+ *
+ * Uploads run on their own (see Transfer Queue Notes), so retired entries also wait for upload_timeline to reach
+ * the value of the last upload submitted, or of the next flush if something is still queued in the staging buffer.
+ * Pending acquire barriers for a retired handle are dropped, since it would be gone by the time they are recorded.
+ *
+ * NOTE: The frame and the upload timeline are the only GPU progress that is tracked. Anything else (vk_buffer_arena_grow)
+ *       is waited on right away.
+ */
+#define VK_DELETION_BLOCK_SIZE 1024
+
+typedef void (*VK_Destroy_Func)(VkDevice device, void *handle, const VkAllocationCallbacks *pAllocator);
+
+struct VK_Deletion_Entry {
+    VK_Destroy_Func func; // NULL if there is only memory to give back, or if it was forgotten
+    void *handle;
+    uint64_t frame;        // Retired on, only for the retire queue
+    uint64_t upload_value; // Of the last upload that can still be writing to it, same
+
+    /* Given back after the handle is destroyed */
+    struct VK_Mem_Arena *mem_arena; // Along with allocation and category
+    struct VK_Mem_Allocation allocation;
+    enum Mem_Category category;
+    struct Range_Allocator *ranges; // Along with range, e.g. of a buffer arena
+    uint32_t range;
+};
+
+struct VK_Deletion_Block {
+    struct VK_Deletion_Entry entries[VK_DELETION_BLOCK_SIZE];
+    struct VK_Deletion_Block *prev;
+    struct VK_Deletion_Block *next;
+};
+
+struct VK_Deletion_Queue {
+    struct VK_Deletion_Block *first; // Oldest entries
+    struct VK_Deletion_Block *last;  // Newest entries
+    uint32_t first_index;            // Entries in first before this are gone already
+    uint32_t last_count;             // Entries in last
+    uint32_t count;
+
+    struct VK_Deletion_Block *spare; // Emptied blocks, chained through next
 };
 
 struct VK_Staging_Entry {
@@ -84,7 +315,11 @@ struct VK_Staging_Entry {
     uint64_t size;
 
     VkImage destination_image;
-    VkExtent3D destination_image_extent;
+    VkExtent3D destination_image_extent; // Of the mip level being copied
+    uint32_t destination_image_mip_level;
+    uint32_t destination_image_array_layer;
+    uint32_t destination_image_row_length;   // In texels, padded to whole blocks for block compressed formats
+    uint32_t destination_image_image_height; // Same
 };
 
 struct VK_Staging_Queue {
@@ -92,20 +327,335 @@ struct VK_Staging_Queue {
     uint32_t entries_top;
 };
 
+/* Transfer Queue Notes:
+ *
+ * Uploads (vk_staging_queue_flush and the stream batches) are submitted to queue_transfer, which is a queue of a transfer-only
+ * family when the device has one. That's the copy engine, so uploads run alongside rendering instead of taking turns with it.
+ * Without one (or without WITH_TRANSFER_QUEUE), queue_transfer is queue_graphics and everything below still works the same,
+ * only without any ownership transfers.
+ *
+ * Every upload submit signals the next value of the upload_timeline semaphore (upload_value is the last one submitted),
+ * and nothing on the CPU waits for it:
+ *  - render's submit waits on upload_wait_value, which covers the last staging flush and whatever had finished when the frame
+ *    was recorded (e.g. the stream batches it retires), so only the GPU waits, and only the stages that read the uploads.
+ *  - Stream batches are polled with vkGetSemaphoreCounterValue instead of fences.
+ *  - The staging buffer is split into VK_UPLOAD_PARTITIONS, each with its own command pool. A flush submits its partition
+ *    and switches to the next one, which is only waited on if its last upload still hasn't finished by the time it comes around.
+ *  - Retired resources wait for the upload that can still be writing to them as well as for the frame (see Deletion Queue Notes).
+ *
+ * Buffers and images are VK_SHARING_MODE_EXCLUSIVE and belong to the graphics family. What an upload writes is released
+ * to the graphics family at the end of the upload, and the matching acquire barrier is kept in pending_acquires,
+ * to be recorded on the graphics queue by a submit that waits on the upload's value (vk_cmd_acquire_uploads).
+ * The transfer queue never acquires anything, since uploads overwrite whatever was there before.
+ * Images go from TRANSFER_DST_OPTIMAL to SHADER_READ_ONLY_OPTIMAL as part of the transfer.
+ *
+ * NOTE: The CPU still waits in a few rare cases: when pending_acquires is full, when both partitions are in flight,
+ *       and on vk_buffer_arena_grow, which copies on the graphics queue (see Arena Growth Notes).
+ * NOTE: Image copies are always whole mip levels from offset 0, so minImageTransferGranularity of the transfer family doesn't matter.
+ */
+#define VK_UPLOAD_STAGES (VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+#define VK_UPLOAD_ACCESS (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT)
+
+struct VK_Upload_Partition {
+    struct VK_Buffer_Arena staging_buffer;
+    VkCommandPool command_pool; // On the transfer family, reset whenever the partition comes around again
+    uint64_t value;             // Of its last submit, the partition is free once upload_timeline has reached it
+};
+
+// Acquire barriers for the graphics queue, in the order they were released, so the values only ever go up
+struct VK_Pending_Acquires {
+    VkBufferMemoryBarrier buffers[VK_MAX_PENDING_ACQUIRES];
+    uint64_t buffer_values[VK_MAX_PENDING_ACQUIRES];
+    uint32_t buffer_count;
+
+    VkImageMemoryBarrier images[VK_MAX_PENDING_ACQUIRES];
+    uint64_t image_values[VK_MAX_PENDING_ACQUIRES];
+    uint32_t image_count;
+};
+
+/* Frame Ring Notes:
+ *
+ * Per-frame data (the global uniforms, the instance data and the indirect draws) is written straight into a persistently
+ * mapped, host visible buffer that the GPU reads from, instead of going through the staging buffer and a blocking copy.
+ * The buffer is split into FRAMES_IN_FLIGHT partitions and a frame only writes into its own. The GPU is done with a partition
+ * once the fence of the frame that used it last has signalled, which render waits on before writing anything.
+ * Within a partition it's a bump allocator that starts over every frame.
+ *
+ * The uniforms and instances are read through dynamic descriptors in a set of their own (set 1), so their offsets are given
+ * when binding instead of rewriting descriptors every frame. They can't be in the global set, since that one is
+ * update-after-bind and those can't have dynamic descriptors.
+ */
+struct VK_Frame_Ring {
+    struct VK_Buffer buffer;
+    char *mapping;
+    uint64_t alignment;        // Enough for uniform and storage buffer offsets
+    uint64_t partition_size;
+    uint64_t partition_offset; // Of the current frame's partition
+    uint64_t top;              // Relative to partition_offset
+};
+
+/* Unified Memory Notes:
+ *
+ * Some devices have memory that is both DEVICE_LOCAL and HOST_VISIBLE, with a heap as big as the device local one:
+ * integrated GPUs (where it's all the same RAM anyway), discrete GPUs with resizable BAR and software rasterizers.
+ * On those, copying through the staging buffer only costs an extra copy, a submit and a wait on the upload fence,
+ * so buffers are put in gpu_mapped_mem instead, which is persistently mapped, and written to directly.
+ * vk_map_buffer_staged and stream_batch_map_buffer hand out pointers into the buffer itself for these, and don't queue a copy.
+ *
+ * Discrete GPUs without resizable BAR only have a small (usually 256MB) window of host visible VRAM in a heap of its own,
+ * which doesn't count, and go through the staging buffer like before.
+ * Images always do, since they are optimally tiled and can't be written to from the CPU.
+ *
+ * The memory has to be HOST_COHERENT, so that writes are visible to the GPU by the time they are submitted without flushing.
+ * It's usually not HOST_CACHED, so it must only be written to, sequentially, and never read back.
+ */
+
+/* Mesh File Notes:
+ *
+ * See tools/mesh_export.py for the format.
+ * Files that don't start with MESH_FILE_MAGIC are from before the header was versioned,
+ * those only have the two counts as a header and always use 16-bit indices.
+ *
+ * Meshes with meshlets (from tools/knz_meshlets) have the meshlet table at the end, and their index buffer is
+ * ordered so that every meshlet is a contiguous range. The meshlets can then be culled individually in render.
+ *
+ * Version 3 files can have LODs (from tools/knz_meshlod), the LOD table comes after the meshlets.
+ * Every LOD is a range of the index buffer (and of the meshlets) and they all share the vertex buffer.
+ *
+ * Version 2 files can have quantized vertices (from tools/knz_meshquant, see tools/mesh_file.h),
+ * those are uploaded as-is and decoded in the vertex shader, using the bounds passed along in the instance data.
+ *
+ * Version 4 files can have compressed vertex and index buffers (from tools/knz_meshcompress),
+ * which are decoded on the CPU straight into the staging buffer (see Mesh Codec Notes).
+ */
+#define MESH_FILE_MAGIC 0x4D5A4E4B // "KNZM" read as a little-endian u32
+#define MESH_FILE_VERSION 4
+
+#define MESH_FILE_FLAG_INDEX_32         (1 << 0)
+#define MESH_FILE_FLAG_VERTEX_QUANTIZED (1 << 1)
+#define MESH_FILE_FLAG_MESHLETS         (1 << 2)
+#define MESH_FILE_FLAG_LODS             (1 << 3)
+#define MESH_FILE_FLAG_COMPRESSED       (1 << 4)
+
+// NOTE: These need to match lit_vert.glsl
+#define VERTEX_FORMAT_FLOAT     0 // float[8]
+#define VERTEX_FORMAT_QUANTIZED 1 // 16 bytes, see tools/mesh_file.h
+
+#define VERTEX_SIZE_FLOAT     (8 * sizeof(float))
+#define VERTEX_SIZE_QUANTIZED 16
+
+struct Mesh_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t flags;
+    uint32_t vert_count;
+    uint32_t index_count;
+};
+
+struct Mesh_File_Quantization {
+    float position_min[3];
+    float position_extent[3];
+};
+
+// NOTE: Needs to match tools/mesh_file.h, see there for how the cone is used
+struct Mesh_File_Meshlet {
+    float center[3];
+    float radius;
+    float cone_apex[3];
+    float cone_cutoff;
+    float cone_axis[3];
+    uint32_t first_index;
+    uint32_t triangle_count;
+    uint32_t vertex_count;
+    uint32_t padding[2];
+};
+
+// NOTE: Needs to match tools/mesh_file.h, error is in mesh units
+struct Mesh_File_Lod {
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    float error;
+    uint32_t padding[3];
+};
+
+/* Mesh Pack Notes:
+ *
+ * See tools/mesh_pack.h for the format, these definitions need to be kept in sync with it.
+ * The pack is memory mapped and the payloads are copied straight from the mapping into the staging buffer,
+ * so there is no intermediate heap copy of every mesh like with the loose .bin files.
+ */
+#define MESH_PACK_MAGIC 0x505A4E4B // "KNZP" read as a little-endian u32
+#define MESH_PACK_VERSION 4
+
+struct Mesh_Pack_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t mesh_count;
+    uint32_t toc_offset;
+};
+
+struct Mesh_Pack_Entry {
+    char name[64];
+    uint32_t flags;
+    uint32_t vert_count;
+    uint32_t index_count;
+    uint32_t vertex_stride;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t meshlet_offset;
+    uint32_t meshlet_count;
+    uint32_t lod_count;
+    uint64_t lod_offset;
+    uint32_t vertex_stream_size; // Only with MESH_FILE_FLAG_COMPRESSED
+    uint32_t index_stream_size;
+};
+
+/* Texture File Notes:
+ *
+ * See tools/texture_file.h for the .ktex format, these definitions need to be kept in sync with it.
+ * The levels are tightly packed in the same order vk_update_image expects, so the whole chain is copied into the staging
+ * buffer in one go. Block compressed textures take 4-8x less VRAM than RGBA8 (see knz_texcook), and are only used when the
+ * device supports BC, otherwise the source images are loaded like before.
+ */
+#define TEXTURE_FILE_MAGIC 0x545A4E4B // "KNZT" read as a little-endian u32
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_FILE_FLAG_SRGB (1u << 0)
+
+enum Texture_File_Format {
+    TEXTURE_FILE_FORMAT_RGBA8,
+    TEXTURE_FILE_FORMAT_BC1,
+    TEXTURE_FILE_FORMAT_BC3,
+    TEXTURE_FILE_FORMAT_BC5,
+    TEXTURE_FILE_FORMAT_BC7,
+    TEXTURE_FILE_FORMAT_COUNT
+};
+
+struct Texture_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format; // Texture_File_Format
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    uint32_t padding;
+};
+
+struct Texture_File_Level {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct File_Mapping {
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
 struct Mesh {
     uint32_t index_offset;
     uint32_t vertex_offset;
 
     uint32_t vert_count;
     uint32_t index_count;
+
+    VkIndexType index_type; // Selects which of the index arenas index_offset is in
+
+    uint32_t vertex_allocation; // In the arenas above, for mesh_destroy
+    uint32_t index_allocation;
+
+    uint32_t meshlet_offset; // Into VK::meshlets, meshlet_count is 0 for meshes that are always drawn whole
+    uint32_t meshlet_count;
+    uint32_t meshlet_allocation; // In VK::meshlet_ranges, RANGE_NONE without meshlets
+
+    // Always at least 1, meshes without LODs get one that covers everything. Ranges are relative to the offsets above.
+    struct Mesh_File_Lod lods[MAX_MESH_LODS];
+    uint32_t lod_count;
+
+    uint32_t vertex_format; // VERTEX_FORMAT_*, vertex_offset is in units of that format's vertex size
+    vec4s position_min;     // Dequantization bounds, only used by VERTEX_FORMAT_QUANTIZED
+    vec4s position_extent;
+    bool resident; // False until the upload has finished, entities using the mesh are skipped until then
 };
 
 struct Texture {
     VkImage image;
     VkImageView image_view;
     VkExtent3D extent;
+    uint32_t mip_levels;
+    VkFormat format;
+    struct VK_Mem_Allocation allocation; // In gpu_image_mem
+    bool destroyable;      // Destroyed with texture_destroy instead of at shutdown
+};
+
+/* Texture Registry Notes:
+ *
+ * Textures are bound through one big descriptor array (binding 3) that the shader indexes with Instance_Data::texture_index.
+ * Its size comes from the device's update-after-bind limits, so slots are handed out from a free list instead of being fixed.
+ * Slots that haven't been written to are never read, which PARTIALLY_BOUND allows, and newly allocated slots show the dummy texture.
+ *
+ * Every frame in flight has its own copy of the array (see Frames in Flight Notes). texture_registry_set only records the view,
+ * and marks the slot as stale in every copy. texture_registry_update then writes the stale slots of the current frame's copy,
+ * once its fence has signalled, so a slot can be pointed at a new texture while a frame on the GPU still reads the old one.
+ * A freed slot is pointed at the dummy right away, but only goes back on the free list FRAMES_IN_FLIGHT frames later,
+ * since a frame that is still on the GPU can be using it for whatever used to be there.
+ *
+ * NOTE: Freeing a slot doesn't destroy the texture, the caller has to keep it alive just as long.
+ */
+struct Texture_Registry_Retired {
+    uint32_t slot;
+    uint64_t frame; // texture_registry_update count when it was freed
+};
+
+struct Texture_Registry {
+    uint32_t capacity;   // Slots in the descriptor array
+    uint32_t slot_count; // Slots handed out so far, the ones at or past this have never been used
+    uint32_t free_slots[TEXTURE_DESCRIPTOR_MAX];
+    uint32_t free_count;
+
+    struct Texture_Registry_Retired retired[TEXTURE_DESCRIPTOR_MAX]; // Oldest first, as a ring
+    uint32_t retired_head;
+    uint32_t retired_count;
+
+    VkImageView views[TEXTURE_DESCRIPTOR_MAX];    // What each slot is set to
+    uint8_t stale_frames[TEXTURE_DESCRIPTOR_MAX]; // Bit per VK::frames whose global_desc doesn't have views[slot] yet
+    uint32_t stale_slots[TEXTURE_DESCRIPTOR_MAX]; // The ones with any stale_frames bits
+    uint32_t stale_count;
+
+    VkImageView dummy_view;
+    uint64_t frame;
+};
+
+/* Frames in Flight Notes:
+ *
+ * The CPU records a frame while the GPU can still be working on up to FRAMES_IN_FLIGHT - 1 earlier ones.
+ * Whatever the CPU changes for every frame comes in FRAMES_IN_FLIGHT copies, one per VK_Frame (picked by vk->frame):
+ * the command buffer, the fence and semaphores, the global descriptor set and a partition of the frame ring.
+ * render waits on the fence of its VK_Frame, from FRAMES_IN_FLIGHT frames ago, before it touches any of them.
+ *
+ * The global set has copies since its descriptors are rewritten in place: the vertex buffer when the arena grows, and the texture
+ * slots when streamed textures are swapped. That can't be done while a frame on the GPU has the set bound, so every copy
+ * catches up on its own turn (see Texture Registry Notes).
+ * Everything else is shared, and only given back once it's FRAMES_IN_FLIGHT frames old: retired resources and ranges
+ * (see Deletion Queue Notes) and freed texture slots.
+ */
+struct VK_Frame {
+    VkCommandBuffer command_buffer;
+    VkSemaphore present_semaphore; // Signalled once the swapchain image can be drawn to
+    VkSemaphore render_semaphore;  // Signalled once the commands are done, presenting waits on it
+    VkFence render_fence;
+    VkDescriptorSet global_desc;
+    uint32_t vertex_buffer_desc_generation; // vertex_buffer's generation when it was last written to global_desc
 };
 
+static_assert(FRAMES_IN_FLIGHT <= 8, "Texture_Registry::stale_frames has a bit per frame");
+
 struct VK {
 	/* Instances and Handles */
 	VkInstance instance;
@@ -129,36 +679,54 @@ struct VK {
 
 	/* Queues and Commands */
 	VkQueue queue_graphics;
+	VkQueue queue_transfer; // Same as queue_graphics if there's no transfer-only family, see Transfer Queue Notes
 
-	VkCommandPool command_pool_upload;
+	VkCommandPool command_pool_upload; // One-time graphics commands, see vk_graphics_commands_begin
 	VkCommandPool command_pool_graphics;
-	VkCommandBuffer command_buffer_graphics;
+	VkCommandPool command_pool_transfer;
 
 	uint32_t queue_graphics_idx;
+	uint32_t queue_transfer_idx;
 
 	/* Synchronization */
-	VkSemaphore present_semaphore;
-	VkSemaphore render_semaphore;
-	VkFence render_fence;
+	struct VK_Frame frames[FRAMES_IN_FLIGHT]; // See Frames in Flight Notes
 	VkFence upload_fence;
+	VkSemaphore upload_timeline;
+	uint64_t upload_value;      // Last one signalled by an upload submit
+	uint64_t upload_wait_value; // What the next frame has to wait for
+	uint32_t upload_stalls;     // Times the CPU had to wait for an upload partition to free up
+
+	/* Features */
+	bool texture_compression_bc;
+	bool memory_budget; // VK_EXT_memory_budget
 
 	/* Memory */
 	int mem_host_coherent_idx;
 	int mem_gpu_local_idx;
+	int mem_gpu_mapped_idx; // -1 if there's no DEVICE_LOCAL | HOST_VISIBLE memory worth writing to directly, see Unified Memory Notes
+	VkPhysicalDeviceMemoryProperties mem_properties;
+	uint64_t heap_allocated[VK_MAX_MEMORY_HEAPS]; // By our arenas
 
 	struct VK_Mem_Arena scratch_mem;
-    struct VK_Mem_Arena staging_mem;
+    struct VK_Mem_Arena staging_mem; // Mapped, like scratch_mem
 	struct VK_Mem_Arena gpu_mem;
+    struct VK_Mem_Arena gpu_image_mem; // Same memory type as gpu_mem, for textures and render targets, see Arena Growth Notes
+    struct VK_Mem_Arena gpu_mapped_mem; // Only with mem_gpu_mapped_idx, mapped too
 
-	struct VK_Buffer_Arena staging_buffer;
-    void *staging_buffer_mapping;
+    struct Mem_Stats mem_stats;
+
+    struct VK_Upload_Partition uploads[VK_UPLOAD_PARTITIONS];
+    uint32_t upload_partition; // The one staging into
     struct VK_Staging_Queue staging_queue;
+    struct VK_Pending_Acquires pending_acquires;
 
 	/* Descriptor */
 	VkDescriptorPool desc_pool;
 
 	/* Resources */
 	struct VK_Deletion_Queue deletion_queue;
+	struct VK_Deletion_Queue retire_queue; // See Deletion Queue Notes
+	uint64_t frame;                        // Counted up by render, what retired entries are tagged with
 
 	// -- TODO: Split out these app-specific things
     /* Pipeline and Shaders */
@@ -168,27 +736,31 @@ struct VK {
     /* Vertex buffers and mesh data */
     struct Mesh meshes[512];
     int mesh_count;
+
+    struct Mesh_File_Meshlet meshlets[MAX_MESHLETS];
+    struct Range_Allocator meshlet_ranges; // Of VK::meshlets, in meshlets instead of bytes, so every mesh's range rounds up to RANGE_MIN_ALIGNMENT of them
     
     struct Texture grid_texture;
     VkSampler default_sampler;
 
     /* Descriptors */
-    VkDescriptorSet global_desc;
-    VkDescriptorSetLayout global_desc_layout;
+    VkDescriptorSetLayout global_desc_layout; // The sets are in VK::frames
+    VkDescriptorSet frame_desc; // Dynamic offsets into frame_ring
+    VkDescriptorSetLayout frame_desc_layout;
+    struct Texture_Registry textures;
     
     /* Buffers */
-    struct VK_Buffer global_uniform_buffer;
-    struct VK_Buffer instance_buffer;
-
-    struct VK_Buffer indirect_command_buffer;
+    struct VK_Frame_Ring frame_ring; // Uniforms, instance data and indirect draws
 
     struct VK_Buffer_Arena vertex_buffer;
-    struct VK_Buffer_Arena index_buffer;
+    struct VK_Buffer_Arena index_buffer;    // 16-bit indices, used by every mesh that fits
+    struct VK_Buffer_Arena index_buffer_32; // 32-bit indices, only for meshes with too many verts
     // --
 };
 
 struct Entity {
     int mesh_idx;
+    uint32_t texture_idx; // Into the texture descriptor array
     vec3s position;
     vec3s rotation;
     vec3s scale;
@@ -199,20 +771,43 @@ struct Scene {
     size_t entities_count;
 };
 
+struct Frame_Stats {
+    double total_ms;
+    double max_ms;
+    double cpu_total_ms; // Of render, without waiting on the frame's fence or on the swapchain
+    double cpu_max_ms;
+    uint32_t frame_count;
+    uint32_t spike_count; // Frames over FRAME_SPIKE_MS
+};
+
 struct Render_State {
 	uint64_t frame_number;
 
     vec3s clear_color;
 
     struct Scene scene;
+
+    float lod_bias; // Multiplies LOD_ERROR_PIXELS, adjusted to stay within LOD_TRIANGLE_BUDGET
+
+    struct Frame_Stats frame_stats; // Since the last report
+    double render_cpu_ms;           // Of the last frame, see Frame_Stats
+
+    uint32_t entity_count; // From --entities, the scene is filled up with copies of its entities to this many
+    uint32_t frame_limit;  // From --frames, quits after this many frames when not 0
+
+    /* Draws are built here on the CPU, since the count is only known after culling.
+     * 16-bit index draws grow up from the start and 32-bit ones grow down from the end. */
+    VkDrawIndexedIndirectCommand draw_commands[MAX_INDIRECT_DRAWS];
 };
 
 struct Instance_Data {
 	mat4s model_matrix;
     uint32_t texture_index;
+    uint32_t vertex_format;
     uint32_t padding_0;
     uint32_t padding_1;
-    uint32_t padding_2;
+    vec4s position_min;
+    vec4s position_extent;
 };
 
 struct Global_Uniform_Data {
@@ -227,11 +822,9 @@ static SDL_Window *s_window;
 
 #define countof(x) (sizeof(x) / sizeof(x[0]))
 
-/*
 #define MIN(a_, b_) ((a_) < (b_) ? (a_) : (b_))
 #define MAX(a_, b_) ((a_) > (b_) ? (a_) : (b_))
 #define CLAMP(v_, min_, max_) (MAX(min_, MIN(v_, max_)))
-*/
 
 static bool g_init_done = false;
 
@@ -267,6 +860,21 @@ static uint64_t align_address(uint64_t addr, uint64_t alignment)
 	return (addr + alignment - 1) & ~(alignment - 1);
 }
 
+static double ticks_to_ms(uint64_t ticks)
+{
+	return (double)ticks * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void frame_stats_add(struct Frame_Stats *stats, double frame_ms, double cpu_ms)
+{
+	stats->total_ms += frame_ms;
+	stats->max_ms = fmax(stats->max_ms, frame_ms);
+	stats->cpu_total_ms += cpu_ms;
+	stats->cpu_max_ms = fmax(stats->cpu_max_ms, cpu_ms);
+	stats->frame_count++;
+	stats->spike_count += frame_ms > FRAME_SPIKE_MS;
+}
+
 // NOTE: Allocates with malloc, must free
 static char *file_load_binary(const char *path, uint32_t *size)
 {
@@ -288,6 +896,70 @@ static char *file_load_binary(const char *path, uint32_t *size)
 	return buf;
 }
 
+// NOTE: Returns false if the file doesn't exist, must file_unmap
+static bool file_map_readonly(const char *path, struct File_Mapping *out)
+{
+	struct File_Mapping fm = {0};
+
+#ifdef _WIN32
+	fm.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(fm.file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(fm.file, &size);
+	fm.size = (size_t)size.QuadPart;
+
+	fm.mapping = CreateFileMappingA(fm.file, NULL, PAGE_READONLY, 0, 0, NULL);
+	fm.data = fm.mapping ? MapViewOfFile(fm.mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if(!fm.data) {
+		if(fm.mapping) CloseHandle(fm.mapping);
+		CloseHandle(fm.file);
+		return false;
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	fm.size = (size_t)st.st_size;
+
+	void *data = mmap(NULL, fm.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // NOTE: The mapping keeps its own reference to the file
+
+	if(data == MAP_FAILED) {
+		return false;
+	}
+
+	fm.data = data;
+#endif
+
+	LOG("Mapped file from: %s\n", path);
+
+	*out = fm;
+	return true;
+}
+
+static void file_unmap(struct File_Mapping *fm)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(fm->data);
+	CloseHandle(fm->mapping);
+	CloseHandle(fm->file);
+#else
+	munmap((void *)fm->data, fm->size);
+#endif
+	*fm = (struct File_Mapping){0};
+}
+
 static VkShaderModule vk_create_shader_module_from_file(struct VK *vk, const char *path)
 {
 	uint32_t size;
@@ -310,1359 +982,4468 @@ static VkShaderModule vk_create_shader_module_from_file(struct VK *vk, const cha
 	return module;
 }
 
+/* Deletion queues (see Deletion Queue Notes) */
+
+static struct VK_Deletion_Entry *vk_deletion_queue_push(struct VK_Deletion_Queue *queue)
+{
+    if(!queue->last || queue->last_count == VK_DELETION_BLOCK_SIZE) {
+        struct VK_Deletion_Block *block = queue->spare;
+        if(block) {
+            queue->spare = block->next;
+        }
+        else {
+            block = malloc(sizeof(*block));
+            CHECK(block, "Out of memory for the deletion queue");
+        }
+
+        block->prev = queue->last;
+        block->next = NULL;
+
+        if(queue->last) {
+            queue->last->next = block;
+        }
+        else {
+            queue->first = block;
+            queue->first_index = 0;
+        }
+
+        queue->last = block;
+        queue->last_count = 0;
+    }
+
+    queue->count++;
+    return &queue->last->entries[queue->last_count++];
+}
+
+// The oldest entry, the queue must not be empty
+static struct VK_Deletion_Entry *vk_deletion_queue_front(struct VK_Deletion_Queue *queue)
+{
+    assert(queue->count);
+    return &queue->first->entries[queue->first_index];
+}
+
+static void vk_deletion_queue_pop(struct VK_Deletion_Queue *queue)
+{
+    assert(queue->count);
+    queue->count--;
+    queue->first_index++;
+
+    const uint32_t first_count = queue->first == queue->last ? queue->last_count : VK_DELETION_BLOCK_SIZE;
+    if(queue->first_index == first_count) {
+        struct VK_Deletion_Block *block = queue->first;
+
+        queue->first = block->next;
+        queue->first_index = 0;
+        if(queue->first) {
+            queue->first->prev = NULL;
+        }
+        else {
+            queue->last = NULL;
+            queue->last_count = 0;
+        }
+
+        block->next = queue->spare;
+        queue->spare = block;
+    }
+}
+
+// NOTE: Doesn't destroy anything that's still on it
+static void vk_deletion_queue_free(struct VK_Deletion_Queue *queue)
+{
+    struct VK_Deletion_Block *lists[] = { queue->first, queue->spare };
+    for(uint32_t i = 0; i < countof(lists); ++i) {
+        for(struct VK_Deletion_Block *block = lists[i]; block;) {
+            struct VK_Deletion_Block *next = block->next;
+            free(block);
+            block = next;
+        }
+    }
+
+    *queue = (struct VK_Deletion_Queue){0};
+}
+
 static void vk_push_deletable(struct VK *vk, void (*func)(), void *handle)
 {
-	CHECK(vk->deletion_queue.entries_top < countof(vk->deletion_queue.entries), "Ran out of slots on deletion queue");
-	
-	vk->deletion_queue.entries[vk->deletion_queue.entries_top++] = (struct VK_Deletion_Entry) {
+	*vk_deletion_queue_push(&vk->deletion_queue) = (struct VK_Deletion_Entry) {
 		.func = func,
 		.handle = handle
 	};
 }
 
-static struct VK_Mem_Arena vk_alloc_mem_arena(struct VK *vk, int memory_type_idx, size_t capacity)
+// For handles destroyed before shutdown, so they aren't destroyed twice
+static void vk_forget_deletable(struct VK *vk, void *handle)
 {
-    VkMemoryAllocateInfo alloc_info = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = capacity,
-        .memoryTypeIndex = memory_type_idx,
-    };
-
-    VkDeviceMemory allocation;
-    
-    VK_CHECK(vkAllocateMemory(vk->device, &alloc_info, NULL, &allocation));
-    vk_push_deletable(vk, vkFreeMemory, allocation);
-
-    LOG("Created GPU memory arena with size: %.1fKB from memory type: %d\n", (float)capacity / 1024.0f, memory_type_idx);
+	struct VK_Deletion_Queue *queue = &vk->deletion_queue;
+
+	// NOTE: Newest first, since it's usually something that was created recently
+	for(struct VK_Deletion_Block *block = queue->last; block; block = block->prev) {
+		const uint32_t count = block == queue->last ? queue->last_count : VK_DELETION_BLOCK_SIZE;
+		for(int i = count - 1; i >= 0; --i) {
+			if(block->entries[i].handle == handle && block->entries[i].func) {
+				block->entries[i].func = NULL;
+				return;
+			}
+		}
+	}
 
-    return (struct VK_Mem_Arena) {
-        .allocation = allocation,
-        .capacity = capacity,
-        .top = 0
-    };
+	panic("Handle isn't on the deletion queue");
 }
 
-static uint64_t vk_mem_arena_push(struct VK *vk, struct VK_Mem_Arena *arena, VkMemoryRequirements mem_req)
+// What's left of the heap for our arenas, see Arena Growth Notes
+static uint64_t vk_mem_heap_available(struct VK *vk, uint32_t heap_index)
 {
-    arena->top = align_address(arena->top, mem_req.alignment);
-    const uint64_t buffer_address = arena->top;
-    arena->top += mem_req.size;
+    if(vk->memory_budget) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT
+        };
+
+        VkPhysicalDeviceMemoryProperties2 mem_properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+            .pNext = &budget_properties
+        };
 
-    LOG("Push to memory arena %p size: %.3fKB (%.3f%% usage)\n", arena, (float)mem_req.size / 1024.0f, 100 * ((float)arena->top / (float)arena->capacity));
+        vkGetPhysicalDeviceMemoryProperties2(vk->physical_device, &mem_properties);
 
-    return buffer_address;
+        const uint64_t budget = budget_properties.heapBudget[heap_index];
+        const uint64_t usage = budget_properties.heapUsage[heap_index];
+        return budget > usage ? budget - usage : 0;
+    }
+
+    const uint64_t usable = vk->mem_properties.memoryHeaps[heap_index].size / 100 * VK_HEAP_USABLE_PERCENT;
+    return usable > vk->heap_allocated[heap_index] ? usable - vk->heap_allocated[heap_index] : 0;
 }
 
-static struct VK_Buffer vk_create_buffer(struct VK *vk, struct VK_Mem_Arena *arena, VkBufferUsageFlagBits usage, size_t size)
+// Returns false if the heap doesn't have size bytes left
+static bool vk_mem_arena_add_block(struct VK *vk, struct VK_Mem_Arena *arena, uint64_t size)
 {
-    if(arena == &vk->gpu_mem) {
-        usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    CHECK(arena->block_count < VK_MEM_ARENA_MAX_BLOCKS, "Memory arena ran out of blocks");
+
+    const uint32_t heap_index = vk->mem_properties.memoryTypes[arena->memory_type_idx].heapIndex;
+    if(size > vk_mem_heap_available(vk, heap_index)) {
+        return false;
     }
 
-    VkBufferCreateInfo buffer_info = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .flags = 0,
-        .size = size,
-        .usage = usage,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    VkMemoryAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = arena->memory_type_idx,
     };
 
-    VkBuffer buffer;
+    struct VK_Mem_Block *block = &arena->blocks[arena->block_count++];
 
-    VK_CHECK(vkCreateBuffer(vk->device, &buffer_info, NULL, &buffer));
+    VK_CHECK(vkAllocateMemory(vk->device, &alloc_info, NULL, &block->memory));
+    vk_push_deletable(vk, vkFreeMemory, block->memory);
 
-    VkMemoryRequirements mem_requirements;
-    vkGetBufferMemoryRequirements(vk->device, buffer, &mem_requirements);
+    block->mapping = NULL;
+    if(arena->mapped) {
+        VK_CHECK(vkMapMemory(vk->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapping));
+    }
 
-    const size_t buffer_addr = vk_mem_arena_push(vk, arena, mem_requirements);
-    vkBindBufferMemory(vk->device, buffer, arena->allocation, buffer_addr);
+    range_allocator_init(&block->ranges, size);
+    arena->capacity += size;
+    vk->heap_allocated[heap_index] += size;
 
-    vk_push_deletable(vk, vkDestroyBuffer, buffer);
+    LOG("Added %.1fKB block %u to GPU memory arena %p from memory type: %d\n", (float)size / 1024.0f, arena->block_count - 1, arena, arena->memory_type_idx);
 
-    LOG("Created buffer\n");
-    
-    return (struct VK_Buffer) {
-        .handle = buffer,
-        .offset = buffer_addr,
-        .size = size, // NOTE: Here we do not use mem_requirements.size because that can be bigger than the wanted buffer size
-        .arena = arena
-    };
+    return true;
 }
 
-static struct VK_Buffer_Arena vk_alloc_buffer_arena(struct VK *vk, struct VK_Mem_Arena *arena, VkBufferUsageFlagBits usage, size_t capacity)
+// Initialized in place, since the blocks' range allocators make it too big to pass around. mapped needs a host visible memory type.
+static void vk_alloc_mem_arena(struct VK *vk, struct VK_Mem_Arena *arena, int memory_type_idx, size_t capacity, bool mapped)
 {
-    struct VK_Buffer buffer = vk_create_buffer(vk, arena, usage, capacity);
-
-    LOG("Created buffer-backed arena with size: %.1fKB\n", (float)capacity / 1024.0f);
+    arena->memory_type_idx = memory_type_idx;
+    arena->mapped = mapped;
+    arena->block_count = 0;
+    arena->capacity = 0;
+    arena->used = 0;
+    arena->peak_used = 0;
+
+    CHECK(vk_mem_arena_add_block(vk, arena, capacity), "Not enough device memory for memory arena");
+}
 
-    return (struct VK_Buffer_Arena) {
-        .buffer = buffer,
-        .capacity = capacity,
-        .top = 0
-    };
+// Where buffers go that the CPU writes into once and the GPU reads from a lot, see Unified Memory Notes
+static struct VK_Mem_Arena *vk_gpu_buffer_mem(struct VK *vk)
+{
+    return vk->mem_gpu_mapped_idx >= 0 ? &vk->gpu_mapped_mem : &vk->gpu_mem;
 }
 
-static uint64_t vk_buffer_arena_push(struct VK *vk, struct VK_Buffer_Arena *arena, size_t size)
+/* Returns where it went, to bind to and to free it with later.
+ * NOTE: Optimally tiled images only go in gpu_image_mem, everything else in it has to be one too (see Arena Growth Notes).
+ * When none of the blocks have room, a new one is added (see Arena Growth Notes). */
+static struct VK_Mem_Allocation vk_mem_arena_push(struct VK *vk, struct VK_Mem_Arena *arena, VkMemoryRequirements mem_req, enum Mem_Category category)
 {
-    // TODO: Maybe deduplicate with vk_mem_arena_push, the logic is exactly the same
-    //arena->top = align_address(arena->top, mem_req.alignment);
-    arena->top = align_address(arena->top, 128); // TODO: What should be done about alignment???
-    const uint64_t buffer_address = arena->top;
-    arena->top += size;
+    CHECK(mem_req.memoryTypeBits & (1u << arena->memory_type_idx), "Resource can't go in the memory arena's memory type");
 
-    LOG_PREINIT("Push to buffer arena %p size: %.3fKB (%.3f%% usage)\n", arena, (float)size / 1024.0f, 100 * ((float)arena->top / (float)arena->capacity));
+    const uint64_t size = mem_req.size;
+    const uint64_t alignment = mem_req.alignment;
 
-    return buffer_address;
-}
+    struct VK_Mem_Allocation out = { .range = RANGE_NONE };
+    for(uint32_t i = 0; i < arena->block_count && out.range == RANGE_NONE; ++i) {
+        out.block = i;
+        out.range = range_alloc(&arena->blocks[i].ranges, size, alignment, &out.offset);
+    }
 
-static void vk_staging_queue_flush(struct VK *vk)
-{
-    // TODO SYNC: This function may need to wait on the graphics render if we want to use it outside of init.
-    //			  Alternatively or in addition, this can maybe use a different queue. (is that necessary?)
+    if(out.range == RANGE_NONE) {
+        const uint64_t min_block_size = align_address(size + alignment, RANGE_MIN_ALIGNMENT);
+        const uint64_t block_size = MAX(arena->blocks[arena->block_count - 1].ranges.capacity * VK_ARENA_GROWTH, min_block_size);
 
-    /* Allocate command buffer and begin command recording */
-    VkCommandBufferAllocateInfo cmd_alloc_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = vk->command_pool_upload,
-        .commandBufferCount = 1,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
-    };
+        // Smaller than the growth would make it if the budget is tight, but always big enough for this
+        const uint32_t heap_index = vk->mem_properties.memoryTypes[arena->memory_type_idx].heapIndex;
+        const uint64_t available = vk_mem_heap_available(vk, heap_index) & ~(uint64_t)(RANGE_MIN_ALIGNMENT - 1);
+        CHECK(vk_mem_arena_add_block(vk, arena, MAX(MIN(block_size, available), min_block_size)), "Out of device memory, the heap's budget is used up");
 
-    VkCommandBuffer cmdbuf;
-    VK_CHECK(vkAllocateCommandBuffers(vk->device, &cmd_alloc_info, &cmdbuf));
+        out.block = arena->block_count - 1;
+        out.range = range_alloc(&arena->blocks[out.block].ranges, size, alignment, &out.offset);
+        CHECK(out.range != RANGE_NONE, "Out of memory in memory arena");
+    }
 
-    VkCommandBufferBeginInfo cmd_begin_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pInheritanceInfo = NULL,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-    };
-    VK_CHECK(vkBeginCommandBuffer(cmdbuf, &cmd_begin_info));
+    const struct VK_Mem_Block *block = &arena->blocks[out.block];
+    out.memory = block->memory;
+    out.mapping = block->mapping ? (char *)block->mapping + out.offset : NULL;
 
-    /* Record commands for every staged entry */
-    for(uint32_t i = 0; i < vk->staging_queue.entries_top; ++i) {
-        struct VK_Staging_Entry *entry = &vk->staging_queue.entries[i];
+    const uint64_t allocated_size = block->ranges.nodes[out.range].size;
+    arena->used += allocated_size;
+    arena->peak_used = MAX(arena->peak_used, arena->used);
 
-        if(entry->destination_buffer) {
-            struct VkBufferCopy buffer_copy = {
-                .srcOffset = entry->offset_in_staging_buffer,
-                .dstOffset = entry->offset_in_destination_buffer,
-                .size = entry->size
-            };
+    struct Mem_Category_Stats *stats = &vk->mem_stats.categories[category];
+    stats->current += allocated_size;
+    stats->peak = MAX(stats->peak, stats->current);
+    stats->allocation_count++;
 
-            vkCmdCopyBuffer(cmdbuf, vk->staging_buffer.buffer.handle, entry->destination_buffer, 1, &buffer_copy);
-        }
+    LOG("Push to memory arena %p size: %.3fKB (%.3f%% usage of %u blocks)\n", arena, (float)mem_req.size / 1024.0f,
+        100 * ((float)arena->used / (float)arena->capacity), arena->block_count);
 
-        if(entry->destination_image) {
-            // NOTE: Hard-coding image format!
+    return out;
+}
 
-            // TODO: Should have more flexible offset/extents for copying a region of an image,
-            //       but to fully support that we need to consider layout transitions more directly...
-            //
-            //       For now it is assumed that the image is copied in its entirety.
+// NOTE: Whatever was bound there must not be in use by the GPU anymore, category must be the one it was pushed with
+static void vk_mem_arena_free(struct VK *vk, struct VK_Mem_Arena *arena, struct VK_Mem_Allocation allocation, enum Mem_Category category)
+{
+    struct Range_Allocator *ranges = &arena->blocks[allocation.block].ranges;
+    const uint64_t allocated_size = ranges->nodes[allocation.range].size;
 
-            {
-                // Transition to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-                VkImageMemoryBarrier barrier = {
-                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                    .image = entry->destination_image,
-                    .subresourceRange = {
-                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, // TODO: This should not be hard-coded!
-                        .baseMipLevel = 0,
-                        .levelCount = 1,
-                        .baseArrayLayer = 0,
-                        .layerCount = 1,
-                    },
-                    .srcAccessMask = 0,
-                    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT
-                };
+    struct Mem_Category_Stats *stats = &vk->mem_stats.categories[category];
+    assert(stats->allocation_count && stats->current >= allocated_size);
+    stats->current -= allocated_size;
+    stats->allocation_count--;
+    arena->used -= allocated_size;
 
-                vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
-            }
+    range_free(ranges, allocation.range);
+}
 
-            VkBufferImageCopy image_copy = {
-                .bufferOffset = entry->offset_in_staging_buffer,
-                .imageSubresource = {
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, // TODO: This should not be hard-coded!
-                    .mipLevel = 0,
-                    .baseArrayLayer = 0,
-                    .layerCount = 1,
-                },
-                .imageExtent = entry->destination_image_extent
-            };
+/* Upload timeline (see Transfer Queue Notes) */
 
-            vkCmdCopyBufferToImage(cmdbuf, vk->staging_buffer.buffer.handle, entry->destination_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_copy);
+static uint64_t vk_upload_completed(struct VK *vk)
+{
+    uint64_t value;
+    VK_CHECK(vkGetSemaphoreCounterValue(vk->device, vk->upload_timeline, &value));
+    return value;
+}
 
-            {
-                // Transition to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                VkImageMemoryBarrier barrier = {
-                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                    .image = entry->destination_image,
-                    .subresourceRange = {
-                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, // TODO: This should not be hard-coded!
-                        .baseMipLevel = 0,
-                        .levelCount = 1,
-                        .baseArrayLayer = 0,
-                        .layerCount = 1,
-                    },
-                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-                    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
-                };
+// Drops the pending acquires of a buffer or image that is going away, keeping the rest in order
+static void vk_forget_acquires(struct VK *vk, void *handle)
+{
+    struct VK_Pending_Acquires *acquires = &vk->pending_acquires;
 
-                vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
-            }
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < acquires->buffer_count; ++i) {
+        if((void *)acquires->buffers[i].buffer != handle) {
+            acquires->buffers[kept] = acquires->buffers[i];
+            acquires->buffer_values[kept++] = acquires->buffer_values[i];
         }
     }
+    acquires->buffer_count = kept;
 
-    VK_CHECK(vkEndCommandBuffer(cmdbuf));
-
-    /* Submit copy commands */
-    VkSubmitInfo submit_info = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pCommandBuffers = &cmdbuf,
-        .commandBufferCount = 1
-    };
+    kept = 0;
+    for(uint32_t i = 0; i < acquires->image_count; ++i) {
+        if((void *)acquires->images[i].image != handle) {
+            acquires->images[kept] = acquires->images[i];
+            acquires->image_values[kept++] = acquires->image_values[i];
+        }
+    }
+    acquires->image_count = kept;
+}
 
-    VK_CHECK(vkQueueSubmit(vk->queue_graphics, 1, &submit_info, vk->upload_fence));
+/* Retiring (see Deletion Queue Notes) */
 
-    vkWaitForFences(vk->device, 1, &vk->upload_fence, true, UINT64_MAX);
-    vkResetFences(vk->device, 1, &vk->upload_fence);
-    vkResetCommandPool(vk->device, vk->command_pool_upload, 0);
+static void vk_retire_entry(struct VK *vk, struct VK_Deletion_Entry entry)
+{
+    entry.frame = vk->frame;
+    // NOTE: Whatever is still in the staging queue goes out with the next flush, which signals the value after this one
+    entry.upload_value = vk->upload_value + (vk->staging_queue.entries_top ? 1 : 0);
 
-    vk->staging_buffer.top = 0;
-    vk->staging_queue.entries_top = 0;
+    if(entry.handle) {
+        vk_forget_acquires(vk, entry.handle);
+    }
 
-    LOG_PREINIT("Finished all pending staging buffer uploads\n");
+    *vk_deletion_queue_push(&vk->retire_queue) = entry;
 }
 
-static void vk_ensure_staging_buffer_capacity(struct VK *vk, size_t size)
+// The handle is destroyed once no frame on the GPU can be using it anymore
+static void vk_retire(struct VK *vk, void (*func)(), void *handle)
 {
-    const bool staging_buffer_full = size > vk->staging_buffer.capacity - vk->staging_buffer.top;
-    const bool staging_queue_full = vk->staging_queue.entries_top == countof(vk->staging_queue.entries);
-    if(staging_buffer_full || staging_queue_full) {
-        vk_staging_queue_flush(vk);
-    }
-
-    assert(size < vk->staging_buffer.capacity - vk->staging_buffer.top);    
+    vk_retire_entry(vk, (struct VK_Deletion_Entry) {
+        .func = func,
+        .handle = handle
+    });
 }
 
-static void vk_update_image(struct VK *vk, struct Texture texture, void *data)
+// Same as vk_retire, and then the memory it was bound to goes back to the arena. func can be NULL for just the memory.
+static void vk_retire_with_memory(struct VK *vk, void (*func)(), void *handle, struct VK_Mem_Arena *arena, struct VK_Mem_Allocation allocation, enum Mem_Category category)
 {
-    // NOTE: We are fully expecting the format to be RGBA8, hard-coded!
-    size_t size = texture.extent.width * texture.extent.height * 4;
+    vk_retire_entry(vk, (struct VK_Deletion_Entry) {
+        .func = func,
+        .handle = handle,
+        .mem_arena = arena,
+        .allocation = allocation,
+        .category = category
+    });
+}
 
-    /* Flush the staging queue if we can't fit any more */
-    vk_ensure_staging_buffer_capacity(vk, size);
+// A range of e.g. a buffer arena's ranges, like a mesh's geometry, which can be allocated again once no frame on the GPU can be reading it
+static void vk_retire_range(struct VK *vk, struct Range_Allocator *ranges, uint32_t range)
+{
+    vk_retire_entry(vk, (struct VK_Deletion_Entry) {
+        .ranges = ranges,
+        .range = range
+    });
+}
 
-    /* Allocate from the staging buffer */
-    const uint64_t staging_buffer_offset = vk_buffer_arena_push(vk, &vk->staging_buffer, size);
-    void *mapped_mem = (char *)vk->staging_buffer_mapping + staging_buffer_offset;
+static void vk_deletion_entry_destroy(struct VK *vk, const struct VK_Deletion_Entry *entry)
+{
+    if(entry->func) {
+        entry->func(vk->device, entry->handle, NULL);
+    }
 
-    /* Copy data */
-    memcpy(mapped_mem, data, size);
+    if(entry->mem_arena) {
+        vk_mem_arena_free(vk, entry->mem_arena, entry->allocation, entry->category);
+    }
 
-    /* Add entry to staging queue */
-    vk->staging_queue.entries[vk->staging_queue.entries_top++] = (struct VK_Staging_Entry) {
-        .offset_in_staging_buffer = staging_buffer_offset,
-        .destination_image = texture.image,
-        .destination_image_extent = texture.extent
-    };
+    if(entry->ranges) {
+        range_free(entry->ranges, entry->range);
+    }
 }
 
-static void *vk_map_buffer_staged(struct VK *vk, struct VK_Buffer buffer, size_t offset, size_t size)
+// NOTE: Once per frame, after render has counted up vk->frame and waited on its fence
+static void vk_retire_update(struct VK *vk)
 {
-    assert(offset + size <= buffer.size);
-
-    /* Flush the staging queue if we can't fit any more */
-    vk_ensure_staging_buffer_capacity(vk, size);
+    struct VK_Deletion_Queue *queue = &vk->retire_queue;
+    const uint64_t upload_completed = queue->count ? vk_upload_completed(vk) : 0;
+    while(queue->count && vk_deletion_queue_front(queue)->frame + FRAMES_IN_FLIGHT <= vk->frame &&
+          vk_deletion_queue_front(queue)->upload_value <= upload_completed)
+    {
+        vk_deletion_entry_destroy(vk, vk_deletion_queue_front(queue));
+        vk_deletion_queue_pop(queue);
+    }
+}
 
-    /* Allocate from the staging buffer */
-    const uint64_t staging_buffer_offset = vk_buffer_arena_push(vk, &vk->staging_buffer, size);
-    void *mapped_mem = (char *)vk->staging_buffer_mapping + staging_buffer_offset;
+static struct VK_Buffer vk_create_buffer(struct VK *vk, struct VK_Mem_Arena *arena, VkBufferUsageFlagBits usage, size_t size, enum Mem_Category category)
+{
+    if(arena == &vk->gpu_mem) {
+        usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    }
 
-    /* Add entry to staging queue */
-    // NOTE: Normally this should be done on unmap, but since we don't have async anything yet, this is still fine.
-    vk->staging_queue.entries[vk->staging_queue.entries_top++] = (struct VK_Staging_Entry) {
-        .destination_buffer = buffer.handle,
+    VkBufferCreateInfo buffer_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .flags = 0,
         .size = size,
-        .offset_in_staging_buffer = staging_buffer_offset,
-        .offset_in_destination_buffer = offset
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
     };
 
-    return mapped_mem;
+    VkBuffer buffer;
+
+    VK_CHECK(vkCreateBuffer(vk->device, &buffer_info, NULL, &buffer));
+
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(vk->device, buffer, &mem_requirements);
+
+    const struct VK_Mem_Allocation allocation = vk_mem_arena_push(vk, arena, mem_requirements, category);
+    vkBindBufferMemory(vk->device, buffer, allocation.memory, allocation.offset);
+
+    vk_push_deletable(vk, vkDestroyBuffer, buffer);
+
+    LOG("Created buffer\n");
+    
+    return (struct VK_Buffer) {
+        .handle = buffer,
+        .size = size, // NOTE: Here we do not use mem_requirements.size because that can be bigger than the wanted buffer size
+        .arena = arena,
+        .allocation = allocation,
+        .category = category
+    };
 }
 
-static void vk_unmap_buffer_staged(struct VK *vk, struct VK_Buffer buffer, void *mapped_mem)
+// Retires it instead of leaving it until shutdown, it's destroyed and its memory given back once no frame can be using it
+static void vk_destroy_buffer(struct VK *vk, struct VK_Buffer *buffer)
 {
-    //vkUnmapMemory(vk->device, vk->scratch_mem.allocation);
+    vk_forget_deletable(vk, buffer->handle);
+    vk_retire_with_memory(vk, vkDestroyBuffer, buffer->handle, buffer->arena, buffer->allocation, buffer->category);
+
+    *buffer = (struct VK_Buffer){0};
 }
 
-static void vk_update_buffer(struct VK *vk, struct VK_Buffer buf, const void *data, size_t offset, size_t size)
+// Growable arenas relocate to a bigger buffer when something doesn't fit, see Arena Growth Notes
+// Initialized in place, like vk_alloc_mem_arena, since the range allocator makes it too big to pass around
+static void vk_alloc_buffer_arena(struct VK *vk, struct VK_Buffer_Arena *out, struct VK_Mem_Arena *arena, VkBufferUsageFlagBits usage, size_t capacity, enum Mem_Category category, bool growable)
 {
-    assert(offset + size <= buf.size);
-    
-    if(buf.arena == &vk->scratch_mem) {
-        void *mapped_mem;
-        vkMapMemory(vk->device, vk->scratch_mem.allocation, buf.offset, buf.size, 0, &mapped_mem);
-        memcpy((char *)mapped_mem + offset, data, size);
-        vkUnmapMemory(vk->device, vk->scratch_mem.allocation);        
+    if(growable) {
+        usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     }
-    else if(buf.arena == &vk->gpu_mem) {
-        void *mapped_mem = vk_map_buffer_staged(vk, buf, offset, size);
-        memcpy(mapped_mem, data, size);
-        vk_unmap_buffer_staged(vk, buf, mapped_mem);
+
+    out->buffer = vk_create_buffer(vk, arena, usage, capacity, category);
+    out->capacity = capacity;
+    out->category = category;
+    out->usage = usage;
+    out->growable = growable;
+    out->generation = 0;
+    range_allocator_init(&out->ranges, capacity);
+
+    LOG("Created buffer-backed arena with size: %.1fKB\n", (float)capacity / 1024.0f);
+}
+
+// Returns false if it doesn't fit, without growing. out_allocation is what to free it with, and can be NULL.
+static bool vk_buffer_arena_try_push(struct VK *vk, struct VK_Buffer_Arena *arena, size_t size, uint64_t *out_offset, uint32_t *out_allocation)
+{
+    const uint32_t allocation = range_alloc(&arena->ranges, size, VK_BUFFER_ARENA_ALIGNMENT, out_offset);
+    if(allocation == RANGE_NONE) {
+        return false;
     }
-    else {
-        panic("Tried to vk_update_buffer on an unknown mem arena");
+
+    LOG_PREINIT("Push to buffer arena %p size: %.3fKB (%.3f%% usage)\n", arena, (float)size / 1024.0f, 100 * ((float)arena->ranges.used / (float)arena->capacity));
+
+    if(out_allocation) {
+        *out_allocation = allocation;
     }
+
+    return true;
 }
 
-// NOTE: With WITH_GROUPED_STAGING_TRANSFER on, the buffer returned is not usable until vk_staging_queue_flush is called.
-static struct VK_Buffer vk_create_and_upload_buffer(struct VK *vk, VkBufferUsageFlagBits usage, const void *data, size_t size)
+// NOTE: The range must not be in use by the GPU anymore
+static void vk_buffer_arena_free(struct VK *vk, struct VK_Buffer_Arena *arena, uint32_t allocation)
 {
-	struct VK_Buffer buffer = vk_create_buffer(vk, &vk->gpu_mem, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size);
-    vk_update_buffer(vk, buffer, data, 0, size);
+    range_free(&arena->ranges, allocation);
+}
 
-	return buffer;
+// Frees everything at once, this is cheap. Keeps the high-water mark for the memory report.
+static void vk_buffer_arena_reset(struct VK *vk, struct VK_Buffer_Arena *arena)
+{
+    const uint64_t peak_used = arena->ranges.peak_used;
+    range_allocator_init(&arena->ranges, arena->capacity);
+    arena->ranges.peak_used = peak_used;
 }
 
-// TODO: Expose more options as parameters
-static VkPipeline vk_create_pipeline(struct VK *vk,
-                                     VkPipelineLayout layout,
-                                     VkPipelineShaderStageCreateInfo *shader_stages,
-                                     int shader_stage_count)
+/* Memory report (see Memory Report Notes) */
+
+// NOTE: The arena must stay where it is, it's read from whenever a report is made
+static void vk_mem_report_track_mem_arena(struct VK *vk, const char *name, const struct VK_Mem_Arena *arena)
 {
-    VkPipelineVertexInputStateCreateInfo vertex_input_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-    };
+    struct Mem_Stats *stats = &vk->mem_stats;
+    CHECK(stats->arena_count < countof(stats->arenas), "Too many arenas for the memory report");
 
-    VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-        .primitiveRestartEnable = VK_FALSE
+    stats->arenas[stats->arena_count++] = (struct Mem_Arena_Report) {
+        .name = name,
+        .mem_arena = arena
     };
+}
 
-    VkViewport viewport = {
-        .x = 0.0f,
-        .y = 0.0f,
-        .width = vk->swapchain_extent.width,
-        .height = vk->swapchain_extent.height,
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f
-    };
+// NOTE: Same as above
+static void vk_mem_report_track_buffer_arena(struct VK *vk, const char *name, const struct VK_Buffer_Arena *arena)
+{
+    struct Mem_Stats *stats = &vk->mem_stats;
+    CHECK(stats->arena_count < countof(stats->arenas), "Too many arenas for the memory report");
 
-    VkRect2D scissor = {
-        .offset = {0, 0},
-        .extent = vk->swapchain_extent
+    stats->arenas[stats->arena_count++] = (struct Mem_Arena_Report) {
+        .name = name,
+        .buffer_arena = arena
     };
+}
 
-    VkPipelineViewportStateCreateInfo viewport_state_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .pViewports = &viewport,
-        .scissorCount = 1,
-        .pScissors = &scissor
-    };
+static void vk_mem_report_query(struct VK *vk, struct Mem_Report *out)
+{
+    *out = (struct Mem_Report){0};
 
-    VkPipelineRasterizationStateCreateInfo rasterizer_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .depthClampEnable = VK_FALSE,
-        .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .lineWidth = 1.0f, // NOTE: Anything thicker than 1 needs a capability enabled
-        //.cullMode = VK_CULL_MODE_BACK_BIT,
-        .cullMode = VK_CULL_MODE_NONE,
-        .frontFace = VK_FRONT_FACE_CLOCKWISE,
-        .depthBiasEnable = VK_FALSE,
-        .depthBiasConstantFactor = 0.0f,
-        .depthBiasClamp = 0.0f,
-        .depthBiasSlopeFactor = 0.0f
+    /* heaps */
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT
     };
 
-    VkPipelineMultisampleStateCreateInfo multisampling_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .sampleShadingEnable = VK_FALSE,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-        .minSampleShading = 1.0f,
-        .pSampleMask = NULL,
-        .alphaToCoverageEnable = VK_FALSE,
-        .alphaToOneEnable = VK_FALSE
+    VkPhysicalDeviceMemoryProperties2 mem_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = vk->memory_budget ? &budget_properties : NULL
     };
 
-    VkPipelineColorBlendAttachmentState color_blend_attachment = {
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-        .blendEnable = VK_FALSE,
-        /*
-        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .colorBlendOp = VK_BLEND_OP_ADD,
-        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .alphaBlendOp = VK_BLEND_OP_ADD
-        */
-    };
+    vkGetPhysicalDeviceMemoryProperties2(vk->physical_device, &mem_properties);
 
-    VkPipelineColorBlendStateCreateInfo color_blending = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .logicOpEnable = VK_FALSE,
-        .logicOp = VK_LOGIC_OP_COPY,
-        .attachmentCount = 1,
-        .pAttachments = &color_blend_attachment,
-    };
+    const VkPhysicalDeviceMemoryProperties *props = &mem_properties.memoryProperties;
+    out->heap_count = props->memoryHeapCount;
+    out->has_budget = vk->memory_budget;
 
-    VkPipelineDepthStencilStateCreateInfo depth_stencil = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
-        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
-        .depthBoundsTestEnable = VK_FALSE, // TODO: Check what this does
-        .minDepthBounds = 0.0f,
-        .maxDepthBounds = 1.0f,
-        .stencilTestEnable = VK_FALSE
-    };
+    for(uint32_t i = 0; i < props->memoryHeapCount; ++i) {
+        out->heaps[i].size = props->memoryHeaps[i].size;
+        if(vk->memory_budget) {
+            out->heaps[i].budget = budget_properties.heapBudget[i];
+            out->heaps[i].usage = budget_properties.heapUsage[i];
+        }
+    }
 
-    VkGraphicsPipelineCreateInfo pipeline_info = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = shader_stage_count,
-        .pStages = shader_stages,
-        .pVertexInputState = &vertex_input_info,
-        .pInputAssemblyState = &input_assembly_info,
-        .pViewportState = &viewport_state_info,
-        .pRasterizationState = &rasterizer_info,
-        .pMultisampleState = &multisampling_info,
-        .pColorBlendState = &color_blending,
-        .pDepthStencilState = &depth_stencil,
-        .layout = layout,
-        .subpass = 0,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .renderPass = vk->render_pass // TODO: Pass this in
-    };
+    /* categories */
+    memcpy(out->categories, vk->mem_stats.categories, sizeof(out->categories));
 
-    VkPipeline pipeline;
-    VK_CHECK(vkCreateGraphicsPipelines(vk->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline));
-    vk_push_deletable(vk, vkDestroyPipeline, pipeline);
+    /* arenas */
+    out->arena_count = vk->mem_stats.arena_count;
 
-    LOG("Created pipeline\n");
+    for(uint32_t i = 0; i < vk->mem_stats.arena_count; ++i) {
+        const struct Mem_Arena_Report *arena = &vk->mem_stats.arenas[i];
+        out->arenas[i].name = arena->name;
 
-    return pipeline;
+        if(arena->buffer_arena) {
+            const struct Range_Allocator *ranges = &arena->buffer_arena->ranges;
+
+            out->arenas[i].category = s_mem_category_names[arena->buffer_arena->category];
+            out->arenas[i].used = ranges->used;
+            out->arenas[i].peak = ranges->peak_used;
+            out->arenas[i].capacity = ranges->capacity;
+            out->arenas[i].allocation_count = ranges->allocation_count;
+            out->arenas[i].fragmentation = range_allocator_fragmentation(ranges);
+        }
+        else {
+            const struct VK_Mem_Arena *mem_arena = arena->mem_arena;
+
+            // Free space is only usable within a block, so the largest free range of any block against all of the free space
+            uint64_t largest_free = 0;
+            for(uint32_t j = 0; j < mem_arena->block_count; ++j) {
+                largest_free = MAX(largest_free, range_allocator_largest_free(&mem_arena->blocks[j].ranges));
+                out->arenas[i].allocation_count += mem_arena->blocks[j].ranges.allocation_count;
+            }
+
+            const uint64_t free_bytes = mem_arena->capacity - mem_arena->used;
+
+            out->arenas[i].category = "mixed";
+            out->arenas[i].used = mem_arena->used;
+            out->arenas[i].peak = mem_arena->peak_used;
+            out->arenas[i].capacity = mem_arena->capacity;
+            out->arenas[i].block_count = mem_arena->block_count;
+            out->arenas[i].fragmentation = free_bytes ? 1.0 - (double)largest_free / (double)free_bytes : 0.0;
+
+            out->heaps[props->memoryTypes[mem_arena->memory_type_idx].heapIndex].arena_capacity += mem_arena->capacity;
+        }
+    }
 }
 
-static VkPipeline vk_create_pipeline_and_shaders(struct VK *vk,
-                                           const char *vert_path,
-                                           const char *frag_path,
-                                           VkPipelineLayout layout)
+static void vk_mem_report_print(struct VK *vk)
 {
-    assert(frag_path && vert_path);
+    struct Mem_Report report;
+    vk_mem_report_query(vk, &report);
 
-    VkShaderModule shader_vert = vk_create_shader_module_from_file(vk, vert_path);
-    VkShaderModule shader_frag = vk_create_shader_module_from_file(vk, frag_path);
+    const double mb = 1024.0 * 1024.0;
 
-    VkPipelineShaderStageCreateInfo shader_stages[] = {
-        {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_VERTEX_BIT,
-            .module = shader_vert,
-            .pName = "main"
+    LOG("Memory report:\n");
+    for(uint32_t i = 0; i < report.heap_count; ++i) {
+        const struct Mem_Heap_Report *heap = &report.heaps[i];
+        if(report.has_budget) {
+            LOG("\tHeap %u: %.1fMB, %.1fMB used of %.1fMB budget by everything, %.1fMB of that is our arenas%s\n", i, heap->size / mb,
+                heap->usage / mb, heap->budget / mb, heap->arena_capacity / mb, heap->usage > heap->budget ? " (OVER BUDGET)" : "");
+        }
+        else {
+            LOG("\tHeap %u: %.1fMB, %.1fMB of that is our arenas (no VK_EXT_memory_budget)\n", i, heap->size / mb, heap->arena_capacity / mb);
+        }
+    }
+
+    for(uint32_t i = 0; i < MEM_CATEGORY_COUNT; ++i) {
+        const struct Mem_Category_Stats *category = &report.categories[i];
+        LOG("\t%-16s %8.2fMB (peak %8.2fMB) in %u allocations\n", s_mem_category_names[i], category->current / mb, category->peak / mb, category->allocation_count);
+    }
+
+    for(uint32_t i = 0; i < report.arena_count; ++i) {
+        const uint64_t capacity = MAX(report.arenas[i].capacity, 1);
+        LOG("\t%-16s %8.2fMB of %8.2fMB (%5.1f%%), peak %8.2fMB (%5.1f%%), %u allocations, %.1f%% fragmentation [%s]", report.arenas[i].name,
+            report.arenas[i].used / mb, report.arenas[i].capacity / mb, 100.0 * report.arenas[i].used / capacity,
+            report.arenas[i].peak / mb, 100.0 * report.arenas[i].peak / capacity,
+            report.arenas[i].allocation_count, 100.0f * report.arenas[i].fragmentation, report.arenas[i].category);
+
+        if(report.arenas[i].block_count > 1) {
+            LOG(" in %u blocks", report.arenas[i].block_count);
+        }
+        LOG("\n");
+    }
+
+    LOG("\tDeletion queues: %u retired and waiting on the GPU, %u for shutdown\n", vk->retire_queue.count, vk->deletion_queue.count);
+    LOG("\tUploads: %llu submitted, %u + %u acquires pending, %u stalls on a full partition\n", (unsigned long long)vk->upload_value,
+        vk->pending_acquires.buffer_count, vk->pending_acquires.image_count, vk->upload_stalls);
+}
+
+// Bytes per texel, or per block for block compressed formats (with the block size in out_block_dim)
+static uint32_t vk_format_block_size(VkFormat format, uint32_t *out_block_dim)
+{
+    switch(format) {
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        *out_block_dim = 4;
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        *out_block_dim = 4;
+        return 16;
+    default:
+        // NOTE: Everything else is assumed to be one of the 8-bit RGBA formats
+        *out_block_dim = 1;
+        return 4;
+    }
+}
+
+static VkExtent3D texture_level_extent(VkExtent3D extent, uint32_t level)
+{
+    return (VkExtent3D){ MAX(extent.width >> level, 1), MAX(extent.height >> level, 1), 1 };
+}
+
+// The region of the buffer a level takes up when the chain is tightly packed, with the copy for it
+static VkBufferImageCopy texture_level_copy(VkFormat format, VkExtent3D extent, uint32_t level, uint64_t buffer_offset, uint64_t *out_size)
+{
+    uint32_t block_dim;
+    const uint32_t block_size = vk_format_block_size(format, &block_dim);
+
+    const VkExtent3D level_extent = texture_level_extent(extent, level);
+    const uint32_t row_length = (uint32_t)align_address(level_extent.width, block_dim);
+    const uint32_t image_height = (uint32_t)align_address(level_extent.height, block_dim);
+
+    *out_size = (uint64_t)(row_length / block_dim) * (image_height / block_dim) * block_size;
+
+    return (VkBufferImageCopy) {
+        .bufferOffset = buffer_offset,
+        .bufferRowLength = row_length,
+        .bufferImageHeight = image_height,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = level,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
         },
-        {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .module = shader_frag,
-            .pName = "main"
+        .imageExtent = level_extent
+    };
+}
+
+static uint64_t texture_mip_chain_size(VkFormat format, VkExtent3D extent, uint32_t mip_levels)
+{
+    uint64_t size = 0;
+    for(uint32_t level = 0; level < mip_levels; ++level) {
+        uint64_t level_size;
+        texture_level_copy(format, extent, level, 0, &level_size);
+        size += level_size;
+    }
+
+    return size;
+}
+
+// Copies mip levels / array layers from a buffer, after transitioning them to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+// Returns the subresources it covers, for vk_cmd_release_image once the upload is done with the image.
+static VkImageSubresourceRange vk_cmd_copy_buffer_to_image(VkCommandBuffer cmdbuf, VkBuffer src_buffer, VkImage image, const VkBufferImageCopy *regions, uint32_t region_count)
+{
+    // NOTE: The barriers cover every level and layer between the lowest and highest ones in the regions,
+    //       and discard their contents, so the regions must write all of those subresources completely.
+    //       That's the case for whole mip chains, which is all that's uploaded for now.
+    uint32_t level_min = UINT32_MAX, level_max = 0;
+    uint32_t layer_min = UINT32_MAX, layer_max = 0;
+    for(uint32_t i = 0; i < region_count; ++i) {
+        const VkImageSubresourceLayers *sub = &regions[i].imageSubresource;
+        level_min = MIN(level_min, sub->mipLevel);
+        level_max = MAX(level_max, sub->mipLevel);
+        layer_min = MIN(layer_min, sub->baseArrayLayer);
+        layer_max = MAX(layer_max, sub->baseArrayLayer + sub->layerCount - 1);
+    }
+
+    const VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, // TODO: This should not be hard-coded!
+        .baseMipLevel = level_min,
+        .levelCount = level_max - level_min + 1,
+        .baseArrayLayer = layer_min,
+        .layerCount = layer_max - layer_min + 1,
+    };
+
+    {
+        // Transition to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+        VkImageMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = range,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT
+        };
+
+        vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+    }
+
+    vkCmdCopyBufferToImage(cmdbuf, src_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region_count, regions);
+
+    return range;
+}
+
+/* Uploads (see Transfer Queue Notes) */
+
+// Hands a buffer range that an upload wrote over to the graphics queue.
+// value is what the upload's submit signals, the acquire waits in pending_acquires for a graphics submit that waits on it.
+static void vk_cmd_release_buffer(struct VK *vk, VkCommandBuffer cmdbuf, VkBuffer buffer, uint64_t offset, uint64_t size, uint64_t value)
+{
+    // NOTE: On a single queue, vk_cmd_end_upload's barrier is all there is to it
+    if(vk->queue_transfer_idx == vk->queue_graphics_idx) {
+        return;
+    }
+
+    struct VK_Pending_Acquires *acquires = &vk->pending_acquires;
+    CHECK(acquires->buffer_count < countof(acquires->buffers), "Too many pending buffer acquires");
+
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcQueueFamilyIndex = vk->queue_transfer_idx,
+        .dstQueueFamilyIndex = vk->queue_graphics_idx,
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = 0
+    };
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_UPLOAD_ACCESS;
+    acquires->buffers[acquires->buffer_count] = barrier;
+    acquires->buffer_values[acquires->buffer_count++] = value;
+}
+
+// Same for an image, which also goes to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+static void vk_cmd_release_image(struct VK *vk, VkCommandBuffer cmdbuf, VkImage image, VkImageSubresourceRange range, uint64_t value)
+{
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = range,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+    };
+
+    // On a single queue it's only the layout transition
+    if(vk->queue_transfer_idx == vk->queue_graphics_idx) {
+        vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+        return;
+    }
+
+    struct VK_Pending_Acquires *acquires = &vk->pending_acquires;
+    CHECK(acquires->image_count < countof(acquires->images), "Too many pending image acquires");
+
+    // NOTE: Both halves name the same layouts, the transition itself only happens once in between
+    barrier.srcQueueFamilyIndex = vk->queue_transfer_idx;
+    barrier.dstQueueFamilyIndex = vk->queue_graphics_idx;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    acquires->images[acquires->image_count] = barrier;
+    acquires->image_values[acquires->image_count++] = value;
+}
+
+// Makes the upload's buffer writes visible to the graphics queue when it's the same queue, after the last copy
+static void vk_cmd_end_upload(struct VK *vk, VkCommandBuffer cmdbuf)
+{
+    if(vk->queue_transfer_idx != vk->queue_graphics_idx) {
+        return;
+    }
+
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_UPLOAD_ACCESS
+    };
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_UPLOAD_STAGES, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+// Records the pending acquires of the uploads up to and including value.
+// NOTE: The submit has to wait on upload_timeline reaching value, with VK_UPLOAD_STAGES, which the barrier starts from.
+static void vk_cmd_acquire_uploads_until(struct VK *vk, VkCommandBuffer cmdbuf, uint64_t value)
+{
+    struct VK_Pending_Acquires *acquires = &vk->pending_acquires;
+
+    uint32_t buffer_count = 0;
+    while(buffer_count < acquires->buffer_count && acquires->buffer_values[buffer_count] <= value) {
+        ++buffer_count;
+    }
+
+    uint32_t image_count = 0;
+    while(image_count < acquires->image_count && acquires->image_values[image_count] <= value) {
+        ++image_count;
+    }
+
+    if(!buffer_count && !image_count) {
+        return;
+    }
+
+    vkCmdPipelineBarrier(cmdbuf, VK_UPLOAD_STAGES, VK_UPLOAD_STAGES, 0, 0, NULL, buffer_count, acquires->buffers, image_count, acquires->images);
+
+    acquires->buffer_count -= buffer_count;
+    memmove(acquires->buffers, acquires->buffers + buffer_count, acquires->buffer_count * sizeof(acquires->buffers[0]));
+    memmove(acquires->buffer_values, acquires->buffer_values + buffer_count, acquires->buffer_count * sizeof(acquires->buffer_values[0]));
+
+    acquires->image_count -= image_count;
+    memmove(acquires->images, acquires->images + image_count, acquires->image_count * sizeof(acquires->images[0]));
+    memmove(acquires->image_values, acquires->image_values + image_count, acquires->image_count * sizeof(acquires->image_values[0]));
+}
+
+static VkCommandBuffer vk_one_time_commands_begin(struct VK *vk, VkCommandPool pool)
+{
+    VkCommandBufferAllocateInfo cmd_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = pool,
+        .commandBufferCount = 1,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
+    };
+
+    VkCommandBuffer cmdbuf;
+    VK_CHECK(vkAllocateCommandBuffers(vk->device, &cmd_alloc_info, &cmdbuf));
+
+    VkCommandBufferBeginInfo cmd_begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pInheritanceInfo = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VK_CHECK(vkBeginCommandBuffer(cmdbuf, &cmd_begin_info));
+
+    return cmdbuf;
+}
+
+// A one-time command buffer on the graphics queue, vk_graphics_commands_submit runs it and waits for it.
+// Everything uploaded so far is acquired first, so it can use all of it.
+static VkCommandBuffer vk_graphics_commands_begin(struct VK *vk)
+{
+    VkCommandBuffer cmdbuf = vk_one_time_commands_begin(vk, vk->command_pool_upload);
+    vk_cmd_acquire_uploads_until(vk, cmdbuf, vk->upload_value);
+
+    return cmdbuf;
+}
+
+static void vk_graphics_commands_submit(struct VK *vk, VkCommandBuffer cmdbuf)
+{
+    VK_CHECK(vkEndCommandBuffer(cmdbuf));
+
+    const VkPipelineStageFlags wait_stage = VK_UPLOAD_STAGES;
+    VkTimelineSemaphoreSubmitInfo timeline_info = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = 1,
+        .pWaitSemaphoreValues = &vk->upload_value
+    };
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &vk->upload_timeline,
+        .pWaitDstStageMask = &wait_stage,
+        .pCommandBuffers = &cmdbuf,
+        .commandBufferCount = 1
+    };
+
+    VK_CHECK(vkQueueSubmit(vk->queue_graphics, 1, &submit_info, vk->upload_fence));
+
+    vkWaitForFences(vk->device, 1, &vk->upload_fence, true, UINT64_MAX);
+    vkResetFences(vk->device, 1, &vk->upload_fence);
+    vkResetCommandPool(vk->device, vk->command_pool_upload, 0);
+}
+
+// Makes room for an upload that releases up to count buffer ranges and images, by acquiring everything right away if needed
+static void vk_reserve_acquires(struct VK *vk, uint32_t count)
+{
+    const struct VK_Pending_Acquires *acquires = &vk->pending_acquires;
+    if(acquires->buffer_count + count <= VK_MAX_PENDING_ACQUIRES && acquires->image_count + count <= VK_MAX_PENDING_ACQUIRES) {
+        return;
+    }
+
+    CHECK(count <= VK_MAX_PENDING_ACQUIRES, "Upload releases more than VK_MAX_PENDING_ACQUIRES");
+    LOG("Too many pending acquires, acquiring them now\n");
+
+    vk_graphics_commands_submit(vk, vk_graphics_commands_begin(vk));
+}
+
+// Submits an upload to the transfer queue without waiting, returns the upload_timeline value it signals once it's done
+static uint64_t vk_transfer_commands_submit(struct VK *vk, VkCommandBuffer cmdbuf)
+{
+    VK_CHECK(vkEndCommandBuffer(cmdbuf));
+
+    const uint64_t value = ++vk->upload_value;
+    VkTimelineSemaphoreSubmitInfo timeline_info = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &value
+    };
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &vk->upload_timeline,
+        .pCommandBuffers = &cmdbuf,
+        .commandBufferCount = 1
+    };
+
+    VK_CHECK(vkQueueSubmit(vk->queue_transfer, 1, &submit_info, NULL));
+
+    return value;
+}
+
+static void vk_staging_queue_flush(struct VK *vk)
+{
+    // NOTE: Nothing to submit and wait for, which is always the case for buffers with unified memory
+    if(!vk->staging_queue.entries_top) {
+        return;
+    }
+
+    struct VK_Upload_Partition *partition = &vk->uploads[vk->upload_partition];
+
+    vk_reserve_acquires(vk, vk->staging_queue.entries_top);
+
+    VkCommandBuffer cmdbuf = vk_one_time_commands_begin(vk, partition->command_pool);
+    const uint64_t value = vk->upload_value + 1; // What vk_transfer_commands_submit signals below
+
+    /* Record commands for every staged entry */
+    for(uint32_t i = 0; i < vk->staging_queue.entries_top; ++i) {
+        struct VK_Staging_Entry *entry = &vk->staging_queue.entries[i];
+        uint32_t run_count = 1;
+
+        if(entry->destination_buffer) {
+            struct VkBufferCopy buffer_copy = {
+                .srcOffset = entry->offset_in_staging_buffer,
+                .dstOffset = entry->offset_in_destination_buffer,
+                .size = entry->size
+            };
+
+            vkCmdCopyBuffer(cmdbuf, partition->staging_buffer.buffer.handle, entry->destination_buffer, 1, &buffer_copy);
+            vk_cmd_release_buffer(vk, cmdbuf, entry->destination_buffer, entry->offset_in_destination_buffer, entry->size, value);
+        }
+
+        if(entry->destination_image) {
+            // Consecutive entries for the same image (i.e. its mip levels) share one copy and one pair of barriers
+            VkBufferImageCopy regions[TEXTURE_MAX_MIPS];
+            run_count = 0;
+            while(run_count < countof(regions) && i + run_count < vk->staging_queue.entries_top &&
+                  vk->staging_queue.entries[i + run_count].destination_image == entry->destination_image)
+            {
+                const struct VK_Staging_Entry *level = &vk->staging_queue.entries[i + run_count];
+                regions[run_count++] = (VkBufferImageCopy) {
+                    .bufferOffset = level->offset_in_staging_buffer,
+                    .bufferRowLength = level->destination_image_row_length,
+                    .bufferImageHeight = level->destination_image_image_height,
+                    .imageSubresource = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, // TODO: This should not be hard-coded!
+                        .mipLevel = level->destination_image_mip_level,
+                        .baseArrayLayer = level->destination_image_array_layer,
+                        .layerCount = 1,
+                    },
+                    .imageExtent = level->destination_image_extent
+                };
+            }
+
+            const VkImageSubresourceRange range = vk_cmd_copy_buffer_to_image(cmdbuf, partition->staging_buffer.buffer.handle, entry->destination_image, regions, run_count);
+            vk_cmd_release_image(vk, cmdbuf, entry->destination_image, range, value);
         }
+
+        i += run_count - 1;
+    }
+
+    vk_cmd_end_upload(vk, cmdbuf);
+
+    /* Submit copy commands, the next frame waits for them on the GPU */
+    partition->value = vk_transfer_commands_submit(vk, cmdbuf);
+    assert(partition->value == value);
+
+    vk->upload_wait_value = partition->value;
+    vk->staging_queue.entries_top = 0;
+
+    /* Stage into the next partition, which can still be copying from the last time around */
+    vk->upload_partition = (vk->upload_partition + 1) % VK_UPLOAD_PARTITIONS;
+    partition = &vk->uploads[vk->upload_partition];
+
+    if(vk_upload_completed(vk) < partition->value) {
+        vk->upload_stalls++;
+
+        VkSemaphoreWaitInfo wait_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &vk->upload_timeline,
+            .pValues = &partition->value
+        };
+        VK_CHECK(vkWaitSemaphores(vk->device, &wait_info, UINT64_MAX));
+    }
+
+    vkResetCommandPool(vk->device, partition->command_pool, 0);
+    vk_buffer_arena_reset(vk, &partition->staging_buffer);
+
+    LOG_PREINIT("Submitted all pending staging buffer uploads\n");
+}
+
+// Flushes the staging queue and records the acquires the frame needs: the ones of every staging flush so far,
+// and of whatever else has finished by now (stream batches being retired). See Transfer Queue Notes.
+// NOTE: The frame's submit has to wait on upload_wait_value.
+static void vk_cmd_acquire_uploads(struct VK *vk, VkCommandBuffer cmdbuf)
+{
+    vk_staging_queue_flush(vk);
+
+    // NOTE: Waiting on what's already finished doesn't hold anything up, but it's what orders the acquires after the releases
+    vk->upload_wait_value = MAX(vk->upload_wait_value, vk_upload_completed(vk));
+    vk_cmd_acquire_uploads_until(vk, cmdbuf, vk->upload_wait_value);
+}
+
+/* Relocates the arena to a buffer with room for at least size more bytes, see Arena Growth Notes.
+ * NOTE: Command buffers that are still being recorded must not have used the old buffer. */
+static void vk_buffer_arena_grow(struct VK *vk, struct VK_Buffer_Arena *arena, size_t size)
+{
+    const uint64_t new_capacity = MAX(arena->capacity * VK_ARENA_GROWTH, align_address(arena->capacity + size + VK_BUFFER_ARENA_ALIGNMENT, VK_BUFFER_ARENA_ALIGNMENT));
+
+    LOG("Growing buffer arena %p from %.1fKB to %.1fKB\n", arena, (float)arena->capacity / 1024.0f, (float)new_capacity / 1024.0f);
+
+    // Whatever is queued for the old buffer has to land in it before it's copied
+    vk_staging_queue_flush(vk);
+
+    struct VK_Buffer new_buffer = vk_create_buffer(vk, arena->buffer.arena, arena->usage, new_capacity, arena->category);
+
+    // NOTE: Waits for the uploads still copying into the old buffer on the GPU, and acquires them (see Transfer Queue Notes)
+    VkCommandBuffer cmdbuf = vk_graphics_commands_begin(vk);
+
+    // Earlier frames' copies within the old buffer (geometry compaction)
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+    };
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+    VkBufferCopy buffer_copy = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = arena->capacity
+    };
+    vkCmdCopyBuffer(cmdbuf, arena->buffer.handle, new_buffer.handle, 1, &buffer_copy);
+
+    vk_graphics_commands_submit(vk, cmdbuf);
+
+    // NOTE: Frames that are still on the GPU keep drawing from the old one
+    vk_destroy_buffer(vk, &arena->buffer);
+
+    arena->buffer = new_buffer;
+    arena->capacity = new_capacity;
+    arena->generation++;
+    range_allocator_grow(&arena->ranges, new_capacity);
+}
+
+static uint64_t vk_buffer_arena_push(struct VK *vk, struct VK_Buffer_Arena *arena, size_t size, uint32_t *out_allocation)
+{
+    uint64_t buffer_address;
+    if(!vk_buffer_arena_try_push(vk, arena, size, &buffer_address, out_allocation)) {
+        CHECK(arena->growable, "Out of space in buffer arena");
+
+        vk_buffer_arena_grow(vk, arena, size);
+        CHECK(vk_buffer_arena_try_push(vk, arena, size, &buffer_address, out_allocation), "Out of space in buffer arena after growing it");
+    }
+
+    return buffer_address;
+}
+
+// Allocates from the staging buffer, flushing the staging queue first if the data or its entries don't fit anymore
+static uint64_t vk_staging_buffer_push(struct VK *vk, size_t size, uint32_t entry_count)
+{
+    uint64_t staging_buffer_offset;
+
+    const bool staging_queue_full = entry_count > countof(vk->staging_queue.entries) - vk->staging_queue.entries_top;
+    if(staging_queue_full || !vk_buffer_arena_try_push(vk, &vk->uploads[vk->upload_partition].staging_buffer, size, &staging_buffer_offset, NULL)) {
+        vk_staging_queue_flush(vk);
+        CHECK(vk_buffer_arena_try_push(vk, &vk->uploads[vk->upload_partition].staging_buffer, size, &staging_buffer_offset, NULL), "Upload is too big for the staging buffer");
+    }
+
+    return staging_buffer_offset;
+}
+
+// Uploads a whole mip chain, with the levels tightly packed one after the other starting from level 0 (see texture_mip_chain_size)
+static void vk_update_image(struct VK *vk, struct Texture texture, const void *data)
+{
+    const uint64_t size = texture_mip_chain_size(texture.format, texture.extent, texture.mip_levels);
+
+    /* Allocate from the staging buffer, flushing the staging queue if we can't fit any more */
+    // NOTE: All of the levels go in the same submit, so that the copy is recorded with a single pair of barriers
+    const uint64_t staging_buffer_offset = vk_staging_buffer_push(vk, size, texture.mip_levels);
+    void *mapped_mem = (char *)vk->uploads[vk->upload_partition].staging_buffer.buffer.allocation.mapping + staging_buffer_offset;
+
+    /* Copy data */
+    memcpy(mapped_mem, data, size);
+
+    /* Add an entry to the staging queue for every level */
+    uint64_t level_offset = staging_buffer_offset;
+    for(uint32_t level = 0; level < texture.mip_levels; ++level) {
+        uint64_t level_size;
+        const VkBufferImageCopy copy = texture_level_copy(texture.format, texture.extent, level, level_offset, &level_size);
+
+        vk->staging_queue.entries[vk->staging_queue.entries_top++] = (struct VK_Staging_Entry) {
+            .offset_in_staging_buffer = copy.bufferOffset,
+            .destination_image = texture.image,
+            .destination_image_extent = copy.imageExtent,
+            .destination_image_mip_level = level,
+            .destination_image_array_layer = 0,
+            .destination_image_row_length = copy.bufferRowLength,
+            .destination_image_image_height = copy.bufferImageHeight
+        };
+
+        level_offset += level_size;
+    }
+}
+
+/* Returns where to write size bytes of the buffer at offset, there is nothing to do after writing.
+ * NOTE: The copy is queued right away, so everything has to be written before the staging queue is flushed,
+ *       which the next vk_map_buffer_staged or vk_staging_buffer_push can do. */
+static void *vk_map_buffer_staged(struct VK *vk, struct VK_Buffer buffer, size_t offset, size_t size)
+{
+    assert(offset + size <= buffer.size);
+
+    // Mapped memory is written to directly (see Unified Memory Notes)
+    if(buffer.allocation.mapping) {
+        return (char *)buffer.allocation.mapping + offset;
+    }
+
+    /* Allocate from the staging buffer, flushing the staging queue if we can't fit any more */
+    const uint64_t staging_buffer_offset = vk_staging_buffer_push(vk, size, 1);
+    void *mapped_mem = (char *)vk->uploads[vk->upload_partition].staging_buffer.buffer.allocation.mapping + staging_buffer_offset;
+
+    /* Add entry to staging queue */
+    vk->staging_queue.entries[vk->staging_queue.entries_top++] = (struct VK_Staging_Entry) {
+        .destination_buffer = buffer.handle,
+        .size = size,
+        .offset_in_staging_buffer = staging_buffer_offset,
+        .offset_in_destination_buffer = offset
+    };
+
+    return mapped_mem;
+}
+
+static void vk_update_buffer(struct VK *vk, struct VK_Buffer buf, const void *data, size_t offset, size_t size)
+{
+    assert(offset + size <= buf.size);
+    
+    if(buf.allocation.mapping) {
+        memcpy((char *)buf.allocation.mapping + offset, data, size);
+    }
+    else if(buf.arena == &vk->gpu_mem) {
+        void *mapped_mem = vk_map_buffer_staged(vk, buf, offset, size);
+        memcpy(mapped_mem, data, size);
+    }
+    else {
+        panic("Tried to vk_update_buffer on an unknown mem arena");
+    }
+}
+
+/* In mapped memory (see Unified Memory Notes) the data is written straight into the buffer, which is usable right away.
+ * Otherwise the copy is only queued: it's submitted by the next vk_staging_queue_flush, and the buffer can only be used by
+ * a graphics submit that waits on that upload's value and has recorded vk_cmd_acquire_uploads (see Transfer Queue Notes). */
+static struct VK_Buffer vk_create_and_upload_buffer(struct VK *vk, VkBufferUsageFlagBits usage, const void *data, size_t size, enum Mem_Category category)
+{
+	struct VK_Buffer buffer = vk_create_buffer(vk, vk_gpu_buffer_mem(vk), usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, category);
+    vk_update_buffer(vk, buffer, data, 0, size);
+
+	return buffer;
+}
+
+/* Frame ring (see Frame Ring Notes) */
+
+static void vk_frame_ring_init(struct VK *vk, struct VK_Frame_Ring *ring, VkBufferUsageFlags usage, uint64_t partition_size)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vk->physical_device, &properties);
+
+    ring->alignment = MAX(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+    ring->alignment = MAX(ring->alignment, 16);
+    ring->partition_size = align_address(partition_size, ring->alignment);
+
+    // Straight into VRAM where it's host visible, it's written once and read by the GPU
+    struct VK_Mem_Arena *arena = vk->mem_gpu_mapped_idx >= 0 ? &vk->gpu_mapped_mem : &vk->scratch_mem;
+    ring->buffer = vk_create_buffer(vk, arena, usage, ring->partition_size * FRAMES_IN_FLIGHT, MEM_CATEGORY_PER_FRAME);
+    ring->mapping = ring->buffer.allocation.mapping;
+    CHECK(ring->mapping, "Frame ring has to be in mapped memory");
+
+    ring->partition_offset = 0;
+    ring->top = 0;
+}
+
+// Starts on the frame's partition, the same one as its VK_Frame (see Frames in Flight Notes).
+// NOTE: Only once the fence of the frame that last used this partition has signalled
+static void vk_frame_ring_begin(struct VK_Frame_Ring *ring, uint64_t frame)
+{
+    ring->partition_offset = (frame % FRAMES_IN_FLIGHT) * ring->partition_size;
+    ring->top = 0;
+}
+
+// Returns size bytes to write into for this frame, out_offset is where they are in the ring's buffer
+static void *vk_frame_ring_push(struct VK_Frame_Ring *ring, uint64_t size, uint64_t *out_offset)
+{
+    const uint64_t offset = align_address(ring->top, ring->alignment);
+    CHECK(offset + size <= ring->partition_size, "Out of space in the frame ring");
+
+    ring->top = offset + size;
+    *out_offset = ring->partition_offset + offset;
+
+    return ring->mapping + *out_offset;
+}
+
+// TODO: Expose more options as parameters
+static VkPipeline vk_create_pipeline(struct VK *vk,
+                                     VkPipelineLayout layout,
+                                     VkPipelineShaderStageCreateInfo *shader_stages,
+                                     int shader_stage_count)
+{
+    VkPipelineVertexInputStateCreateInfo vertex_input_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE
+    };
+
+    VkViewport viewport = {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = vk->swapchain_extent.width,
+        .height = vk->swapchain_extent.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+
+    VkRect2D scissor = {
+        .offset = {0, 0},
+        .extent = vk->swapchain_extent
+    };
+
+    VkPipelineViewportStateCreateInfo viewport_state_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .pViewports = &viewport,
+        .scissorCount = 1,
+        .pScissors = &scissor
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterizer_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1.0f, // NOTE: Anything thicker than 1 needs a capability enabled
+        //.cullMode = VK_CULL_MODE_BACK_BIT,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0.0f,
+        .depthBiasClamp = 0.0f,
+        .depthBiasSlopeFactor = 0.0f
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisampling_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .sampleShadingEnable = VK_FALSE,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .minSampleShading = 1.0f,
+        .pSampleMask = NULL,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE
+    };
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment = {
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = VK_FALSE,
+        /*
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD
+        */
+    };
+
+    VkPipelineColorBlendStateCreateInfo color_blending = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_COPY,
+        .attachmentCount = 1,
+        .pAttachments = &color_blend_attachment,
+    };
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+        .depthBoundsTestEnable = VK_FALSE, // TODO: Check what this does
+        .minDepthBounds = 0.0f,
+        .maxDepthBounds = 1.0f,
+        .stencilTestEnable = VK_FALSE
+    };
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = shader_stage_count,
+        .pStages = shader_stages,
+        .pVertexInputState = &vertex_input_info,
+        .pInputAssemblyState = &input_assembly_info,
+        .pViewportState = &viewport_state_info,
+        .pRasterizationState = &rasterizer_info,
+        .pMultisampleState = &multisampling_info,
+        .pColorBlendState = &color_blending,
+        .pDepthStencilState = &depth_stencil,
+        .layout = layout,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .renderPass = vk->render_pass // TODO: Pass this in
+    };
+
+    VkPipeline pipeline;
+    VK_CHECK(vkCreateGraphicsPipelines(vk->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline));
+    vk_push_deletable(vk, vkDestroyPipeline, pipeline);
+
+    LOG("Created pipeline\n");
+
+    return pipeline;
+}
+
+static VkPipeline vk_create_pipeline_and_shaders(struct VK *vk,
+                                           const char *vert_path,
+                                           const char *frag_path,
+                                           VkPipelineLayout layout)
+{
+    assert(frag_path && vert_path);
+
+    VkShaderModule shader_vert = vk_create_shader_module_from_file(vk, vert_path);
+    VkShaderModule shader_frag = vk_create_shader_module_from_file(vk, frag_path);
+
+    VkPipelineShaderStageCreateInfo shader_stages[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = shader_vert,
+            .pName = "main"
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = shader_frag,
+            .pName = "main"
+        }
+    };
+
+    /* pipeline */
+    VkPipeline pipeline = vk_create_pipeline(vk, layout, shader_stages, countof(shader_stages));
+
+    vkDestroyShaderModule(vk->device, shader_frag, NULL);
+    vkDestroyShaderModule(vk->device, shader_vert, NULL);
+    
+    return pipeline;
+}
+
+static void vk_init(struct VK *vk)
+{
+	/* instance */
+	{
+		/* extensions */
+		const char *extension_names[256];
+		uint32_t extension_count = countof(extension_names);
+
+		SDL_Vulkan_GetInstanceExtensions(s_window, &extension_count, extension_names);
+
+		/* layers */
+		VkLayerProperties available_layers[256];
+		uint32_t available_layer_count = countof(available_layers);
+
+		vkEnumerateInstanceLayerProperties(&available_layer_count, available_layers);
+
+		const char *layer_names[] = {
+			"VK_LAYER_KHRONOS_validation"
+		};
+		uint32_t layer_count = countof(layer_names);
+
+		static_assert(countof(layer_names) == 1, "Edit the code below to support more");
+		bool found = false;
+		for(uint32_t i = 0; i < available_layer_count; ++i) {
+			if(0 == strcmp(available_layers[i].layerName, layer_names[0])) {
+				found = true;
+				break;
+			}
+		}
+
+		if(!found) {
+			layer_count = 0;
+		}
+
+        /* application info */
+        VkApplicationInfo application_info = {
+            .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+            .pApplicationName = "vk_scene",
+            .apiVersion = VK_API_VERSION_1_3
+        };
+
+		/* instance */
+		VkInstanceCreateInfo instance_create_info = {
+			.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+			.enabledLayerCount = layer_count,
+			.ppEnabledLayerNames = layer_names,
+			.enabledExtensionCount = extension_count,
+			.ppEnabledExtensionNames = extension_names,
+            .pApplicationInfo = &application_info
+		};
+
+		VK_CHECK(vkCreateInstance(&instance_create_info, NULL, &vk->instance));
+	}
+
+	/* physical device */
+	{
+		VkPhysicalDevice devices[256];
+		uint32_t device_count = countof(devices);
+
+		vkEnumeratePhysicalDevices(vk->instance, &device_count, devices);
+		CHECK(device_count, "No GPUs found");
+
+        int target_index = 0;
+        for(int i = 0; i < device_count; ++i) {
+            VkPhysicalDeviceProperties props;
+            vkGetPhysicalDeviceProperties(devices[i], &props);
+
+            if(props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+                target_index = i;
+                break;
+            }
+        }
+
+		vk->physical_device = devices[target_index];
+	}
+
+    /* memory query */
+    {
+        VkPhysicalDeviceMemoryProperties mem_properties;
+        vkGetPhysicalDeviceMemoryProperties(vk->physical_device, &mem_properties);
+        vk->mem_properties = mem_properties;
+    
+        /* print info */
+        printf("Memory heaps:\n");
+        for(uint32_t i = 0; i < mem_properties.memoryHeapCount; ++i) {
+            printf("-> [%d] %zuMB\n", i, mem_properties.memoryHeaps[i].size / (1024 * 1024));
+        }
+        printf("\n");
+
+        printf("Memory types:\n");
+        for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
+            printf("-> [%d] Index: %d Flags:", i, mem_properties.memoryTypes[i].heapIndex);
+            int flags = mem_properties.memoryTypes[i].propertyFlags;
+            if(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+                printf("DEVICE_LOCAL ");
+            if(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+                printf("HOST_VISIBLE ");
+            if(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+                printf("HOST_COHERENT ");
+            if(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
+                printf("HOST_CACHED ");
+            if(flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+                printf("LAZILY_ALLOCATED ");
+            printf("\n");
+        }
+        printf("\n");
+        
+        /* Choose a memory type that is host visible */
+        printf("Searching HOST_VISIBLE | HOST_COHERENT | HOST_CACHED, memory heap\n");
+        bool found = false;
+        for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
+            if(mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT &&
+               mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT &&
+               mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+            ) {
+                vk->mem_host_coherent_idx = i;
+                found = true;
+                break;
+            }
+        }
+
+        if(!found) {
+            printf("Falling back to un-cached HOST_VISIBLE | HOST_COHERENT memory heap\n");
+
+            for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
+                if(mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT &&
+                   mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                ) {
+                    vk->mem_host_coherent_idx = i;
+                    found = true;
+                    break;
+                }
+            }            
+        }
+
+        CHECK(found, "Couldn't find host visible and coherent memory heap");
+        printf("-> Chose type %d (heap %d)\n", vk->mem_host_coherent_idx, mem_properties.memoryTypes[vk->mem_host_coherent_idx].heapIndex);
+        
+        /* Choose a memory type that is fast */
+        printf("Searching DEVICE_LOCAL and not HOST_VISIBLE memory heap\n");
+        found = false;
+        for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
+            if(mem_properties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) &&
+               !(mem_properties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+            ) {
+                vk->mem_gpu_local_idx = i;
+                found = true;
+                break;
+            }
+        }
+
+        if(!found) {
+            printf("Falling back to any DEVICE_LOCAL, even if HOST_VISIBLE (is this an integrated card?)\n");
+            for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
+                if(mem_properties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                    vk->mem_gpu_local_idx = i;
+                    found = true;
+                    break;
+                }
+            }   
+        }
+
+        CHECK(found, "Couldn't find device local memory");
+        printf("-> Chose type %d (heap %d)\n", vk->mem_gpu_local_idx, mem_properties.memoryTypes[vk->mem_gpu_local_idx].heapIndex);
+
+        /* Choose a memory type that is fast and that we can write to directly (see Unified Memory Notes) */
+        printf("Searching DEVICE_LOCAL | HOST_VISIBLE | HOST_COHERENT memory heap, as big as the DEVICE_LOCAL one\n");
+        vk->mem_gpu_mapped_idx = -1;
+#if WITH_UNIFIED_MEMORY
+        const VkMemoryPropertyFlags mapped_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        const uint64_t gpu_local_heap_size = mem_properties.memoryHeaps[mem_properties.memoryTypes[vk->mem_gpu_local_idx].heapIndex].size;
+
+        for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
+            if((mem_properties.memoryTypes[i].propertyFlags & mapped_flags) == mapped_flags &&
+               mem_properties.memoryHeaps[mem_properties.memoryTypes[i].heapIndex].size >= gpu_local_heap_size
+            ) {
+                vk->mem_gpu_mapped_idx = i;
+                break;
+            }
+        }
+#endif
+
+        if(vk->mem_gpu_mapped_idx >= 0) {
+            printf("-> Chose type %d (heap %d), buffers will skip the staging buffer\n\n", vk->mem_gpu_mapped_idx, mem_properties.memoryTypes[vk->mem_gpu_mapped_idx].heapIndex);
+        }
+        else {
+            printf("-> None, buffers will be uploaded through the staging buffer\n\n");
+        }
+    }
+
+	/* surface */
+	{
+		// TODO: Make sure we are allowed to have this before VkDevice creation
+		CHECK(SDL_Vulkan_CreateSurface(s_window, vk->instance, &vk->surface), "Couldn't create surface");
+	}
+
+	/* queues query */
+	{
+		VkQueueFamilyProperties queue_families[32];
+		uint32_t queue_families_count = countof(queue_families);
+		vkGetPhysicalDeviceQueueFamilyProperties(vk->physical_device, &queue_families_count, queue_families);
+
+		bool found_graphics = false;
+		for(uint32_t i = 0; i < queue_families_count; ++i) {
+			/* :NOTE:
+			 * Unlike vulkan-tutorial, we find combined present/graphics queues because
+			 * drivers that don't support this do not seem to exist.
+			 */
+			VkBool32 present_support = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(vk->physical_device, i, vk->surface, &present_support);
+			if(!found_graphics && present_support && queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+				found_graphics = true;
+				vk->queue_graphics_idx = i;
+			}
+		}
+
+		CHECK(found_graphics, "No combined graphics/present queue found");
+
+		// Without a transfer-only family, uploads go on the graphics queue (see Transfer Queue Notes)
+		vk->queue_transfer_idx = vk->queue_graphics_idx;
+#if WITH_TRANSFER_QUEUE
+		for(uint32_t i = 0; i < queue_families_count; ++i) {
+			const VkQueueFlags flags = queue_families[i].queueFlags;
+			if(flags & VK_QUEUE_TRANSFER_BIT && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				vk->queue_transfer_idx = i;
+				break;
+			}
+		}
+#endif
+
+		LOG("Uploading on queue family %u, %s\n", vk->queue_transfer_idx,
+		    vk->queue_transfer_idx == vk->queue_graphics_idx ? "same as graphics" : "transfer only");
+	}
+
+	/* logical device */
+	{
+		/* extensions */
+		const char *extension_names[8] = {
+			VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+		};
+		uint32_t extension_count = 1; // Required ones, optional ones are added after checking these
+
+		VkExtensionProperties supported_extensions[1024];
+		uint32_t supported_extension_count = countof(supported_extensions);
+		vkEnumerateDeviceExtensionProperties(vk->physical_device, NULL, &supported_extension_count, supported_extensions);
+
+		for(uint32_t i = 0; i < extension_count; ++i) {
+			bool found = false;
+			for(uint32_t j = 0; j < supported_extension_count; ++j) {
+				if(0 == strcmp(extension_names[i], supported_extensions[j].extensionName)) {
+					found = true;
+					break;
+				}
+			}
+
+			CHECK(found, "Didn't find all required extensions");
+		}
+
+		// Optional, only for the memory report
+		for(uint32_t j = 0; j < supported_extension_count; ++j) {
+			if(0 == strcmp(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, supported_extensions[j].extensionName)) {
+				vk->memory_budget = true;
+				extension_names[extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+				break;
+			}
+		}
+
+		/* queue */
+		VkDeviceQueueCreateInfo queue_infos[2];
+		uint32_t queue_indices[2] = {
+			vk->queue_graphics_idx,
+			vk->queue_transfer_idx,
+		};
+
+		static_assert(countof(queue_infos) == countof(queue_indices), "");
+
+		// NOTE: The transfer queue is the graphics queue when they're the same family
+		uint32_t queue_count = vk->queue_transfer_idx == vk->queue_graphics_idx ? 1 : countof(queue_indices);
+
+		float queue_priority = 1.0f;
+		for(uint32_t i = 0; i < queue_count; ++i) {
+			queue_infos[i] = (VkDeviceQueueCreateInfo) {
+				.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+				.queueFamilyIndex = queue_indices[i],
+				.queueCount = 1,
+				.pQueuePriorities = &queue_priority,
+			};
+		}
+
+		/* device features */
+        VkPhysicalDeviceFeatures supported_features;
+        vkGetPhysicalDeviceFeatures(vk->physical_device, &supported_features);
+
+        // Optional, .ktex textures are skipped for the source images without it
+        vk->texture_compression_bc = supported_features.textureCompressionBC;
+
+        VkPhysicalDeviceFeatures device_features = {
+            .multiDrawIndirect = true,
+            .textureCompressionBC = vk->texture_compression_bc
+        };
+
+		/* create */
+        // Core and required since Vulkan 1.2, for the upload timeline (see Transfer Queue Notes)
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+            .timelineSemaphore = VK_TRUE
+        };
+
+        VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing_features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+            .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+            .runtimeDescriptorArray = VK_TRUE,
+            .descriptorBindingVariableDescriptorCount = VK_TRUE,
+            
+            .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+
+            // TODO: May not need these, if we put our bindless textures on a separate descriptor set
+            .descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE,
+            .descriptorBindingUniformTexelBufferUpdateAfterBind = VK_TRUE,
+            .descriptorBindingPartiallyBound = VK_TRUE,
+            .descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
+            .pNext = &timeline_semaphore_features
+        };
+
+		VkDeviceCreateInfo create_info = {
+			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+			.queueCreateInfoCount = queue_count,
+			.pQueueCreateInfos = queue_infos,
+			.enabledExtensionCount = extension_count,
+			.ppEnabledExtensionNames = extension_names,
+            .pEnabledFeatures = &device_features,
+            .pNext = &descriptor_indexing_features
+		};
+
+		VK_CHECK(vkCreateDevice(vk->physical_device, &create_info, NULL, &vk->device));
+
+		vkGetDeviceQueue(vk->device, vk->queue_graphics_idx, 0, &vk->queue_graphics);
+		vkGetDeviceQueue(vk->device, vk->queue_transfer_idx, 0, &vk->queue_transfer);
+	}
+
+    /* memory allocation */
+    {
+        vk_alloc_mem_arena(vk, &vk->scratch_mem, vk->mem_host_coherent_idx, GPU_SCRATCH_POOL_SIZE, true);
+#if WITH_STREAMING
+        vk_alloc_mem_arena(vk, &vk->staging_mem, vk->mem_host_coherent_idx, GPU_STAGING_POOL_SIZE * VK_UPLOAD_PARTITIONS + GPU_STREAM_STAGING_POOL_SIZE, true);
+#else
+        vk_alloc_mem_arena(vk, &vk->staging_mem, vk->mem_host_coherent_idx, GPU_STAGING_POOL_SIZE * VK_UPLOAD_PARTITIONS, true);
+#endif
+        vk_alloc_mem_arena(vk, &vk->gpu_mem, vk->mem_gpu_local_idx, GPU_VRAM_POOL_SIZE, false);
+        vk_alloc_mem_arena(vk, &vk->gpu_image_mem, vk->mem_gpu_local_idx, GPU_IMAGE_POOL_SIZE, false);
+        if(vk->mem_gpu_mapped_idx >= 0) {
+            vk_alloc_mem_arena(vk, &vk->gpu_mapped_mem, vk->mem_gpu_mapped_idx, GPU_VRAM_MAPPED_POOL_SIZE, true);
+        }
+        for(uint32_t i = 0; i < VK_UPLOAD_PARTITIONS; ++i) {
+            vk_alloc_buffer_arena(vk, &vk->uploads[i].staging_buffer, &vk->staging_mem, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GPU_STAGING_POOL_SIZE, MEM_CATEGORY_STAGING, false);
+        }
+
+        vk_mem_report_track_mem_arena(vk, "scratch_mem", &vk->scratch_mem);
+        vk_mem_report_track_mem_arena(vk, "staging_mem", &vk->staging_mem);
+        vk_mem_report_track_mem_arena(vk, "gpu_mem", &vk->gpu_mem);
+        vk_mem_report_track_mem_arena(vk, "gpu_image_mem", &vk->gpu_image_mem);
+        if(vk->mem_gpu_mapped_idx >= 0) {
+            vk_mem_report_track_mem_arena(vk, "gpu_mapped_mem", &vk->gpu_mapped_mem);
+        }
+        static_assert(VK_UPLOAD_PARTITIONS == 2, "Needs a name for every partition");
+        vk_mem_report_track_buffer_arena(vk, "staging_buffer[0]", &vk->uploads[0].staging_buffer);
+        vk_mem_report_track_buffer_arena(vk, "staging_buffer[1]", &vk->uploads[1].staging_buffer);
+    }
+
+	/* swap chain */
+	{
+		/* query */
+		VkSurfaceFormatKHR supported_formats[256];
+		uint32_t supported_formats_count = countof(supported_formats);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(vk->physical_device, vk->surface, &supported_formats_count, supported_formats);
+
+		VkPresentModeKHR supported_modes[256];
+		uint32_t support_modes_count = countof(supported_modes);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physical_device, vk->surface, &support_modes_count, supported_modes);
+
+		VkSurfaceCapabilitiesKHR capabilities;
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk->physical_device, vk->surface, &capabilities);
+
+		int width, height;
+		SDL_Vulkan_GetDrawableSize(s_window, &width, &height);
+        VkExtent2D extent = {width, height};
+        vk->swapchain_extent = extent;
+
+		/* find */
+		VkSurfaceFormatKHR format;
+		bool format_found = false;
+		for(uint32_t i = 0; i < supported_formats_count; ++i) {
+			if(supported_formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
+			   supported_formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+			{
+				format = supported_formats[i];
+				format_found = true;
+				break;
+			}
+		}
+		CHECK(format_found, "Couldn't find a suitable surface format");
+
+		VkPresentModeKHR mode;
+		bool mode_found = false;
+		for(uint32_t i = 0; i < support_modes_count; ++i) {
+			if(supported_modes[i] == VK_PRESENT_MODE_FIFO_KHR) {
+				mode = supported_modes[i];
+				mode_found = true;
+				break;
+			}
+		}
+		CHECK(mode_found, "Couldn't find a suitable present mode");
+
+		/* create */
+		uint32_t image_count = capabilities.minImageCount;
+		CHECK(image_count < countof(vk->swapchain_image_views), "Minimum swapchain image count is too high");
+
+		VkExtent3D depth_image_extent = {
+			vk->swapchain_extent.width,
+			vk->swapchain_extent.height,
+			1
+		};
+
+		vk->depth_format = VK_FORMAT_D32_SFLOAT;
+
+		VkImageCreateInfo depth_image_create_info = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = vk->depth_format,
+			.extent = depth_image_extent,
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+		};	
+
+		VK_CHECK(vkCreateImage(vk->device, &depth_image_create_info, NULL, &vk->depth_image));
+		vk_push_deletable(vk, vkDestroyImage, vk->depth_image);
+
+        VkMemoryRequirements depth_image_mem_requirements;
+        vkGetImageMemoryRequirements(vk->device, vk->depth_image, &depth_image_mem_requirements);
+
+        VkMemoryAllocateInfo alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = depth_image_mem_requirements.size,
+            .memoryTypeIndex = vk->mem_gpu_local_idx
+        };
+
+        const struct VK_Mem_Allocation depth_allocation = vk_mem_arena_push(vk, &vk->gpu_image_mem, depth_image_mem_requirements, MEM_CATEGORY_RENDER_TARGETS);
+        vkBindImageMemory(vk->device, vk->depth_image, depth_allocation.memory, depth_allocation.offset);
+
+		VkImageViewCreateInfo depth_image_view_create_info = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.image = vk->depth_image,
+			.format = vk->depth_format,
+			.subresourceRange = {
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT
+			}
+		};
+
+		VK_CHECK(vkCreateImageView(vk->device, &depth_image_view_create_info, NULL, &vk->depth_image_view));
+		vk_push_deletable(vk, vkDestroyImageView, vk->depth_image_view);
+
+		VkSwapchainCreateInfoKHR create_info = {
+			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+			.surface = vk->surface,
+			.minImageCount = image_count,
+			.imageFormat = format.format,
+			.imageColorSpace = format.colorSpace,
+			.imageExtent = extent,
+			.imageArrayLayers = 1,
+			.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			.preTransform = capabilities.currentTransform,
+			.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+			.presentMode = mode,
+			.clipped = VK_TRUE,
+			.oldSwapchain = VK_NULL_HANDLE,
+			.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE // NOTE: This would be VK_SHARING_MODE_CONCURRENT for separate present/graphics queue but we don't support that
+		};
+
+		VK_CHECK(vkCreateSwapchainKHR(vk->device, &create_info, NULL, &vk->swapchain));
+		vk_push_deletable(vk, vkDestroySwapchainKHR, vk->swapchain);
+		
+        // NOTE: There is a warning on Intel GPUs that suggests this function does actually want to be called twice
+		vk->swapchain_image_count = image_count;
+        vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &vk->swapchain_image_count, NULL);
+		VK_CHECK(vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &vk->swapchain_image_count, vk->swapchain_images));
+
+		vk->swapchain_format = format.format;
+	}
+
+	/* swapchain image views */
+	{
+		for(uint32_t i = 0; i < vk->swapchain_image_count; ++i) {
+			VkImageViewCreateInfo create_info = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.image = vk->swapchain_images[i],
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = vk->swapchain_format,
+				.components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+				.subresourceRange = {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				}
+			};
+
+			VK_CHECK(vkCreateImageView(vk->device, &create_info, NULL, &vk->swapchain_image_views[i]));
+			vk_push_deletable(vk, vkDestroyImageView, vk->swapchain_image_views[i]);
+		}
+	}
+
+	/* commands */
+	{
+		/* graphics pool */
+		VkCommandPoolCreateInfo graphics_pool_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.queueFamilyIndex = vk->queue_graphics_idx,
+			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT // allow for resetting individual command buffers, but do we need it?
+		};
+
+		VK_CHECK(vkCreateCommandPool(vk->device, &graphics_pool_info, NULL, &vk->command_pool_graphics));
+		vk_push_deletable(vk, vkDestroyCommandPool, vk->command_pool_graphics);
+
+		/* upload pool */
+		VkCommandPoolCreateInfo upload_pool_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.queueFamilyIndex = vk->queue_graphics_idx,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+		};
+
+		VK_CHECK(vkCreateCommandPool(vk->device, &graphics_pool_info, NULL, &vk->command_pool_upload));
+		vk_push_deletable(vk, vkDestroyCommandPool, vk->command_pool_upload);
+
+		/* transfer pools */
+		VkCommandPoolCreateInfo transfer_pool_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.queueFamilyIndex = vk->queue_transfer_idx,
+			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT // For the stream batches, which are reset one at a time
+		};
+
+		VK_CHECK(vkCreateCommandPool(vk->device, &transfer_pool_info, NULL, &vk->command_pool_transfer));
+		vk_push_deletable(vk, vkDestroyCommandPool, vk->command_pool_transfer);
+
+		VkCommandPoolCreateInfo partition_pool_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.queueFamilyIndex = vk->queue_transfer_idx,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+		};
+
+		for(uint32_t i = 0; i < VK_UPLOAD_PARTITIONS; ++i) {
+			VK_CHECK(vkCreateCommandPool(vk->device, &partition_pool_info, NULL, &vk->uploads[i].command_pool));
+			vk_push_deletable(vk, vkDestroyCommandPool, vk->uploads[i].command_pool);
+		}
+		
+		/* graphics buffers, one per frame in flight */
+		VkCommandBufferAllocateInfo command_alloc_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = vk->command_pool_graphics,
+			.commandBufferCount = 1,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
+		};
+
+		for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+			VK_CHECK(vkAllocateCommandBuffers(vk->device, &command_alloc_info, &vk->frames[i].command_buffer));
+		}
+	}
+
+    /* render pass */
+    {
+        VkAttachmentDescription attachments[] = {
+            {
+                // Colour
+                .format = vk->swapchain_format,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+            },
+            {
+                // Depth
+                .format = vk->depth_format,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+            }
+        };
+        
+        VkAttachmentReference color_attachment_ref = {
+            .attachment = 0, // References the pAttachments array in the parent renderpass
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+        };
+
+        VkAttachmentReference depth_attachment_ref = {
+            .attachment = 1,
+            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        };
+
+        VkSubpassDescription subpass = {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &color_attachment_ref,
+            .pDepthStencilAttachment = &depth_attachment_ref
+        };
+       
+        VkRenderPassCreateInfo render_pass_info = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+            .attachmentCount = countof(attachments),
+            .pAttachments = attachments, // This is where VkAttachmentReference::attachment indexes into
+            .subpassCount = 1,
+            .pSubpasses = &subpass
+        };
+
+        VK_CHECK(vkCreateRenderPass(vk->device, &render_pass_info, NULL, &vk->render_pass));
+        vk_push_deletable(vk, vkDestroyRenderPass, vk->render_pass);
+    }
+
+    /* descriptors */
+    {
+        // TODO: Make a function for creating this too, since it's app-specific
+        /* texture array size (see Texture Registry Notes) */
+        VkPhysicalDeviceDescriptorIndexingProperties descriptor_indexing_properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES
+        };
+
+        VkPhysicalDeviceProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &descriptor_indexing_properties
+        };
+        vkGetPhysicalDeviceProperties2(vk->physical_device, &properties);
+
+        vk->textures.capacity = MIN(descriptor_indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                    descriptor_indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages);
+        vk->textures.capacity = MIN(vk->textures.capacity, TEXTURE_DESCRIPTOR_MAX);
+
+        printf("Texture descriptor slots: %u (device allows %u)\n\n", vk->textures.capacity,
+               descriptor_indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages);
+
+        /* descriptor layouts */
+        VkDescriptorSetLayoutBinding bindings[] = {
+            {
+                .binding = 2,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+            },
+            {
+                .binding = 3,
+                .descriptorCount = vk->textures.capacity,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+            }
+        };
+
+        VkDescriptorBindingFlags binding_flags[] = {
+            0,
+            VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+        };
+
+        static_assert(countof(binding_flags) == countof(bindings), "");
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+            .bindingCount = countof(binding_flags),
+            .pBindingFlags = binding_flags
+        };
+
+        VkDescriptorSetLayoutCreateInfo desc_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = countof(bindings),
+            .pBindings = bindings,
+            .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+            .pNext = &binding_flags_info
+        };
+
+        VK_CHECK(vkCreateDescriptorSetLayout(vk->device, &desc_info, NULL, &vk->global_desc_layout));
+        vk_push_deletable(vk, vkDestroyDescriptorSetLayout, vk->global_desc_layout);
+
+        // Per-frame data, see Frame Ring Notes
+        VkDescriptorSetLayoutBinding frame_bindings[] = {
+            {
+                .binding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+            },
+            {
+                .binding = 1,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+            }
+        };
+
+        VkDescriptorSetLayoutCreateInfo frame_desc_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = countof(frame_bindings),
+            .pBindings = frame_bindings
+        };
+
+        VK_CHECK(vkCreateDescriptorSetLayout(vk->device, &frame_desc_info, NULL, &vk->frame_desc_layout));
+        vk_push_deletable(vk, vkDestroyDescriptorSetLayout, vk->frame_desc_layout);
+
+        /* descriptor pool */
+        VkDescriptorPoolSize sizes[] = {
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10 },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 10 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 10 },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, vk->textures.capacity * FRAMES_IN_FLIGHT }
+        };
+
+        VkDescriptorPoolCreateInfo pool_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+            .maxSets = 10,
+            .poolSizeCount = countof(sizes),
+            .pPoolSizes = sizes
+        };
+        
+        VK_CHECK(vkCreateDescriptorPool(vk->device, &pool_info, NULL, &vk->desc_pool));
+        vk_push_deletable(vk, vkDestroyDescriptorPool, vk->desc_pool);
+
+        /* descriptors */
+        // NOTE: The actual buffer is created way after in scene_init, so this just allocates the descriptor for use later
+        uint32_t variable_descriptor_counts[] = {
+            vk->textures.capacity
+        };
+
+        VkDescriptorSetVariableDescriptorCountAllocateInfo descriptor_count_alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+            .descriptorSetCount = countof(variable_descriptor_counts),
+            .pDescriptorCounts = variable_descriptor_counts
+        };
+
+        VkDescriptorSetAllocateInfo alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = vk->desc_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &vk->global_desc_layout,
+            .pNext = &descriptor_count_alloc_info
+        };
+        
+        // One per frame in flight, see Frames in Flight Notes
+        for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+            VK_CHECK(vkAllocateDescriptorSets(vk->device, &alloc_info, &vk->frames[i].global_desc));
+        }
+
+        VkDescriptorSetAllocateInfo frame_alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = vk->desc_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &vk->frame_desc_layout
+        };
+
+        VK_CHECK(vkAllocateDescriptorSets(vk->device, &frame_alloc_info, &vk->frame_desc));
+    }
+
+	/* pipeline layout */
+	{
+		// TODO: Make a function for creating this too, since it's app-specific
+		VkPushConstantRange ranges[] = {
+			{
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				.offset = 0,
+				.size = sizeof(struct Instance_Data)
+			}
+		};
+
+		VkDescriptorSetLayout set_layouts[] = {
+			vk->global_desc_layout,
+			vk->frame_desc_layout
+		};
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = countof(set_layouts),
+            .pSetLayouts = set_layouts,
+            .pushConstantRangeCount = countof(ranges),
+            .pPushConstantRanges = ranges
+        };
+
+        VK_CHECK(vkCreatePipelineLayout(vk->device, &pipeline_layout_info, NULL, &vk->simple_piepline_layout));
+        vk_push_deletable(vk, vkDestroyPipelineLayout, vk->simple_piepline_layout);
+    }
+
+    /* framebuffers */
+    {
+        VkFramebufferCreateInfo framebuffer_info = {
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .renderPass = vk->render_pass,
+            .width = vk->swapchain_extent.width,
+            .height = vk->swapchain_extent.height,
+            .layers = 1
+        };
+
+        for(uint32_t i = 0; i < vk->swapchain_image_count; ++i) {
+            VkImageView attachments[] = {
+                vk->swapchain_image_views[i],
+                vk->depth_image_view
+            };
+            
+            framebuffer_info.pAttachments = attachments;
+            framebuffer_info.attachmentCount = countof(attachments);
+
+            VK_CHECK(vkCreateFramebuffer(vk->device, &framebuffer_info, NULL, &vk->framebuffers[i]));
+            vk_push_deletable(vk, vkDestroyFramebuffer, vk->framebuffers[i]);
+        }
+    }
+
+    /* synchronization */
+    {
+        /* render fences */
+        {
+            VkFenceCreateInfo fence_info = {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+            };
+    
+            for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+                VK_CHECK(vkCreateFence(vk->device, &fence_info, NULL, &vk->frames[i].render_fence));
+                vk_push_deletable(vk, vkDestroyFence, vk->frames[i].render_fence);
+            }
+        }
+
+        /* upload fence */
+        {
+            VkFenceCreateInfo fence_info = {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            };
+    
+            VK_CHECK(vkCreateFence(vk->device, &fence_info, NULL, &vk->upload_fence));
+            vk_push_deletable(vk, vkDestroyFence, vk->upload_fence);
+        }
+
+        /* upload timeline */
+        {
+            VkSemaphoreTypeCreateInfo type_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                .initialValue = 0
+            };
+
+            VkSemaphoreCreateInfo semaphore_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &type_info
+            };
+
+            VK_CHECK(vkCreateSemaphore(vk->device, &semaphore_info, NULL, &vk->upload_timeline));
+            vk_push_deletable(vk, vkDestroySemaphore, vk->upload_timeline);
+        }
+
+        /* semaphores */        
+        VkSemaphoreCreateInfo semaphore_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .flags = 0
+        };
+
+        for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+            VK_CHECK(vkCreateSemaphore(vk->device, &semaphore_info, NULL, &vk->frames[i].present_semaphore));
+            VK_CHECK(vkCreateSemaphore(vk->device, &semaphore_info, NULL, &vk->frames[i].render_semaphore));
+            vk_push_deletable(vk, vkDestroySemaphore, vk->frames[i].present_semaphore);
+            vk_push_deletable(vk, vkDestroySemaphore, vk->frames[i].render_semaphore);
+        }
+    }
+    
+    LOG("vk_init done\n");
+}
+
+static void vk_destroy(struct VK *vk)
+{
+    vkDeviceWaitIdle(vk->device);
+
+    struct VK_Mem_Arena *mapped_arenas[] = { &vk->scratch_mem, &vk->staging_mem, &vk->gpu_mapped_mem };
+    for(uint32_t i = 0; i < countof(mapped_arenas); ++i) {
+        // NOTE: gpu_mapped_mem has no blocks when it's not used
+        for(uint32_t j = 0; j < mapped_arenas[i]->block_count; ++j) {
+            vkUnmapMemory(vk->device, mapped_arenas[i]->blocks[j].memory);
+        }
+    }
+
+    /* Everything retired is done with now, and its memory has to go back before the arenas are freed below */
+    while(vk->retire_queue.count) {
+        vk_deletion_entry_destroy(vk, vk_deletion_queue_front(&vk->retire_queue));
+        vk_deletion_queue_pop(&vk->retire_queue);
+    }
+
+    for(struct VK_Deletion_Block *block = vk->deletion_queue.last; block; block = block->prev) {
+        const uint32_t count = block == vk->deletion_queue.last ? vk->deletion_queue.last_count : VK_DELETION_BLOCK_SIZE;
+        for(int i = count - 1; i >= 0; --i) {
+            if(block->entries[i].func) {
+                block->entries[i].func(vk->device, block->entries[i].handle, NULL);
+            }
+        }
+    }
+
+    vk_deletion_queue_free(&vk->retire_queue);
+    vk_deletion_queue_free(&vk->deletion_queue);
+
+	vkDestroySurfaceKHR(vk->instance, vk->surface, NULL);
+	vkDestroyDevice(vk->device, NULL);
+	vkDestroyInstance(vk->instance, NULL);
+	
+	LOG("vk_destroy done\n");
+}
+
+/* Mesh Codec Notes:
+ *
+ * The decoders are the ones in tools/mesh_codec.h, see there for the stream formats.
+ * Compressed meshes are decoded straight into the mapped staging memory, so there is no extra copy compared to raw meshes.
+ * The decoders only write whole vertices and indices front to back, which is fine for write-combined memory.
+ */
+
+// Where the data of one mesh is: in a loaded .bin file, in the mapped pack, or decoded by a stream worker
+struct Mesh_Source {
+    struct Mesh_File_Header header;
+    struct Mesh_File_Quantization quant;
+
+    // With MESH_FILE_FLAG_COMPRESSED these are the compressed streams, of the given stream sizes
+    const void *vert_buffer_data;
+    size_t vert_stream_size;
+    const void *index_buffer_data;
+    size_t index_stream_size;
+
+    const void *meshlet_data;
+    uint32_t meshlet_count;
+    const void *lod_data;
+    uint32_t lod_count;
+};
+
+// Where mesh_create put the mesh's buffers, for writing their contents
+struct Mesh_Upload {
+    uint64_t vertex_buffer_offset;
+    uint64_t vertex_buffer_size;
+
+    struct VK_Buffer_Arena *index_arena;
+    uint64_t index_buffer_offset;
+    uint64_t index_buffer_size;
+};
+
+static void mesh_source_from_raw_data(const char *mesh_data, struct Mesh_Source *out)
+{
+    const char *p = mesh_data;
+
+    struct Mesh_Source src = {0};
+    if(*(uint32_t *)p == MESH_FILE_MAGIC) {
+        memcpy(&src.header, p, sizeof(src.header));
+        CHECK(src.header.version <= MESH_FILE_VERSION, "Mesh file is from a newer version of the exporter");
+
+        if(src.header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) {
+            CHECK(src.header.header_size >= sizeof(src.header) + sizeof(src.quant), "Quantized mesh file is missing its bounds");
+            memcpy(&src.quant, p + sizeof(src.header), sizeof(src.quant));
+        }
+
+        p += src.header.header_size;
+    }
+    else {
+        // Legacy header
+        src.header.vert_count = ((uint32_t *)p)[0];
+        src.header.index_count = ((uint32_t *)p)[1];
+        p += 2 * sizeof(uint32_t);
+    }
+
+    const size_t vert_buffer_stride_bytes = (src.header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) ? VERTEX_SIZE_QUANTIZED : VERTEX_SIZE_FLOAT;
+
+    const size_t index_size = (src.header.flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    src.vert_buffer_data = p;
+    src.index_buffer_data = p + src.header.vert_count * vert_buffer_stride_bytes;
+    const char *section_end = (const char *)src.index_buffer_data + src.header.index_count * index_size;
+
+    // Compressed buffers are each a u32 size followed by the stream
+    if(src.header.flags & MESH_FILE_FLAG_COMPRESSED) {
+        uint32_t vert_stream_size, index_stream_size;
+
+        memcpy(&vert_stream_size, p, sizeof(vert_stream_size));
+        src.vert_buffer_data = p + sizeof(vert_stream_size);
+        src.vert_stream_size = vert_stream_size;
+
+        memcpy(&index_stream_size, (const char *)src.vert_buffer_data + vert_stream_size, sizeof(index_stream_size));
+        src.index_buffer_data = (const char *)src.vert_buffer_data + vert_stream_size + sizeof(index_stream_size);
+        src.index_stream_size = index_stream_size;
+
+        section_end = (const char *)src.index_buffer_data + index_stream_size;
+    }
+
+    // Meshlets, then LODs, each start at the next multiple of 4 in the file after the previous section
+    if(src.header.flags & MESH_FILE_FLAG_MESHLETS) {
+        const char *meshlet_section = mesh_data + align_address(section_end - mesh_data, 4);
+        memcpy(&src.meshlet_count, meshlet_section, sizeof(src.meshlet_count));
+        src.meshlet_data = meshlet_section + sizeof(src.meshlet_count);
+        section_end = (const char *)src.meshlet_data + src.meshlet_count * sizeof(struct Mesh_File_Meshlet);
+    }
+
+    if(src.header.flags & MESH_FILE_FLAG_LODS) {
+        const char *lod_section = mesh_data + align_address(section_end - mesh_data, 4);
+        memcpy(&src.lod_count, lod_section, sizeof(src.lod_count));
+        src.lod_data = lod_section + sizeof(src.lod_count);
+    }
+
+    *out = src;
+}
+
+// NOTE: pack_data is the whole mapped pack, the payloads are read straight out of it
+static void mesh_source_from_pack_entry(const char *pack_data, const struct Mesh_Pack_Entry *entry, struct Mesh_Source *out)
+{
+    CHECK(entry->vertex_stride == VERTEX_SIZE_FLOAT && !(entry->flags & MESH_FILE_FLAG_VERTEX_QUANTIZED), "Mesh pack entry has an unsupported vertex format");
+
+    *out = (struct Mesh_Source) {
+        .header = {
+            .flags = entry->flags,
+            .vert_count = entry->vert_count,
+            .index_count = entry->index_count
+        },
+        .vert_buffer_data = pack_data + entry->vertex_offset,
+        .vert_stream_size = entry->vertex_stream_size,
+        .index_buffer_data = pack_data + entry->index_offset,
+        .index_stream_size = entry->index_stream_size,
+        .meshlet_data = pack_data + entry->meshlet_offset,
+        .meshlet_count = entry->meshlet_count,
+        .lod_data = pack_data + entry->lod_offset,
+        .lod_count = entry->lod_count
+    };
+}
+
+// Allocates the mesh's buffer ranges and takes in its meshlets and LODs. The buffer contents are written separately,
+// see upload_mesh. The mesh isn't resident yet.
+static struct Mesh mesh_create(struct VK *vk, const struct Mesh_Source *src, struct Mesh_Upload *out_upload)
+{
+    const struct Mesh_File_Header *header = &src->header;
+
+    const bool quantized = header->flags & MESH_FILE_FLAG_VERTEX_QUANTIZED;
+    const size_t vert_buffer_stride_bytes = quantized ? VERTEX_SIZE_QUANTIZED : VERTEX_SIZE_FLOAT;
+
+    const bool index_32 = header->flags & MESH_FILE_FLAG_INDEX_32;
+    const size_t index_size = index_32 ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    const size_t vert_buffer_size = header->vert_count * vert_buffer_stride_bytes;
+    const size_t index_buffer_size = header->index_count * index_size;
+
+    struct Mesh mesh = {
+        .vert_count = header->vert_count,
+        .index_count = header->index_count,
+        .index_type = index_32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16,
+        .vertex_format = quantized ? VERTEX_FORMAT_QUANTIZED : VERTEX_FORMAT_FLOAT
+    };
+
+    if(quantized) {
+        mesh.position_min = (vec4s){ src->quant.position_min[0], src->quant.position_min[1], src->quant.position_min[2], 0.0f };
+        mesh.position_extent = (vec4s){ src->quant.position_extent[0], src->quant.position_extent[1], src->quant.position_extent[2], 0.0f };
+    }
+
+    // NOTE: The arena alignment is a multiple of every vertex size, so the offset can be expressed in vertices
+    uint64_t vertex_buffer_offset = vk_buffer_arena_push(vk, &vk->vertex_buffer, vert_buffer_size, &mesh.vertex_allocation);
+    mesh.vertex_offset = vertex_buffer_offset / vert_buffer_stride_bytes;
+
+    struct VK_Buffer_Arena *index_arena = index_32 ? &vk->index_buffer_32 : &vk->index_buffer;
+    uint64_t index_buffer_offset = vk_buffer_arena_push(vk, index_arena, index_buffer_size, &mesh.index_allocation);
+    mesh.index_offset = index_buffer_offset / index_size;
+
+    *out_upload = (struct Mesh_Upload) {
+        .vertex_buffer_offset = vertex_buffer_offset,
+        .vertex_buffer_size = vert_buffer_size,
+        .index_arena = index_arena,
+        .index_buffer_offset = index_buffer_offset,
+        .index_buffer_size = index_buffer_size
+    };
+
+    // Meshlets stay on the CPU, they're only used for culling
+    mesh.meshlet_allocation = RANGE_NONE;
+    if(src->meshlet_count) {
+        uint64_t meshlet_offset;
+        mesh.meshlet_allocation = range_alloc(&vk->meshlet_ranges, src->meshlet_count, 1, &meshlet_offset);
+        CHECK(mesh.meshlet_allocation != RANGE_NONE, "Out of meshlet space");
+
+        memcpy(&vk->meshlets[meshlet_offset], src->meshlet_data, src->meshlet_count * sizeof(struct Mesh_File_Meshlet));
+        mesh.meshlet_offset = (uint32_t)meshlet_offset;
+        mesh.meshlet_count = src->meshlet_count;
+    }
+
+    if(src->lod_count) {
+        CHECK(src->lod_count <= MAX_MESH_LODS, "Mesh has too many LODs");
+        memcpy(mesh.lods, src->lod_data, src->lod_count * sizeof(struct Mesh_File_Lod));
+        mesh.lod_count = src->lod_count;
+
+        for(uint32_t i = 0; i < mesh.lod_count; ++i) {
+            CHECK(mesh.lods[i].first_index + mesh.lods[i].index_count <= mesh.index_count &&
+                  mesh.lods[i].first_meshlet + mesh.lods[i].meshlet_count <= mesh.meshlet_count, "Mesh LOD is out of range");
+        }
+    }
+    else {
+        mesh.lods[0] = (struct Mesh_File_Lod) {
+            .index_count = mesh.index_count,
+            .meshlet_count = mesh.meshlet_count
+        };
+        mesh.lod_count = 1;
+    }
+
+    return mesh;
+}
+
+// Gives the mesh's geometry back to the arenas once frames on the GPU are done drawing it.
+// The slot in VK::meshes stays and is just not resident anymore.
+static void mesh_destroy(struct VK *vk, struct Mesh *mesh)
+{
+    vk_retire_range(vk, &vk->vertex_buffer.ranges, mesh->vertex_allocation);
+    vk_retire_range(vk, mesh->index_type == VK_INDEX_TYPE_UINT32 ? &vk->index_buffer_32.ranges : &vk->index_buffer.ranges, mesh->index_allocation);
+    if(mesh->meshlet_allocation != RANGE_NONE) {
+        vk_retire_range(vk, &vk->meshlet_ranges, mesh->meshlet_allocation);
+    }
+
+    *mesh = (struct Mesh){0};
+}
+
+// Copies or decodes the vertices into mapped (staging) memory
+static void mesh_write_vertices(const struct Mesh_Source *src, void *mapped_mem)
+{
+    const size_t vert_buffer_stride_bytes = (src->header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) ? VERTEX_SIZE_QUANTIZED : VERTEX_SIZE_FLOAT;
+
+    if(src->header.flags & MESH_FILE_FLAG_COMPRESSED) {
+        CHECK(mesh_codec_decode_vertices(mapped_mem, src->header.vert_count, vert_buffer_stride_bytes, src->vert_buffer_data, src->vert_stream_size), "Mesh has a corrupt vertex stream");
+    }
+    else {
+        memcpy(mapped_mem, src->vert_buffer_data, src->header.vert_count * vert_buffer_stride_bytes);
+    }
+}
+
+static void mesh_write_indices(const struct Mesh_Source *src, void *mapped_mem)
+{
+    const size_t index_size = (src->header.flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    if(src->header.flags & MESH_FILE_FLAG_COMPRESSED) {
+        CHECK(mesh_codec_decode_indices(mapped_mem, src->header.index_count, index_size, src->index_buffer_data, src->index_stream_size), "Mesh has a corrupt index stream");
+    }
+    else {
+        memcpy(mapped_mem, src->index_buffer_data, src->header.index_count * index_size);
+    }
+}
+
+// NOTE: The mesh is usable after the next vk_staging_queue_flush
+static struct Mesh upload_mesh(struct VK *vk, const struct Mesh_Source *src)
+{
+    struct Mesh_Upload upload;
+    struct Mesh mesh = mesh_create(vk, src, &upload);
+
+    // NOTE: One at a time, since mapping can flush the staging queue and that would copy the other one before it's written
+    void *mapped_mem = vk_map_buffer_staged(vk, vk->vertex_buffer.buffer, upload.vertex_buffer_offset, upload.vertex_buffer_size);
+    mesh_write_vertices(src, mapped_mem);
+
+    mapped_mem = vk_map_buffer_staged(vk, upload.index_arena->buffer, upload.index_buffer_offset, upload.index_buffer_size);
+    mesh_write_indices(src, mapped_mem);
+
+    mesh.resident = true;
+
+    return mesh;
+}
+
+static struct Mesh upload_mesh_from_raw_data(struct VK *vk, const char *mesh_data)
+{
+    struct Mesh_Source src;
+    mesh_source_from_raw_data(mesh_data, &src);
+
+    struct Mesh mesh = upload_mesh(vk, &src);
+
+    LOG("Uploaded mesh from raw data (%s indices, %s vertices%s, %u meshlets, %u LODs)\n",
+        mesh.index_type == VK_INDEX_TYPE_UINT32 ? "32-bit" : "16-bit",
+        mesh.vertex_format == VERTEX_FORMAT_QUANTIZED ? "quantized" : "float",
+        (src.header.flags & MESH_FILE_FLAG_COMPRESSED) ? ", compressed" : "",
+        mesh.meshlet_count, mesh.lod_count);
+
+    return mesh;
+}
+
+/* Geometry Compaction Notes:
+ *
+ * Meshes can be destroyed, which leaves holes in the vertex and index arenas that only fit meshes as big or smaller.
+ * geometry_compact_step runs at the start of every frame's command buffer and moves geometry down into the lowest hole in front of it
+ * (range_alloc_in_front) with vkCmdCopyBuffer, followed by a barrier before the draws. Since things only ever move down, it settles.
+ * It looks at COMPACT_MESHES_PER_FRAME meshes per frame, round-robin, and moves at most COMPACT_BUDGET_BYTES
+ * (except for a mesh bigger than that, which moves on its own), so the cost per frame is bounded.
+ * It doesn't do anything while every arena's free space is in one range.
+ * The meshlets in VK::meshlets get the same treatment, with a memcpy instead, since only the CPU reads them.
+ *
+ * The Mesh offsets are patched right away on the CPU, before the frame's draws are built, and the copies come before the draws
+ * in the same command buffer. So a frame either draws everything from the old place or everything from the new one.
+ * The old ranges are retired (see Deletion Queue Notes), so they are only allocated again once the frame has finished.
+ * Destination and source are in the same buffer, but never overlap, since one is allocated and the other was a hole.
+ *
+ * Meshes that aren't resident are left alone, since their upload (e.g. a stream batch) may still be writing to them.
+ * NOTE: Nothing may allocate from the geometry arenas between the step and the submit, since growing one replaces its buffer.
+ *
+ * "Fragmented" free space is the free space outside of the largest free range, i.e. what a big allocation can't use.
+ * When a run of compaction finishes, how much of that was reclaimed, and the most it copied and spent on the CPU in a frame, are logged.
+ * The GPU time of the copies isn't measured, there are no timestamp queries yet, the bytes copied are the proxy for it.
+ */
+struct Geometry_Compactor {
+    uint32_t next_mesh;              // Round-robin
+    uint32_t meshes_since_move;      // The run is over once every mesh has been looked at without anything moving
+    uint64_t last_move_frame;        // vk->frame of the last move, the run also waits for its old ranges to be freed
+
+    /* Stats, for the current run */
+    bool running;
+    uint64_t fragmented_at_start;
+    uint64_t bytes_moved;
+    uint32_t moves;
+    uint32_t frames;
+    uint64_t max_frame_bytes;
+    double max_frame_cpu_ms;
+};
+
+static struct Geometry_Compactor s_compactor;
+
+static uint64_t geometry_fragmented_bytes(struct VK *vk)
+{
+    const struct Range_Allocator *arenas[] = { &vk->vertex_buffer.ranges, &vk->index_buffer.ranges, &vk->index_buffer_32.ranges };
+
+    uint64_t fragmented = 0;
+    for(uint32_t i = 0; i < countof(arenas); ++i) {
+        fragmented += arenas[i]->capacity - arenas[i]->used - range_allocator_largest_free(arenas[i]);
+    }
+
+    return fragmented;
+}
+
+// Moves the allocation down if there is a hole for it, the copy is added to copies. Returns the new offset in bytes, or the old one.
+static uint64_t geometry_compact_move(struct Geometry_Compactor *c, struct VK *vk, struct VK_Buffer_Arena *arena, uint32_t *allocation, uint64_t offset, uint64_t size,
+                                      VkBufferCopy *copies, uint32_t *copy_count)
+{
+    uint64_t new_offset;
+    const uint32_t new_allocation = range_alloc_in_front(&arena->ranges, *allocation, VK_BUFFER_ARENA_ALIGNMENT, &new_offset);
+    if(new_allocation == RANGE_NONE) {
+        return offset;
+    }
+
+    copies[(*copy_count)++] = (VkBufferCopy) {
+        .srcOffset = offset,
+        .dstOffset = new_offset,
+        .size = size
+    };
+
+    vk_retire_range(vk, &arena->ranges, *allocation);
+    *allocation = new_allocation;
+    c->bytes_moved += size;
+    c->moves++;
+
+    return new_offset;
+}
+
+// See Geometry Compaction Notes. Has to be called before anything reads the Mesh offsets for the frame.
+static void geometry_compact_step(struct Geometry_Compactor *c, struct VK *vk, VkCommandBuffer cmdbuf)
+{
+    const uint64_t t_start = SDL_GetPerformanceCounter();
+
+    if(!c->running) {
+        if(vk->vertex_buffer.ranges.free_range_count <= 1 && vk->index_buffer.ranges.free_range_count <= 1 && vk->index_buffer_32.ranges.free_range_count <= 1 &&
+           vk->meshlet_ranges.free_range_count <= 1) {
+            return;
+        }
+
+        *c = (struct Geometry_Compactor) {
+            .running = true,
+            .next_mesh = c->next_mesh,
+            .fragmented_at_start = geometry_fragmented_bytes(vk)
+        };
+    }
+
+    struct VK_Buffer_Arena *arenas[] = { &vk->vertex_buffer, &vk->index_buffer, &vk->index_buffer_32 };
+    VkBufferCopy copies[countof(arenas)][COMPACT_MESHES_PER_FRAME];
+    uint32_t copy_counts[countof(arenas)] = {0};
+
+    const uint64_t bytes_before = c->bytes_moved;
+    const uint32_t mesh_count = vk->mesh_count;
+    const uint32_t look_count = MIN(mesh_count, COMPACT_MESHES_PER_FRAME);
+
+    for(uint32_t n = 0; n < look_count; ++n) {
+        struct Mesh *mesh = &vk->meshes[c->next_mesh % mesh_count];
+
+        const uint64_t vertex_size = mesh->vertex_format == VERTEX_FORMAT_QUANTIZED ? VERTEX_SIZE_QUANTIZED : VERTEX_SIZE_FLOAT;
+        const uint64_t index_size = mesh->index_type == VK_INDEX_TYPE_UINT32 ? sizeof(uint32_t) : sizeof(uint16_t);
+        const uint64_t mesh_bytes = mesh->resident ? mesh->vert_count * vertex_size + mesh->index_count * index_size : 0;
+
+        // NOTE: Before the cursor moves on, so a mesh that didn't fit is the first one looked at next frame
+        const uint64_t frame_bytes = c->bytes_moved - bytes_before;
+        if(frame_bytes && frame_bytes + mesh_bytes > COMPACT_BUDGET_BYTES) {
+            break;
+        }
+
+        c->next_mesh++;
+        c->meshes_since_move++;
+
+        if(!mesh->resident) {
+            continue;
+        }
+
+        const uint32_t moves_before = c->moves;
+
+        const uint64_t vertex_offset = geometry_compact_move(c, vk, &vk->vertex_buffer, &mesh->vertex_allocation, mesh->vertex_offset * vertex_size,
+                                                             mesh->vert_count * vertex_size, copies[0], &copy_counts[0]);
+        mesh->vertex_offset = vertex_offset / vertex_size;
+
+        const uint32_t index_arena = mesh->index_type == VK_INDEX_TYPE_UINT32 ? 2 : 1;
+        const uint64_t index_offset = geometry_compact_move(c, vk, arenas[index_arena], &mesh->index_allocation, mesh->index_offset * index_size,
+                                                            mesh->index_count * index_size, copies[index_arena], &copy_counts[index_arena]);
+        mesh->index_offset = index_offset / index_size;
+
+        // The meshlets are only read on the CPU while building the draws, so they're just copied here
+        if(mesh->meshlet_allocation != RANGE_NONE) {
+            uint64_t meshlet_offset;
+            const uint32_t meshlet_allocation = range_alloc_in_front(&vk->meshlet_ranges, mesh->meshlet_allocation, 1, &meshlet_offset);
+            if(meshlet_allocation != RANGE_NONE) {
+                memcpy(&vk->meshlets[meshlet_offset], &vk->meshlets[mesh->meshlet_offset], mesh->meshlet_count * sizeof(struct Mesh_File_Meshlet));
+                vk_retire_range(vk, &vk->meshlet_ranges, mesh->meshlet_allocation);
+                mesh->meshlet_allocation = meshlet_allocation;
+                mesh->meshlet_offset = (uint32_t)meshlet_offset;
+                c->moves++;
+            }
+        }
+
+        if(c->moves != moves_before) {
+            c->meshes_since_move = 0;
+            c->last_move_frame = vk->frame;
+        }
+    }
+
+    /* Record the copies, and make them visible to the draws that come after */
+    for(uint32_t i = 0; i < countof(arenas); ++i) {
+        if(copy_counts[i]) {
+            vkCmdCopyBuffer(cmdbuf, arenas[i]->buffer.handle, arenas[i]->buffer.handle, copy_counts[i], copies[i]);
+        }
+    }
+
+    const uint64_t frame_bytes = c->bytes_moved - bytes_before;
+    if(frame_bytes) {
+        VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+        };
+        vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                             0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+
+    c->frames++;
+    c->max_frame_bytes = MAX(c->max_frame_bytes, frame_bytes);
+    c->max_frame_cpu_ms = MAX(c->max_frame_cpu_ms, ticks_to_ms(SDL_GetPerformanceCounter() - t_start));
+
+    /* Done once a whole round of the meshes didn't move anything, and the old ranges of the last move
+     * have been freed (FRAMES_IN_FLIGHT frames after it) so the stats below see them. */
+    if(c->meshes_since_move >= mesh_count && vk->frame >= c->last_move_frame + FRAMES_IN_FLIGHT) {
+        const uint64_t fragmented = geometry_fragmented_bytes(vk);
+
+        LOG("Geometry compaction: %u moves, %.1fKB copied over %u frames, reclaimed %.1fKB of fragmented free space (%.1fKB left). "
+            "Per frame at most %.1fKB copied, %.3fms CPU\n",
+            c->moves, c->bytes_moved / 1024.0, c->frames,
+            (fragmented < c->fragmented_at_start ? c->fragmented_at_start - fragmented : 0) / 1024.0, fragmented / 1024.0,
+            c->max_frame_bytes / 1024.0, c->max_frame_cpu_ms);
+
+        c->running = false;
+    }
+}
+
+// NOTE: Returns NULL if there is no pack, so the caller can fall back to loose files. Must file_unmap otherwise.
+static const struct Mesh_Pack_Entry *mesh_pack_open(const char *path, struct File_Mapping *fm, uint32_t *out_mesh_count)
+{
+    if(!file_map_readonly(path, fm)) {
+        return NULL;
+    }
+
+    const struct Mesh_Pack_Header *header = (const struct Mesh_Pack_Header *)fm->data;
+    CHECK(fm->size >= sizeof(*header) && header->magic == MESH_PACK_MAGIC, "Mesh pack file is corrupt");
+    CHECK(header->version == MESH_PACK_VERSION, "Mesh pack file is from a different version of the packer, rebuild it");
+    CHECK((uint64_t)header->toc_offset + (uint64_t)header->mesh_count * sizeof(struct Mesh_Pack_Entry) <= fm->size, "Mesh pack file is truncated");
+
+    const struct Mesh_Pack_Entry *toc = (const struct Mesh_Pack_Entry *)(fm->data + header->toc_offset);
+
+    for(uint32_t i = 0; i < header->mesh_count; ++i) {
+        const struct Mesh_Pack_Entry *entry = &toc[i];
+        const uint64_t index_size = (entry->flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t);
+        const bool compressed = entry->flags & MESH_FILE_FLAG_COMPRESSED;
+        CHECK(entry->vertex_offset + (compressed ? entry->vertex_stream_size : (uint64_t)entry->vert_count * entry->vertex_stride) <= fm->size &&
+              entry->index_offset + (compressed ? entry->index_stream_size : (uint64_t)entry->index_count * index_size) <= fm->size &&
+              entry->meshlet_offset + (uint64_t)entry->meshlet_count * sizeof(struct Mesh_File_Meshlet) <= fm->size &&
+              entry->lod_offset + (uint64_t)entry->lod_count * sizeof(struct Mesh_File_Lod) <= fm->size, "Mesh pack file is truncated");
+    }
+
+    *out_mesh_count = header->mesh_count;
+    return toc;
+}
+
+// NOTE: Returns false if there is no pack, so the caller can fall back to loose files
+static bool upload_meshes_from_pack_file(struct VK *vk, const char *path)
+{
+    struct File_Mapping fm;
+    uint32_t mesh_count;
+    const struct Mesh_Pack_Entry *toc = mesh_pack_open(path, &fm, &mesh_count);
+    if(!toc) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < mesh_count; ++i) {
+        CHECK(vk->mesh_count < countof(vk->meshes), "Too many meshes in mesh pack");
+
+        struct Mesh_Source src;
+        mesh_source_from_pack_entry(fm.data, &toc[i], &src);
+        vk->meshes[vk->mesh_count++] = upload_mesh(vk, &src);
+
+        LOG("Uploaded mesh %s from pack (%s indices%s, %u meshlets, %u LODs)\n", toc[i].name, (toc[i].flags & MESH_FILE_FLAG_INDEX_32) ? "32-bit" : "16-bit",
+            (toc[i].flags & MESH_FILE_FLAG_COMPRESSED) ? ", compressed" : "", toc[i].meshlet_count, toc[i].lod_count);
+    }
+
+    // NOTE: The payloads have to stay mapped until they've been copied into the staging buffer,
+    //       which only happens during the uploads above, so it's fine to unmap before flushing.
+    file_unmap(&fm);
+
+    return true;
+}
+
+/* Texture Mip Notes:
+ *
+ * Mip chains are generated on the CPU when the texture is loaded (on the stream workers when streaming), with a 2x2 box filter.
+ * sRGB textures are filtered in linear space, otherwise the smaller levels come out darker than they should. Alpha is always linear.
+ * The chain stays in linear float until it's done and each level is only quantized on the way out, so the error doesn't build up.
+ * Odd sizes just drop the last row/column, which is fine for the kinds of textures we have.
+ * The levels are tightly packed one after the other starting from level 0, which is what vk_update_image expects.
+ */
+#define MIP_LINEAR_TO_SRGB_LUT_SIZE 4096
+
+static float s_srgb_to_linear_lut[256];
+static uint8_t s_linear_to_srgb_lut[MIP_LINEAR_TO_SRGB_LUT_SIZE];
+
+// NOTE: Has to be called before any textures are loaded, the stream workers read the tables without any locking
+static void texture_mip_tables_init(void)
+{
+    for(int i = 0; i < 256; ++i) {
+        const float c = i / 255.0f;
+        s_srgb_to_linear_lut[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for(int i = 0; i < MIP_LINEAR_TO_SRGB_LUT_SIZE; ++i) {
+        const float l = i / (float)(MIP_LINEAR_TO_SRGB_LUT_SIZE - 1);
+        const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+        s_linear_to_srgb_lut[i] = (uint8_t)(c * 255.0f + 0.5f);
+    }
+}
+
+static uint32_t texture_mip_count(VkExtent3D extent)
+{
+    uint32_t levels = 1;
+    while(((extent.width | extent.height) >> levels) && levels < TEXTURE_MAX_MIPS) {
+        ++levels;
+    }
+
+    return levels;
+}
+
+static void mip_decode_level(float *dst, const uint8_t *src, size_t texel_count, bool srgb)
+{
+    for(size_t i = 0; i < texel_count; ++i) {
+        for(int c = 0; c < 3; ++c) {
+            dst[i * 4 + c] = srgb ? s_srgb_to_linear_lut[src[i * 4 + c]] : src[i * 4 + c] / 255.0f;
+        }
+        dst[i * 4 + 3] = src[i * 4 + 3] / 255.0f;
+    }
+}
+
+static void mip_downsample_level(float *dst, const float *src, uint32_t src_width, uint32_t src_height)
+{
+    const uint32_t dst_width = MAX(src_width / 2, 1);
+    const uint32_t dst_height = MAX(src_height / 2, 1);
+
+    for(uint32_t y = 0; y < dst_height; ++y) {
+        const float *row0 = src + (size_t)(y * 2) * src_width * 4;
+        const float *row1 = src + (size_t)MIN(y * 2 + 1, src_height - 1) * src_width * 4;
+        float *out = dst + (size_t)y * dst_width * 4;
+
+        for(uint32_t x = 0; x < dst_width; ++x) {
+            const uint32_t x0 = x * 2 * 4;
+            const uint32_t x1 = MIN(x * 2 + 1, src_width - 1) * 4;
+#if MIP_GEN_SSE2
+            // One texel per register, all four channels are filtered the same way
+            const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                          _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for(int c = 0; c < 4; ++c) {
+                out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+            }
+#endif
+        }
+    }
+}
+
+static void mip_encode_level(uint8_t *dst, const float *src, size_t texel_count, bool srgb)
+{
+    // sRGB channels are quantized to the LUT's resolution, alpha (or everything, for linear textures) straight to 8 bits
+    const float color_scale = srgb ? (float)(MIP_LINEAR_TO_SRGB_LUT_SIZE - 1) : 255.0f;
+
+#if MIP_GEN_SSE2
+    const __m128 scale = _mm_setr_ps(color_scale, color_scale, color_scale, 255.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for(size_t i = 0; i < texel_count; ++i) {
+        const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i * 4), zero), one);
+        __m128i q = _mm_cvtps_epi32(_mm_mul_ps(v, scale)); // Rounds to nearest
+
+        if(srgb) {
+            int32_t q_lanes[4];
+            _mm_storeu_si128((__m128i *)q_lanes, q);
+            dst[i * 4 + 0] = s_linear_to_srgb_lut[q_lanes[0]];
+            dst[i * 4 + 1] = s_linear_to_srgb_lut[q_lanes[1]];
+            dst[i * 4 + 2] = s_linear_to_srgb_lut[q_lanes[2]];
+            dst[i * 4 + 3] = (uint8_t)q_lanes[3];
+        }
+        else {
+            q = _mm_packs_epi32(q, q);
+            q = _mm_packus_epi16(q, q);
+            const uint32_t texel = (uint32_t)_mm_cvtsi128_si32(q);
+            memcpy(dst + i * 4, &texel, sizeof(texel));
+        }
+    }
+#else
+    for(size_t i = 0; i < texel_count; ++i) {
+        for(int c = 0; c < 4; ++c) {
+            const float v = CLAMP(src[i * 4 + c], 0.0f, 1.0f);
+            if(srgb && c < 3) {
+                dst[i * 4 + c] = s_linear_to_srgb_lut[(int)(v * color_scale + 0.5f)];
+            }
+            else {
+                dst[i * 4 + c] = (uint8_t)(v * 255.0f + 0.5f);
+            }
+        }
+    }
+#endif
+}
+
+// Fills in levels 1 and up of the chain, level 0 has to be there already
+static void texture_generate_mips(uint8_t *chain, VkExtent3D extent, uint32_t mip_levels, bool srgb)
+{
+    if(mip_levels <= 1) {
+        return;
+    }
+
+    // Ping-pongs between the two, every level after the first fits in either
+    float *level_a = malloc((size_t)extent.width * extent.height * 4 * sizeof(float));
+    float *level_b = malloc((size_t)MAX(extent.width / 2, 1) * MAX(extent.height / 2, 1) * 4 * sizeof(float));
+    CHECK(level_a && level_b, "Out of memory generating mips");
+
+    mip_decode_level(level_a, chain, (size_t)extent.width * extent.height, srgb);
+
+    float *src = level_a;
+    float *dst = level_b;
+    uint8_t *out = chain + (size_t)extent.width * extent.height * 4;
+    for(uint32_t level = 1; level < mip_levels; ++level) {
+        const uint32_t src_width = MAX(extent.width >> (level - 1), 1);
+        const uint32_t src_height = MAX(extent.height >> (level - 1), 1);
+        const size_t texel_count = (size_t)MAX(extent.width >> level, 1) * MAX(extent.height >> level, 1);
+
+        mip_downsample_level(dst, src, src_width, src_height);
+        mip_encode_level(out, dst, texel_count, srgb);
+        out += texel_count * 4;
+
+        float *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    free(level_a);
+    free(level_b);
+}
+
+// Returns the whole mip chain as RGBA8, free with free()
+static uint8_t *texture_load_mip_chain(const char *path, VkExtent3D *out_extent, uint32_t *out_mip_levels)
+{
+    int x, y, n;
+    uint8_t *pixels = stbi_load(path, &x, &y, &n, 4);
+    if(!pixels) {
+        return NULL;
+    }
+
+    const VkExtent3D extent = { x, y, 1 };
+    const uint32_t mip_levels = texture_mip_count(extent);
+
+    uint8_t *chain = malloc(texture_mip_chain_size(TEXTURE_IMAGE_FORMAT, extent, mip_levels));
+    CHECK(chain, "Out of memory loading texture");
+    memcpy(chain, pixels, (size_t)x * y * 4);
+    stbi_image_free(pixels);
+
+    // NOTE: texture_create always makes sRGB images
+    texture_generate_mips(chain, extent, mip_levels, true);
+
+    *out_extent = extent;
+    *out_mip_levels = mip_levels;
+    return chain;
+}
+
+static VkFormat texture_file_vk_format(uint32_t format, uint32_t flags)
+{
+    const bool srgb = flags & TEXTURE_FILE_FLAG_SRGB;
+
+    switch(format) {
+    case TEXTURE_FILE_FORMAT_BC1: return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case TEXTURE_FILE_FORMAT_BC3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case TEXTURE_FILE_FORMAT_BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case TEXTURE_FILE_FORMAT_BC7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    default:                      return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+// Checks a .ktex file that's been loaded or mapped, returns its mip chain (NULL if it's broken)
+static const char *texture_file_parse(const char *data, size_t size, VkExtent3D *out_extent, uint32_t *out_mip_levels, VkFormat *out_format)
+{
+    const struct Texture_File_Header *header = (const struct Texture_File_Header *)data;
+
+    if(size < sizeof(*header) ||
+       header->magic != TEXTURE_FILE_MAGIC ||
+       header->version != TEXTURE_FILE_VERSION ||
+       header->format >= TEXTURE_FILE_FORMAT_COUNT ||
+       header->mip_count == 0 || header->mip_count > TEXTURE_MAX_MIPS ||
+       sizeof(*header) + (uint64_t)header->mip_count * sizeof(struct Texture_File_Level) > size
+    ) {
+        return NULL;
+    }
+
+    const struct Texture_File_Level *levels = (const struct Texture_File_Level *)(data + sizeof(*header));
+    const VkFormat format = texture_file_vk_format(header->format, header->flags);
+    const VkExtent3D extent = { header->width, header->height, 1 };
+
+    // The levels are always written back to back (tools/texture_file.h checks them one by one), so only the whole chain needs checking
+    if(levels[0].offset % 16 != 0 || levels[0].offset + texture_mip_chain_size(format, extent, header->mip_count) > size) {
+        return NULL;
+    }
+
+    *out_extent = extent;
+    *out_mip_levels = header->mip_count;
+    *out_format = format;
+    return data + levels[0].offset;
+}
+
+static bool texture_path_is_file(const char *path)
+{
+    const size_t len = strlen(path);
+    return len > 5 && 0 == strcmp(path + len - 5, ".ktex");
+}
+
+// Picks the .ktex version of an image when there is one and the device can sample it (see Texture File Notes)
+static const char *texture_pick_path(struct VK *vk, const char *file_path, const char *image_path)
+{
+    FILE *fp = vk->texture_compression_bc ? fopen(file_path, "rb") : NULL;
+    if(!fp) {
+        return image_path;
+    }
+
+    fclose(fp);
+    return file_path;
+}
+
+#if WITH_TEXTURE_CACHE
+/* Texture Cache Notes:
+ *
+ * Decoding the source images (zlib for PNGs) and generating their mips takes most of the texture loading time,
+ * so the result is kept in TEXTURE_CACHE_DIR as .ktex files (RGBA8, see Texture File Notes) and reused on the next start.
+ * Cache files are memory mapped and copied straight into the staging buffer, so a warm start never touches stb_image.
+ *
+ * Files are named after a hash of the source image's contents and the import settings (TEXTURE_CACHE_VERSION and the format),
+ * so editing an image or changing the import just makes new files. Nothing is ever evicted, delete the directory to clear it.
+ * Hashing the source still means reading it, but that's a lot cheaper than decoding it.
+ *
+ * NOTE: The stream workers read the cache files into the heap instead of mapping them,
+ *       so that the page faults don't end up on the render thread when the batch is filled.
+ */
+#define TEXTURE_CACHE_PRIME_1 0x9E3779B185EBCA87ull
+#define TEXTURE_CACHE_PRIME_2 0xC2B2AE3D27D4EB4Full
+
+static uint64_t texture_cache_round(uint64_t acc, uint64_t word)
+{
+    acc += word * TEXTURE_CACHE_PRIME_2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * TEXTURE_CACHE_PRIME_1;
+}
+
+// 64-bit content hash in the style of xxHash64 (but not compatible with it), a few GB/s
+static uint64_t texture_cache_hash(const char *data, size_t size, uint64_t seed)
+{
+    // Four independent lanes, so it's not one long chain of dependent multiplies
+    uint64_t lanes[4] = {
+        seed + TEXTURE_CACHE_PRIME_1 + TEXTURE_CACHE_PRIME_2,
+        seed + TEXTURE_CACHE_PRIME_2,
+        seed,
+        seed - TEXTURE_CACHE_PRIME_1
+    };
+
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32) {
+        for(int lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            memcpy(&word, data + i + lane * 8, sizeof(word));
+            lanes[lane] = texture_cache_round(lanes[lane], word);
+        }
+    }
+
+    uint64_t hash = size;
+    for(int lane = 0; lane < 4; ++lane) {
+        hash = (hash ^ texture_cache_round(0, lanes[lane])) * TEXTURE_CACHE_PRIME_1;
+    }
+
+    for(; i < size; ++i) {
+        hash = (hash ^ (uint8_t)data[i]) * TEXTURE_CACHE_PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+// Fills in the cache file path for an image, returns whether that file exists already.
+// out_path is left empty if the image can't be read, then there's nothing to cache either.
+static bool texture_cache_lookup(const char *image_path, char *out_path, size_t out_path_size)
+{
+    out_path[0] = '\0';
+
+    struct File_Mapping fm;
+    if(!file_map_readonly(image_path, &fm)) {
+        return false;
+    }
+
+    const uint64_t settings = ((uint64_t)TEXTURE_CACHE_VERSION << 32) | (uint64_t)TEXTURE_IMAGE_FORMAT;
+    const uint64_t key = texture_cache_hash(fm.data, fm.size, settings);
+    file_unmap(&fm);
+
+    snprintf(out_path, out_path_size, TEXTURE_CACHE_DIR "/%016llx.ktex", (unsigned long long)key);
+
+    FILE *fp = fopen(out_path, "rb");
+    if(!fp) {
+        return false;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+// NOTE: Written to a temporary file that's then renamed over, so a crash (or another worker) never leaves a partial file behind
+static void texture_cache_write(const char *cache_path, VkExtent3D extent, uint32_t mip_levels, const uint8_t *chain)
+{
+    if(!cache_path[0]) {
+        return;
+    }
+
+#ifdef _WIN32
+    CreateDirectoryA(TEXTURE_CACHE_DIR, NULL);
+#else
+    mkdir(TEXTURE_CACHE_DIR, 0755);
+#endif
+
+    char tmp_path[300];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%lu.tmp", cache_path, (unsigned long)SDL_ThreadID());
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if(!fp) {
+        LOG("Couldn't write the texture cache file %s\n", tmp_path);
+        return;
+    }
+
+    const struct Texture_File_Header header = {
+        .magic = TEXTURE_FILE_MAGIC,
+        .version = TEXTURE_FILE_VERSION,
+        .format = TEXTURE_FILE_FORMAT_RGBA8,
+        .flags = TEXTURE_FILE_FLAG_SRGB, // NOTE: Needs to match TEXTURE_IMAGE_FORMAT
+        .width = extent.width,
+        .height = extent.height,
+        .mip_count = mip_levels
+    };
+
+    struct Texture_File_Level levels[TEXTURE_MAX_MIPS];
+    const uint64_t data_offset = align_address(sizeof(header) + mip_levels * sizeof(levels[0]), 16);
+    uint64_t offset = data_offset;
+    for(uint32_t level = 0; level < mip_levels; ++level) {
+        uint64_t level_size;
+        texture_level_copy(TEXTURE_IMAGE_FORMAT, extent, level, offset, &level_size);
+        levels[level] = (struct Texture_File_Level){ .offset = offset, .size = level_size };
+        offset += level_size;
+    }
+
+    static const char padding[16];
+    const size_t padding_size = data_offset - (sizeof(header) + mip_levels * sizeof(levels[0]));
+    const size_t chain_size = offset - data_offset;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(levels, sizeof(levels[0]), mip_levels, fp) == mip_levels &&
+              fwrite(padding, 1, padding_size, fp) == padding_size &&
+              fwrite(chain, 1, chain_size, fp) == chain_size;
+    ok = (fclose(fp) == 0) && ok;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, cache_path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp_path, cache_path) == 0;
+#endif
+
+    if(!ok) {
+        LOG("Couldn't write the texture cache file %s\n", cache_path);
+        remove(tmp_path);
+    }
+}
+#endif
+
+/* Creates the image and its view, the contents are uploaded separately.
+ * Textures normally live until shutdown. Destroyable ones aren't put on the deletion queue,
+ * and are retired with texture_destroy instead, which gives their memory back to gpu_image_mem once the GPU is done with them. */
+static struct Texture texture_create(struct VK *vk, VkExtent3D extent, uint32_t mip_levels, VkFormat format, bool destroyable)
+{
+    VkImageCreateInfo image_create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = extent,
+        .mipLevels = mip_levels,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+    };
+
+    struct Texture out_texture = {
+        .extent = extent,
+        .mip_levels = mip_levels,
+        .format = format,
+        .destroyable = destroyable
+    };
+
+    VK_CHECK(vkCreateImage(vk->device, &image_create_info, NULL, &out_texture.image));
+    if(!destroyable) {
+        vk_push_deletable(vk, vkDestroyImage, out_texture.image);
+    }
+
+    VkMemoryRequirements mem_requirements;
+    vkGetImageMemoryRequirements(vk->device, out_texture.image, &mem_requirements);
+
+    out_texture.allocation = vk_mem_arena_push(vk, &vk->gpu_image_mem, mem_requirements, MEM_CATEGORY_TEXTURES);
+    vkBindImageMemory(vk->device, out_texture.image, out_texture.allocation.memory, out_texture.allocation.offset);
+
+    VkImageViewCreateInfo image_view_create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .image = out_texture.image,
+        .format = image_create_info.format,
+        .subresourceRange = {
+            .baseMipLevel = 0,
+            .levelCount = mip_levels,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
+        }
+    };
+
+    VK_CHECK(vkCreateImageView(vk->device, &image_view_create_info, NULL, &out_texture.image_view));
+    if(!destroyable) {
+        vk_push_deletable(vk, vkDestroyImageView, out_texture.image_view);
+    }
+
+    return out_texture;
+}
+
+// NOTE: Only for destroyable textures. It's retired, frames that are still on the GPU can keep using it.
+static void texture_destroy(struct VK *vk, struct Texture *texture)
+{
+    assert(texture->destroyable);
+
+    vk_retire(vk, vkDestroyImageView, texture->image_view);
+    vk_retire_with_memory(vk, vkDestroyImage, texture->image, &vk->gpu_image_mem, texture->allocation, MEM_CATEGORY_TEXTURES);
+
+    *texture = (struct Texture){0};
+}
+
+/* Texture registry (see Texture Registry Notes) */
+static void texture_registry_init(struct VK *vk, VkImageView dummy_view)
+{
+    vk->textures.dummy_view = dummy_view;
+}
+
+// Writes the slots that the current frame's global set doesn't have yet, see Texture Registry Notes
+static void texture_registry_write_stale(struct VK *vk)
+{
+    struct Texture_Registry *reg = &vk->textures;
+    const uint32_t frame_idx = vk->frame % FRAMES_IN_FLIGHT;
+    const uint8_t frame_bit = 1 << frame_idx;
+
+    VkDescriptorImageInfo image_infos[TEXTURE_REGISTRY_MAX_WRITES];
+    VkWriteDescriptorSet set_writes[TEXTURE_REGISTRY_MAX_WRITES];
+    uint32_t write_count = 0;
+
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < reg->stale_count; ++i) {
+        const uint32_t slot = reg->stale_slots[i];
+
+        if(reg->stale_frames[slot] & frame_bit) {
+            if(write_count == countof(set_writes)) {
+                vkUpdateDescriptorSets(vk->device, write_count, set_writes, 0, NULL);
+                write_count = 0;
+            }
+
+            image_infos[write_count] = (VkDescriptorImageInfo) {
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                .imageView = reg->views[slot],
+                .sampler = vk->default_sampler,
+            };
+
+            set_writes[write_count] = (VkWriteDescriptorSet) {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstBinding = 3,
+                .dstArrayElement = slot,
+                .dstSet = vk->frames[frame_idx].global_desc,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .descriptorCount = 1,
+                .pImageInfo = &image_infos[write_count]
+            };
+            write_count++;
+
+            reg->stale_frames[slot] &= ~frame_bit;
+        }
+
+        if(reg->stale_frames[slot]) {
+            reg->stale_slots[kept++] = slot;
+        }
+    }
+    reg->stale_count = kept;
+
+    if(write_count) {
+        vkUpdateDescriptorSets(vk->device, write_count, set_writes, 0, NULL);
+    }
+}
+
+// Points the slot at image_view, starting from the next texture_registry_update
+static void texture_registry_set(struct VK *vk, uint32_t slot, VkImageView image_view)
+{
+    struct Texture_Registry *reg = &vk->textures;
+    assert(slot < reg->slot_count);
+
+    // NOTE: A slot is only in stale_slots once, setting it again before it's written just replaces the view
+    if(!reg->stale_frames[slot]) {
+        reg->stale_slots[reg->stale_count++] = slot;
+    }
+
+    reg->views[slot] = image_view;
+    reg->stale_frames[slot] = (1 << FRAMES_IN_FLIGHT) - 1;
+}
+
+// The slot shows the dummy texture until it's set
+static uint32_t texture_registry_alloc(struct VK *vk)
+{
+    struct Texture_Registry *reg = &vk->textures;
+
+    uint32_t slot;
+    if(reg->free_count) {
+        slot = reg->free_slots[--reg->free_count];
+    }
+    else {
+        CHECK(reg->slot_count < reg->capacity, "Out of texture descriptor slots");
+        slot = reg->slot_count++;
+    }
+
+    texture_registry_set(vk, slot, reg->dummy_view);
+
+    return slot;
+}
+
+static void texture_registry_free(struct VK *vk, uint32_t slot)
+{
+    struct Texture_Registry *reg = &vk->textures;
+    assert(reg->retired_count < countof(reg->retired));
+
+    texture_registry_set(vk, slot, reg->dummy_view);
+
+    reg->retired[(reg->retired_head + reg->retired_count++) % countof(reg->retired)] = (struct Texture_Registry_Retired) {
+        .slot = slot,
+        .frame = reg->frame
     };
+}
 
-    /* pipeline */
-    VkPipeline pipeline = vk_create_pipeline(vk, layout, shader_stages, countof(shader_stages));
+// NOTE: Once per frame, after waiting on the render fence and before recording
+static void texture_registry_update(struct VK *vk)
+{
+    struct Texture_Registry *reg = &vk->textures;
 
-    vkDestroyShaderModule(vk->device, shader_frag, NULL);
-    vkDestroyShaderModule(vk->device, shader_vert, NULL);
-    
-    return pipeline;
+    texture_registry_write_stale(vk);
+
+    /* Slots freed FRAMES_IN_FLIGHT frames ago aren't used by anything on the GPU anymore */
+    reg->frame++;
+
+    while(reg->retired_count && reg->retired[reg->retired_head].frame + FRAMES_IN_FLIGHT <= reg->frame) {
+        reg->free_slots[reg->free_count++] = reg->retired[reg->retired_head].slot;
+        reg->retired_head = (reg->retired_head + 1) % countof(reg->retired);
+        reg->retired_count--;
+    }
 }
 
-static void vk_init(struct VK *vk)
+// Returns false if the file can't be read or is broken
+static bool texture_upload_from_texture_file(struct VK *vk, const char *path, struct Texture *out_texture)
 {
-	/* instance */
-	{
-		/* extensions */
-		const char *extension_names[256];
-		uint32_t extension_count = countof(extension_names);
+    struct File_Mapping fm;
+    if(!file_map_readonly(path, &fm)) {
+        return false;
+    }
 
-		SDL_Vulkan_GetInstanceExtensions(s_window, &extension_count, extension_names);
+    VkExtent3D extent;
+    uint32_t mip_levels;
+    VkFormat format;
+    const char *data = texture_file_parse(fm.data, fm.size, &extent, &mip_levels, &format);
+    if(!data) {
+        file_unmap(&fm);
+        return false;
+    }
 
-		/* layers */
-		VkLayerProperties available_layers[256];
-		uint32_t available_layer_count = countof(available_layers);
+    LOG("Loaded texture from %s of size %d x %d with %d mips (format %d, %.1fKB)\n", path, extent.width, extent.height, mip_levels, format,
+        texture_mip_chain_size(format, extent, mip_levels) / 1024.0);
 
-		vkEnumerateInstanceLayerProperties(&available_layer_count, available_layers);
+    *out_texture = texture_create(vk, extent, mip_levels, format, false);
+    vk_update_image(vk, *out_texture, data);
 
-		const char *layer_names[] = {
-			"VK_LAYER_KHRONOS_validation"
-		};
-		uint32_t layer_count = countof(layer_names);
+    // NOTE: Already copied into the staging buffer
+    file_unmap(&fm);
 
-		static_assert(countof(layer_names) == 1, "Edit the code below to support more");
-		bool found = false;
-		for(uint32_t i = 0; i < available_layer_count; ++i) {
-			if(0 == strcmp(available_layers[i].layerName, layer_names[0])) {
-				found = true;
-				break;
-			}
-		}
+    return true;
+}
 
-		if(!found) {
-			layer_count = 0;
-		}
+// Either a .ktex file or an image that gets its mips generated here (or comes from the texture cache)
+static struct Texture upload_texture_from_file_path(struct VK *vk, const char *path)
+{
+    struct Texture out_texture;
 
-        /* application info */
-        VkApplicationInfo application_info = {
-            .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-            .pApplicationName = "vk_scene",
-            .apiVersion = VK_API_VERSION_1_3
-        };
+    if(texture_path_is_file(path)) {
+        CHECK(texture_upload_from_texture_file(vk, path, &out_texture), "Could not load texture");
+        return out_texture;
+    }
 
-		/* instance */
-		VkInstanceCreateInfo instance_create_info = {
-			.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-			.enabledLayerCount = layer_count,
-			.ppEnabledLayerNames = layer_names,
-			.enabledExtensionCount = extension_count,
-			.ppEnabledExtensionNames = extension_names,
-            .pApplicationInfo = &application_info
-		};
+#if WITH_TEXTURE_CACHE
+    char cache_path[256];
+    if(texture_cache_lookup(path, cache_path, sizeof(cache_path)) && texture_upload_from_texture_file(vk, cache_path, &out_texture)) {
+        return out_texture;
+    }
+#endif
 
-		VK_CHECK(vkCreateInstance(&instance_create_info, NULL, &vk->instance));
-	}
+    VkExtent3D extent;
+    uint32_t mip_levels;
+    uint8_t *data = texture_load_mip_chain(path, &extent, &mip_levels);
+    if(!data) {
+        panic("Could not load texture");
+    };
 
-	/* physical device */
-	{
-		VkPhysicalDevice devices[256];
-		uint32_t device_count = countof(devices);
+    LOG("Loaded texture from %s of size %d x %d with %d mips (@%p)\n", path, extent.width, extent.height, mip_levels, data);
 
-		vkEnumeratePhysicalDevices(vk->instance, &device_count, devices);
-		CHECK(device_count, "No GPUs found");
+    out_texture = texture_create(vk, extent, mip_levels, TEXTURE_IMAGE_FORMAT, false);
 
-        int target_index = 0;
-        for(int i = 0; i < device_count; ++i) {
-            VkPhysicalDeviceProperties props;
-            vkGetPhysicalDeviceProperties(devices[i], &props);
+    vk_update_image(vk, out_texture, data);
 
-            if(props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-                target_index = i;
-                break;
-            }
-        }
+#if WITH_TEXTURE_CACHE
+    texture_cache_write(cache_path, extent, mip_levels, data);
+#endif
 
-		vk->physical_device = devices[target_index];
-	}
+    // NOTE: Already copied into the staging buffer
+    free(data);
 
-    /* memory query */
-    {
-        VkPhysicalDeviceMemoryProperties mem_properties;
-        vkGetPhysicalDeviceMemoryProperties(vk->physical_device, &mem_properties);
-    
-        /* print info */
-        printf("Memory heaps:\n");
-        for(uint32_t i = 0; i < mem_properties.memoryHeapCount; ++i) {
-            printf("-> [%d] %zuMB\n", i, mem_properties.memoryHeaps[i].size / (1024 * 1024));
-        }
-        printf("\n");
+    return out_texture;
+}
 
-        printf("Memory types:\n");
-        for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
-            printf("-> [%d] Index: %d Flags:", i, mem_properties.memoryTypes[i].heapIndex);
-            int flags = mem_properties.memoryTypes[i].propertyFlags;
-            if(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-                printf("DEVICE_LOCAL ");
-            if(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
-                printf("HOST_VISIBLE ");
-            if(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
-                printf("HOST_COHERENT ");
-            if(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
-                printf("HOST_CACHED ");
-            if(flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
-                printf("LAZILY_ALLOCATED ");
-            printf("\n");
+#if WITH_STREAMING
+/* Streaming Notes:
+ *
+ * Meshes and textures are loaded in the background while rendering. STREAM_WORKER_COUNT worker threads take requests,
+ * read the file and decode it (decompressing meshes, stb_image for textures) into a heap payload, and put it on the done list.
+ * All of the Vulkan work stays on the render thread: stream_update takes the finished payloads, creates their resources and
+ * copies them into a batch of the stream staging buffer, which is submitted to the transfer queue without anything waiting on it.
+ * Once a later stream_update sees upload_timeline reach the batch's value, the meshes become resident and the textures
+ * replace the dummy in their slot. Their acquires are recorded by that same frame (see Transfer Queue Notes).
+ *
+ * The stream staging buffer is separate from the regular one, since that is reused after every vk_staging_queue_flush
+ * while a batch can still be copying. It's split into STREAM_BATCH_COUNT batches so one can be filled while the other is in flight,
+ * and at most one batch is filled per frame, which bounds the copying the render thread does per frame.
+ * A mesh bigger than a whole batch is the oversized mesh, of which there is one at a time: it goes last in every batch and
+ * fills up whatever the rest left, until the batch with the last of it makes it resident. Textures never need that, since
+ * they are only ever requested at levels that fit in a batch.
+ * With unified memory meshes are written straight into the buffer arenas, so they don't take up any of a batch.
+ *
+ * Textures are streamed by mip level. stream_request_texture only loads the mip tail (TEXTURE_STREAM_TAIL_SIZE and smaller),
+ * and from then on the render loop reports how many pixels each texture covers on screen (its demand, from entity distance).
+ * Every frame stream_update_texture_residency turns last frame's demand into the finest level each texture wants, and:
+ *  - Evicts: While over TEXTURE_STREAM_BUDGET, textures holding finer levels than they want are requested at the level they want.
+ *  - Upgrades: Textures missing the most levels go first (ties go to the one covering more pixels),
+ *    with at most TEXTURE_STREAM_MAX_UPGRADES in flight so the priorities keep up with the camera.
+ *    An upgrade is cut short at whatever still fits in the budget, the budget is never exceeded to add detail.
+ * Either way a new, smaller or larger, image with just the levels from there on down is uploaded the same as the first one,
+ * and swapped into the descriptor slot when its batch retires. The workers only read the levels that are needed.
+ * Streamed textures are destroyable, so replacing one gives its memory back to gpu_image_mem.
+ *
+ * NOTE: stream_update has to be called after waiting on the render fence and before texture_registry_update.
+ *       The new textures are written to this frame's set by the registry update right after, and to the other frames' sets on their turn.
+ *       Replaced textures are retired right after their slot is set (see Deletion Queue Notes), frames on the GPU can still be using them.
+ */
+#define STREAM_BATCH_SIZE (GPU_STREAM_STAGING_POOL_SIZE / STREAM_BATCH_COUNT)
+#define STREAM_STAGING_ALIGNMENT 16
+
+enum Stream_Kind {
+    STREAM_MESH_FILE,
+    STREAM_MESH_PACK_ENTRY,
+    STREAM_TEXTURE
+};
+
+struct Stream_Request {
+    enum Stream_Kind kind;
+    uint32_t slot;                            // Into VK::meshes, or the texture descriptor array
+    const char *path;                         // STREAM_MESH_FILE and STREAM_TEXTURE, must outlive the request
+    uint32_t base_level;                      // STREAM_TEXTURE, finest mip level to load, clamped to the mip tail
+    const struct Mesh_Pack_Entry *pack_entry; // STREAM_MESH_PACK_ENTRY, in Streamer::pack
+    uint64_t t_requested;
+};
+
+struct Stream_Payload {
+    struct Stream_Request request;
+
+    struct Mesh_Source mesh; // Never compressed, points into file_data, decoded_data or the mapped pack
+    char *file_data;
+    char *decoded_data;
+
+    uint8_t *pixels;       // Either the RGBA8 mip chain generated from an image, or the levels read from a .ktex file
+    const char *texels;    // The levels to upload, in pixels
+    VkExtent3D extent;     // Of the levels to upload, starting from base_level of the source
+    uint32_t mip_levels;
+    VkFormat format;
+    uint32_t base_level;
+    VkExtent3D full_extent;
+    uint32_t full_mip_levels;
+    bool from_cache;
+
+    uint64_t upload_size; // Including alignment, see stream_payload_staging_size for how much of a batch it takes
+};
+
+struct Stream_Batch_Item {
+    struct Stream_Request request;
+    struct Texture texture;
+    uint32_t base_level;
+    VkExtent3D full_extent;
+    uint32_t full_mip_levels;
+};
+
+// Render thread side of a texture slot
+struct Stream_Texture {
+    const char *path;         // NULL if the slot isn't streamed
+    struct Texture texture;   // Dedicated, what the slot points at. There's no image until the mip tail is in
+    VkExtent3D full_extent;   // Of the source's level 0, texture starts at resident_level of it
+    uint32_t full_mip_levels;
+    uint32_t resident_level;
+    uint32_t target_level;    // Same as resident_level unless pending
+    float demand;             // The most screen pixels it covers this frame, see stream_texture_demand
+    bool pending;
+
+    /* Scratch for stream_update_texture_residency */
+    uint32_t wanted_level;
+    float last_demand;
+    bool schedulable;
+};
+
+struct Stream_Buffer_Copy {
+    struct VK_Buffer_Arena *arena;
+    VkBufferCopy copy;
+};
+
+struct Stream_Batch {
+    VkCommandBuffer cmdbuf;
+    uint64_t value; // The upload_timeline value its submit signals
+    bool in_flight;
+
+    uint64_t staging_offset; // Start of this batch in the stream staging buffer
+    uint64_t staging_top;    // Relative to staging_offset
+
+    struct Stream_Batch_Item items[STREAM_MAX_BATCH_ITEMS];
+    uint32_t item_count;
+
+    // Only recorded on submit, since the buffer arenas can be relocated while the batch is being filled
+    struct Stream_Buffer_Copy buffer_copies[STREAM_MAX_BATCH_ITEMS * 2];
+    uint32_t buffer_copy_count;
+};
+
+struct Streamer {
+    SDL_Thread *workers[STREAM_WORKER_COUNT];
+    SDL_mutex *mutex;
+    SDL_cond *request_cond;
+
+    /* Shared with the workers, only touched with the mutex held */
+    bool quit;
+    struct Stream_Request requests[STREAM_MAX_REQUESTS];
+    uint32_t request_head;
+    uint32_t request_count;
+    struct Stream_Payload *done[STREAM_MAX_REQUESTS];
+    uint32_t done_head;
+    uint32_t done_count;
+
+    /* Render thread only */
+    uint32_t pending_count;   // Requested but not resident yet, which also bounds how full the rings above can get
+    struct File_Mapping pack; // Kept mapped while its entries are pending
+
+    struct VK_Buffer_Arena staging_buffer;
+    char *staging_mapping;
+    struct Stream_Batch batches[STREAM_BATCH_COUNT];
+    uint32_t next_batch;
+
+    // Too big for a batch, copied over as many as it takes (see Streaming Notes)
+    struct Stream_Payload *oversized;
+    struct Mesh_Upload oversized_upload;
+    uint64_t oversized_copied;
+
+    struct Stream_Texture textures[TEXTURE_DESCRIPTOR_MAX]; // By descriptor slot
+    uint32_t texture_slot_end;                              // Past the highest streamed slot
+    uint64_t texture_bytes;            // Of every streamed texture at its target level, what the budget is checked against
+    uint32_t texture_upgrades_pending;
+
+    /* Stats since streaming last started, reported once everything is resident */
+    uint64_t t_start;
+    uint32_t meshes_streamed;
+    uint32_t textures_streamed;
+    uint32_t textures_from_cache;
+    uint64_t bytes_streamed;
+    double update_ms_max;          // Render thread time spent in stream_update
+    struct Frame_Stats frame_stats; // Fed by the main loop
+};
+
+static struct Streamer s_streamer;
+
+static void stream_payload_free(struct Stream_Payload *payload)
+{
+    free(payload->pixels);
+    free(payload->file_data);
+    free(payload->decoded_data);
+    free(payload);
+}
+
+// Finest level of the mip tail, which is streamed in first and never evicted
+static uint32_t texture_stream_tail_level(VkExtent3D extent, uint32_t mip_levels)
+{
+    uint32_t level = 0;
+    while(level + 1 < mip_levels && MAX(extent.width >> level, extent.height >> level) > TEXTURE_STREAM_TAIL_SIZE) {
+        ++level;
+    }
+
+    return level;
+}
+
+// Skips texels ahead to the requested base level, after this the extent and mip levels are of what's left
+static void stream_payload_select_levels(struct Stream_Payload *payload)
+{
+    payload->full_extent = payload->extent;
+    payload->full_mip_levels = payload->mip_levels;
+    payload->base_level = MIN(payload->request.base_level, texture_stream_tail_level(payload->extent, payload->mip_levels));
+
+    payload->texels += texture_mip_chain_size(payload->format, payload->extent, payload->base_level);
+    payload->extent = texture_level_extent(payload->extent, payload->base_level);
+    payload->mip_levels -= payload->base_level;
+}
+
+// Returns false if the file can't be read or is broken. Only the levels from the base level on are read.
+static bool stream_load_texture_file(struct Stream_Payload *payload, const char *path)
+{
+    struct File_Mapping fm;
+    if(!file_map_readonly(path, &fm)) {
+        return false;
+    }
+
+    payload->texels = texture_file_parse(fm.data, fm.size, &payload->extent, &payload->mip_levels, &payload->format);
+    if(!payload->texels) {
+        file_unmap(&fm);
+        return false;
+    }
+
+    stream_payload_select_levels(payload);
+
+    const uint64_t size = texture_mip_chain_size(payload->format, payload->extent, payload->mip_levels);
+    payload->pixels = malloc(size);
+    CHECK(payload->pixels, "Out of memory");
+    memcpy(payload->pixels, payload->texels, size);
+    payload->texels = (const char *)payload->pixels;
+
+    file_unmap(&fm);
+
+    return true;
+}
+
+// NOTE: Runs on the worker threads, so there must not be any Vulkan calls in here
+static struct Stream_Payload *stream_load(struct Streamer *s, const struct Stream_Request *request)
+{
+    struct Stream_Payload *payload = calloc(1, sizeof(*payload));
+    payload->request = *request;
+
+    if(request->kind == STREAM_TEXTURE) {
+#if WITH_TEXTURE_CACHE
+        char cache_path[256] = "";
+#endif
+
+        if(texture_path_is_file(request->path)) {
+            CHECK(stream_load_texture_file(payload, request->path), "Could not load texture");
         }
-        printf("\n");
-        
-        /* Choose a memory type that is host visible */
-        printf("Searching HOST_VISIBLE | HOST_COHERENT | HOST_CACHED, memory heap\n");
-        bool found = false;
-        for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
-            if(mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT &&
-               mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT &&
-               mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT
-            ) {
-                vk->mem_host_coherent_idx = i;
-                found = true;
-                break;
-            }
+#if WITH_TEXTURE_CACHE
+        else if(texture_cache_lookup(request->path, cache_path, sizeof(cache_path)) && stream_load_texture_file(payload, cache_path)) {
+            payload->from_cache = true;
         }
+#endif
+        else {
+            payload->pixels = texture_load_mip_chain(request->path, &payload->extent, &payload->mip_levels);
+            CHECK(payload->pixels, "Could not load texture");
 
-        if(!found) {
-            printf("Falling back to un-cached HOST_VISIBLE | HOST_COHERENT memory heap\n");
+            payload->texels = (const char *)payload->pixels;
+            payload->format = TEXTURE_IMAGE_FORMAT;
 
-            for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
-                if(mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT &&
-                   mem_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-                ) {
-                    vk->mem_host_coherent_idx = i;
-                    found = true;
-                    break;
-                }
-            }            
-        }
+#if WITH_TEXTURE_CACHE
+            texture_cache_write(cache_path, payload->extent, payload->mip_levels, payload->pixels);
+#endif
 
-        CHECK(found, "Couldn't find host visible and coherent memory heap");
-        printf("-> Chose type %d (heap %d)\n", vk->mem_host_coherent_idx, mem_properties.memoryTypes[vk->mem_host_coherent_idx].heapIndex);
-        
-        /* Choose a memory type that is fast */
-        printf("Searching DEVICE_LOCAL and not HOST_VISIBLE memory heap\n");
-        found = false;
-        for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
-            if(mem_properties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) &&
-               !(mem_properties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
-            ) {
-                vk->mem_gpu_local_idx = i;
-                found = true;
-                break;
-            }
+            stream_payload_select_levels(payload);
         }
 
-        if(!found) {
-            printf("Falling back to any DEVICE_LOCAL, even if HOST_VISIBLE (is this an integrated card?)\n");
-            for(uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
-                if(mem_properties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-                    vk->mem_gpu_local_idx = i;
-                    found = true;
-                    break;
-                }
-            }   
-        }
+        payload->upload_size = align_address(texture_mip_chain_size(payload->format, payload->extent, payload->mip_levels), STREAM_STAGING_ALIGNMENT);
 
-        CHECK(found, "Couldn't find device local memory");
-        printf("-> Chose type %d (heap %d)\n\n", vk->mem_gpu_local_idx, mem_properties.memoryTypes[vk->mem_gpu_local_idx].heapIndex);
+        return payload;
     }
 
-	/* surface */
-	{
-		// TODO: Make sure we are allowed to have this before VkDevice creation
-		CHECK(SDL_Vulkan_CreateSurface(s_window, vk->instance, &vk->surface), "Couldn't create surface");
-	}
+    struct Mesh_Source src;
+    if(request->kind == STREAM_MESH_FILE) {
+        uint32_t file_size;
+        payload->file_data = file_load_binary(request->path, &file_size);
+        CHECK(payload->file_data, "Couldn't load mesh file");
 
-	/* queues query */
-	{
-		VkQueueFamilyProperties queue_families[32];
-		uint32_t queue_families_count = countof(queue_families);
-		vkGetPhysicalDeviceQueueFamilyProperties(vk->physical_device, &queue_families_count, queue_families);
+        mesh_source_from_raw_data(payload->file_data, &src);
+    }
+    else {
+        mesh_source_from_pack_entry(s->pack.data, request->pack_entry, &src);
+    }
 
-		bool found_graphics = false;
-		for(uint32_t i = 0; i < queue_families_count; ++i) {
-			/* :NOTE:
-			 * Unlike vulkan-tutorial, we find combined present/graphics queues because
-			 * drivers that don't support this do not seem to exist.
-			 */
-			VkBool32 present_support = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(vk->physical_device, i, vk->surface, &present_support);
-			if(!found_graphics && present_support && queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				found_graphics = true;
-				vk->queue_graphics_idx = i;
-			}
-		}
+    const size_t vert_buffer_size = src.header.vert_count * ((src.header.flags & MESH_FILE_FLAG_VERTEX_QUANTIZED) ? VERTEX_SIZE_QUANTIZED : VERTEX_SIZE_FLOAT);
+    const size_t index_buffer_size = src.header.index_count * ((src.header.flags & MESH_FILE_FLAG_INDEX_32) ? sizeof(uint32_t) : sizeof(uint16_t));
 
-		CHECK(found_graphics, "No combined graphics/present queue found");
-	}
+    // Pack entries are copied out here as well, so that the page faults on the mapping happen on this thread
+    if((src.header.flags & MESH_FILE_FLAG_COMPRESSED) || request->kind == STREAM_MESH_PACK_ENTRY) {
+        payload->decoded_data = malloc(vert_buffer_size + index_buffer_size);
+        CHECK(payload->decoded_data, "Out of memory");
+        mesh_write_vertices(&src, payload->decoded_data);
+        mesh_write_indices(&src, payload->decoded_data + vert_buffer_size);
+
+        src.header.flags &= ~MESH_FILE_FLAG_COMPRESSED;
+        src.vert_buffer_data = payload->decoded_data;
+        src.index_buffer_data = payload->decoded_data + vert_buffer_size;
+    }
 
-	/* logical device */
-	{
-		/* extensions */
-		const char *extension_names[] = {
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-		};
-		uint32_t extension_count = countof(extension_names);
+    payload->mesh = src;
+    payload->upload_size = align_address(vert_buffer_size, STREAM_STAGING_ALIGNMENT) + align_address(index_buffer_size, STREAM_STAGING_ALIGNMENT);
 
-		VkExtensionProperties supported_extensions[1024];
-		uint32_t supported_extension_count = countof(supported_extensions);
-		vkEnumerateDeviceExtensionProperties(vk->physical_device, NULL, &supported_extension_count, supported_extensions);
+    return payload;
+}
 
-		for(uint32_t i = 0; i < extension_count; ++i) {
-			bool found = false;
-			for(uint32_t j = 0; j < supported_extension_count; ++j) {
-				if(0 == strcmp(extension_names[i], supported_extensions[j].extensionName)) {
-					found = true;
-					break;
-				}
-			}
+static int stream_worker(void *data)
+{
+    struct Streamer *s = data;
 
-			CHECK(found, "Didn't find all required extensions");
-		}
+    for(;;) {
+        SDL_LockMutex(s->mutex);
+        while(!s->quit && s->request_count == 0) {
+            SDL_CondWait(s->request_cond, s->mutex);
+        }
 
-		/* queue */
-		VkDeviceQueueCreateInfo queue_infos[1];
-		uint32_t queue_indices[1] = {
-			vk->queue_graphics_idx,
-		};
+        if(s->quit) {
+            SDL_UnlockMutex(s->mutex);
+            return 0;
+        }
 
-		static_assert(countof(queue_infos) == countof(queue_indices), "");
+        const struct Stream_Request request = s->requests[s->request_head];
+        s->request_head = (s->request_head + 1) % STREAM_MAX_REQUESTS;
+        s->request_count--;
+        SDL_UnlockMutex(s->mutex);
 
-		uint32_t queue_count = countof(queue_indices);
+        struct Stream_Payload *payload = stream_load(s, &request);
 
-		float queue_priority = 1.0f;
-		for(uint32_t i = 0; i < queue_count; ++i) {
-			queue_infos[i] = (VkDeviceQueueCreateInfo) {
-				.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-				.queueFamilyIndex = queue_indices[i],
-				.queueCount = 1,
-				.pQueuePriorities = &queue_priority,
-			};
-		}
+        SDL_LockMutex(s->mutex);
+        s->done[(s->done_head + s->done_count) % STREAM_MAX_REQUESTS] = payload;
+        s->done_count++;
+        SDL_UnlockMutex(s->mutex);
+    }
+}
 
-		/* device features */
-        VkPhysicalDeviceFeatures device_features = {
-            .multiDrawIndirect = true
+static void stream_init(struct Streamer *s, struct VK *vk)
+{
+    vk_alloc_buffer_arena(vk, &s->staging_buffer, &vk->staging_mem, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GPU_STREAM_STAGING_POOL_SIZE, MEM_CATEGORY_STAGING, false);
+    vk_mem_report_track_buffer_arena(vk, "stream_staging", &s->staging_buffer);
+    s->staging_mapping = s->staging_buffer.buffer.allocation.mapping;
+
+    for(uint32_t i = 0; i < STREAM_BATCH_COUNT; ++i) {
+        struct Stream_Batch *batch = &s->batches[i];
+        batch->staging_offset = i * STREAM_BATCH_SIZE;
+
+        VkCommandBufferAllocateInfo cmd_alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = vk->command_pool_transfer, // NOTE: Not a partition's pool, those are reset on every flush
+            .commandBufferCount = 1,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
         };
+        VK_CHECK(vkAllocateCommandBuffers(vk->device, &cmd_alloc_info, &batch->cmdbuf));
+    }
 
-		/* create */
-        VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing_features = {
-            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
-            .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
-            .runtimeDescriptorArray = VK_TRUE,
-            .descriptorBindingVariableDescriptorCount = VK_TRUE,
-            
-            // TODO: May not need these, if we put our bindless textures on a separate descriptor set
-            .descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE,
-            .descriptorBindingUniformTexelBufferUpdateAfterBind = VK_TRUE,
-            .descriptorBindingPartiallyBound = VK_TRUE,
-            .descriptorBindingUpdateUnusedWhilePending = VK_TRUE
-        };
+    s->mutex = SDL_CreateMutex();
+    s->request_cond = SDL_CreateCond();
 
-		VkDeviceCreateInfo create_info = {
-			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			.queueCreateInfoCount = queue_count,
-			.pQueueCreateInfos = queue_infos,
-			.enabledExtensionCount = extension_count,
-			.ppEnabledExtensionNames = extension_names,
-            .pEnabledFeatures = &device_features,
-            .pNext = &descriptor_indexing_features
-		};
+    for(uint32_t i = 0; i < STREAM_WORKER_COUNT; ++i) {
+        s->workers[i] = SDL_CreateThread(stream_worker, "stream_worker", s);
+        CHECK(s->workers[i], "Couldn't create stream worker thread");
+    }
 
-		VK_CHECK(vkCreateDevice(vk->physical_device, &create_info, NULL, &vk->device));
+    LOG("Started %d stream workers\n", STREAM_WORKER_COUNT);
+}
 
-		vkGetDeviceQueue(vk->device, vk->queue_graphics_idx, 0, &vk->queue_graphics);
-	}
+// NOTE: Must be called before vk_destroy
+static void stream_destroy(struct Streamer *s, struct VK *vk)
+{
+    SDL_LockMutex(s->mutex);
+    s->quit = true;
+    SDL_CondBroadcast(s->request_cond);
+    SDL_UnlockMutex(s->mutex);
 
-    /* memory allocation */
-    {
-        vk->scratch_mem = vk_alloc_mem_arena(vk, vk->mem_host_coherent_idx, GPU_SCRATCH_POOL_SIZE);
-        vk->staging_mem = vk_alloc_mem_arena(vk, vk->mem_host_coherent_idx, GPU_STAGING_POOL_SIZE);
-        vk->gpu_mem = vk_alloc_mem_arena(vk, vk->mem_gpu_local_idx, GPU_VRAM_POOL_SIZE);
-        vk->staging_buffer = vk_alloc_buffer_arena(vk, &vk->staging_mem, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GPU_STAGING_POOL_SIZE);
+    for(uint32_t i = 0; i < STREAM_WORKER_COUNT; ++i) {
+        SDL_WaitThread(s->workers[i], NULL);
+    }
 
-        VK_CHECK(vkMapMemory(vk->device, vk->staging_mem.allocation, 0, vk->staging_buffer.capacity, 0, &vk->staging_buffer_mapping));
+    for(uint32_t i = 0; i < s->done_count; ++i) {
+        stream_payload_free(s->done[(s->done_head + i) % STREAM_MAX_REQUESTS]);
     }
 
-	/* swap chain */
-	{
-		/* query */
-		VkSurfaceFormatKHR supported_formats[256];
-		uint32_t supported_formats_count = countof(supported_formats);
-		vkGetPhysicalDeviceSurfaceFormatsKHR(vk->physical_device, vk->surface, &supported_formats_count, supported_formats);
+    if(s->oversized) {
+        stream_payload_free(s->oversized);
+    }
 
-		VkPresentModeKHR supported_modes[256];
-		uint32_t support_modes_count = countof(supported_modes);
-		vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physical_device, vk->surface, &support_modes_count, supported_modes);
+    if(s->pack.data) {
+        file_unmap(&s->pack);
+    }
 
-		VkSurfaceCapabilitiesKHR capabilities;
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk->physical_device, vk->surface, &capabilities);
+    // In-flight batches can still be copying into their textures
+    vkDeviceWaitIdle(vk->device);
 
-		int width, height;
-		SDL_Vulkan_GetDrawableSize(s_window, &width, &height);
-        VkExtent2D extent = {width, height};
-        vk->swapchain_extent = extent;
+    for(uint32_t i = 0; i < STREAM_BATCH_COUNT; ++i) {
+        for(uint32_t j = 0; j < s->batches[i].item_count; ++j) {
+            if(s->batches[i].items[j].texture.image) {
+                texture_destroy(vk, &s->batches[i].items[j].texture);
+            }
+        }
+    }
 
-		/* find */
-		VkSurfaceFormatKHR format;
-		bool format_found = false;
-		for(uint32_t i = 0; i < supported_formats_count; ++i) {
-			if(supported_formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
-			   supported_formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-			{
-				format = supported_formats[i];
-				format_found = true;
-				break;
-			}
-		}
-		CHECK(format_found, "Couldn't find a suitable surface format");
+    for(uint32_t i = 0; i < s->texture_slot_end; ++i) {
+        if(s->textures[i].texture.image) {
+            texture_destroy(vk, &s->textures[i].texture);
+        }
+    }
 
-		VkPresentModeKHR mode;
-		bool mode_found = false;
-		for(uint32_t i = 0; i < support_modes_count; ++i) {
-			if(supported_modes[i] == VK_PRESENT_MODE_FIFO_KHR) {
-				mode = supported_modes[i];
-				mode_found = true;
-				break;
-			}
-		}
-		CHECK(mode_found, "Couldn't find a suitable present mode");
+    SDL_DestroyCond(s->request_cond);
+    SDL_DestroyMutex(s->mutex);
+}
 
-		/* create */
-		uint32_t image_count = capabilities.minImageCount;
-		CHECK(image_count < countof(vk->swapchain_image_views), "Minimum swapchain image count is too high");
+static void stream_request(struct Streamer *s, struct Stream_Request request)
+{
+    CHECK(s->pending_count < STREAM_MAX_REQUESTS, "Too many stream requests in flight");
+
+    request.t_requested = SDL_GetPerformanceCounter();
+
+    if(s->pending_count++ == 0) {
+        s->t_start = request.t_requested;
+        s->meshes_streamed = 0;
+        s->textures_streamed = 0;
+        s->textures_from_cache = 0;
+        s->bytes_streamed = 0;
+        s->update_ms_max = 0.0;
+        s->frame_stats = (struct Frame_Stats){0};
+    }
 
-		VkExtent3D depth_image_extent = {
-			vk->swapchain_extent.width,
-			vk->swapchain_extent.height,
-			1
-		};
+    SDL_LockMutex(s->mutex);
+    s->requests[(s->request_head + s->request_count) % STREAM_MAX_REQUESTS] = request;
+    s->request_count++;
+    SDL_CondSignal(s->request_cond);
+    SDL_UnlockMutex(s->mutex);
+}
 
-		vk->depth_format = VK_FORMAT_D32_SFLOAT;
+// Reserves the mesh slot right away, so entities can refer to it before it's resident
+static uint32_t stream_request_mesh_file(struct Streamer *s, struct VK *vk, const char *path)
+{
+    CHECK(vk->mesh_count < countof(vk->meshes), "Too many meshes");
 
-		VkImageCreateInfo depth_image_create_info = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-			.imageType = VK_IMAGE_TYPE_2D,
-			.format = vk->depth_format,
-			.extent = depth_image_extent,
-			.mipLevels = 1,
-			.arrayLayers = 1,
-			.samples = VK_SAMPLE_COUNT_1_BIT,
-			.tiling = VK_IMAGE_TILING_OPTIMAL,
-			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
-		};	
+    const uint32_t slot = vk->mesh_count++;
+    vk->meshes[slot] = (struct Mesh){0};
 
-		VK_CHECK(vkCreateImage(vk->device, &depth_image_create_info, NULL, &vk->depth_image));
-		vk_push_deletable(vk, vkDestroyImage, vk->depth_image);
+    stream_request(s, (struct Stream_Request) {
+        .kind = STREAM_MESH_FILE,
+        .slot = slot,
+        .path = path
+    });
 
-        VkMemoryRequirements depth_image_mem_requirements;
-        vkGetImageMemoryRequirements(vk->device, vk->depth_image, &depth_image_mem_requirements);
+    return slot;
+}
 
-        VkMemoryAllocateInfo alloc_info = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = depth_image_mem_requirements.size,
-            .memoryTypeIndex = vk->mem_gpu_local_idx
-        };
+// NOTE: Returns false if there is no pack, so the caller can fall back to loose files
+static bool stream_request_meshes_from_pack_file(struct Streamer *s, struct VK *vk, const char *path)
+{
+    CHECK(!s->pack.data, "A mesh pack is already streaming");
 
-        const uint64_t buffer_address = vk_mem_arena_push(vk, &vk->gpu_mem, depth_image_mem_requirements);
-        vkBindImageMemory(vk->device, vk->depth_image, vk->gpu_mem.allocation, buffer_address);
+    uint32_t mesh_count;
+    const struct Mesh_Pack_Entry *toc = mesh_pack_open(path, &s->pack, &mesh_count);
+    if(!toc) {
+        return false;
+    }
 
-		VkImageViewCreateInfo depth_image_view_create_info = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.image = vk->depth_image,
-			.format = vk->depth_format,
-			.subresourceRange = {
-				.baseMipLevel = 0,
-				.levelCount = 1,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT
-			}
-		};
+    for(uint32_t i = 0; i < mesh_count; ++i) {
+        CHECK(vk->mesh_count < countof(vk->meshes), "Too many meshes in mesh pack");
 
-		VK_CHECK(vkCreateImageView(vk->device, &depth_image_view_create_info, NULL, &vk->depth_image_view));
-		vk_push_deletable(vk, vkDestroyImageView, vk->depth_image_view);
+        const uint32_t slot = vk->mesh_count++;
+        vk->meshes[slot] = (struct Mesh){0};
 
-		VkSwapchainCreateInfoKHR create_info = {
-			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-			.surface = vk->surface,
-			.minImageCount = image_count,
-			.imageFormat = format.format,
-			.imageColorSpace = format.colorSpace,
-			.imageExtent = extent,
-			.imageArrayLayers = 1,
-			.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			.preTransform = capabilities.currentTransform,
-			.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-			.presentMode = mode,
-			.clipped = VK_TRUE,
-			.oldSwapchain = VK_NULL_HANDLE,
-			.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE // NOTE: This would be VK_SHARING_MODE_CONCURRENT for separate present/graphics queue but we don't support that
-		};
+        stream_request(s, (struct Stream_Request) {
+            .kind = STREAM_MESH_PACK_ENTRY,
+            .slot = slot,
+            .pack_entry = &toc[i]
+        });
+    }
 
-		VK_CHECK(vkCreateSwapchainKHR(vk->device, &create_info, NULL, &vk->swapchain));
-		vk_push_deletable(vk, vkDestroySwapchainKHR, vk->swapchain);
-		
-        // NOTE: There is a warning on Intel GPUs that suggests this function does actually want to be called twice
-		vk->swapchain_image_count = image_count;
-        vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &vk->swapchain_image_count, NULL);
-		VK_CHECK(vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &vk->swapchain_image_count, vk->swapchain_images));
+    return true;
+}
 
-		vk->swapchain_format = format.format;
-	}
+// Allocates the texture's slot, which shows the dummy texture until the mip tail is resident.
+// Finer levels follow as the texture gets used.
+static uint32_t stream_request_texture(struct Streamer *s, struct VK *vk, const char *path)
+{
+    const uint32_t slot = texture_registry_alloc(vk);
+    CHECK(!s->textures[slot].path, "Texture slot is already streamed");
 
-	/* swapchain image views */
-	{
-		for(uint32_t i = 0; i < vk->swapchain_image_count; ++i) {
-			VkImageViewCreateInfo create_info = {
-				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-				.image = vk->swapchain_images[i],
-				.viewType = VK_IMAGE_VIEW_TYPE_2D,
-				.format = vk->swapchain_format,
-				.components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
-				.subresourceRange = {
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseMipLevel = 0,
-					.levelCount = 1,
-					.baseArrayLayer = 0,
-					.layerCount = 1
-				}
-			};
+    s->textures[slot] = (struct Stream_Texture) {
+        .path = path,
+        .pending = true
+    };
+    s->texture_slot_end = MAX(s->texture_slot_end, slot + 1);
 
-			VK_CHECK(vkCreateImageView(vk->device, &create_info, NULL, &vk->swapchain_image_views[i]));
-			vk_push_deletable(vk, vkDestroyImageView, vk->swapchain_image_views[i]);
-		}
-	}
+    stream_request(s, (struct Stream_Request) {
+        .kind = STREAM_TEXTURE,
+        .slot = slot,
+        .path = path,
+        .base_level = UINT32_MAX
+    });
 
-	/* commands */
-	{
-		/* graphics pool */
-		VkCommandPoolCreateInfo graphics_pool_info = {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-			.queueFamilyIndex = vk->queue_graphics_idx,
-			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT // allow for resetting individual command buffers, but do we need it?
-		};
+    return slot;
+}
 
-		VK_CHECK(vkCreateCommandPool(vk->device, &graphics_pool_info, NULL, &vk->command_pool_graphics));
-		vk_push_deletable(vk, vkDestroyCommandPool, vk->command_pool_graphics);
+// Bytes of the texture's levels from level on
+static uint64_t stream_texture_size(const struct Stream_Texture *t, uint32_t level)
+{
+    return texture_mip_chain_size(t->texture.format, texture_level_extent(t->full_extent, level), t->full_mip_levels - level);
+}
 
-		/* upload pool */
-		VkCommandPoolCreateInfo upload_pool_info = {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-			.queueFamilyIndex = vk->queue_graphics_idx,
-			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
-		};
+// Replaces the texture with one that has the levels from level on, once streamed in
+static void stream_request_texture_levels(struct Streamer *s, uint32_t slot, uint32_t level)
+{
+    struct Stream_Texture *t = &s->textures[slot];
+    assert(!t->pending && level != t->resident_level);
+
+    s->texture_bytes = s->texture_bytes + stream_texture_size(t, level) - stream_texture_size(t, t->resident_level);
+    s->texture_upgrades_pending += level < t->resident_level;
+
+    t->target_level = level;
+    t->pending = true;
+
+    stream_request(s, (struct Stream_Request) {
+        .kind = STREAM_TEXTURE,
+        .slot = slot,
+        .path = t->path,
+        .base_level = level
+    });
+}
+
+// Called for every entity drawn with the texture, with how many pixels across one repeat of it covers on screen
+static void stream_texture_demand(struct Streamer *s, uint32_t slot, float pixels)
+{
+    if(slot < s->texture_slot_end) {
+        s->textures[slot].demand = fmaxf(s->textures[slot].demand, pixels);
+    }
+}
+
+// Coarsest level with at least one texel per pixel at the demanded size, never coarser than the mip tail
+static uint32_t stream_texture_wanted_level(const struct Stream_Texture *t)
+{
+    const uint32_t tail_level = texture_stream_tail_level(t->full_extent, t->full_mip_levels);
+    if(t->demand < 1.0f) {
+        return tail_level;
+    }
+
+    const float level = floorf(log2f((float)MAX(t->full_extent.width, t->full_extent.height) / t->demand));
+
+    return level <= 0.0f ? 0 : MIN((uint32_t)level, tail_level);
+}
+
+// Picks which textures get finer or coarser mips, from the demand since the last call (see Streaming Notes)
+static void stream_update_texture_residency(struct Streamer *s)
+{
+    for(uint32_t i = 0; i < s->texture_slot_end; ++i) {
+        struct Stream_Texture *t = &s->textures[i];
 
-		VK_CHECK(vkCreateCommandPool(vk->device, &graphics_pool_info, NULL, &vk->command_pool_upload));
-		vk_push_deletable(vk, vkDestroyCommandPool, vk->command_pool_upload);
-		
-		/* graphics buffer */
-		VkCommandBufferAllocateInfo command_alloc_info = {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-			.commandPool = vk->command_pool_graphics,
-			.commandBufferCount = 1,
-			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
-		};
+        t->schedulable = t->texture.image && !t->pending;
+        t->wanted_level = t->schedulable ? stream_texture_wanted_level(t) : 0;
+        t->last_demand = t->demand;
+        t->demand = 0.0f;
+    }
 
-		VK_CHECK(vkAllocateCommandBuffers(vk->device, &command_alloc_info, &vk->command_buffer_graphics));
-	}
+    /* Evict: Give back the levels that aren't wanted anymore, those furthest from what they want first */
+    while(s->texture_bytes > TEXTURE_STREAM_BUDGET) {
+        struct Stream_Texture *evict = NULL;
+        uint32_t evict_slot = 0;
 
-    /* render pass */
-    {
-        VkAttachmentDescription attachments[] = {
-            {
-                // Colour
-                .format = vk->swapchain_format,
-                .samples = VK_SAMPLE_COUNT_1_BIT,
-                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-            },
+        for(uint32_t i = 0; i < s->texture_slot_end; ++i) {
+            const struct Stream_Texture *t = &s->textures[i];
+            if(t->schedulable && t->wanted_level > t->resident_level &&
+               (!evict || t->wanted_level - t->resident_level > evict->wanted_level - evict->resident_level))
             {
-                // Depth
-                .format = vk->depth_format,
-                .samples = VK_SAMPLE_COUNT_1_BIT,
-                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                evict = &s->textures[i];
+                evict_slot = i;
             }
-        };
-        
-        VkAttachmentReference color_attachment_ref = {
-            .attachment = 0, // References the pAttachments array in the parent renderpass
-            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-        };
+        }
 
-        VkAttachmentReference depth_attachment_ref = {
-            .attachment = 1,
-            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
-        };
+        if(!evict) {
+            break;
+        }
 
-        VkSubpassDescription subpass = {
-            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-            .colorAttachmentCount = 1,
-            .pColorAttachments = &color_attachment_ref,
-            .pDepthStencilAttachment = &depth_attachment_ref
-        };
-       
-        VkRenderPassCreateInfo render_pass_info = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-            .attachmentCount = countof(attachments),
-            .pAttachments = attachments, // This is where VkAttachmentReference::attachment indexes into
-            .subpassCount = 1,
-            .pSubpasses = &subpass
-        };
+        LOG("Evicting mips of %s up to level %u (%.1fMB streamed, budget %.1fMB)\n", evict->path, evict->wanted_level,
+            s->texture_bytes / (1024.0 * 1024.0), TEXTURE_STREAM_BUDGET / (1024.0 * 1024.0));
 
-        VK_CHECK(vkCreateRenderPass(vk->device, &render_pass_info, NULL, &vk->render_pass));
-        vk_push_deletable(vk, vkDestroyRenderPass, vk->render_pass);
+        evict->schedulable = false;
+        stream_request_texture_levels(s, evict_slot, evict->wanted_level);
     }
 
-    /* descriptors */
-    {
-        // TODO: Make a function for creating this too, since it's app-specific
-        /* descriptor layouts */
-        VkDescriptorSetLayoutBinding bindings[] = {
-            {
-                .binding = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-            },
-            {
-                .binding = 1,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-            },
-            {
-                .binding = 2,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-            },
-            {
-                .binding = 3,
-                .descriptorCount = TEXTURE_DESCRIPTOR_COUNT,
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
-            }
-        };
+    /* Upgrade: Priority goes to the most missing levels, then to the most pixels covered.
+     * NOTE: Only a few get picked per frame, so looking for the best one each time is cheaper than keeping a heap up to date. */
+    while(s->texture_upgrades_pending < TEXTURE_STREAM_MAX_UPGRADES) {
+        struct Stream_Texture *best = NULL;
+        uint32_t best_slot = 0;
 
-        VkDescriptorBindingFlags binding_flags[] = {
-            0,
-            0,
-            0,
-            VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
-        };
+        for(uint32_t i = 0; i < s->texture_slot_end; ++i) {
+            const struct Stream_Texture *t = &s->textures[i];
+            if(!t->schedulable || t->wanted_level >= t->resident_level) {
+                continue;
+            }
 
-        VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
-            .bindingCount = 4,
-            .pBindingFlags = binding_flags
-        };
+            const uint32_t missing = t->resident_level - t->wanted_level;
+            const uint32_t best_missing = best ? best->resident_level - best->wanted_level : 0;
+            if(missing > best_missing || (missing == best_missing && t->last_demand > best->last_demand)) {
+                best = &s->textures[i];
+                best_slot = i;
+            }
+        }
 
-        VkDescriptorSetLayoutCreateInfo desc_info = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-            .bindingCount = countof(bindings),
-            .pBindings = bindings,
-            .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
-            .pNext = &binding_flags_info
-        };
+        if(!best) {
+            break;
+        }
 
-        VK_CHECK(vkCreateDescriptorSetLayout(vk->device, &desc_info, NULL, &vk->global_desc_layout));
-        vk_push_deletable(vk, vkDestroyDescriptorSetLayout, vk->global_desc_layout);
+        best->schedulable = false;
 
-        /* descriptor pool */
-        VkDescriptorPoolSize sizes[] = {
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10 },
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, TEXTURE_DESCRIPTOR_COUNT }
-        };
+        // Only as far as fits in the budget and in a stream batch
+        const uint64_t resident_size = stream_texture_size(best, best->resident_level);
 
-        VkDescriptorPoolCreateInfo pool_info = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-            .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
-            .maxSets = 10,
-            .poolSizeCount = countof(sizes),
-            .pPoolSizes = sizes
-        };
-        
-        VK_CHECK(vkCreateDescriptorPool(vk->device, &pool_info, NULL, &vk->desc_pool));
-        vk_push_deletable(vk, vkDestroyDescriptorPool, vk->desc_pool);
+        uint32_t level = best->wanted_level;
+        while(level < best->resident_level &&
+              (s->texture_bytes + stream_texture_size(best, level) - resident_size > TEXTURE_STREAM_BUDGET ||
+               align_address(stream_texture_size(best, level), STREAM_STAGING_ALIGNMENT) > STREAM_BATCH_SIZE))
+        {
+            ++level;
+        }
 
-        /* descriptors */
-        // NOTE: The actual buffer is created way after in scene_init, so this just allocates the descriptor for use later
-        uint32_t variable_descriptor_counts[] = {
-            TEXTURE_DESCRIPTOR_COUNT
-        };
+        if(level < best->resident_level) {
+            stream_request_texture_levels(s, best_slot, level);
+        }
+    }
+}
 
-        VkDescriptorSetVariableDescriptorCountAllocateInfo descriptor_count_alloc_info = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
-            .descriptorSetCount = countof(variable_descriptor_counts),
-            .pDescriptorCounts = variable_descriptor_counts
-        };
+// Returns size bytes of the batch's staging memory to write into, and adds the copy from there into the arena's buffer.
+// With unified memory, it's the arena's own memory instead (see Unified Memory Notes).
+static void *stream_batch_map_buffer(struct Streamer *s, struct Stream_Batch *batch, struct VK_Buffer_Arena *arena, uint64_t offset, uint64_t size)
+{
+    assert(offset + size <= arena->capacity);
 
-        VkDescriptorSetAllocateInfo alloc_info = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .descriptorPool = vk->desc_pool,
-            .descriptorSetCount = 1,
-            .pSetLayouts = &vk->global_desc_layout,
-            .pNext = &descriptor_count_alloc_info
-        };
-        
-        VK_CHECK(vkAllocateDescriptorSets(vk->device, &alloc_info, &vk->global_desc));
+    // NOTE: Written right away on this thread, so the arena relocating later on copies it along with everything else
+    if(arena->buffer.allocation.mapping) {
+        return (char *)arena->buffer.allocation.mapping + offset;
     }
 
-	/* pipeline layout */
-	{
-		// TODO: Make a function for creating this too, since it's app-specific
-		VkPushConstantRange ranges[] = {
-			{
-				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				.offset = 0,
-				.size = sizeof(struct Instance_Data)
-			}
-		};
+    const uint64_t staging_offset = batch->staging_offset + batch->staging_top;
+    batch->staging_top += align_address(size, STREAM_STAGING_ALIGNMENT);
+    CHECK(batch->staging_top <= STREAM_BATCH_SIZE, "Stream batch overflow");
+
+    CHECK(batch->buffer_copy_count < countof(batch->buffer_copies), "Stream batch has too many buffer copies");
+    batch->buffer_copies[batch->buffer_copy_count++] = (struct Stream_Buffer_Copy) {
+        .arena = arena,
+        .copy = {
+            .srcOffset = staging_offset,
+            .dstOffset = offset,
+            .size = size
+        }
+    };
 
-		VkPipelineLayoutCreateInfo pipeline_layout_info = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 1,
-            .pSetLayouts = &vk->global_desc_layout,
-            .pushConstantRangeCount = countof(ranges),
-            .pPushConstantRanges = ranges
-        };
+    return s->staging_mapping + staging_offset;
+}
 
-        VK_CHECK(vkCreatePipelineLayout(vk->device, &pipeline_layout_info, NULL, &vk->simple_piepline_layout));
-        vk_push_deletable(vk, vkDestroyPipelineLayout, vk->simple_piepline_layout);
+// How much of a batch the payload takes up, meshes don't take any with unified memory
+static uint64_t stream_payload_staging_size(struct VK *vk, const struct Stream_Payload *payload)
+{
+    if(payload->request.kind != STREAM_TEXTURE && vk->vertex_buffer.buffer.allocation.mapping) {
+        return 0;
     }
 
-    /* framebuffers */
-    {
-        VkFramebufferCreateInfo framebuffer_info = {
-            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-            .renderPass = vk->render_pass,
-            .width = vk->swapchain_extent.width,
-            .height = vk->swapchain_extent.height,
-            .layers = 1
-        };
+    return payload->upload_size;
+}
 
-        for(uint32_t i = 0; i < vk->swapchain_image_count; ++i) {
-            VkImageView attachments[] = {
-                vk->swapchain_image_views[i],
-                vk->depth_image_view
-            };
-            
-            framebuffer_info.pAttachments = attachments;
-            framebuffer_info.attachmentCount = countof(attachments);
+static void stream_batch_add(struct Streamer *s, struct VK *vk, struct Stream_Batch *batch, const struct Stream_Payload *payload)
+{
+    CHECK(batch->item_count < STREAM_MAX_BATCH_ITEMS, "Stream batch is full");
 
-            VK_CHECK(vkCreateFramebuffer(vk->device, &framebuffer_info, NULL, &vk->framebuffers[i]));
-            vk_push_deletable(vk, vkDestroyFramebuffer, vk->framebuffers[i]);
+    struct Stream_Batch_Item *item = &batch->items[batch->item_count++];
+    *item = (struct Stream_Batch_Item) {
+        .request = payload->request
+    };
+
+    if(payload->request.kind == STREAM_TEXTURE) {
+        item->texture = texture_create(vk, payload->extent, payload->mip_levels, payload->format, true);
+        item->base_level = payload->base_level;
+        item->full_extent = payload->full_extent;
+        item->full_mip_levels = payload->full_mip_levels;
+
+        const uint64_t size = texture_mip_chain_size(payload->format, payload->extent, payload->mip_levels);
+        const uint64_t staging_offset = batch->staging_offset + batch->staging_top;
+        batch->staging_top += align_address(size, STREAM_STAGING_ALIGNMENT);
+        CHECK(batch->staging_top <= STREAM_BATCH_SIZE, "Stream batch overflow");
+
+        memcpy(s->staging_mapping + staging_offset, payload->texels, size);
+
+        VkBufferImageCopy regions[TEXTURE_MAX_MIPS];
+        uint64_t level_offset = staging_offset;
+        for(uint32_t level = 0; level < payload->mip_levels; ++level) {
+            uint64_t level_size;
+            regions[level] = texture_level_copy(payload->format, payload->extent, level, level_offset, &level_size);
+            level_offset += level_size;
         }
+
+        vk_cmd_copy_buffer_to_image(batch->cmdbuf, s->staging_buffer.buffer.handle, item->texture.image, regions, payload->mip_levels);
+
+        s->textures_streamed++;
+        s->textures_from_cache += payload->from_cache;
     }
+    else {
+        struct Mesh_Upload upload;
+        struct Mesh mesh = mesh_create(vk, &payload->mesh, &upload);
 
-    /* synchronization */
-    {
-        /* render fence */
-        {
-            VkFenceCreateInfo fence_info = {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-            };
-    
-            VK_CHECK(vkCreateFence(vk->device, &fence_info, NULL, &vk->render_fence));
-            vk_push_deletable(vk, vkDestroyFence, vk->render_fence);
-        }
+        mesh_write_vertices(&payload->mesh, stream_batch_map_buffer(s, batch, &vk->vertex_buffer, upload.vertex_buffer_offset, upload.vertex_buffer_size));
+        mesh_write_indices(&payload->mesh, stream_batch_map_buffer(s, batch, upload.index_arena, upload.index_buffer_offset, upload.index_buffer_size));
 
-        /* upload fence */
-        {
-            VkFenceCreateInfo fence_info = {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            };
-    
-            VK_CHECK(vkCreateFence(vk->device, &fence_info, NULL, &vk->upload_fence));
-            vk_push_deletable(vk, vkDestroyFence, vk->upload_fence);
+        // NOTE: Not resident until the batch's upload is done
+        vk->meshes[payload->request.slot] = mesh;
+
+        s->meshes_streamed++;
+    }
+
+    s->bytes_streamed += payload->upload_size;
+}
+
+// NOTE: Not resident until the batch with the last of it is done
+static void stream_oversized_begin(struct Streamer *s, struct VK *vk, struct Stream_Payload *payload)
+{
+    s->oversized = payload;
+    s->oversized_copied = 0;
+    vk->meshes[payload->request.slot] = mesh_create(vk, &payload->mesh, &s->oversized_upload);
+}
+
+// Copies as much of the oversized mesh as fits in what's left of the batch, and adds it to the batch once all of it is in
+static void stream_batch_add_oversized(struct Streamer *s, struct VK *vk, struct Stream_Batch *batch)
+{
+    const struct Stream_Payload *payload = s->oversized;
+    const struct Mesh_Upload *upload = &s->oversized_upload;
+
+    // Vertices, then indices. Payloads are never compressed, so both are copied as they are.
+    struct VK_Buffer_Arena *arenas[] = { &vk->vertex_buffer, upload->index_arena };
+    const uint64_t offsets[] = { upload->vertex_buffer_offset, upload->index_buffer_offset };
+    const uint64_t sizes[] = { upload->vertex_buffer_size, upload->index_buffer_size };
+    const char *data[] = { payload->mesh.vert_buffer_data, payload->mesh.index_buffer_data };
+
+    uint64_t start = 0;
+    for(uint32_t i = 0; i < countof(arenas); ++i) {
+        const uint64_t copied = s->oversized_copied > start ? MIN(s->oversized_copied - start, sizes[i]) : 0;
+        const uint64_t part = MIN(sizes[i] - copied, STREAM_BATCH_SIZE - batch->staging_top);
+
+        if(part) {
+            memcpy(stream_batch_map_buffer(s, batch, arenas[i], offsets[i] + copied, part), data[i] + copied, part);
+            s->oversized_copied += part;
         }
 
-        /* semaphores */        
-        VkSemaphoreCreateInfo semaphore_info = {
-            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-            .flags = 0
-        };
+        start += sizes[i];
+    }
 
-        VK_CHECK(vkCreateSemaphore(vk->device, &semaphore_info, NULL, &vk->present_semaphore));
-        VK_CHECK(vkCreateSemaphore(vk->device, &semaphore_info, NULL, &vk->render_semaphore));
-        vk_push_deletable(vk, vkDestroySemaphore, vk->present_semaphore);
-        vk_push_deletable(vk, vkDestroySemaphore, vk->render_semaphore);
+    if(s->oversized_copied < sizes[0] + sizes[1]) {
+        return;
     }
-    
-    LOG("vk_init done\n");
+
+    CHECK(batch->item_count < STREAM_MAX_BATCH_ITEMS, "Stream batch is full");
+    batch->items[batch->item_count++] = (struct Stream_Batch_Item) {
+        .request = payload->request
+    };
+
+    s->meshes_streamed++;
+    s->bytes_streamed += payload->upload_size;
+
+    stream_payload_free(s->oversized);
+    s->oversized = NULL;
 }
 
-static void vk_destroy(struct VK *vk)
+static void stream_batch_submit(struct Streamer *s, struct VK *vk, struct Stream_Batch *batch)
 {
-    vkDeviceWaitIdle(vk->device);
+    vk_reserve_acquires(vk, batch->buffer_copy_count + batch->item_count);
 
-    vkUnmapMemory(vk->device, vk->staging_mem.allocation);
+    // NOTE: Known only now, since filling the batch can flush the staging queue (when an arena grows)
+    const uint64_t value = vk->upload_value + 1;
 
-    for(int i = vk->deletion_queue.entries_top - 1; i >= 0; --i) {
-        vk->deletion_queue.entries[i].func(vk->device, vk->deletion_queue.entries[i].handle, NULL);
+    for(uint32_t i = 0; i < batch->buffer_copy_count; ++i) {
+        const struct Stream_Buffer_Copy *copy = &batch->buffer_copies[i];
+        vkCmdCopyBuffer(batch->cmdbuf, s->staging_buffer.buffer.handle, copy->arena->buffer.handle, 1, &copy->copy);
+        vk_cmd_release_buffer(vk, batch->cmdbuf, copy->arena->buffer.handle, copy->copy.dstOffset, copy->copy.size, value);
     }
 
-	vkDestroySurfaceKHR(vk->instance, vk->surface, NULL);
-	vkDestroyDevice(vk->device, NULL);
-	vkDestroyInstance(vk->instance, NULL);
-	
-	LOG("vk_destroy done\n");
+    // The draws only start using the data after stream_update has seen the batch finish, but it still has to be handed over to them
+    for(uint32_t i = 0; i < batch->item_count; ++i) {
+        const struct Stream_Batch_Item *item = &batch->items[i];
+        if(item->request.kind == STREAM_TEXTURE) {
+            const VkImageSubresourceRange range = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = item->texture.mip_levels,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            };
+            vk_cmd_release_image(vk, batch->cmdbuf, item->texture.image, range, value);
+        }
+    }
+
+    vk_cmd_end_upload(vk, batch->cmdbuf);
+
+    batch->value = vk_transfer_commands_submit(vk, batch->cmdbuf);
+    assert(batch->value == value);
+    batch->in_flight = true;
 }
 
-static struct Mesh upload_mesh_from_raw_data(struct VK *vk, const char *mesh_data)
+static void stream_batch_retire(struct Streamer *s, struct VK *vk, struct Stream_Batch *batch)
 {
-    const size_t vert_buffer_stride = 8;
-    const size_t vert_buffer_stride_bytes = vert_buffer_stride * sizeof(float);
+    const uint64_t t_now = SDL_GetPerformanceCounter();
+
+    for(uint32_t i = 0; i < batch->item_count; ++i) {
+        const struct Stream_Batch_Item *item = &batch->items[i];
+
+        if(item->request.kind == STREAM_TEXTURE) {
+            struct Stream_Texture *t = &s->textures[item->request.slot];
+
+            texture_registry_set(vk, item->request.slot, item->texture.image_view);
+
+            // NOTE: Retired, see Streaming Notes
+            if(t->texture.image) {
+                s->texture_upgrades_pending -= item->base_level < t->resident_level;
+                texture_destroy(vk, &t->texture);
+            }
+            else {
+                s->texture_bytes += texture_mip_chain_size(item->texture.format, item->texture.extent, item->texture.mip_levels);
+            }
 
-    const char *p = mesh_data;
-    uint32_t vert_count = *(uint32_t *)p;
-    p += sizeof(vert_count);
+            t->texture = item->texture;
+            t->full_extent = item->full_extent;
+            t->full_mip_levels = item->full_mip_levels;
+            t->resident_level = item->base_level;
+            t->target_level = item->base_level;
+            t->pending = false;
 
-    uint32_t index_count = *(uint32_t *)p;
-    p += sizeof(index_count);
+            LOG("Streamed in texture %s levels %u-%u (%d x %d) after %.1fms, %.1fMB of textures streamed\n", item->request.path,
+                item->base_level, item->full_mip_levels - 1, item->texture.extent.width, item->texture.extent.height,
+                ticks_to_ms(t_now - item->request.t_requested), s->texture_bytes / (1024.0 * 1024.0));
+        }
+        else {
+            vk->meshes[item->request.slot].resident = true;
 
-    const size_t vert_buffer_size = vert_count * vert_buffer_stride_bytes;
-    const size_t index_buffer_size = index_count * sizeof(uint16_t);
+            LOG("Streamed in mesh %s after %.1fms\n", item->request.kind == STREAM_MESH_PACK_ENTRY ? item->request.pack_entry->name : item->request.path,
+                ticks_to_ms(t_now - item->request.t_requested));
+        }
+    }
 
-    const float *vert_buffer_data = (float *)p;
-    p += vert_buffer_size;
+    s->pending_count -= batch->item_count;
+    batch->item_count = 0;
+    batch->staging_top = 0;
+    batch->buffer_copy_count = 0;
+    batch->in_flight = false;
+}
 
-    const uint16_t *index_buffer_data = (uint16_t *)p;
+static void stream_update(struct Streamer *s, struct VK *vk)
+{
+    const uint64_t t_start = SDL_GetPerformanceCounter();
 
-    struct Mesh mesh = {
-        .vert_count = vert_count,
-        .index_count = index_count
-    };
+    // NOTE: Also when nothing is pending, this is what starts the next round of mips
+    stream_update_texture_residency(s);
 
-    uint64_t vertex_buffer_offset = vk_buffer_arena_push(vk, &vk->vertex_buffer, vert_buffer_size);
-    vk_update_buffer(vk, vk->vertex_buffer.buffer, vert_buffer_data, vertex_buffer_offset, vert_buffer_size);
-    mesh.vertex_offset = vertex_buffer_offset / vert_buffer_stride_bytes;
+    if(!s->pending_count) {
+        return;
+    }
 
-    uint64_t index_buffer_offset = vk_buffer_arena_push(vk, &vk->vertex_buffer, index_buffer_size);
-    vk_update_buffer(vk, vk->index_buffer.buffer, index_buffer_data, index_buffer_offset, index_buffer_size);    
-    mesh.index_offset = index_buffer_offset / 2;
+    /* Make everything from finished batches usable */
+    const uint64_t upload_completed = vk_upload_completed(vk);
+    for(uint32_t i = 0; i < STREAM_BATCH_COUNT; ++i) {
+        if(s->batches[i].in_flight && s->batches[i].value <= upload_completed) {
+            stream_batch_retire(s, vk, &s->batches[i]);
+        }
+    }
 
-    LOG("Uploaded mesh from raw data\n");
-    
-    return mesh;
-}
+    /* Fill and submit the next batch with whatever the workers have finished and fits */
+    struct Stream_Batch *batch = &s->batches[s->next_batch];
+    if(!batch->in_flight) {
+        struct Stream_Payload *payloads[STREAM_MAX_BATCH_ITEMS];
+        uint32_t payload_count = 0;
+        uint64_t batch_size = 0;
+        struct Stream_Payload *oversized = NULL;
+
+        SDL_LockMutex(s->mutex);
+        // NOTE: One item is always left for the oversized mesh
+        while(s->done_count && payload_count + 1 < STREAM_MAX_BATCH_ITEMS) {
+            struct Stream_Payload *payload = s->done[s->done_head];
+            const uint64_t staging_size = stream_payload_staging_size(vk, payload);
+
+            if(staging_size > STREAM_BATCH_SIZE) {
+                assert(payload->request.kind != STREAM_TEXTURE); // See stream_update_texture_residency
+                if(s->oversized || oversized) {
+                    break;
+                }
 
-static struct Texture upload_texture_from_file_path(struct VK *vk, const char *path)
-{
-    int x, y, n;
-    uint8_t *data = stbi_load(path, &x, &y, &n, 4);
-    if(!data) {
-        panic("Could not load texture");
-    };
+                oversized = payload;
+            }
+            else if(batch_size + staging_size > STREAM_BATCH_SIZE) {
+                break;
+            }
+            else {
+                batch_size += staging_size;
+                payloads[payload_count++] = payload;
+            }
 
-    LOG("Loaded texture from %s of size %d x %d (@%p)\n", path, x, y, data);
+            s->done_head = (s->done_head + 1) % STREAM_MAX_REQUESTS;
+            s->done_count--;
+        }
+        SDL_UnlockMutex(s->mutex);
 
-    VkExtent3D extent = { x, y, 1 };
+        if(oversized) {
+            stream_oversized_begin(s, vk, oversized);
+        }
 
-    VkImageCreateInfo image_create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = VK_FORMAT_B8G8R8A8_SRGB,
-        .extent = extent,
-        .mipLevels = 1,
-        .arrayLayers = 1,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
-    };
+        if(payload_count || s->oversized) {
+            VK_CHECK(vkResetCommandBuffer(batch->cmdbuf, 0));
 
-    struct Texture out_texture = { 
-        .extent = extent
-    };
+            VkCommandBufferBeginInfo cmd_begin_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+            };
+            VK_CHECK(vkBeginCommandBuffer(batch->cmdbuf, &cmd_begin_info));
 
-    VK_CHECK(vkCreateImage(vk->device, &image_create_info, NULL, &out_texture.image));
-    vk_push_deletable(vk, vkDestroyImage, out_texture.image);
+            for(uint32_t i = 0; i < payload_count; ++i) {
+                stream_batch_add(s, vk, batch, payloads[i]);
+                stream_payload_free(payloads[i]);
+            }
 
-    VkMemoryRequirements mem_requirements;
-    vkGetImageMemoryRequirements(vk->device, out_texture.image, &mem_requirements);
+            if(s->oversized) {
+                stream_batch_add_oversized(s, vk, batch);
+            }
 
-    const uint64_t buffer_base_offset = vk_mem_arena_push(vk, &vk->gpu_mem, mem_requirements);
-    vkBindImageMemory(vk->device, out_texture.image, vk->gpu_mem.allocation, buffer_base_offset);
+            stream_batch_submit(s, vk, batch);
+            s->next_batch = (s->next_batch + 1) % STREAM_BATCH_COUNT;
+        }
+    }
 
-    VkImageViewCreateInfo image_view_create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .image = out_texture.image,
-        .format = image_create_info.format,
-        .subresourceRange = {
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
+    s->update_ms_max = fmax(s->update_ms_max, ticks_to_ms(SDL_GetPerformanceCounter() - t_start));
+
+    if(!s->pending_count) {
+        if(s->pack.data) {
+            file_unmap(&s->pack);
         }
-    };
 
-    VK_CHECK(vkCreateImageView(vk->device, &image_view_create_info, NULL, &out_texture.image_view));
-    vk_push_deletable(vk, vkDestroyImageView, out_texture.image_view);
+        const struct Frame_Stats *fs = &s->frame_stats;
+        LOG("Streaming done: %u meshes and %u textures (%u from the texture cache, %.1fMB) in %.1fms\n", s->meshes_streamed, s->textures_streamed,
+            s->textures_from_cache, s->bytes_streamed / (1024.0 * 1024.0), ticks_to_ms(SDL_GetPerformanceCounter() - s->t_start));
+        LOG("\tFrames while streaming: %u, avg %.2fms, max %.2fms, %u over %.0fms. Longest stream_update: %.2fms\n",
+            fs->frame_count, fs->frame_count ? fs->total_ms / fs->frame_count : 0.0, fs->max_ms, fs->spike_count, FRAME_SPIKE_MS, s->update_ms_max);
+    }
+}
+#endif
 
-    vk_update_image(vk, out_texture, data);
+// Vertex buffer is a storage buffer, so it goes through the descriptor. Rewritten whenever the vertex buffer is relocated.
+// NOTE: The frame that last used the set must be done with it
+static void scene_write_vertex_buffer_descriptor(struct VK *vk, struct VK_Frame *frame)
+{
+    VkDescriptorBufferInfo desc_buf_info = {
+        .buffer = vk->vertex_buffer.buffer.handle,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE, // NOTE: Whole buffer, streamed meshes are added after this
+    };
 
-    return out_texture;
+    VkWriteDescriptorSet set_write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstBinding = 2,
+        .dstSet = frame->global_desc,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &desc_buf_info
+    };
+
+    vkUpdateDescriptorSets(vk->device, 1, &set_write, 0, NULL);
+    frame->vertex_buffer_desc_generation = vk->vertex_buffer.generation;
 }
 
 static void scene_init(struct Render_State *r, struct VK *vk)
 {
+    texture_mip_tables_init();
+
 	vk->lit_pipeline = vk_create_pipeline_and_shaders(vk, "shaders/lit_vert.spv", "shaders/lit_frag.spv", vk->simple_piepline_layout);
 
     /* Geometry init */
     {
-        vk->vertex_buffer = vk_alloc_buffer_arena(vk, &vk->gpu_mem, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, (16 * 1024 * 1024));
-        vk->index_buffer = vk_alloc_buffer_arena(vk, &vk->gpu_mem, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, (8 * 1024 * 1024));
+        vk_alloc_buffer_arena(vk, &vk->vertex_buffer, vk_gpu_buffer_mem(vk), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, (16 * 1024 * 1024), MEM_CATEGORY_GEOMETRY, true);
+        vk_alloc_buffer_arena(vk, &vk->index_buffer, vk_gpu_buffer_mem(vk), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, (8 * 1024 * 1024), MEM_CATEGORY_GEOMETRY, true);
+        vk_alloc_buffer_arena(vk, &vk->index_buffer_32, vk_gpu_buffer_mem(vk), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, (8 * 1024 * 1024), MEM_CATEGORY_GEOMETRY, true);
 
-        const char *mesh_paths[] = {
-            "data/suzanne.bin",
-            "data/cube.bin"
-        };
+        vk_mem_report_track_buffer_arena(vk, "vertex_buffer", &vk->vertex_buffer);
+        vk_mem_report_track_buffer_arena(vk, "index_buffer", &vk->index_buffer);
+        vk_mem_report_track_buffer_arena(vk, "index_buffer_32", &vk->index_buffer_32);
+
+        range_allocator_init(&vk->meshlet_ranges, MAX_MESHLETS);
 
-        for(int i = 0; i < countof(mesh_paths); ++i) {
-            uint32_t file_size;
+#if WITH_STREAMING
+        stream_init(&s_streamer, vk);
+
+        if(!stream_request_meshes_from_pack_file(&s_streamer, vk, "data/meshes.pack")) {
+#else
+        if(!upload_meshes_from_pack_file(vk, "data/meshes.pack")) {
+#endif
+            LOG("No mesh pack found, loading loose mesh files\n");
+
+            const char *mesh_paths[] = {
+                "data/suzanne.bin",
+                "data/cube.bin"
+            };
+
+            for(int i = 0; i < countof(mesh_paths); ++i) {
+#if WITH_STREAMING
+                stream_request_mesh_file(&s_streamer, vk, mesh_paths[i]);
+#else
+                uint32_t file_size;
    
-            char *mesh_data = file_load_binary(mesh_paths[i], &file_size);
-            vk->meshes[vk->mesh_count++] = upload_mesh_from_raw_data(vk, mesh_data);
-            free(mesh_data);            
+                char *mesh_data = file_load_binary(mesh_paths[i], &file_size);
+                vk->meshes[vk->mesh_count++] = upload_mesh_from_raw_data(vk, mesh_data);
+                free(mesh_data);            
+#endif
+            }
         }
 
         vk_staging_queue_flush(vk);
-
-        {
-            // Vertex buffer is a storage buffer, so update the descriptor
-            VkDescriptorBufferInfo desc_buf_info = {
-                .buffer = vk->vertex_buffer.buffer.handle,
-                .offset = 0,
-                .range = vk->vertex_buffer.top,
-            };
-            
-            VkWriteDescriptorSet set_write = {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstBinding = 2,
-                .dstSet = vk->global_desc,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                .pBufferInfo = &desc_buf_info
-            };
-            
-            vkUpdateDescriptorSets(vk->device, 1, &set_write, 0, NULL);
+        for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+            scene_write_vertex_buffer_descriptor(vk, &vk->frames[i]);
         }
     }
 
     /* Texture init */
+    uint32_t texture_slots[4]; // For the entities below
     {
-        const char *texture_paths[] = {
-            "data/grid.png",
-            "data/noise.tga"
-        };
-
-        struct Texture textures[countof(texture_paths)];
-
-        for(int i = 0; i < countof(texture_paths); ++i) {
-            textures[i] = upload_texture_from_file_path(vk, texture_paths[i]);
-        }
-
         struct Texture dummy_texture = upload_texture_from_file_path(vk, "data/dummy.tga");
 
         VkSamplerCreateInfo sampler_info = {
@@ -1681,95 +5462,93 @@ static void scene_init(struct Render_State *r, struct VK *vk)
             .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
             .mipLodBias = 0.0f,
             .minLod = 0.0f,
-            .maxLod = 0.0f
+            .maxLod = VK_LOD_CLAMP_NONE // Every texture has its full mip chain, the views limit it to the levels there are
         };
         VK_CHECK(vkCreateSampler(vk->device, &sampler_info, NULL, &vk->default_sampler));
         vk_push_deletable(vk, vkDestroySampler, vk->default_sampler);
 
-        VkDescriptorImageInfo desc_image_info[TEXTURE_DESCRIPTOR_COUNT];
+        // NOTE: The slots are written by the first texture_registry_update in render
+        texture_registry_init(vk, dummy_texture.image_view);
 
-        for(int i = 0; i < countof(textures); ++i) {
-            desc_image_info[i] = (VkDescriptorImageInfo) {
-                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                .imageView = textures[i].image_view,
-                .sampler = vk->default_sampler,
-            };
+        // The .ktex versions are cooked by the build with knz_texcook (f_add_texture), one for each BC format
+        const char *texture_paths[][2] = {
+            { "data/grid.ktex", "data/grid.png" },       // BC7
+            { "data/noise.ktex", "data/noise.tga" },     // BC1
+            { "data/grid_bc3.ktex", "data/grid.png" },   // BC3
+            { "data/noise_bc5.ktex", "data/noise.tga" }  // BC5, only red and green
+        };
+        assert(countof(texture_paths) == countof(texture_slots));
+
+#if WITH_STREAMING
+        // The dummy fills their slots until they're streamed in
+        for(int i = 0; i < countof(texture_paths); ++i) {
+            texture_slots[i] = stream_request_texture(&s_streamer, vk, texture_pick_path(vk, texture_paths[i][0], texture_paths[i][1]));
         }
+#else
+        // Compare cold and warm starts (with and without TEXTURE_CACHE_DIR) with this
+        const uint64_t t_textures = SDL_GetPerformanceCounter();
 
-        for(int i = countof(textures); i < countof(desc_image_info); ++i) {
-            desc_image_info[i] = (VkDescriptorImageInfo) {
-                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                .imageView = dummy_texture.image_view,
-                .sampler = vk->default_sampler,
-            };
+        for(int i = 0; i < countof(texture_paths); ++i) {
+            const struct Texture texture = upload_texture_from_file_path(vk, texture_pick_path(vk, texture_paths[i][0], texture_paths[i][1]));
+
+            texture_slots[i] = texture_registry_alloc(vk);
+            texture_registry_set(vk, texture_slots[i], texture.image_view);
         }
 
-        VkWriteDescriptorSet set_write = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstBinding = 3,
-            .dstArrayElement = 0,
-            .dstSet = vk->global_desc,
-            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .descriptorCount = countof(desc_image_info),
-            .pImageInfo = desc_image_info
-        };
-        
-        vkUpdateDescriptorSets(vk->device, 1, &set_write, 0, NULL);
+        LOG("Loaded %u textures in %.1fms\n", (uint32_t)countof(texture_paths), ticks_to_ms(SDL_GetPerformanceCounter() - t_textures));
+#endif
     }
 
-    /* Uniform buffer init */
+    /* Frame ring init (see Frame Ring Notes) */
     {
-        vk->global_uniform_buffer = vk_create_buffer(vk, &vk->gpu_mem, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(struct Global_Uniform_Data));
-        
-        VkDescriptorBufferInfo desc_buf_info = {
-            .buffer = vk->global_uniform_buffer.handle,
-            .offset = 0,
-            .range = sizeof(struct Global_Uniform_Data),
-        };
-        
-        VkWriteDescriptorSet set_write = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstBinding = 0,
-            .dstSet = vk->global_desc,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .pBufferInfo = &desc_buf_info
-        };
-        
-        vkUpdateDescriptorSets(vk->device, 1, &set_write, 0, NULL);
-    }
+        // NOTE: The instance data always takes up room for every entity, since that's the range its descriptor was written with
+        const uint64_t instances_size = sizeof(struct Instance_Data) * countof(r->scene.entities);
+        const uint64_t partition_size = sizeof(struct Global_Uniform_Data) + instances_size +
+                                        MAX_INDIRECT_DRAWS * sizeof(VkDrawIndexedIndirectCommand) + 3 * 256; // Offset alignments are at most 256
 
-    /* Instance buffer init */
-    {
-        vk->instance_buffer = vk_create_buffer(vk, &vk->gpu_mem, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(struct Instance_Data) * countof(r->scene.entities));
+        vk_frame_ring_init(vk, &vk->frame_ring, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                           partition_size);
 
-        VkDescriptorBufferInfo desc_buf_info = {
-            .buffer = vk->instance_buffer.handle,
-            .offset = 0,
-            .range = vk->instance_buffer.size,
+        VkDescriptorBufferInfo desc_buf_infos[] = {
+            {
+                .buffer = vk->frame_ring.buffer.handle,
+                .offset = 0,
+                .range = sizeof(struct Global_Uniform_Data)
+            },
+            {
+                .buffer = vk->frame_ring.buffer.handle,
+                .offset = 0,
+                .range = instances_size
+            }
         };
-        
-        VkWriteDescriptorSet set_write = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstBinding = 1,
-            .dstSet = vk->global_desc,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pBufferInfo = &desc_buf_info
+
+        VkWriteDescriptorSet set_writes[] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstBinding = 0,
+                .dstSet = vk->frame_desc,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                .pBufferInfo = &desc_buf_infos[0]
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstBinding = 1,
+                .dstSet = vk->frame_desc,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                .pBufferInfo = &desc_buf_infos[1]
+            }
         };
-        
-        vkUpdateDescriptorSets(vk->device, 1, &set_write, 0, NULL);
-    }
 
-    /* Indirect command buffer init */
-    {
-        vk->indirect_command_buffer = vk_create_buffer(vk, &vk->gpu_mem, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, countof(r->scene.entities) * sizeof(VkDrawIndexedIndirectCommand));
+        vkUpdateDescriptorSets(vk->device, countof(set_writes), set_writes, 0, NULL);
     }
 
     /* Scene entities init */
     {
         r->scene.entities[r->scene.entities_count++] = (struct Entity) {
             .mesh_idx = 0,
+            .texture_idx = texture_slots[0],
             .position = { -1.5f, 0.15f, 3.5f },
             .rotation = { 0.0f, 0.0f, 0.0f },
             .scale = { 1.0f, 1.0f, 1.0f}
@@ -1777,13 +5556,88 @@ static void scene_init(struct Render_State *r, struct VK *vk)
 
         r->scene.entities[r->scene.entities_count++] = (struct Entity) {
             .mesh_idx = 1,
+            .texture_idx = texture_slots[1],
             .position = { 1.5f, 0.15f, 3.5f },
             .rotation = { 0.0f, 0.0f, 0.0f },
             .scale = { 0.5f, 0.5f, 0.5f}
         };
+
+        r->scene.entities[r->scene.entities_count++] = (struct Entity) {
+            .mesh_idx = 1,
+            .texture_idx = texture_slots[2],
+            .position = { -4.5f, 0.15f, 3.5f },
+            .rotation = { 0.0f, 0.0f, 0.0f },
+            .scale = { 0.5f, 0.5f, 0.5f}
+        };
+
+        r->scene.entities[r->scene.entities_count++] = (struct Entity) {
+            .mesh_idx = 0,
+            .texture_idx = texture_slots[3],
+            .position = { 4.5f, 0.15f, 3.5f },
+            .rotation = { 0.0f, 0.0f, 0.0f },
+            .scale = { 1.0f, 1.0f, 1.0f}
+        };
+    }
+
+    /* Copies of the entities above in a grid behind them, to have a scene as big as --entities asks for */
+    {
+        const uint32_t base_count = r->scene.entities_count;
+        const uint32_t target_count = MIN(r->entity_count, countof(r->scene.entities));
+        const uint32_t grid_width = 64;
+
+        for(uint32_t i = base_count; i < target_count; ++i) {
+            const uint32_t n = i - base_count;
+            struct Entity entity = r->scene.entities[n % base_count];
+
+            entity.position.x = ((float)(n % grid_width) - grid_width * 0.5f) * 1.5f;
+            entity.position.z += 2.0f + (float)(n / grid_width) * 1.5f;
+
+            r->scene.entities[r->scene.entities_count++] = entity;
+        }
     }
+
+    r->lod_bias = 1.0f;
     
-    LOG("Scene init done\n");
+    LOG("Scene init done with %u entities\n", (uint32_t)r->scene.entities_count);
+}
+
+/* Cluster culling: A meshlet is skipped when its bounding sphere is fully outside the frustum,
+ * or when its normal cone says that every triangle faces away from the camera.
+ * NOTE: Like the vertex shader, this assumes no non-uniform scaling. */
+static bool meshlet_visible(const struct Mesh_File_Meshlet *meshlet, mat4s model_matrix, float max_scale, vec4 frustum_planes[6], vec3s camera_position)
+{
+    const vec3s center = glms_mat4_mulv3(model_matrix, (vec3s){ meshlet->center[0], meshlet->center[1], meshlet->center[2] }, 1.0f);
+    const float radius = meshlet->radius * max_scale;
+
+    for(int i = 0; i < 6; ++i) {
+        if(glm_vec3_dot(frustum_planes[i], (float *)center.raw) + frustum_planes[i][3] < -radius) {
+            return false;
+        }
+    }
+
+    if(meshlet->cone_cutoff <= 1.0f) {
+        const vec3s apex = glms_mat4_mulv3(model_matrix, (vec3s){ meshlet->cone_apex[0], meshlet->cone_apex[1], meshlet->cone_apex[2] }, 1.0f);
+        const vec3s axis = glms_vec3_normalize(glms_mat4_mulv3(model_matrix, (vec3s){ meshlet->cone_axis[0], meshlet->cone_axis[1], meshlet->cone_axis[2] }, 0.0f));
+        const vec3s view_dir = glms_vec3_sub(apex, camera_position);
+
+        if(glms_vec3_dot(view_dir, axis) >= meshlet->cone_cutoff * glms_vec3_norm(view_dir)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* LOD selection: The coarsest LOD whose error, projected to the screen, is still under LOD_ERROR_PIXELS * lod_bias.
+ * pixels_per_unit is how many pixels one unit of the mesh covers at the entity's distance. */
+static uint32_t mesh_select_lod(const struct Mesh *mesh, float pixels_per_unit, float lod_bias)
+{
+    uint32_t lod = 0;
+    while(lod + 1 < mesh->lod_count && mesh->lods[lod + 1].error * pixels_per_unit <= LOD_ERROR_PIXELS * lod_bias) {
+        lod++;
+    }
+
+    return lod;
 }
 
 static void update(struct Render_State *r)
@@ -1808,8 +5662,27 @@ static void update(struct Render_State *r)
 static void render(struct Render_State *r, struct VK *vk)
 {
 	/* sync */
-	VK_CHECK(vkWaitForFences(vk->device, 1, &vk->render_fence, true, TIMEOUT));
-	VK_CHECK(vkResetFences(vk->device, 1, &vk->render_fence));
+    // NOTE: This frame's fence is from FRAMES_IN_FLIGHT frames ago, the ones after it can still be on the GPU (see Frames in Flight Notes)
+    vk->frame++;
+    struct VK_Frame *frame = &vk->frames[vk->frame % FRAMES_IN_FLIGHT];
+
+	VK_CHECK(vkWaitForFences(vk->device, 1, &frame->render_fence, true, TIMEOUT));
+	VK_CHECK(vkResetFences(vk->device, 1, &frame->render_fence));
+
+    const uint64_t t_start = SDL_GetPerformanceCounter();
+
+    vk_retire_update(vk);
+
+#if WITH_STREAMING
+    // NOTE: Before the texture registry update, which writes the textures it swapped in into this frame's set
+    stream_update(&s_streamer, vk);
+#endif
+
+    texture_registry_update(vk);
+
+    if(frame->vertex_buffer_desc_generation != vk->vertex_buffer.generation) {
+        scene_write_vertex_buffer_descriptor(vk, frame);
+    }
 
 	/* SYNC: Here we pass in a semaphore that will be signalled once we have an
 	 * image available to draw into.
@@ -1819,12 +5692,14 @@ static void render(struct Render_State *r, struct VK *vk)
      * This effectively pauses the application until it's visible again.
 	*/
 	uint32_t swapchain_index;
-    VK_CHECK(vkAcquireNextImageKHR(vk->device, vk->swapchain, UINT64_MAX, vk->present_semaphore, NULL, &swapchain_index));
+    const uint64_t t_acquire = SDL_GetPerformanceCounter();
+    VK_CHECK(vkAcquireNextImageKHR(vk->device, vk->swapchain, UINT64_MAX, frame->present_semaphore, NULL, &swapchain_index));
+    const uint64_t t_acquired = SDL_GetPerformanceCounter();
 
 	/* commands */
-	VK_CHECK(vkResetCommandBuffer(vk->command_buffer_graphics, 0));
+	VK_CHECK(vkResetCommandBuffer(frame->command_buffer, 0));
 
-	VkCommandBuffer cmdbuf = vk->command_buffer_graphics;
+	VkCommandBuffer cmdbuf = frame->command_buffer;
 
 	VkCommandBufferBeginInfo cmdbuf_begin_info = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -1834,6 +5709,15 @@ static void render(struct Render_State *r, struct VK *vk)
 
 	VK_CHECK(vkBeginCommandBuffer(cmdbuf, &cmdbuf_begin_info));
 
+    // NOTE: Before anything reads the uploads, compaction included, see Transfer Queue Notes.
+    //       Nothing after this in render uploads anything, the per-frame data goes through the frame ring.
+    vk_cmd_acquire_uploads(vk, cmdbuf);
+
+#if WITH_GEOMETRY_COMPACTION
+    // NOTE: Before the draws are built, since it can move meshes
+    geometry_compact_step(&s_compactor, vk, cmdbuf);
+#endif
+
 	VkClearValue clear_values[] = {
 		{ .color = {0} },
 		{ .depthStencil = {.depth = 1.0f} }
@@ -1868,16 +5752,45 @@ static void render(struct Render_State *r, struct VK *vk)
 			.color.float32 = { r->clear_color.x, r->clear_color.y, r->clear_color.z, 1.0f }
 		};
 
-		/* update GPU data */
-		vk_update_buffer(vk, vk->global_uniform_buffer, &uniforms, 0, sizeof(uniforms));
+		/* update GPU data, straight into this frame's part of the frame ring */
+        struct VK_Frame_Ring *ring = &vk->frame_ring;
+        vk_frame_ring_begin(ring, vk->frame);
+
+        uint64_t uniforms_offset;
+        memcpy(vk_frame_ring_push(ring, sizeof(uniforms), &uniforms_offset), &uniforms, sizeof(uniforms));
+
+        // NOTE: As big as the descriptor's range, the instance ids are the entity indices
+        uint64_t instances_offset;
+        struct Instance_Data *instance_buffer_mapped = vk_frame_ring_push(ring, countof(r->scene.entities) * sizeof(*instance_buffer_mapped), &instances_offset);
+
+        const vec3s camera_position = glms_vec3(glms_mat4_inv(view).col[3]);
+
+        // Screen pixels covered by 1 unit at a distance of 1
+        const float pixels_per_unit = fabsf(proj.raw[1][1]) * (float)HEIGHT * 0.5f;
+        uint32_t triangle_count = 0;
+
+#if WITH_CLUSTER_CULLING
+        vec4 frustum_planes[6];
+        glm_frustum_planes(uniforms.view_proj_mat.raw, frustum_planes);
+
+        uint32_t meshlets_tested = 0;
+        uint32_t meshlets_visible = 0;
+#endif
 
-        struct Instance_Data *instance_buffer_mapped = vk_map_buffer_staged(vk, vk->instance_buffer, 0, r->scene.entities_count * sizeof(*instance_buffer_mapped));
-        VkDrawIndexedIndirectCommand *indirect_command_buffer_mapped = vk_map_buffer_staged(vk, vk->indirect_command_buffer, 0, r->scene.entities_count * sizeof(*indirect_command_buffer_mapped));
+        /* Draws are binned by index type, with all the 16-bit draws first and the 32-bit ones after them.
+         * Each bin is then one indirect draw with its own index buffer bound. */
+        uint32_t draw_count_16 = 0;
+        uint32_t draw_count_32 = 0;
 
         for(int i = 0; i < r->scene.entities_count; ++i) {
             struct Entity *entity = &r->scene.entities[i];
             struct Instance_Data *instance_data = &instance_buffer_mapped[i];
-            VkDrawIndexedIndirectCommand *draw_cmd = &indirect_command_buffer_mapped[i];
+            struct Mesh *mesh = &vk->meshes[entity->mesh_idx];
+
+            // Still streaming in, or missing
+            if(!mesh->resident) {
+                continue;
+            }
 
             mat4s model_matrix = glms_mat4_identity();
             model_matrix = glms_translate_make((vec3s){entity->position.x, entity->position.y, entity->position.z});
@@ -1888,39 +5801,143 @@ static void render(struct Render_State *r, struct VK *vk)
 
             *instance_data = (struct Instance_Data) {
                 .model_matrix = model_matrix,
-                .texture_index = i
+                .texture_index = entity->texture_idx,
+                .vertex_format = mesh->vertex_format,
+                .position_min = mesh->position_min,
+                .position_extent = mesh->position_extent
             };
 
-            struct Mesh *mesh = &vk->meshes[entity->mesh_idx];
-
             //vkCmdDrawIndexed(cmdbuf, mesh->index_count, 1, mesh->index_offset, mesh->vertex_offset, i);
 
-            *draw_cmd = (VkDrawIndexedIndirectCommand) {
-                .indexCount = mesh->index_count,
+            const float max_scale = glm_max(fabsf(entity->scale.x), glm_max(fabsf(entity->scale.y), fabsf(entity->scale.z)));
+            const float distance = glms_vec3_distance(camera_position, entity->position);
+            const struct Mesh_File_Lod *lod = &mesh->lods[mesh_select_lod(mesh, max_scale * pixels_per_unit / glm_max(distance, 0.1f), r->lod_bias)];
+
+#if WITH_STREAMING
+            stream_texture_demand(&s_streamer, entity->texture_idx, TEXTURE_STREAM_UNITS_PER_UV * max_scale * pixels_per_unit / glm_max(distance, 0.1f));
+#endif
+
+            /* Either one draw per run of visible meshlets, or the whole LOD if it doesn't have any */
+            const VkDrawIndexedIndirectCommand lod_draw_cmd = {
+                .indexCount = lod->index_count,
                 .instanceCount = 1,
-                .firstIndex = mesh->index_offset,
+                .firstIndex = mesh->index_offset + lod->first_index,
                 .vertexOffset = mesh->vertex_offset,
                 .firstInstance = i
             };
+
+            const bool is_16 = mesh->index_type == VK_INDEX_TYPE_UINT16;
+            VkDrawIndexedIndirectCommand *draw_cmd = NULL;
+
+#if WITH_CLUSTER_CULLING
+            if(lod->meshlet_count) {
+                /* Always keep a slot free for every entity after this one, so if the meshlet draws would
+                 * eat into those this entity just goes back to drawing its whole LOD instead */
+                const uint32_t draw_count_16_start = draw_count_16;
+                const uint32_t draw_count_32_start = draw_count_32;
+                const uint32_t triangle_count_start = triangle_count;
+                const uint32_t draw_limit = MAX_INDIRECT_DRAWS - (r->scene.entities_count - i - 1);
+                bool out_of_draws = false;
+
+                for(uint32_t c = 0; c < lod->meshlet_count; ++c) {
+                    const struct Mesh_File_Meshlet *meshlet = &vk->meshlets[mesh->meshlet_offset + lod->first_meshlet + c];
+                    meshlets_tested++;
+
+                    if(!meshlet_visible(meshlet, model_matrix, max_scale, frustum_planes, camera_position)) {
+                        continue;
+                    }
+
+                    meshlets_visible++;
+                    triangle_count += meshlet->triangle_count;
+
+                    // NOTE: Meshlets of a LOD are laid out back to back, so consecutive visible ones are one draw
+                    const uint32_t first_index = mesh->index_offset + meshlet->first_index;
+                    if(draw_cmd && draw_cmd->firstIndex + draw_cmd->indexCount == first_index) {
+                        draw_cmd->indexCount += meshlet->triangle_count * 3;
+                        continue;
+                    }
+
+                    if(draw_count_16 + draw_count_32 >= draw_limit) {
+                        out_of_draws = true;
+                        break;
+                    }
+
+                    draw_cmd = is_16 ? &r->draw_commands[draw_count_16++] : &r->draw_commands[MAX_INDIRECT_DRAWS - ++draw_count_32];
+                    *draw_cmd = lod_draw_cmd;
+                    draw_cmd->indexCount = meshlet->triangle_count * 3;
+                    draw_cmd->firstIndex = first_index;
+                }
+
+                if(!out_of_draws) {
+                    continue;
+                }
+
+                draw_count_16 = draw_count_16_start;
+                draw_count_32 = draw_count_32_start;
+                triangle_count = triangle_count_start;
+            }
+#endif
+
+            triangle_count += lod_draw_cmd.indexCount / 3;
+            draw_cmd = is_16 ? &r->draw_commands[draw_count_16++] : &r->draw_commands[MAX_INDIRECT_DRAWS - ++draw_count_32];
+            *draw_cmd = lod_draw_cmd;
+        }
+
+        const uint32_t draw_count = draw_count_16 + draw_count_32;
+        uint64_t draws_offset = 0;
+        if(draw_count) {
+            VkDrawIndexedIndirectCommand *indirect_command_buffer_mapped = vk_frame_ring_push(ring, draw_count * sizeof(*indirect_command_buffer_mapped), &draws_offset);
+            memcpy(indirect_command_buffer_mapped, r->draw_commands, draw_count_16 * sizeof(*indirect_command_buffer_mapped));
+            memcpy(indirect_command_buffer_mapped + draw_count_16, &r->draw_commands[MAX_INDIRECT_DRAWS - draw_count_32], draw_count_32 * sizeof(*indirect_command_buffer_mapped));
+        }
+
+#if WITH_LOD_TRIANGLE_BUDGET
+        /* Feedback on the triangle count instead of the frame time itself, since with vsync the frame time
+         * says nothing until it's already too late. Goes back down slowly so it doesn't oscillate. */
+        if(triangle_count > LOD_TRIANGLE_BUDGET) {
+            r->lod_bias = glm_min(r->lod_bias * 1.1f, 64.0f); // Capped for when everything is at its last LOD already
+        }
+        else if(triangle_count < LOD_TRIANGLE_BUDGET * 0.8f) {
+            r->lod_bias = glm_max(r->lod_bias * 0.98f, 1.0f);
+        }
+#endif
+
+#if WITH_CLUSTER_CULLING
+        if(r->frame_number % 600 == 0) {
+            LOG("Cluster culling: %u / %u meshlets visible, %u draws\n", meshlets_visible, meshlets_tested, draw_count);
+        }
+#endif
+
+        if(r->frame_number % 600 == 0) {
+            LOG("LOD: %u triangles, bias %.2f\n", triangle_count, r->lod_bias);
         }
 
-        // TODO: Instead of a blocking flush, consider tying it into the draw commands
-        vk_staging_queue_flush(vk);
-		
 		/* record commands */
 		vkCmdBeginRenderPass(cmdbuf, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
         
         vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->lit_pipeline);
 
-        VkBuffer buffers[] = { vk->vertex_buffer.buffer.handle };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindIndexBuffer(cmdbuf, vk->index_buffer.buffer.handle, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->simple_piepline_layout, 0, 1, &vk->global_desc, 0, NULL);
+        VkDescriptorSet desc_sets[] = {
+            frame->global_desc,
+            vk->frame_desc
+        };
+
+        uint32_t dynamic_offsets[] = {
+            (uint32_t)uniforms_offset,
+            (uint32_t)instances_offset
+        };
+
+        vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->simple_piepline_layout, 0, countof(desc_sets), desc_sets, countof(dynamic_offsets), dynamic_offsets);
 
-        vkCmdDrawIndexedIndirect(cmdbuf, vk->indirect_command_buffer.handle, 0, r->scene.entities_count, sizeof(VkDrawIndexedIndirectCommand));
+        if(draw_count_16) {
+            vkCmdBindIndexBuffer(cmdbuf, vk->index_buffer.buffer.handle, 0, VK_INDEX_TYPE_UINT16);
+            vkCmdDrawIndexedIndirect(cmdbuf, ring->buffer.handle, draws_offset, draw_count_16, sizeof(VkDrawIndexedIndirectCommand));
+        }
 
-        vk_unmap_buffer_staged(vk, vk->instance_buffer, instance_buffer_mapped);
-        vk_unmap_buffer_staged(vk, vk->indirect_command_buffer, indirect_command_buffer_mapped);
+        if(draw_count_32) {
+            vkCmdBindIndexBuffer(cmdbuf, vk->index_buffer_32.buffer.handle, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexedIndirect(cmdbuf, ring->buffer.handle, draws_offset + draw_count_16 * sizeof(VkDrawIndexedIndirectCommand), draw_count_32, sizeof(VkDrawIndexedIndirectCommand));
+        }
 
 		vkCmdEndRenderPass(cmdbuf);
 	}
@@ -1928,19 +5945,28 @@ static void render(struct Render_State *r, struct VK *vk)
 	VK_CHECK(vkEndCommandBuffer(cmdbuf));
 
 	/* submission */
-	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	VkSemaphore wait_semaphores[] = { frame->present_semaphore, vk->upload_timeline };
+	VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_UPLOAD_STAGES };
+	uint64_t wait_values[] = { 0, vk->upload_wait_value }; // The present semaphore is binary, its value is ignored
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = countof(wait_values),
+		.pWaitSemaphoreValues = wait_values
+	};
 
 	/* SYNC: The GPU waits on the present semaphore that signals when we
-	 * have an available image to draw into.
+	 * have an available image to draw into, and on the uploads this frame acquired (see Transfer Queue Notes).
 	 * Then the GPU will signal the render semaphore once it's done executing this cmd buffer.
 	 */
 	VkSubmitInfo submit_info = {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pWaitDstStageMask = &wait_stage,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &vk->present_semaphore,
+		.pNext = &timeline_info,
+		.pWaitDstStageMask = wait_stages,
+		.waitSemaphoreCount = countof(wait_semaphores),
+		.pWaitSemaphores = wait_semaphores,
 		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &vk->render_semaphore,
+		.pSignalSemaphores = &frame->render_semaphore,
 		.commandBufferCount = 1,
 		.pCommandBuffers = &cmdbuf
 	};
@@ -1948,14 +5974,16 @@ static void render(struct Render_State *r, struct VK *vk)
 	/* SYNC: The render fence will be signalled once all commands are executed.
 	 * This is what we wait for at the beginning of this function.
 	 */
-	VK_CHECK(vkQueueSubmit(vk->queue_graphics, 1, &submit_info, vk->render_fence));
+	VK_CHECK(vkQueueSubmit(vk->queue_graphics, 1, &submit_info, frame->render_fence));
+
+    r->render_cpu_ms = ticks_to_ms((t_acquire - t_start) + (SDL_GetPerformanceCounter() - t_acquired));
 
 	/* SYNC: Here the GPU will wait on the semaphore from the above queue submission before presenting */
 	VkPresentInfoKHR present_info = {
 		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 		.pSwapchains = &vk->swapchain,
 		.swapchainCount = 1,
-		.pWaitSemaphores = &vk->render_semaphore,
+		.pWaitSemaphores = &frame->render_semaphore,
 		.waitSemaphoreCount = 1,
 		.pImageIndices = &swapchain_index
 	};
@@ -1965,6 +5993,20 @@ static void render(struct Render_State *r, struct VK *vk)
 
 int main(int argc, char **argv)
 {
+	struct VK *vk = &s_vk;
+	struct Render_State *r = &s_render_state;
+
+	// --entities N: For measuring with a bigger scene
+	// --frames N: Quit after N frames, to take a measurement without anyone at the window
+	for(int i = 1; i + 1 < argc; i += 2) {
+		if(strcmp(argv[i], "--entities") == 0) {
+			r->entity_count = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--frames") == 0) {
+			r->frame_limit = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+		}
+	}
+
 	SDL_Init(SDL_INIT_VIDEO);
 
 	s_window = SDL_CreateWindow("vk_meshview",
@@ -1972,13 +6014,14 @@ int main(int argc, char **argv)
 							    SDL_WINDOWPOS_UNDEFINED,
 							    WIDTH, HEIGHT, SDL_WINDOW_VULKAN);
 
-	struct VK *vk = &s_vk;
-	struct Render_State *r = &s_render_state;
-
 	vk_init(vk);
 	scene_init(r, vk);
     g_init_done = true;
 
+    vk_mem_report_print(vk);
+
+	uint64_t t_last_frame = SDL_GetPerformanceCounter();
+
 	bool running = true;
 	while(running) {
 		SDL_Event event;
@@ -1988,6 +6031,17 @@ int main(int argc, char **argv)
 			}
 			else if(event.type == SDL_KEYDOWN) {
 				switch(event.key.keysym.sym) {
+                case SDLK_m:
+                    vk_mem_report_print(vk);
+                    break;
+                case SDLK_u:
+                    // Unloads every other mesh, which leaves holes for geometry compaction to fill
+                    for(int i = 1; i < vk->mesh_count; i += 2) {
+                        if(vk->meshes[i].resident) {
+                            mesh_destroy(vk, &vk->meshes[i]);
+                        }
+                    }
+                    break;
 				/*
                 case SDLK_SPACE:
 					r->unlit_shader = !r->unlit_shader;
@@ -2013,9 +6067,41 @@ int main(int argc, char **argv)
         update(r);
 		render(r, vk);
 
+        /* Frame time is measured from frame to frame, so it includes waiting on the GPU and on vsync */
+        const uint64_t t_frame = SDL_GetPerformanceCounter();
+        const double frame_ms = ticks_to_ms(t_frame - t_last_frame);
+        t_last_frame = t_frame;
+
+        frame_stats_add(&r->frame_stats, frame_ms, r->render_cpu_ms);
+#if WITH_STREAMING
+        if(s_streamer.pending_count) {
+            frame_stats_add(&s_streamer.frame_stats, frame_ms, r->render_cpu_ms);
+        }
+#endif
+
 		++s_render_state.frame_number;
+
+        if(r->frame_limit && s_render_state.frame_number >= r->frame_limit) {
+            running = false;
+        }
+
+        if(s_render_state.frame_number % 600 == 0 || (!running && r->frame_stats.frame_count)) {
+            const struct Frame_Stats *fs = &r->frame_stats;
+            LOG("Frame time: avg %.2fms, max %.2fms, %u over %.0fms. CPU: avg %.2fms, max %.2fms\n", fs->total_ms / fs->frame_count, fs->max_ms,
+                fs->spike_count, FRAME_SPIKE_MS, fs->cpu_total_ms / fs->frame_count, fs->cpu_max_ms);
+            r->frame_stats = (struct Frame_Stats){0};
+        }
+
+#if WITH_MEMORY_REPORT
+        if(s_render_state.frame_number % MEM_REPORT_INTERVAL == 0) {
+            vk_mem_report_print(vk);
+        }
+#endif
 	}
 
+#if WITH_STREAMING
+    stream_destroy(&s_streamer, vk);
+#endif
 	vk_destroy(vk);
 	SDL_DestroyWindow(s_window);
 	SDL_Quit();
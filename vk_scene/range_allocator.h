@@ -0,0 +1,434 @@
+/*
+ * Range allocator
+ *
+ * Hands out offset ranges in [0, capacity) for the memory and buffer arenas, with O(1) allocation and freeing.
+ * It's TLSF (two-level segregated fit): free ranges are kept in lists by size class, where the first level is the power of two
+ * and the second level splits that into RANGE_SL_COUNT linear steps. A bitmap per level says which lists have anything in them,
+ * so finding a big enough free range is a couple of bit scans instead of a search.
+ * Every range, free or not, is a node that knows its neighbours in memory, so a freed range is merged with free neighbours right away.
+ *
+ * Allocations take the first range from the size class above the requested size, which always fits without looking at it.
+ * Only when there is nothing there is the list of the requested size's own class searched, so that e.g. an allocation
+ * that is exactly as big as the free space still works.
+ * Alignments above RANGE_MIN_ALIGNMENT ask for size + alignment, and give the padding in front back as a free range.
+ * Sizes and offsets are always multiples of RANGE_MIN_ALIGNMENT.
+ *
+ * Nodes come from a fixed pool in the allocator, so there can be at most RANGE_MAX_NODES ranges, free and allocated, at once.
+ * range_alloc_in_front is the odd one out, it walks the ranges in memory order to find the lowest hole an allocation can move into.
+ * vk_scene/tools/test_range_allocator.c (the test_range_allocator test) checks it against random allocations and frees and times it.
+ */
+#ifndef KNZ_RANGE_ALLOCATOR_H
+#define KNZ_RANGE_ALLOCATOR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+// Running out of nodes is fatal, define this before including to go through your own error handling
+#ifndef RANGE_PANIC
+    #define RANGE_PANIC(msg_) do { fprintf(stderr, "%s\n", msg_); abort(); } while(0)
+#endif
+#define RANGE_CHECK(x_, msg_) do { if(!(x_)) { RANGE_PANIC(msg_); } } while(0)
+
+#define RANGE_MIN_ALIGNMENT 16
+#define RANGE_SL_LOG2 5
+#define RANGE_SL_COUNT (1 << RANGE_SL_LOG2)
+#define RANGE_FL_COUNT 64
+#define RANGE_MAX_NODES 4096
+#define RANGE_NONE UINT32_MAX
+
+struct Range_Node {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t prev_phys; // Neighbours in memory
+    uint32_t next_phys;
+    uint32_t prev_free; // In its size class's list while free, unused nodes are chained through next_free
+    uint32_t next_free;
+    bool free;
+};
+
+struct Range_Allocator {
+    uint64_t capacity;
+
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmaps[RANGE_FL_COUNT];
+    uint32_t heads[RANGE_FL_COUNT][RANGE_SL_COUNT];
+
+    // NOTE: Node 0 is always the first range in memory, since merging keeps the lower node and splitting keeps the front one
+    struct Range_Node nodes[RANGE_MAX_NODES];
+    uint32_t node_count;   // Nodes at and past this have never been used
+    uint32_t unused_nodes; // Used before but not anymore
+
+    /* Stats */
+    uint64_t used;
+    uint64_t peak_used;
+    uint32_t allocation_count;
+    uint32_t free_range_count;
+};
+
+static inline uint64_t range_align(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static inline uint64_t range_max(uint64_t a, uint64_t b)
+{
+    return a > b ? a : b;
+}
+
+// Index of the highest set bit, v must not be 0
+static inline uint32_t range_bit_high(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return index;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+// Index of the lowest set bit, v must not be 0
+static inline uint32_t range_bit_low(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return index;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static inline void range_mapping(uint64_t size, uint32_t *out_fl, uint32_t *out_sl)
+{
+    if(size < RANGE_SL_COUNT) {
+        *out_fl = 0;
+        *out_sl = (uint32_t)size;
+        return;
+    }
+
+    const uint32_t log2 = range_bit_high(size);
+    *out_fl = log2 - RANGE_SL_LOG2 + 1;
+    *out_sl = (uint32_t)(size >> (log2 - RANGE_SL_LOG2)) - RANGE_SL_COUNT;
+}
+
+static inline void range_insert_free(struct Range_Allocator *ra, uint32_t index)
+{
+    struct Range_Node *node = &ra->nodes[index];
+
+    uint32_t fl, sl;
+    range_mapping(node->size, &fl, &sl);
+
+    node->free = true;
+    node->prev_free = RANGE_NONE;
+    node->next_free = ra->heads[fl][sl];
+    if(node->next_free != RANGE_NONE) {
+        ra->nodes[node->next_free].prev_free = index;
+    }
+
+    ra->heads[fl][sl] = index;
+    ra->sl_bitmaps[fl] |= 1u << sl;
+    ra->fl_bitmap |= 1ull << fl;
+    ra->free_range_count++;
+}
+
+static inline void range_remove_free(struct Range_Allocator *ra, uint32_t index)
+{
+    struct Range_Node *node = &ra->nodes[index];
+    assert(node->free);
+
+    uint32_t fl, sl;
+    range_mapping(node->size, &fl, &sl);
+
+    if(node->prev_free != RANGE_NONE) {
+        ra->nodes[node->prev_free].next_free = node->next_free;
+    }
+    else {
+        ra->heads[fl][sl] = node->next_free;
+    }
+
+    if(node->next_free != RANGE_NONE) {
+        ra->nodes[node->next_free].prev_free = node->prev_free;
+    }
+
+    if(ra->heads[fl][sl] == RANGE_NONE) {
+        ra->sl_bitmaps[fl] &= ~(1u << sl);
+        if(!ra->sl_bitmaps[fl]) {
+            ra->fl_bitmap &= ~(1ull << fl);
+        }
+    }
+
+    node->free = false;
+    ra->free_range_count--;
+}
+
+// Splits the back of the node off into a new free node, so that the node is size bytes
+static inline void range_split_back(struct Range_Allocator *ra, uint32_t index, uint64_t size)
+{
+    uint32_t back_index = ra->unused_nodes;
+    if(back_index != RANGE_NONE) {
+        ra->unused_nodes = ra->nodes[back_index].next_free;
+    }
+    else {
+        RANGE_CHECK(ra->node_count < RANGE_MAX_NODES, "Range allocator ran out of nodes");
+        back_index = ra->node_count++;
+    }
+
+    struct Range_Node *node = &ra->nodes[index];
+    struct Range_Node *back = &ra->nodes[back_index];
+
+    *back = (struct Range_Node) {
+        .offset = node->offset + size,
+        .size = node->size - size,
+        .prev_phys = index,
+        .next_phys = node->next_phys
+    };
+
+    if(node->next_phys != RANGE_NONE) {
+        ra->nodes[node->next_phys].prev_phys = back_index;
+    }
+
+    node->next_phys = back_index;
+    node->size = size;
+}
+
+// Merges the node after index into it, the other node goes back to the pool
+static inline void range_merge_next(struct Range_Allocator *ra, uint32_t index)
+{
+    struct Range_Node *node = &ra->nodes[index];
+    const uint32_t next_index = node->next_phys;
+    struct Range_Node *next = &ra->nodes[next_index];
+
+    node->size += next->size;
+    node->next_phys = next->next_phys;
+    if(next->next_phys != RANGE_NONE) {
+        ra->nodes[next->next_phys].prev_phys = index;
+    }
+
+    next->next_free = ra->unused_nodes;
+    ra->unused_nodes = next_index;
+}
+
+// Also frees everything, without having to touch the nodes
+static inline void range_allocator_init(struct Range_Allocator *ra, uint64_t capacity)
+{
+    ra->capacity = capacity & ~(uint64_t)(RANGE_MIN_ALIGNMENT - 1);
+
+    ra->fl_bitmap = 0;
+    memset(ra->sl_bitmaps, 0, sizeof(ra->sl_bitmaps));
+    memset(ra->heads, 0xFF, sizeof(ra->heads)); // RANGE_NONE
+
+    ra->nodes[0] = (struct Range_Node) {
+        .offset = 0,
+        .size = ra->capacity,
+        .prev_phys = RANGE_NONE,
+        .next_phys = RANGE_NONE
+    };
+    ra->node_count = 1;
+    ra->unused_nodes = RANGE_NONE;
+
+    ra->used = 0;
+    ra->peak_used = 0;
+    ra->allocation_count = 0;
+    ra->free_range_count = 0;
+
+    if(ra->capacity) {
+        range_insert_free(ra, 0);
+    }
+}
+
+// Allocates size bytes (already aligned to RANGE_MIN_ALIGNMENT) from the free node at index, which has to have room for it
+static inline uint32_t range_take(struct Range_Allocator *ra, uint32_t index, uint64_t size, uint64_t alignment, uint64_t *out_offset)
+{
+    range_remove_free(ra, index);
+
+    /* Give back the padding in front, and whatever is left behind */
+    const uint64_t padding = range_align(ra->nodes[index].offset, alignment) - ra->nodes[index].offset;
+    if(padding) {
+        range_split_back(ra, index, padding);
+        range_insert_free(ra, index);
+        index = ra->nodes[index].next_phys;
+    }
+
+    if(ra->nodes[index].size > size) {
+        range_split_back(ra, index, size);
+        range_insert_free(ra, ra->nodes[index].next_phys);
+    }
+
+    ra->used += size;
+    ra->peak_used = range_max(ra->peak_used, ra->used);
+    ra->allocation_count++;
+
+    *out_offset = ra->nodes[index].offset;
+    return index;
+}
+
+// Returns the allocation to free it with, or RANGE_NONE if it doesn't fit
+static inline uint32_t range_alloc(struct Range_Allocator *ra, uint64_t size, uint64_t alignment, uint64_t *out_offset)
+{
+    size = range_align(size ? size : 1, RANGE_MIN_ALIGNMENT);
+    alignment = range_max(alignment, RANGE_MIN_ALIGNMENT);
+
+    const uint64_t search_size = size + alignment - RANGE_MIN_ALIGNMENT;
+
+    /* Good fit: The first free range in the next size class up, where everything is big enough */
+    uint64_t class_size = search_size;
+    if(class_size >= RANGE_SL_COUNT) {
+        class_size += (1ull << (range_bit_high(class_size) - RANGE_SL_LOG2)) - 1;
+    }
+
+    uint32_t fl, sl;
+    range_mapping(class_size, &fl, &sl);
+
+    uint32_t index = RANGE_NONE;
+    if(fl < RANGE_FL_COUNT) {
+        uint32_t sl_map = ra->sl_bitmaps[fl] & (~0u << sl);
+        if(!sl_map) {
+            const uint64_t fl_map = fl + 1 < RANGE_FL_COUNT ? ra->fl_bitmap & (~0ull << (fl + 1)) : 0;
+            if(fl_map) {
+                fl = range_bit_low(fl_map);
+                sl_map = ra->sl_bitmaps[fl];
+            }
+        }
+
+        if(sl_map) {
+            index = ra->heads[fl][range_bit_low(sl_map)];
+        }
+    }
+
+    /* Otherwise something in the requested size's own class may still be big enough */
+    if(index == RANGE_NONE) {
+        range_mapping(search_size, &fl, &sl);
+        for(uint32_t i = ra->heads[fl][sl]; i != RANGE_NONE; i = ra->nodes[i].next_free) {
+            if(ra->nodes[i].size >= search_size) {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    if(index == RANGE_NONE) {
+        return RANGE_NONE;
+    }
+
+    return range_take(ra, index, size, alignment, out_offset);
+}
+
+/* For compaction: Allocates a range as big as the given allocation from the lowest free range in front of it that has room,
+ * or returns RANGE_NONE if there is none. The allocation itself is left alone, it's freed once its contents have been moved.
+ * NOTE: Walks every range in front of the allocation */
+static inline uint32_t range_alloc_in_front(struct Range_Allocator *ra, uint32_t allocation, uint64_t alignment, uint64_t *out_offset)
+{
+    assert(allocation < RANGE_MAX_NODES && !ra->nodes[allocation].free);
+
+    const uint64_t size = ra->nodes[allocation].size;
+    alignment = range_max(alignment, RANGE_MIN_ALIGNMENT);
+
+    // NOTE: Node 0 is always the first range in memory, and the allocation is somewhere after it
+    for(uint32_t i = 0; i != allocation; i = ra->nodes[i].next_phys) {
+        const struct Range_Node *node = &ra->nodes[i];
+        if(node->free && range_align(node->offset, alignment) + size <= node->offset + node->size) {
+            return range_take(ra, i, size, alignment, out_offset);
+        }
+    }
+
+    return RANGE_NONE;
+}
+
+static inline void range_free(struct Range_Allocator *ra, uint32_t allocation)
+{
+    assert(allocation < RANGE_MAX_NODES && !ra->nodes[allocation].free);
+
+    uint32_t index = allocation;
+    ra->used -= ra->nodes[index].size;
+    ra->allocation_count--;
+
+    const uint32_t next = ra->nodes[index].next_phys;
+    if(next != RANGE_NONE && ra->nodes[next].free) {
+        range_remove_free(ra, next);
+        range_merge_next(ra, index);
+    }
+
+    const uint32_t prev = ra->nodes[index].prev_phys;
+    if(prev != RANGE_NONE && ra->nodes[prev].free) {
+        range_remove_free(ra, prev);
+        range_merge_next(ra, prev);
+        index = prev;
+    }
+
+    range_insert_free(ra, index);
+}
+
+// Adds free space at the end, everything allocated keeps its offset
+static inline void range_allocator_grow(struct Range_Allocator *ra, uint64_t capacity)
+{
+    capacity &= ~(uint64_t)(RANGE_MIN_ALIGNMENT - 1);
+    assert(capacity >= ra->capacity);
+
+    if(!ra->capacity) {
+        const uint64_t peak_used = ra->peak_used;
+        range_allocator_init(ra, capacity);
+        ra->peak_used = peak_used;
+        return;
+    }
+
+    const uint64_t extra = capacity - ra->capacity;
+    if(!extra) {
+        return;
+    }
+
+    // NOTE: Walks every range, but this is only for the odd relocation
+    uint32_t last = 0;
+    while(ra->nodes[last].next_phys != RANGE_NONE) {
+        last = ra->nodes[last].next_phys;
+    }
+
+    if(ra->nodes[last].free) {
+        range_remove_free(ra, last);
+        ra->nodes[last].size += extra;
+        range_insert_free(ra, last);
+    }
+    else {
+        const uint64_t last_size = ra->nodes[last].size;
+        ra->nodes[last].size += extra;
+        range_split_back(ra, last, last_size);
+        range_insert_free(ra, ra->nodes[last].next_phys);
+    }
+
+    ra->capacity = capacity;
+}
+
+// NOTE: Walks the list of the biggest size class there is, so it's for stats only
+static inline uint64_t range_allocator_largest_free(const struct Range_Allocator *ra)
+{
+    if(!ra->fl_bitmap) {
+        return 0;
+    }
+
+    const uint32_t fl = range_bit_high(ra->fl_bitmap);
+    const uint32_t sl = range_bit_high(ra->sl_bitmaps[fl]);
+
+    uint64_t largest = 0;
+    for(uint32_t i = ra->heads[fl][sl]; i != RANGE_NONE; i = ra->nodes[i].next_free) {
+        largest = range_max(largest, ra->nodes[i].size);
+    }
+
+    return largest;
+}
+
+// How much of the free space is unusable for an allocation as big as all of it, 0 when it's all in one range
+static inline double range_allocator_fragmentation(const struct Range_Allocator *ra)
+{
+    const uint64_t free_bytes = ra->capacity - ra->used;
+    return free_bytes ? 1.0 - (double)range_allocator_largest_free(ra) / (double)free_bytes : 0.0;
+}
+
+#endif
@@ -9,12 +9,14 @@ layout(location = 0) out vec4 out_color;
 struct Instance_Data {
     mat4 model_mat;
     uint texture_id;
+    uint vertex_format;
     uint padding_0;
     uint padding_1;
-    uint padding_2;
+    vec4 position_min;
+    vec4 position_extent;
 };
 
-layout (set = 0, binding = 1) readonly buffer Instance_Data_Buffer {
+layout (set = 1, binding = 1) readonly buffer Instance_Data_Buffer {
     Instance_Data instance_data[];
 };
 
@@ -10,21 +10,27 @@ layout (location = 0) out vec3 out_world_normal;
 layout (location = 1) out vec2 out_uv;
 layout (location = 2) out flat uint out_instance_id;
 
-layout (set = 0, binding = 0) uniform Global_Uniforms {
+layout (set = 1, binding = 0) uniform Global_Uniforms {
     mat4 view_mat;
     mat4 proj_mat;
     mat4 view_proj_mat;
 } u;
 
+// NOTE: These need to match main.c
+#define VERTEX_FORMAT_FLOAT     0
+#define VERTEX_FORMAT_QUANTIZED 1
+
 struct Instance_Data {
     mat4 model_mat;
     uint texture_id;
+    uint vertex_format;
     uint padding_0;
     uint padding_1;
-    uint padding_2;
+    vec4 position_min;
+    vec4 position_extent;
 };
 
-layout (set = 0, binding = 1) readonly buffer Instance_Data_Buffer {
+layout (set = 1, binding = 1) readonly buffer Instance_Data_Buffer {
     Instance_Data instance_data[];
 };
 
@@ -32,6 +38,11 @@ layout (set = 0, binding = 2) readonly buffer Vertex_Buffer {
     float vertex_data[];
 };
 
+// NOTE: Same buffer as above, quantized vertices are read as raw words so the bits aren't touched by float loads
+layout (set = 0, binding = 2) readonly buffer Vertex_Buffer_Packed {
+    uint vertex_data_packed[];
+};
+
 Vertex load_vertex(uint id)
 {
     // TODO: This is only like this because of struct packing rules, fix things so that this is not necessary
@@ -44,9 +55,38 @@ Vertex load_vertex(uint id)
     return v;
 }
 
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+
+    return normalize(n);
+}
+
+// See tools/mesh_file.h for the layout, 16 bytes per vertex
+Vertex load_vertex_quantized(uint id, Instance_Data instance)
+{
+    Vertex v;
+
+    uint w0 = vertex_data_packed[id * 4 + 0];
+    uint w1 = vertex_data_packed[id * 4 + 1];
+    uint w2 = vertex_data_packed[id * 4 + 2];
+    uint w3 = vertex_data_packed[id * 4 + 3];
+
+    vec3 position_unorm = vec3(unpackUnorm2x16(w0), unpackUnorm2x16(w1).x);
+    v.position = instance.position_min.xyz + position_unorm * instance.position_extent.xyz;
+    v.normal = oct_decode(unpackSnorm2x16(w2));
+    v.uv = unpackHalf2x16(w3);
+
+    return v;
+}
+
 void main() {
     Instance_Data instance = instance_data[gl_InstanceIndex];
-    Vertex v = load_vertex(gl_VertexIndex);
+    Vertex v = instance.vertex_format == VERTEX_FORMAT_QUANTIZED ? load_vertex_quantized(gl_VertexIndex, instance)
+                                                                 : load_vertex(gl_VertexIndex);
 
     gl_Position = u.view_proj_mat * instance.model_mat * vec4(v.position, 1.0);
 
@@ -0,0 +1,248 @@
+/*
+ * Tests for vk_scene's range allocator (see range_allocator.h): random allocations, frees and growing, with the allocator
+ * checked against itself as it goes, then compaction, then a benchmark of the same mix.
+ * Only needs the C runtime, it's built as a tool and run by ctest as test_range_allocator.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../range_allocator.h"
+
+// NOTE: timespec_get is C11 and available on both glibc and MSVC, unlike clock_gettime
+static double time_now_ms(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec * 1e-6;
+}
+
+#define RANGE_TEST_CAPACITY (64 * 1024 * 1024)
+#define RANGE_TEST_OPS 200000
+#define RANGE_TEST_BENCH_OPS 2000000
+#define RANGE_TEST_MAX_LIVE 1024
+
+struct Range_Test_Allocation {
+    uint32_t allocation;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static uint64_t range_test_random(uint64_t *state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+// Sizes from 1 byte to 1MB, spread evenly over the powers of two
+static uint64_t range_test_size(uint64_t *state)
+{
+    const uint32_t log2 = range_test_random(state) % 21;
+    return 1 + range_test_random(state) % (1ull << log2);
+}
+
+// Walks all of the ranges in memory and all of the free lists, and checks them against each other and the stats
+static bool range_allocator_check(const struct Range_Allocator *ra)
+{
+    uint64_t offset = 0;
+    uint64_t used = 0;
+    uint32_t free_count = 0;
+    uint32_t allocation_count = 0;
+    uint32_t prev = RANGE_NONE;
+
+    for(uint32_t i = 0; i != RANGE_NONE; i = ra->nodes[i].next_phys) {
+        const struct Range_Node *node = &ra->nodes[i];
+        if(node->offset != offset || node->prev_phys != prev || node->size == 0 || node->size % RANGE_MIN_ALIGNMENT) {
+            return false;
+        }
+
+        // Free neighbours are always merged
+        if(node->free && prev != RANGE_NONE && ra->nodes[prev].free) {
+            return false;
+        }
+
+        free_count += node->free;
+        allocation_count += !node->free;
+        used += node->free ? 0 : node->size;
+        offset += node->size;
+        prev = i;
+    }
+
+    if(offset != ra->capacity || used != ra->used || free_count != ra->free_range_count || allocation_count != ra->allocation_count) {
+        return false;
+    }
+
+    uint32_t listed_count = 0;
+    for(uint32_t fl = 0; fl < RANGE_FL_COUNT; ++fl) {
+        for(uint32_t sl = 0; sl < RANGE_SL_COUNT; ++sl) {
+            const bool listed = ra->heads[fl][sl] != RANGE_NONE;
+            if(listed != !!(ra->sl_bitmaps[fl] & (1u << sl)) || (listed && !(ra->fl_bitmap & (1ull << fl)))) {
+                return false;
+            }
+
+            for(uint32_t i = ra->heads[fl][sl]; i != RANGE_NONE; i = ra->nodes[i].next_free) {
+                uint32_t node_fl, node_sl;
+                range_mapping(ra->nodes[i].size, &node_fl, &node_sl);
+
+                if(!ra->nodes[i].free || node_fl != fl || node_sl != sl) {
+                    return false;
+                }
+
+                listed_count++;
+            }
+        }
+    }
+
+    return listed_count == free_count;
+}
+
+// Returns false if anything was wrong, prints what and the timings
+static bool range_allocator_test(void)
+{
+    static struct Range_Allocator ra;
+    static struct Range_Test_Allocation live[RANGE_TEST_MAX_LIVE];
+    uint32_t live_count = 0;
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+    // Starts out smaller and grows twice along the way, like a relocated buffer arena
+    range_allocator_init(&ra, RANGE_TEST_CAPACITY / 4);
+
+    /* Random allocations and frees, with everything checked as it goes */
+    uint32_t failed_allocs = 0;
+    for(uint32_t op = 0; op < RANGE_TEST_OPS; ++op) {
+        if(op == RANGE_TEST_OPS / 4 || op == RANGE_TEST_OPS / 2) {
+            range_allocator_grow(&ra, ra.capacity * 2);
+        }
+
+        const bool alloc = live_count == 0 || (live_count < RANGE_TEST_MAX_LIVE && range_test_random(&rng) % 100 < 55);
+
+        if(alloc) {
+            const uint64_t size = range_test_size(&rng);
+            const uint64_t alignment = 1ull << (range_test_random(&rng) % 17);
+
+            uint64_t offset;
+            const uint32_t allocation = range_alloc(&ra, size, alignment, &offset);
+            if(allocation == RANGE_NONE) {
+                failed_allocs++;
+                continue;
+            }
+
+            if(offset % alignment || offset + size > ra.capacity) {
+                printf("Range allocator test: bad allocation of %llu bytes aligned to %llu at %llu\n",
+                       (unsigned long long)size, (unsigned long long)alignment, (unsigned long long)offset);
+                return false;
+            }
+
+            live[live_count++] = (struct Range_Test_Allocation) { allocation, offset, size };
+        }
+        else {
+            const uint32_t victim = range_test_random(&rng) % live_count;
+            range_free(&ra, live[victim].allocation);
+            live[victim] = live[--live_count];
+        }
+
+        if(op % 997 == 0) {
+            // Also makes sure that live allocations haven't moved or overlapped, since the walk covers every byte once
+            for(uint32_t i = 0; i < live_count; ++i) {
+                const struct Range_Node *node = &ra.nodes[live[i].allocation];
+                if(node->free || node->offset != live[i].offset || node->size < live[i].size) {
+                    printf("Range allocator test: allocation %u changed\n", live[i].allocation);
+                    return false;
+                }
+            }
+
+            if(!range_allocator_check(&ra)) {
+                printf("Range allocator test: inconsistent after %u operations\n", op + 1);
+                return false;
+            }
+        }
+    }
+
+    printf("Range allocator test: %u operations, %u allocations didn't fit, %u live using %.1fMB (peak %.1fMB), %u free ranges, %.1f%% fragmentation\n",
+           RANGE_TEST_OPS, failed_allocs, live_count, ra.used / (1024.0 * 1024.0), ra.peak_used / (1024.0 * 1024.0),
+           ra.free_range_count, 100.0 * range_allocator_fragmentation(&ra));
+
+    /* Compaction: Keep moving everything into the lowest hole in front of it, until nothing moves anymore */
+    const double fragmentation_before = range_allocator_fragmentation(&ra);
+    uint32_t moves = 0;
+    for(bool moved = true; moved;) {
+        moved = false;
+        for(uint32_t i = 0; i < live_count; ++i) {
+            uint64_t offset;
+            const uint32_t allocation = range_alloc_in_front(&ra, live[i].allocation, RANGE_MIN_ALIGNMENT, &offset);
+            if(allocation == RANGE_NONE) {
+                continue;
+            }
+
+            if(offset + live[i].size > live[i].offset) {
+                printf("Range allocator test: compaction moved %llu bytes from %llu to %llu\n",
+                       (unsigned long long)live[i].size, (unsigned long long)live[i].offset, (unsigned long long)offset);
+                return false;
+            }
+
+            range_free(&ra, live[i].allocation);
+            live[i].allocation = allocation;
+            live[i].offset = offset;
+            moved = true;
+            moves++;
+        }
+    }
+
+    if(!range_allocator_check(&ra)) {
+        printf("Range allocator test: inconsistent after compaction\n");
+        return false;
+    }
+
+    printf("Range allocator test: compaction made %u moves, %.1f%% fragmentation before, %.1f%% after, %u free ranges\n",
+           moves, 100.0 * fragmentation_before, 100.0 * range_allocator_fragmentation(&ra), ra.free_range_count);
+
+    while(live_count) {
+        range_free(&ra, live[--live_count].allocation);
+    }
+
+    if(!range_allocator_check(&ra) || ra.free_range_count != 1 || range_allocator_largest_free(&ra) != ra.capacity) {
+        printf("Range allocator test: not everything came back after freeing it all\n");
+        return false;
+    }
+
+    /* Benchmark: Same mix, nothing checked */
+    const double t_start = time_now_ms();
+
+    for(uint32_t op = 0; op < RANGE_TEST_BENCH_OPS; ++op) {
+        if(live_count == 0 || (live_count < RANGE_TEST_MAX_LIVE && (range_test_random(&rng) & 1))) {
+            uint64_t offset;
+            const uint32_t allocation = range_alloc(&ra, range_test_size(&rng), RANGE_MIN_ALIGNMENT << (range_test_random(&rng) & 3), &offset);
+            if(allocation != RANGE_NONE) {
+                live[live_count++] = (struct Range_Test_Allocation) { allocation, offset, 0 };
+            }
+        }
+        else {
+            const uint32_t victim = range_test_random(&rng) % live_count;
+            range_free(&ra, live[victim].allocation);
+            live[victim] = live[--live_count];
+        }
+    }
+
+    const double bench_ms = time_now_ms() - t_start;
+
+    printf("Range allocator bench: %u operations in %.1fms (%.1fns each, including the random numbers), %.1f%% fragmentation at the end\n",
+           RANGE_TEST_BENCH_OPS, bench_ms, bench_ms * 1000000.0 / RANGE_TEST_BENCH_OPS, 100.0 * range_allocator_fragmentation(&ra));
+
+    return range_allocator_check(&ra);
+}
+
+int main(void)
+{
+    if(!range_allocator_test()) {
+        printf("Range allocator test: FAILED\n");
+        return 1;
+    }
+
+    printf("Range allocator test: passed\n");
+    return 0;
+}